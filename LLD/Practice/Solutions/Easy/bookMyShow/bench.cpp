@@ -0,0 +1,368 @@
+#include <bits/stdc++.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "services/BookingService.cpp"
+using namespace std;
+
+// Booking throughput with and without replication: 'ops' hold + confirm pairs
+// spread over 'shows' freshly scheduled shows. Prints one JSON object.
+//
+//   ./bookMyShowBench [--ops N] [--shows N] [--changes N] [--queries N]
+//                     [--mode plain|log|standby|rejoin|schedule|query]
+//
+//   plain    no replication
+//   log      replication log kept, no standby attached
+//   standby  a standby process follows over a local socket; once the primary
+//            stops, the standby's seats, bookings and timers are checked against it
+//   rejoin   as standby, but that standby is killed halfway, after the log it was
+//            sent has been dropped; a fresh one must join from a snapshot and
+//            end up with the same state
+//   schedule no bookings: one change set adding 'changes' shows, then one
+//            removing half of them and adding as many new ones
+//   query    no bookings: 'shows' shows (1M unless given), some partly sold,
+//            then 'queries' searchShows calls of each query shape, timed one
+//            by one for latency percentiles
+//
+// cpu_ops_per_s divides by the booking thread's own CPU time, which is what its
+// throughput is on a machine where the standby and the replication sender
+// have cores of their own.
+
+using Clock = chrono::steady_clock;
+
+static const int FIRST_SHOW_ID = 1000;
+
+static double cpuSeconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Free seats left in every benchmark show, every booking's status and the
+// number of pending timers, folded into one number
+static uint64_t stateChecksum(BookingService &service, int shows)
+{
+    TheatreController &theatres = service.getTheatreController();
+    BookingController &bookings = service.getBookingController();
+    uint64_t checksum = 0;
+    for (int i = 0; i < shows; i++)
+    {
+        Show *show = theatres.findShow(FIRST_SHOW_ID + i);
+        int free = show ? theatres.getSeatInventory().getFreeSeatCount(show->getInventorySlot()) : -1;
+        checksum = checksum * 1000003 + uint64_t(free + 1);
+    }
+    for (int bookingId = 0; Booking *booking = bookings.getBooking(bookingId); bookingId++)
+    {
+        checksum = checksum * 1000003 + uint64_t(booking->getStatus()) * 2 + booking->isCancellable();
+    }
+    return checksum * 1000003 + bookings.getPendingTimerCount();
+}
+
+// Times applyScheduleChanges on an add-only set of 'count' shows, then on a
+// mixed set that removes every other one of them and adds as many new shows
+static int runScheduleBench(int count)
+{
+    ofstream quiet("/dev/null");
+    streambuf *console = cout.rdbuf(quiet.rdbuf());
+    BookingService *service = BookingService::getInstance();
+    service->initialize();
+    const vector<int> &slots = service->getTheatreController().getSeatInventory().getFreeColumn();
+
+    vector<ScheduleChange> adds;
+    for (int i = 0; i < count; i++)
+    {
+        adds.push_back({ScheduleOp::ADD_SHOW, FIRST_SHOW_ID + i, 1 + i % 2, 1, 1 + i % 2, i % 24, 0});
+    }
+    auto started = Clock::now();
+    ScheduleChangeResult added = service->applyScheduleChanges(adds);
+    double addSeconds = chrono::duration<double>(Clock::now() - started).count();
+    size_t slotsBefore = slots.size();
+
+    vector<ScheduleChange> mixed;
+    for (int i = 0; i < count; i += 2)
+    {
+        mixed.push_back({ScheduleOp::REMOVE_SHOW, FIRST_SHOW_ID + i, 1 + i % 2, 0, 0, 0, 0});
+        mixed.push_back({ScheduleOp::ADD_SHOW, FIRST_SHOW_ID + count + i, 1 + i % 2, 1, 1 + i % 2, i % 24, 0});
+    }
+    started = Clock::now();
+    ScheduleChangeResult swapped = service->applyScheduleChanges(mixed);
+    double mixedSeconds = chrono::duration<double>(Clock::now() - started).count();
+    cout.rdbuf(console);
+
+    // Removals go first, so the additions fit in the slots they free
+    bool reused = swapped.applied && slots.size() == slotsBefore;
+    printf("{\n  \"mode\": \"schedule\",\n  \"changes\": %d,\n  \"add_applied\": %s,\n  \"add_seconds\": %.3f,\n"
+           "  \"add_changes_per_s\": %.0f,\n  \"mixed_changes\": %zu,\n  \"mixed_applied\": %s,\n"
+           "  \"mixed_seconds\": %.3f,\n  \"mixed_changes_per_s\": %.0f,\n  \"slots_reused\": %s\n}\n",
+           count, added.applied ? "true" : "false", addSeconds, count / addSeconds, mixed.size(),
+           swapped.applied ? "true" : "false", mixedSeconds, mixed.size() / mixedSeconds, reused ? "true" : "false");
+    return added.applied && reused ? 0 : 1;
+}
+
+// One query shape: a name and the query to run for the q-th call
+struct QueryShape
+{
+    const char *name;
+    function<ShowQuery(int)> make;
+};
+
+// Latency percentiles of searchShows over 'shows' shows in both demo theatres
+static int runQueryBench(int shows, int queries)
+{
+    ofstream quiet("/dev/null");
+    streambuf *console = cout.rdbuf(quiet.rdbuf());
+    BookingService *service = BookingService::getInstance();
+    service->initialize();
+
+    vector<ScheduleChange> changes;
+    changes.reserve(shows);
+    for (int i = 0; i < shows; i++)
+    {
+        changes.push_back({ScheduleOp::ADD_SHOW, FIRST_SHOW_ID + i, 1 + i % 2, 1, 1 + i / 2 % 2, i % 24, 150 + i % 5 * 50});
+    }
+    bool scheduled = service->applyScheduleChanges(changes).applied;
+
+    // Sell the front of every third show so free counts, and cheapest categories, differ
+    TheatreController &theatres = service->getTheatreController();
+    SeatInventory &inventory = theatres.getSeatInventory();
+    for (Theatre *theatre : theatres.allTheatre)
+    {
+        for (const Show &show : theatre->getShows())
+        {
+            int i = show.getShowId() - FIRST_SHOW_ID;
+            for (int seat = 1; i >= 0 && i % 3 == 0 && seat <= i % 97; seat++)
+            {
+                inventory.bookSeat(show.getInventorySlot(), seat);
+            }
+        }
+    }
+    cout.rdbuf(console);
+
+    CityId cities[2] = {CityRegistry::findCity("Bangalore"), CityRegistry::findCity("Delhi")};
+    int gold = static_cast<int>(SeatCategory::GOLD);
+    vector<QueryShape> shapes = {
+        {"movie_city_evening_gold", [&](int q)
+         {
+             ShowQuery query;
+             query.movieId = 1 + q % 2;
+             query.city = cities[q / 2 % 2];
+             query.fromHour = 19;
+             query.minFreeSeats = 4;
+             query.category = gold;
+             return query;
+         }},
+        {"city", [&](int q)
+         {
+             ShowQuery query;
+             query.city = cities[q % 2];
+             return query;
+         }},
+        {"theatre_window", [](int q)
+         {
+             ShowQuery query;
+             query.theatreId = 1 + q % 2;
+             query.fromHour = 10;
+             query.toHour = 14;
+             return query;
+         }},
+        {"time_window", [](int q)
+         {
+             ShowQuery query;
+             query.fromHour = q % 20;
+             query.toHour = q % 20 + 4;
+             query.minFreeSeats = 50;
+             return query;
+         }},
+    };
+
+    printf("{\n  \"mode\": \"query\",\n  \"shows\": %d,\n  \"scheduled\": %s,\n  \"queries_per_shape\": %d",
+           shows, scheduled ? "true" : "false", queries);
+    for (const QueryShape &shape : shapes)
+    {
+        vector<double> micros;
+        size_t matches = 0;
+        for (int q = 0; q < queries; q++)
+        {
+            ShowQuery query = shape.make(q);
+            auto started = Clock::now();
+            matches += service->searchShows(query).size();
+            micros.push_back(chrono::duration<double, micro>(Clock::now() - started).count());
+        }
+        sort(micros.begin(), micros.end());
+        printf(",\n  \"%s\": {\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, \"matches\": %zu}",
+               shape.name, micros[micros.size() / 2], micros[micros.size() * 99 / 100], micros.back(), matches);
+    }
+    printf("\n}\n");
+    return scheduled ? 0 : 1;
+}
+
+// Forks a standby that reports its seat checksum on resultFd once the primary
+// stops. With goFd it waits for a byte there before connecting.
+static pid_t forkStandby(const string &socketPath, int shows, int resultFd, int goFd)
+{
+    pid_t standby = fork();
+    if (standby != 0)
+    {
+        return standby;
+    }
+    char go;
+    if (goFd >= 0 && read(goFd, &go, 1) != 1)
+    {
+        _exit(1);
+    }
+    BookingService *service = BookingService::getInstance();
+    service->initialize();
+    bool followed = service->runAsStandby(socketPath);
+    service->stopReplication();
+    uint64_t checksum = followed ? stateChecksum(*service, shows) : 0;
+    ssize_t written = write(resultFd, &checksum, sizeof(checksum));
+    _exit(written == sizeof(checksum) ? 0 : 1);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t ops = 1000000;
+    int shows = 0; // 0 = the mode's default
+    int scheduleChanges = 100000;
+    int queries = 200;
+    string mode = "plain";
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string flag = argv[i];
+        if (flag == "--ops")
+            ops = stoull(argv[i + 1]);
+        else if (flag == "--shows")
+            shows = max(1, stoi(argv[i + 1]));
+        else if (flag == "--queries")
+            queries = max(1, stoi(argv[i + 1]));
+        else if (flag == "--changes")
+            scheduleChanges = max(2, stoi(argv[i + 1]));
+        else if (flag == "--mode")
+            mode = argv[i + 1];
+        else
+        {
+            cerr << "Unknown option " << flag << endl;
+            return 2;
+        }
+    }
+    if (mode == "schedule")
+    {
+        return runScheduleBench(scheduleChanges);
+    }
+    if (mode == "query")
+    {
+        return runQueryBench(shows ? shows : 1000000, queries);
+    }
+    shows = shows ? shows : 20000;
+    if (mode != "plain" && mode != "log" && mode != "standby" && mode != "rejoin")
+    {
+        cerr << "Unknown mode " << mode << endl;
+        return 2;
+    }
+
+    // Setup chatter goes nowhere; only the results reach stdout
+    ofstream quiet("/dev/null");
+    streambuf *console = cout.rdbuf(quiet.rdbuf());
+    string socketPath = "/tmp/bookMyShowBench." + to_string(getpid()) + ".sock";
+
+    // Standbys are forked before this process has a BookingService or threads
+    int results[2] = {-1, -1};
+    int go[2] = {-1, -1};
+    pid_t standby = -1, rejoining = -1;
+    if (mode == "standby" || mode == "rejoin")
+    {
+        if (pipe(results) != 0 || (mode == "rejoin" && pipe(go) != 0) ||
+            (standby = forkStandby(socketPath, shows, results[1], -1)) < 0 ||
+            (mode == "rejoin" && (rejoining = forkStandby(socketPath, shows, results[1], go[0])) < 0))
+        {
+            cerr << "Could not start the standby" << endl;
+            return 1;
+        }
+        close(results[1]);
+    }
+
+    BookingService *service = BookingService::getInstance();
+    service->initialize();
+    if (mode != "plain" && !service->startReplicationPrimary(socketPath))
+    {
+        cerr << "Could not listen on " << socketPath << endl;
+        return 1;
+    }
+
+    // Shows to book into, added as one schedule change set (replicated like any other)
+    vector<ScheduleChange> changes;
+    for (int i = 0; i < shows; i++)
+    {
+        changes.push_back({ScheduleOp::ADD_SHOW, FIRST_SHOW_ID + i, 1 + i % 2, 1, 1 + i % 2, i % 24, 0});
+    }
+    service->applyScheduleChanges(changes);
+    for (int waited = 0; standby > 0 && !service->hasStandby(); waited++)
+    {
+        if (waited == 1000)
+        {
+            cerr << "The standby never attached" << endl;
+            kill(standby, SIGKILL);
+            return 1;
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    TheatreController &theatres = service->getTheatreController();
+    BookingController &bookings = service->getBookingController();
+    vector<Show *> targets;
+    for (int i = 0; i < shows; i++)
+    {
+        targets.push_back(theatres.findShow(FIRST_SHOW_ID + i));
+    }
+    int seatsPerShow = theatres.getSeatInventory().getSeatsPerShow();
+
+    size_t confirmed = 0;
+    int64_t now = 1700000000;
+    double cpuBefore = cpuSeconds();
+    auto started = Clock::now();
+    size_t i = 0;
+    // When rejoining, keep booking until the fresh standby is attached: its snapshot
+    // is taken between two bookings
+    for (; i < ops || (rejoining > 0 && !service->hasStandby() && Clock::now() - started < chrono::seconds(60)); i++)
+    {
+        if (rejoining > 0 && i == ops / 2)
+        {
+            kill(standby, SIGKILL);
+            waitpid(standby, nullptr, 0);
+            standby = -1;
+            char start = 1;
+            if (write(go[1], &start, 1) != 1)
+            {
+                cerr << "Could not start the second standby" << endl;
+                return 1;
+            }
+        }
+        Show &show = *targets[i % shows];
+        int seat = int(i / shows % seatsPerShow) + 1;
+        int bookingId = bookings.holdSeats(show, {seat}, 100, "", now + int64_t(i / 1000));
+        confirmed += bookingId >= 0 && bookings.confirmBooking(bookingId, now + int64_t(i / 1000));
+    }
+    ops = i;
+    double seconds = chrono::duration<double>(Clock::now() - started).count();
+    double cpu = cpuSeconds() - cpuBefore;
+
+    service->stopReplication(); // hands the standby the rest of the log and closes the stream
+    bookings.advanceClock(time(nullptr)); // as the standby does when it takes over
+    uint64_t primaryChecksum = stateChecksum(*service, shows);
+    cout.rdbuf(console);
+
+    string match = "null";
+    pid_t follower = rejoining > 0 ? rejoining : standby;
+    if (follower > 0)
+    {
+        uint64_t standbyChecksum = 0;
+        bool received = read(results[0], &standbyChecksum, sizeof(standbyChecksum)) == sizeof(standbyChecksum);
+        waitpid(follower, nullptr, 0);
+        match = received && standbyChecksum == primaryChecksum ? "true" : "false";
+    }
+
+    printf("{\n  \"mode\": \"%s\",\n  \"ops\": %zu,\n  \"shows\": %d,\n  \"confirmed\": %zu,\n"
+           "  \"seconds\": %.3f,\n  \"ops_per_s\": %.0f,\n  \"cpu_seconds\": %.3f,\n  \"cpu_ops_per_s\": %.0f,\n"
+           "  \"standby_matches\": %s\n}\n",
+           mode.c_str(), ops, shows, confirmed, seconds, ops / seconds, cpu, cpu > 0 ? ops / cpu : 0.0, match.c_str());
+    return match == "false" ? 1 : 0;
+}
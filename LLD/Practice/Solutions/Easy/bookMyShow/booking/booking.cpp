@@ -0,0 +1,111 @@
+#ifndef BOOKING_H
+#define BOOKING_H
+
+#include <bits/stdc++.h>
+#include "../enums/bookingStatus.cpp"
+using namespace std;
+
+class Booking
+{
+    int bookingId;
+    string bookingRef; // UUID shown on the ticket
+    int showId;
+    int inventorySlot;
+    vector<int> seatNumbers;
+    double pricePerSeat;
+    double amountRefunded;
+    BookingStatus status;
+    bool cancellable; // cleared when the cancellation window closes
+    int timerId;      // pending hold-expiry or window-close timer, -1 if none
+
+public:
+    Booking() : bookingId(0), showId(0), inventorySlot(-1), pricePerSeat(0), amountRefunded(0),
+                status(BookingStatus::HELD), cancellable(false), timerId(-1) {}
+    Booking(int id, const string &ref, int showId, int slot, const vector<int> &seats, double price)
+        : bookingId(id), bookingRef(ref), showId(showId), inventorySlot(slot), seatNumbers(seats),
+          pricePerSeat(price), amountRefunded(0), status(BookingStatus::HELD), cancellable(false), timerId(-1) {}
+
+    // Getters & Setters
+    int getBookingId() const
+    {
+        return bookingId;
+    }
+
+    const string &getBookingRef() const
+    {
+        return bookingRef;
+    }
+
+    int getShowId() const
+    {
+        return showId;
+    }
+
+    // -1 once the show is gone and its slot belongs to another
+    int getInventorySlot() const
+    {
+        return inventorySlot;
+    }
+
+    void detachSlot()
+    {
+        inventorySlot = -1;
+    }
+
+    vector<int> &getSeatNumbers()
+    {
+        return seatNumbers;
+    }
+
+    const vector<int> &getSeatNumbers() const
+    {
+        return seatNumbers;
+    }
+
+    double getPricePerSeat() const
+    {
+        return pricePerSeat;
+    }
+
+    double getAmountRefunded() const
+    {
+        return amountRefunded;
+    }
+
+    void addRefund(double amount)
+    {
+        amountRefunded += amount;
+    }
+
+    BookingStatus getStatus() const
+    {
+        return status;
+    }
+
+    void setStatus(BookingStatus s)
+    {
+        status = s;
+    }
+
+    bool isCancellable() const
+    {
+        return cancellable;
+    }
+
+    void setCancellable(bool c)
+    {
+        cancellable = c;
+    }
+
+    int getTimerId() const
+    {
+        return timerId;
+    }
+
+    void setTimerId(int id)
+    {
+        timerId = id;
+    }
+};
+
+#endif // BOOKING_H
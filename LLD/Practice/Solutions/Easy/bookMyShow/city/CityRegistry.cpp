@@ -0,0 +1,65 @@
+#ifndef CITYREGISTRY_H
+#define CITYREGISTRY_H
+
+#include <bits/stdc++.h>
+using namespace std;
+
+// Dense city id: 0..CityRegistry::size()-1, usable directly as an array index
+using CityId = int;
+const CityId INVALID_CITY = -1;
+
+class CityRegistry
+{
+private:
+    // deque keeps the interned strings at stable addresses, so the index can key on string_view
+    static deque<string> cityNames;
+    static unordered_map<string_view, CityId> cityIndex;
+
+public:
+    // Only Admin - returns the existing id if the city is already registered
+    static CityId registerCity(const string &name)
+    {
+        auto it = cityIndex.find(name);
+        if (it != cityIndex.end())
+        {
+            return it->second;
+        }
+        CityId id = static_cast<CityId>(cityNames.size());
+        cityNames.push_back(name);
+        cityIndex.emplace(cityNames.back(), id);
+        return id;
+    }
+
+    static CityId findCity(string_view name)
+    {
+        auto it = cityIndex.find(name);
+        return it != cityIndex.end() ? it->second : INVALID_CITY;
+    }
+
+    // True only for ids handed out by registerCity (never INVALID_CITY)
+    static bool isValid(CityId id)
+    {
+        return id >= 0 && id < size();
+    }
+
+    static const string &getCityName(CityId id)
+    {
+        static const string unknown = "Unknown";
+        if (!isValid(id))
+        {
+            return unknown;
+        }
+        return cityNames[id];
+    }
+
+    static int size()
+    {
+        return static_cast<int>(cityNames.size());
+    }
+};
+
+// Define static members
+deque<string> CityRegistry::cityNames;
+unordered_map<string_view, CityId> CityRegistry::cityIndex;
+
+#endif // CITYREGISTRY_H
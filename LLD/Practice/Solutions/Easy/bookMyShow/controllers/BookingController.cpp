@@ -0,0 +1,389 @@
+#ifndef BOOKINGCONTROLLER_H
+#define BOOKINGCONTROLLER_H
+
+#include <bits/stdc++.h>
+#include "../booking/booking.cpp"
+#include "../enums/bookingStatus.cpp"
+#include "../theatre/show.cpp"
+#include "../theatre/SeatInventory.cpp"
+#include "../services/PaymentService.cpp"
+#include "../utils/TimingWheel.cpp"
+#include "../replication/ReplicationLog.cpp"
+using namespace std;
+
+// Owns every booking: seat holds, confirmation, (partial) cancellation and refunds.
+// Hold expiries and cancellation windows are timers on one TimingWheel.
+class BookingController
+{
+public:
+    static const int64_t HOLD_SECONDS = 5 * 60;
+    static const int64_t CANCELLATION_WINDOW_SECONDS = 30 * 60;
+
+    // Called with (inventorySlot, seatNumber) when a seat comes back to inventory
+    using WaitlistCallback = function<void(int, int)>;
+
+private:
+    enum TimerKind : uint64_t
+    {
+        HOLD_EXPIRY = 0,
+        WINDOW_CLOSE = 1
+    };
+
+    SeatInventory &seatInventory;
+    PaymentService paymentService;
+    vector<Booking> bookings; // indexed by bookingId
+    unordered_map<string, int> bookingByRef;
+    unordered_map<int, deque<WaitlistCallback>> waitlists; // inventorySlot → waiting users
+    unordered_map<int, vector<int>> bookingsBySlot;          // inventorySlot → bookings ever made on it
+    TimingWheel timers;
+    ReplicationLog *replicationLog = nullptr; // set on a replicating primary
+    bool replica = false;                     // replaying a primary's log: no payment side effects
+
+    static uint64_t timerPayload(int bookingId, TimerKind kind)
+    {
+        return (uint64_t(bookingId) << 1) | kind;
+    }
+
+    void onTimer(uint64_t payload)
+    {
+        Booking &booking = bookings[payload >> 1];
+        booking.setTimerId(-1);
+        if ((payload & 1) == HOLD_EXPIRY)
+        {
+            if (booking.getStatus() == BookingStatus::HELD)
+            {
+                releaseSeats(booking, booking.getSeatNumbers());
+                booking.getSeatNumbers().clear();
+                booking.setStatus(BookingStatus::EXPIRED);
+            }
+        }
+        else
+        {
+            booking.setCancellable(false);
+        }
+    }
+
+    // O(1) per seat: clear the occupancy bit, bump the free counter, wake one waiter
+    void releaseSeats(Booking &booking, const vector<int> &seatNumbers)
+    {
+        int slot = booking.getInventorySlot();
+        if (slot < 0)
+        {
+            return; // detached: the slot now belongs to another show
+        }
+        for (int seatNumber : seatNumbers)
+        {
+            if (!seatInventory.releaseSeat(slot, seatNumber))
+            {
+                continue;
+            }
+            auto it = waitlists.find(slot);
+            if (it != waitlists.end() && !it->second.empty())
+            {
+                WaitlistCallback waiter = move(it->second.front());
+                it->second.pop_front();
+                waiter(slot, seatNumber);
+            }
+        }
+    }
+
+    void fireDueTimers(int64_t now)
+    {
+        timers.advance(now, [this](uint64_t payload)
+                       { onTimer(payload); });
+    }
+
+    void clearTimer(Booking &booking)
+    {
+        timers.cancel(booking.getTimerId());
+        booking.setTimerId(-1);
+    }
+
+public:
+    // The clock starts at the 'now' of the first call; every call passes the time it happened at
+    explicit BookingController(SeatInventory &inventory)
+        : seatInventory(inventory) {}
+
+    // Every mutating call is logged with its inputs (including the time it happened at),
+    // so replaying the log on a standby reproduces the same bookings, seats and timers
+    void setReplicationLog(ReplicationLog *log)
+    {
+        replicationLog = log;
+    }
+
+    void setReplicaMode(bool enabled)
+    {
+        replica = enabled;
+    }
+
+    // Fire every hold expiry / window close that is due by 'now'
+    void advanceClock(int64_t now)
+    {
+        if (replicationLog)
+        {
+            replicationLog->beginRecord(ReplicationOp::ADVANCE_CLOCK).put<int64_t>(now);
+            replicationLog->commitRecord();
+        }
+        fireDueTimers(now);
+    }
+
+    // Reserve all seats or none; returns the booking id, or -1 if any seat is taken
+    int holdSeats(const Show &show, const vector<int> &seatNumbers, double pricePerSeat,
+                  const string &bookingRef, int64_t now)
+    {
+        if (replicationLog)
+        {
+            RecordWriter &record = replicationLog->beginRecord(ReplicationOp::HOLD_SEATS);
+            record.put<int64_t>(now);
+            record.put<int32_t>(show.getShowId());
+            record.put<int32_t>(show.getInventorySlot());
+            record.put<double>(pricePerSeat);
+            record.putString(bookingRef);
+            record.putInts(seatNumbers);
+            replicationLog->commitRecord();
+        }
+        fireDueTimers(now);
+        int slot = show.getInventorySlot();
+        for (size_t i = 0; i < seatNumbers.size(); i++)
+        {
+            if (!seatInventory.isValidSeat(seatNumbers[i]) || !seatInventory.bookSeat(slot, seatNumbers[i]))
+            {
+                for (size_t j = 0; j < i; j++)
+                {
+                    seatInventory.releaseSeat(slot, seatNumbers[j]);
+                }
+                return -1;
+            }
+        }
+
+        int bookingId = static_cast<int>(bookings.size());
+        bookings.emplace_back(bookingId, bookingRef, show.getShowId(), slot, seatNumbers, pricePerSeat);
+        bookingByRef[bookingRef] = bookingId;
+        bookingsBySlot[slot].push_back(bookingId);
+        bookings.back().setTimerId(timers.schedule(now + HOLD_SECONDS, timerPayload(bookingId, HOLD_EXPIRY)));
+        return bookingId;
+    }
+
+    // Payment succeeded: the hold becomes a booking that can be cancelled inside the window
+    bool confirmBooking(int bookingId, int64_t now)
+    {
+        if (replicationLog)
+        {
+            RecordWriter &record = replicationLog->beginRecord(ReplicationOp::CONFIRM_BOOKING);
+            record.put<int32_t>(bookingId);
+            record.put<int64_t>(now);
+            replicationLog->commitRecord();
+        }
+        fireDueTimers(now);
+        Booking *booking = getBooking(bookingId);
+        if (booking == nullptr || booking->getStatus() != BookingStatus::HELD)
+        {
+            return false; // unknown, or the hold already expired
+        }
+        clearTimer(*booking);
+        booking->setStatus(BookingStatus::CONFIRMED);
+        booking->setCancellable(true);
+        booking->setTimerId(timers.schedule(now + CANCELLATION_WINDOW_SECONDS, timerPayload(bookingId, WINDOW_CLOSE)));
+        return true;
+    }
+
+    // Payment failed: give the held seats back straight away
+    void releaseHold(int bookingId)
+    {
+        if (replicationLog)
+        {
+            replicationLog->beginRecord(ReplicationOp::RELEASE_HOLD).put<int32_t>(bookingId);
+            replicationLog->commitRecord();
+        }
+        Booking *booking = getBooking(bookingId);
+        if (booking == nullptr || booking->getStatus() != BookingStatus::HELD)
+        {
+            return;
+        }
+        clearTimer(*booking);
+        releaseSeats(*booking, booking->getSeatNumbers());
+        booking->getSeatNumbers().clear();
+        booking->setStatus(BookingStatus::CANCELLED);
+    }
+
+    // Cancel some seats of a confirmed booking; returns the refunded amount or -1 if not allowed
+    double cancelSeats(int bookingId, const vector<int> &seatNumbers, int64_t now)
+    {
+        if (replicationLog)
+        {
+            RecordWriter &record = replicationLog->beginRecord(ReplicationOp::CANCEL_SEATS);
+            record.put<int32_t>(bookingId);
+            record.put<int64_t>(now);
+            record.putInts(seatNumbers);
+            replicationLog->commitRecord();
+        }
+        fireDueTimers(now);
+        Booking *booking = getBooking(bookingId);
+        if (booking == nullptr || booking->getStatus() != BookingStatus::CONFIRMED || !booking->isCancellable())
+        {
+            return -1;
+        }
+
+        vector<int> &booked = booking->getSeatNumbers();
+        vector<int> released;
+        for (int seatNumber : seatNumbers)
+        {
+            auto it = find(booked.begin(), booked.end(), seatNumber);
+            if (it != booked.end())
+            {
+                *it = booked.back(); // seat order on a booking does not matter
+                booked.pop_back();
+                released.push_back(seatNumber);
+            }
+        }
+        if (released.empty())
+        {
+            return -1;
+        }
+
+        releaseSeats(*booking, released);
+        double refund = booking->getPricePerSeat() * released.size();
+        if (!replica)
+        {
+            paymentService.processRefund(refund);
+        }
+        booking->addRefund(refund);
+
+        if (booked.empty())
+        {
+            clearTimer(*booking);
+            booking->setStatus(BookingStatus::CANCELLED);
+            booking->setCancellable(false);
+        }
+        return refund;
+    }
+
+    double cancelBooking(int bookingId, int64_t now)
+    {
+        Booking *booking = getBooking(bookingId);
+        if (booking == nullptr)
+        {
+            return -1;
+        }
+        vector<int> allSeats = booking->getSeatNumbers();
+        return cancelSeats(bookingId, allSeats, now);
+    }
+
+    // The shows on these slots were removed and the slots recycled: every
+    // booking made on them lets go of its slot and timer, so a later cancel or
+    // expiry cannot touch the show that gets the slot next. A live booking is
+    // cancelled (and refunded if confirmed), though schedule validation
+    // normally refuses to remove a show that still has one. Waiters are dropped.
+    void detachSlots(const vector<int> &slots)
+    {
+        for (int slot : slots)
+        {
+            auto it = bookingsBySlot.find(slot);
+            if (it != bookingsBySlot.end())
+            {
+                for (int bookingId : it->second)
+                {
+                    Booking &booking = bookings[bookingId];
+                    clearTimer(booking);
+                    if (booking.getStatus() == BookingStatus::CONFIRMED || booking.getStatus() == BookingStatus::HELD)
+                    {
+                        if (booking.getStatus() == BookingStatus::CONFIRMED)
+                        {
+                            double refund = booking.getPricePerSeat() * booking.getSeatNumbers().size();
+                            if (!replica)
+                            {
+                                paymentService.processRefund(refund);
+                            }
+                            booking.addRefund(refund);
+                        }
+                        booking.getSeatNumbers().clear();
+                        booking.setStatus(BookingStatus::CANCELLED);
+                        booking.setCancellable(false);
+                    }
+                    booking.detachSlot();
+                }
+                bookingsBySlot.erase(it);
+            }
+            waitlists.erase(slot);
+        }
+    }
+
+    // Ask to be told (once) when a seat of this show is released
+    void joinWaitlist(const Show &show, WaitlistCallback callback)
+    {
+        waitlists[show.getInventorySlot()].push_back(move(callback));
+    }
+
+    Booking *getBooking(int bookingId)
+    {
+        if (bookingId < 0 || bookingId >= static_cast<int>(bookings.size()))
+        {
+            return nullptr;
+        }
+        return &bookings[bookingId];
+    }
+
+    Booking *findBookingByRef(const string &bookingRef)
+    {
+        auto it = bookingByRef.find(bookingRef);
+        return it != bookingByRef.end() ? &bookings[it->second] : nullptr;
+    }
+
+    // Every booking and pending timer, for a replication snapshot. Waitlists are
+    // callbacks into this process and are not part of it.
+    void saveTo(RecordWriter &out) const
+    {
+        out.put<uint32_t>(bookings.size());
+        for (const Booking &booking : bookings)
+        {
+            out.putString(booking.getBookingRef());
+            out.put<int32_t>(booking.getShowId());
+            out.put<int32_t>(booking.getInventorySlot());
+            out.putInts(booking.getSeatNumbers());
+            out.put<double>(booking.getPricePerSeat());
+            out.put<double>(booking.getAmountRefunded());
+            out.put<BookingStatus>(booking.getStatus());
+            out.put<bool>(booking.isCancellable());
+            out.put<int32_t>(booking.getTimerId());
+        }
+        timers.saveTo(out);
+    }
+
+    // Replaces every booking and timer with a snapshot's
+    void loadFrom(RecordReader &in)
+    {
+        bookings.clear();
+        bookingByRef.clear();
+        bookingsBySlot.clear();
+        waitlists.clear();
+        uint32_t count = in.get<uint32_t>();
+        bookings.reserve(count);
+        for (uint32_t bookingId = 0; bookingId < count; bookingId++)
+        {
+            string bookingRef = in.getString();
+            int showId = in.get<int32_t>();
+            int slot = in.get<int32_t>();
+            vector<int> seats = in.getInts();
+            double pricePerSeat = in.get<double>();
+            bookings.emplace_back(bookingId, bookingRef, showId, slot, seats, pricePerSeat);
+            Booking &booking = bookings.back();
+            booking.addRefund(in.get<double>());
+            booking.setStatus(in.get<BookingStatus>());
+            booking.setCancellable(in.get<bool>());
+            booking.setTimerId(in.get<int32_t>());
+            bookingByRef[bookingRef] = bookingId;
+            if (slot >= 0)
+            {
+                bookingsBySlot[slot].push_back(bookingId);
+            }
+        }
+        timers.loadFrom(in);
+    }
+
+    size_t getPendingTimerCount() const
+    {
+        return timers.size();
+    }
+};
+
+#endif // BOOKINGCONTROLLER_H
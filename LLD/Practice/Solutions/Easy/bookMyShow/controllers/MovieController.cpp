@@ -3,22 +3,93 @@
 
 #include <bits/stdc++.h>
 #include "../movie/movie.cpp"
-#include "../enums/city.cpp"
+#include "../city/CityRegistry.cpp"
+#include "../replication/ReplicationLog.cpp"
 using namespace std;
 
 class MovieController
 {
 private:
-    unordered_map<City, vector<Movie *>> cityVsMovies;
+    vector<vector<Movie *>> cityVsMovies; // indexed by CityId
     vector<Movie *> allMovies;
+    unordered_map<int, Movie *> movieById;
 
 public:
     MovieController() = default;
 
-    void addMovie(Movie *movie, City city)
+    // False, and nothing is added, for a city CityRegistry never handed out
+    bool addMovie(Movie *movie, CityId city)
     {
+        if (!CityRegistry::isValid(city))
+        {
+            return false;
+        }
         allMovies.push_back(movie);
+        movieById[movie->getMovieId()] = movie;
+        if (city >= static_cast<CityId>(cityVsMovies.size()))
+        {
+            cityVsMovies.resize(city + 1);
+        }
         cityVsMovies[city].push_back(movie);
+        return true;
+    }
+
+    // Add the movie to a city's listing unless it is already there
+    void ensureMovieInCity(Movie *movie, CityId city)
+    {
+        const vector<Movie *> &movies = getMoviesByCity(city);
+        if (find(movies.begin(), movies.end(), movie) == movies.end())
+        {
+            addMovie(movie, city);
+        }
+    }
+
+    // Drop the movie from a city's listing, if it is there
+    void removeMovieFromCity(Movie *movie, CityId city)
+    {
+        if (city < 0 || city >= static_cast<CityId>(cityVsMovies.size()))
+        {
+            return;
+        }
+        vector<Movie *> &movies = cityVsMovies[city];
+        movies.erase(remove(movies.begin(), movies.end(), movie), movies.end());
+    }
+
+    // Each city's listing, in order, for a replication snapshot
+    void saveTo(RecordWriter &out) const
+    {
+        out.put<uint32_t>(cityVsMovies.size());
+        for (const vector<Movie *> &movies : cityVsMovies)
+        {
+            vector<int> movieIds;
+            for (Movie *movie : movies)
+            {
+                movieIds.push_back(movie->getMovieId());
+            }
+            out.putInts(movieIds);
+        }
+    }
+
+    // Replaces every city's listing; the movies themselves come from the seed data
+    void loadFrom(RecordReader &in)
+    {
+        cityVsMovies.assign(in.get<uint32_t>(), {});
+        for (vector<Movie *> &movies : cityVsMovies)
+        {
+            for (int movieId : in.getInts())
+            {
+                if (Movie *movie = getMovieById(movieId))
+                {
+                    movies.push_back(movie);
+                }
+            }
+        }
+    }
+
+    Movie *getMovieById(int movieId) const
+    {
+        auto it = movieById.find(movieId);
+        return it != movieById.end() ? it->second : nullptr;
     }
 
     Movie *getMovieByName(const string &movieName)
@@ -33,13 +104,14 @@ public:
         return nullptr;
     }
 
-    vector<Movie *> getMoviesByCity(City city)
+    const vector<Movie *> &getMoviesByCity(CityId city) const
     {
-        if (cityVsMovies.find(city) != cityVsMovies.end())
+        static const vector<Movie *> none;
+        if (city < 0 || city >= static_cast<CityId>(cityVsMovies.size()))
         {
-            return cityVsMovies[city];
+            return none; // return empty vector if city has no movies
         }
-        return {}; // return empty vector if city not found
+        return cityVsMovies[city];
     }
 };
 
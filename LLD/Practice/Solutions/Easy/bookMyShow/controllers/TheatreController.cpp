@@ -4,9 +4,14 @@
 #include <bits/stdc++.h>
 #include <map>
 #include "../movie/movie.cpp"
-#include "../enums/city.cpp"
+#include "../city/CityRegistry.cpp"
+#include "MovieController.cpp"
 #include "../theatre/show.cpp"
 #include "../theatre/theatre.cpp"
+#include "../theatre/SeatInventory.cpp"
+#include "../theatre/ScheduleChange.cpp"
+#include "../query/ShowTable.cpp"
+#include "../replication/ReplicationLog.cpp"
 using namespace std;
 
 // Forward declarations
@@ -17,8 +22,8 @@ class Theatre;
 class TheatreController
 {
 public:
-    // Map<City, List<Theatre>>
-    unordered_map<City, vector<Theatre *>> cityVsTheatre;
+    // List<List<Theatre>> indexed by CityId
+    vector<vector<Theatre *>> cityVsTheatre;
     // Nagpur → [PVR, INOX]
     // Mumbai → [Cinepolis, Carnival]
 
@@ -26,48 +31,353 @@ public:
     vector<Theatre *> allTheatre;
     // allTheatre = [PVR, INOX, Cinepolis, Carnival]
 
-    // Constructor
-    TheatreController()
+private:
+    unordered_map<int, Theatre *> theatreById;
+    unordered_map<int, Theatre *> showOwner; // showId → theatre running it
+    unordered_map<int, int> showSlot;        // showId → inventory slot, row of showTable
+
+    // Per city: movieId → (theatre → number of shows of that movie)
+    vector<unordered_map<int, map<Theatre *, int>>> cityMovieTheatres;
+
+    SeatInventory seatInventory;
+    ShowTable showTable; // columnar copy of every scheduled show, row = inventory slot
+
+    void adjustMovieIndex(CityId city, int movieId, Theatre *theatre, int delta)
     {
-        cityVsTheatre = unordered_map<City, vector<Theatre *>>();
-        allTheatre = vector<Theatre *>();
+        if (city >= static_cast<CityId>(cityMovieTheatres.size()))
+        {
+            cityMovieTheatres.resize(city + 1);
+        }
+        map<Theatre *, int> &theatres = cityMovieTheatres[city][movieId];
+        if ((theatres[theatre] += delta) <= 0)
+        {
+            theatres.erase(theatre);
+            if (theatres.empty())
+            {
+                cityMovieTheatres[city].erase(movieId);
+            }
+        }
     }
 
-    // ADD theatre to a particular city
-    void addTheatre(Theatre *theatre, City city)
+    static Screen *findScreen(Theatre *theatre, int screenId)
     {
+        for (Screen &screen : theatre->getScreens())
+        {
+            if (screen.getScreenId() == screenId)
+            {
+                return &screen;
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    // Constructor
+    TheatreController() = default;
+
+    // ADD theatre to a particular city - amortized O(1) plus indexing its shows.
+    // False, and nothing is added, for a city CityRegistry never handed out,
+    // a theatre id already taken, or a show id already scheduled or repeated
+    // in the theatre's own list.
+    bool addTheatre(Theatre *theatre, CityId city)
+    {
+        if (!CityRegistry::isValid(city) || theatreById.count(theatre->getTheatreId()))
+        {
+            return false;
+        }
+        unordered_set<int> showIds;
+        for (const Show &show : theatre->getShows())
+        {
+            if (showOwner.count(show.getShowId()) || !showIds.insert(show.getShowId()).second)
+            {
+                return false;
+            }
+        }
         allTheatre.push_back(theatre);
+        theatreById[theatre->getTheatreId()] = theatre;
 
-        vector<Theatre *> theatres;
-        if (cityVsTheatre.find(city) != cityVsTheatre.end())
+        if (city >= static_cast<CityId>(cityVsTheatre.size()))
         {
-            theatres = cityVsTheatre[city];
+            cityVsTheatre.resize(city + 1);
+        }
+        cityVsTheatre[city].push_back(theatre);
+
+        vector<Show> &shows = theatre->getShows();
+        vector<int> slots = seatInventory.allocateSlots(shows.size());
+        Screen *defaultScreen = theatre->getScreens().empty() ? nullptr : &theatre->getScreens().front();
+        for (size_t i = 0; i < shows.size(); i++)
+        {
+            Show &show = shows[i];
+            show.setInventorySlot(slots[i]);
+            if (show.getScreen() == nullptr)
+            {
+                show.setScreen(defaultScreen);
+            }
+            showOwner[show.getShowId()] = theatre;
+            showSlot[show.getShowId()] = slots[i];
+            showTable.setRow(show, theatre->getTheatreId(), city);
+            adjustMovieIndex(city, show.getMovie()->getMovieId(), theatre, +1);
+        }
+        return true;
+    }
+
+    const vector<Theatre *> &getTheatresByCity(CityId city) const
+    {
+        static const vector<Theatre *> none;
+        if (city < 0 || city >= static_cast<CityId>(cityVsTheatre.size()))
+        {
+            return none;
+        }
+        return cityVsTheatre[city];
+    }
+
+    Theatre *getTheatreById(int theatreId) const
+    {
+        auto it = theatreById.find(theatreId);
+        return it != theatreById.end() ? it->second : nullptr;
+    }
+
+    bool hasShow(int showId) const
+    {
+        return showOwner.count(showId) != 0;
+    }
+
+    // Whether any theatre in the city still runs a show of the movie
+    bool cityRunsMovie(CityId city, int movieId) const
+    {
+        return city >= 0 && city < static_cast<CityId>(cityMovieTheatres.size()) && cityMovieTheatres[city].count(movieId) != 0;
+    }
+
+    // Theatre running the show, nullptr if it is not scheduled
+    Theatre *getShowOwner(int showId) const
+    {
+        auto it = showOwner.find(showId);
+        return it != showOwner.end() ? it->second : nullptr;
+    }
+
+    // Whether any seat of the show is booked or held - O(1)
+    bool hasOccupiedSeats(int showId)
+    {
+        auto it = showSlot.find(showId);
+        return it != showSlot.end() && seatInventory.getFreeSeatCount(it->second) < seatInventory.getSeatsPerShow();
+    }
+
+    // Movie id of a scheduled show, -1 if it is not scheduled - O(1)
+    int getShowMovieId(int showId) const
+    {
+        auto it = showSlot.find(showId);
+        return it != showSlot.end() ? showTable.getMovieIds()[it->second] : -1;
+    }
+
+    bool hasScreen(Theatre *theatre, int screenId) const
+    {
+        return findScreen(theatre, screenId) != nullptr;
+    }
+
+    Show *findShow(int showId)
+    {
+        auto it = showOwner.find(showId);
+        if (it == showOwner.end())
+        {
+            return nullptr;
+        }
+        for (Show &show : it->second->getShows())
+        {
+            if (show.getShowId() == showId)
+            {
+                return &show;
+            }
+        }
+        return nullptr;
+    }
+
+    SeatInventory &getSeatInventory()
+    {
+        return seatInventory;
+    }
+
+    const ShowTable &getShowTable() const
+    {
+        return showTable;
+    }
+
+    // Apply a validated change set sorted by (theatreId, op, startTime, showId).
+    // movies[i] is the resolved movie of changes[i] (nullptr for removals).
+    // Every removal in the set goes first, so the seat slots it frees are
+    // reused by the additions, which are then allocated in one call. Each
+    // touched theatre's show list is rebuilt once, and the movie index
+    // receives one update per (theatre, movie).
+    // Returns the released slots; additions in this set may already hold some.
+    vector<int> applyScheduleBatch(const vector<ScheduleChange> &changes, const vector<Movie *> &movies)
+    {
+        struct TheatreChanges
+        {
+            Theatre *theatre;
+            size_t firstAdd; // changes[firstAdd, end) are its additions, removals sort before them
+            size_t end;
+            map<int, int> movieDelta; // movieId → change in show count
+        };
+        vector<TheatreChanges> touched;
+        vector<int> releasedSlots;
+        size_t addCount = 0;
+
+        for (size_t begin = 0; begin < changes.size();)
+        {
+            TheatreChanges group{theatreById[changes[begin].theatreId], begin, begin, {}};
+            while (group.end < changes.size() && changes[group.end].theatreId == changes[begin].theatreId)
+            {
+                group.end++;
+            }
+
+            // Ids are collected sorted for binary search
+            vector<int> removedIds;
+            for (; group.firstAdd < group.end && changes[group.firstAdd].op == ScheduleOp::REMOVE_SHOW; group.firstAdd++)
+            {
+                removedIds.push_back(changes[group.firstAdd].showId);
+            }
+            if (!removedIds.empty())
+            {
+                vector<Show> &shows = group.theatre->getShows();
+                sort(removedIds.begin(), removedIds.end());
+                auto removedBegin = stable_partition(shows.begin(), shows.end(),
+                                                     [&removedIds](const Show &show)
+                                                     { return !binary_search(removedIds.begin(), removedIds.end(), show.getShowId()); });
+                for (auto it = removedBegin; it != shows.end(); ++it)
+                {
+                    releasedSlots.push_back(it->getInventorySlot());
+                    showTable.clearRow(it->getInventorySlot());
+                    group.movieDelta[it->getMovie()->getMovieId()]--;
+                    showOwner.erase(it->getShowId());
+                    showSlot.erase(it->getShowId());
+                }
+                shows.erase(removedBegin, shows.end());
+            }
+            addCount += group.end - group.firstAdd;
+            begin = group.end;
+            touched.push_back(move(group));
+        }
+        seatInventory.releaseSlots(releasedSlots);
+
+        vector<int> newSlots = seatInventory.allocateSlots(addCount);
+        size_t nextSlot = 0;
+        for (TheatreChanges &group : touched)
+        {
+            Theatre *theatre = group.theatre;
+            vector<Show> &shows = theatre->getShows();
+            shows.reserve(shows.size() + (group.end - group.firstAdd));
+            for (size_t i = group.firstAdd; i < group.end; i++)
+            {
+                const ScheduleChange &change = changes[i];
+                Show show(change.showId, movies[i], findScreen(theatre, change.screenId), change.startTime,
+                          change.basePrice > 0 ? change.basePrice : SeatLayout::DEFAULT_BASE_PRICE);
+                show.setInventorySlot(newSlots[nextSlot++]);
+                showTable.setRow(show, theatre->getTheatreId(), theatre->getCity());
+                shows.push_back(show);
+                showOwner[change.showId] = theatre;
+                showSlot[change.showId] = show.getInventorySlot();
+                group.movieDelta[movies[i]->getMovieId()]++;
+            }
+
+            for (auto &entry : group.movieDelta)
+            {
+                if (entry.second != 0)
+                {
+                    adjustMovieIndex(theatre->getCity(), entry.first, theatre, entry.second);
+                }
+            }
+        }
+        return releasedSlots;
+    }
+
+    // Seat occupancy and every theatre's shows, for a replication snapshot
+    void saveTo(RecordWriter &out) const
+    {
+        seatInventory.saveTo(out);
+        out.put<uint32_t>(allTheatre.size());
+        for (Theatre *theatre : allTheatre)
+        {
+            const vector<Show> &shows = theatre->getShows();
+            out.put<int32_t>(theatre->getTheatreId());
+            out.put<uint32_t>(shows.size());
+            for (const Show &show : shows)
+            {
+                out.put<int32_t>(show.getShowId());
+                out.put<int32_t>(show.getMovie()->getMovieId());
+                out.put<int32_t>(show.getScreen() ? show.getScreen()->getScreenId() : -1);
+                out.put<int32_t>(show.getShowStartTime());
+                out.put<int32_t>(show.getBasePrice());
+                out.put<int32_t>(show.getInventorySlot());
+            }
+        }
+    }
+
+    // Replaces every show, on the slots the snapshot had, and rebuilds the indexes.
+    // The theatres themselves come from the seed data on both sides.
+    void loadFrom(RecordReader &in, const MovieController &movies)
+    {
+        seatInventory.loadFrom(in);
+        showOwner.clear();
+        showSlot.clear();
+        cityMovieTheatres.clear();
+        showTable.clear();
+        for (Theatre *theatre : allTheatre)
+        {
+            theatre->getShows().clear();
+        }
+
+        uint32_t theatreCount = in.get<uint32_t>();
+        for (uint32_t t = 0; t < theatreCount; t++)
+        {
+            Theatre *theatre = getTheatreById(in.get<int32_t>());
+            uint32_t showCount = in.get<uint32_t>();
+            for (uint32_t s = 0; s < showCount; s++)
+            {
+                int showId = in.get<int32_t>();
+                Movie *movie = movies.getMovieById(in.get<int32_t>());
+                int screenId = in.get<int32_t>();
+                int startTime = in.get<int32_t>();
+                int basePrice = in.get<int32_t>();
+                int slot = in.get<int32_t>();
+                if (theatre == nullptr || movie == nullptr)
+                {
+                    continue; // not in this process's seed data
+                }
+                Show show(showId, movie, findScreen(theatre, screenId), startTime, basePrice);
+                show.setInventorySlot(slot);
+                theatre->getShows().push_back(show);
+                showOwner[showId] = theatre;
+                showSlot[showId] = slot;
+                showTable.setRow(show, theatre->getTheatreId(), theatre->getCity());
+                adjustMovieIndex(theatre->getCity(), movie->getMovieId(), theatre, +1);
+            }
         }
-        theatres.push_back(theatre);
-        cityVsTheatre[city] = theatres;
     }
 
     // Get all shows of a particular movie in a particular city
-    map<Theatre *, vector<Show>> getAllShow(Movie *movie, City city)
+    map<Theatre *, vector<Show>> getAllShow(Movie *movie, CityId city)
     {
         // get all the theatres of this city
         map<Theatre *, vector<Show>> theatreVsShows;
 
-        vector<Theatre *> theatres;
-        if (cityVsTheatre.find(city) != cityVsTheatre.end())
+        if (city < 0 || city >= static_cast<CityId>(cityMovieTheatres.size()))
         {
-            theatres = cityVsTheatre[city];
+            return theatreVsShows;
         }
-        // theatre = [PVR, INOX]
+        auto it = cityMovieTheatres[city].find(movie->getMovieId());
+        if (it == cityMovieTheatres[city].end())
+        {
+            return theatreVsShows;
+        }
+        // only the theatres which run this movie, e.g. [PVR, INOX]
 
-        // filter the theatres which run this movie
-        for (Theatre *theatre : theatres)
+        for (auto &entry : it->second)
         {
+            Theatre *theatre = entry.first;
             vector<Show> givenMovieShows;
-            vector<Show> shows = theatre->getShows();
+            const vector<Show> &shows = theatre->getShows();
             // shows = [morning, evening]
 
-            for (Show &show : shows)
+            for (const Show &show : shows)
             {
                 if (show.getMovie()->getMovieId() == movie->getMovieId())
                 {
@@ -75,10 +385,7 @@ public:
                 }
             }
             // givenMovieShows = [morning, evening]
-            if (!givenMovieShows.empty())
-            {
-                theatreVsShows[theatre] = givenMovieShows;
-            }
+            theatreVsShows[theatre] = givenMovieShows;
         }
 
         return theatreVsShows;
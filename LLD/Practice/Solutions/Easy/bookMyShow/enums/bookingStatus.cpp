@@ -0,0 +1,12 @@
+#ifndef BOOKINGSTATUS_H
+#define BOOKINGSTATUS_H
+
+enum class BookingStatus
+{
+    HELD,      // seats reserved, waiting for payment
+    CONFIRMED, // paid; may still be (partially) cancelled inside the window
+    CANCELLED, // every seat released
+    EXPIRED    // hold ran out before payment
+};
+
+#endif // BOOKINGSTATUS_H
@@ -0,0 +1,58 @@
+#!/bin/bash
+# Two-process failover check: a primary books seat 5, is killed with SIGKILL,
+# and the standby that takes over must refuse seat 5 and still sell seat 6.
+
+cd "$(dirname "$0")"
+[ -x ./bookMyShow ] || g++ -std=c++17 -O2 -pthread -o bookMyShow main.cpp || exit 1
+
+work=$(mktemp -d)
+socket="$work/bookmyshow.sock"
+trap 'kill -9 $primary $standby 2>/dev/null; rm -rf "$work"' EXIT
+
+# Standby: once promoted, city 1 / movie 1 / show 1, try seat 5 (taken), then 6
+printf '1\n1\n1\n5\n6\nno\n' >"$work/standby.in"
+./bookMyShow --standby "$socket" <"$work/standby.in" >"$work/standby.out" 2>&1 &
+standby=$!
+sleep 0.5
+
+# Primary: the same show, seat 5; its stdin stays open so it waits at the next prompt
+mkfifo "$work/primary.in"
+./bookMyShow --primary "$socket" <"$work/primary.in" >"$work/primary.out" 2>&1 &
+primary=$!
+disown $primary # no "Killed" notice when it is killed below
+exec 3>"$work/primary.in"
+printf '1\n1\n1\n5\n' >&3
+
+for _ in $(seq 100); do
+    grep -q "Booking Successful" "$work/primary.out" && break
+    sleep 0.1
+done
+if ! grep -q "Booking Successful" "$work/primary.out"; then
+    echo "❌ The primary never booked seat 5"
+    exit 1
+fi
+sleep 0.2 # well past the sender's batching delay
+kill -9 $primary
+exec 3>&-
+
+for _ in $(seq 100); do
+    kill -0 $standby 2>/dev/null || break
+    sleep 0.1
+done
+if kill -0 $standby 2>/dev/null; then
+    echo "❌ The standby did not finish its session"
+    exit 1
+fi
+
+failed=0
+for expected in "Primary lost" "Seat already booked" "Booking Successful"; do
+    if ! grep -q "$expected" "$work/standby.out"; then
+        echo "❌ Standby output is missing: $expected"
+        failed=1
+    fi
+done
+if [ $failed -ne 0 ]; then
+    cat "$work/standby.out"
+    exit 1
+fi
+echo "✅ Failover test passed: the standby kept the primary's booking and took over"
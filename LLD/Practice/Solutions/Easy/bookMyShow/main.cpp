@@ -2,12 +2,30 @@
 #include "services/BookingService.cpp"
 using namespace std;
 
-int main()
+// Usage: ./bookMyShow                         standalone
+//        ./bookMyShow --primary <socket>      stream bookings to a standby
+//        ./bookMyShow --standby <socket>      mirror a primary, take over when it dies
+int main(int argc, char *argv[])
 {
     // ✅ Singleton usage
     BookingService *bookService = BookingService::getInstance();
     bookService->initialize();
+
+    string mode = argc > 2 ? argv[1] : "";
+    if (mode == "--primary")
+    {
+        bookService->startReplicationPrimary(argv[2]);
+    }
+    else if (mode == "--standby")
+    {
+        if (!bookService->runAsStandby(argv[2]))
+        {
+            return 1;
+        }
+    }
+
     bookService->startBookingSession();
+    bookService->stopReplication();
 
     return 0;
-}
\ No newline at end of file
+}
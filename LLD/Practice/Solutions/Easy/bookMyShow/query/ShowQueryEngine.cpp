@@ -0,0 +1,208 @@
+#ifndef SHOWQUERYENGINE_H
+#define SHOWQUERYENGINE_H
+
+#include <bits/stdc++.h>
+#include "../city/CityRegistry.cpp"
+#include "../theatre/SeatInventory.cpp"
+#include "../theatre/SeatLayout.cpp"
+#include "ShowTable.cpp"
+using namespace std;
+
+// e.g. "any show of movie M in city C after 7pm with >= 4 GOLD seats, cheapest first"
+struct ShowQuery
+{
+    int movieId = -1;           // -1 = any movie
+    CityId city = INVALID_CITY; // INVALID_CITY = any city
+    int theatreId = -1;         // -1 = any theatre
+    int fromHour = 0;           // start time >= fromHour
+    int toHour = 24;            // start time < toHour
+    int minFreeSeats = 1;
+    int category = -1;          // SeatCategory as int, -1 = any category
+    size_t limit = 10;          // top-k cheapest
+};
+
+struct ShowMatch
+{
+    int showId;
+    int theatreId;
+    int screenId;
+    int startTime;
+    int price;     // requested category, or cheapest category with a free seat
+    int freeSeats; // in the requested category, or in total
+};
+
+class ShowQueryEngine
+{
+private:
+    static const size_t BLOCK = 2048;
+
+    const ShowTable &table;
+    const SeatInventory &seatInventory;
+    unique_ptr<uint32_t[]> selectionBuffer; // reused between queries
+    size_t selectionCapacity = 0;
+    size_t selectionSize = 0;
+
+    // Dense pass over one column: evaluate the predicate a block at a time into a byte
+    // mask (a plain compare loop the compiler vectorizes), then compress the set bytes
+    // into row ids eight at a time.
+    template <typename Predicate>
+    void selectRows(size_t rows, Predicate matches)
+    {
+        if (selectionCapacity < rows)
+        {
+            selectionCapacity = max(rows, selectionCapacity * 2);
+            selectionBuffer.reset(new uint32_t[selectionCapacity]);
+        }
+        uint32_t *out = selectionBuffer.get();
+        size_t count = 0;
+        uint8_t mask[BLOCK];
+
+        for (size_t base = 0; base < rows; base += BLOCK)
+        {
+            size_t length = min(BLOCK, rows - base);
+            if (length == BLOCK)
+            {
+                for (size_t j = 0; j < BLOCK; j++)
+                {
+                    mask[j] = matches(base + j);
+                }
+            }
+            else
+            {
+                for (size_t j = 0; j < length; j++)
+                {
+                    mask[j] = matches(base + j);
+                }
+                fill(mask + length, mask + ((length + 7) & ~size_t(7)), 0);
+            }
+
+            for (size_t j = 0; j < length; j += 8)
+            {
+                uint64_t word;
+                memcpy(&word, mask + j, sizeof(word));
+                while (word)
+                {
+                    out[count++] = static_cast<uint32_t>(base + j + (__builtin_ctzll(word) >> 3));
+                    word &= word - 1;
+                }
+            }
+        }
+        selectionSize = count;
+    }
+
+public:
+    ShowQueryEngine(const ShowTable &table, const SeatInventory &inventory)
+        : table(table), seatInventory(inventory) {}
+
+    // No matches for a category outside [-1, SeatLayout::CATEGORY_COUNT)
+    vector<ShowMatch> search(const ShowQuery &query)
+    {
+        if (query.category < -1 || query.category >= SeatLayout::CATEGORY_COUNT)
+        {
+            return {};
+        }
+        const int *showIds = table.getShowIds().data();
+        const int *startTimes = table.getStartTimes().data();
+        const int *theatreIds = table.getTheatreIds().data();
+        const int *movieIds = table.getMovieIds().data();
+        const int *cityIds = table.getCityIds().data();
+        const int *basePrices = table.getBasePrices().data();
+        size_t rows = table.size();
+
+        // 1. Narrow down with the most selective column that has a filter
+        if (query.movieId >= 0)
+        {
+            int movieId = query.movieId;
+            selectRows(rows, [movieIds, movieId](size_t i)
+                       { return movieIds[i] == movieId; });
+        }
+        else if (query.theatreId >= 0)
+        {
+            int theatreId = query.theatreId;
+            selectRows(rows, [theatreIds, theatreId](size_t i)
+                       { return theatreIds[i] == theatreId; });
+        }
+        else if (query.city != INVALID_CITY)
+        {
+            int city = query.city;
+            selectRows(rows, [cityIds, city](size_t i)
+                       { return cityIds[i] == city; });
+        }
+        else
+        {
+            unsigned from = query.fromHour, span = query.toHour - query.fromHour;
+            selectRows(rows, [startTimes, from, span](size_t i)
+                       { return unsigned(startTimes[i]) - from < span; });
+        }
+
+        // 2. Apply every predicate to the surviving rows (combined branch-free into one test),
+        //    keeping the k cheapest in a bounded max-heap
+        const int *free[SeatLayout::CATEGORY_COUNT];
+        int multipliers[SeatLayout::CATEGORY_COUNT];
+        for (int c = 0; c < SeatLayout::CATEGORY_COUNT; c++)
+        {
+            free[c] = seatInventory.getFreeColumn(static_cast<SeatCategory>(c)).data();
+            multipliers[c] = SeatLayout::getPriceMultiplier(static_cast<SeatCategory>(c));
+        }
+        const int *freeCounts = query.category >= 0 ? free[query.category] : seatInventory.getFreeColumn().data();
+        bool anyMovie = query.movieId < 0, anyTheatre = query.theatreId < 0, anyCity = query.city == INVALID_CITY;
+
+        auto cheaper = [](const ShowMatch &a, const ShowMatch &b)
+        { return tie(a.price, a.startTime, a.showId) < tie(b.price, b.startTime, b.showId); };
+        vector<ShowMatch> best;
+        best.reserve(query.limit + 1);
+        if (query.limit == 0)
+        {
+            return best;
+        }
+
+        for (size_t s = 0; s < selectionSize; s++)
+        {
+            uint32_t row = selectionBuffer[s];
+            bool keep = (showIds[row] >= 0) &
+                        (anyMovie | (movieIds[row] == query.movieId)) &
+                        (anyTheatre | (theatreIds[row] == query.theatreId)) &
+                        (anyCity | (cityIds[row] == query.city)) &
+                        (startTimes[row] >= query.fromHour) & (startTimes[row] < query.toHour) &
+                        (freeCounts[row] >= query.minFreeSeats);
+            if (!keep)
+            {
+                continue;
+            }
+
+            int multiplier;
+            if (query.category >= 0)
+            {
+                multiplier = multipliers[query.category];
+            }
+            else
+            {
+                // Cheapest category that still has a seat (SILVER < GOLD < PLATINUM)
+                multiplier = multipliers[SeatLayout::CATEGORY_COUNT - 1];
+                for (int c = SeatLayout::CATEGORY_COUNT - 2; c >= 0; c--)
+                {
+                    multiplier = free[c][row] > 0 ? multipliers[c] : multiplier;
+                }
+            }
+            ShowMatch match = {showIds[row], theatreIds[row], table.getScreenIds()[row], startTimes[row],
+                               basePrices[row] * multiplier / 100, freeCounts[row]};
+            if (best.size() < query.limit)
+            {
+                best.push_back(match);
+                push_heap(best.begin(), best.end(), cheaper);
+            }
+            else if (cheaper(match, best.front()))
+            {
+                pop_heap(best.begin(), best.end(), cheaper);
+                best.back() = match;
+                push_heap(best.begin(), best.end(), cheaper);
+            }
+        }
+
+        // 3. Cheapest first (ties: earlier show, then lower id)
+        sort_heap(best.begin(), best.end(), cheaper);
+        return best;
+    }
+};
+
+#endif // SHOWQUERYENGINE_H
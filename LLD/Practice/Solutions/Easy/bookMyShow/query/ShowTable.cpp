@@ -0,0 +1,93 @@
+#ifndef SHOWTABLE_H
+#define SHOWTABLE_H
+
+#include <bits/stdc++.h>
+#include "../city/CityRegistry.cpp"
+#include "../theatre/show.cpp"
+using namespace std;
+
+// Structure-of-arrays copy of every scheduled show, one row per SeatInventory slot,
+// so the per-category free counts live in SeatInventory columns with the same index.
+class ShowTable
+{
+private:
+    vector<int> showIds; // -1 marks an unused slot
+    vector<int> startTimes;
+    vector<int> theatreIds;
+    vector<int> screenIds;
+    vector<int> movieIds;
+    vector<int> cityIds;
+    vector<int> basePrices;
+
+    void ensureRow(int slot)
+    {
+        if (slot < static_cast<int>(showIds.size()))
+        {
+            return;
+        }
+        size_t rows = slot + 1;
+        showIds.resize(rows, -1);
+        startTimes.resize(rows, -1);
+        theatreIds.resize(rows, -1);
+        screenIds.resize(rows, -1);
+        movieIds.resize(rows, -1);
+        cityIds.resize(rows, INVALID_CITY);
+        basePrices.resize(rows, 0);
+    }
+
+public:
+    void reserve(size_t rows)
+    {
+        for (vector<int> *column : {&showIds, &startTimes, &theatreIds, &screenIds, &movieIds, &cityIds, &basePrices})
+        {
+            column->reserve(rows);
+        }
+    }
+
+    void setRow(const Show &show, int theatreId, CityId city)
+    {
+        int slot = show.getInventorySlot();
+        ensureRow(slot);
+        showIds[slot] = show.getShowId();
+        startTimes[slot] = show.getShowStartTime();
+        theatreIds[slot] = theatreId;
+        screenIds[slot] = show.getScreen() ? show.getScreen()->getScreenId() : -1;
+        movieIds[slot] = show.getMovie()->getMovieId();
+        cityIds[slot] = city;
+        basePrices[slot] = show.getBasePrice();
+    }
+
+    void clearRow(int slot)
+    {
+        showIds[slot] = -1;
+        startTimes[slot] = -1; // never inside a valid time range
+        theatreIds[slot] = -1;
+        screenIds[slot] = -1;
+        movieIds[slot] = -1;
+        cityIds[slot] = INVALID_CITY;
+    }
+
+    // Drops every row
+    void clear()
+    {
+        for (vector<int> *column : {&showIds, &startTimes, &theatreIds, &screenIds, &movieIds, &cityIds, &basePrices})
+        {
+            column->clear();
+        }
+    }
+
+    size_t size() const
+    {
+        return showIds.size();
+    }
+
+    const vector<int> &getShowIds() const { return showIds; }
+    const vector<int> &getStartTimes() const { return startTimes; }
+    const vector<int> &getTheatreIds() const { return theatreIds; }
+    const vector<int> &getScreenIds() const { return screenIds; }
+    const vector<int> &getMovieIds() const { return movieIds; }
+    const vector<int> &getCityIds() const { return cityIds; }
+    const vector<int> &getBasePrices() const { return basePrices; }
+};
+
+#endif // SHOWTABLE_H
@@ -0,0 +1,390 @@
+#ifndef REPLICATIONLOG_H
+#define REPLICATIONLOG_H
+
+#include <bits/stdc++.h>
+using namespace std;
+
+// Every booking mutation, recorded with its inputs so a standby replays it deterministically
+enum class ReplicationOp : uint8_t
+{
+    HOLD_SEATS = 1,
+    CONFIRM_BOOKING,
+    RELEASE_HOLD,
+    CANCEL_SEATS,
+    ADVANCE_CLOCK,
+    SCHEDULE_CHANGES,
+    LOG_TRIMMED, // sent alone to a standby the primary can no longer serve from startup
+    SNAPSHOT     // the whole booking state, followed by the log from where it was taken
+};
+
+// Builds one record: [uint32 total length][uint8 op][fields...], fields in host byte order
+class RecordWriter
+{
+    vector<char> bytes; // grows to the largest record seen, then reused
+    size_t length = 0;
+
+    char *reserve(size_t size)
+    {
+        if (length + size > bytes.size())
+        {
+            bytes.resize(max(bytes.size() * 2, length + size));
+        }
+        char *out = bytes.data() + length;
+        length += size;
+        return out;
+    }
+
+public:
+    void start(ReplicationOp op)
+    {
+        length = 0;
+        reserve(sizeof(uint32_t));
+        *reserve(1) = static_cast<char>(op);
+    }
+
+    template <typename T>
+    void put(T value)
+    {
+        static_assert(is_trivially_copyable<T>::value, "fields are copied as raw bytes");
+        memcpy(reserve(sizeof(T)), &value, sizeof(T));
+    }
+
+    void putString(const string &value)
+    {
+        put<uint32_t>(value.size());
+        memcpy(reserve(value.size()), value.data(), value.size());
+    }
+
+    template <typename T>
+    void putArray(const vector<T> &values)
+    {
+        static_assert(is_trivially_copyable<T>::value, "elements are copied as raw bytes");
+        put<uint32_t>(values.size());
+        memcpy(reserve(values.size() * sizeof(T)), values.data(), values.size() * sizeof(T));
+    }
+
+    void putInts(const vector<int> &values)
+    {
+        putArray(values);
+    }
+
+    // Fills in the length prefix; returns the finished record
+    const char *finish(size_t &size)
+    {
+        uint32_t total = length;
+        memcpy(bytes.data(), &total, sizeof(total));
+        size = length;
+        return bytes.data();
+    }
+};
+
+// Reads back one complete record produced by RecordWriter
+class RecordReader
+{
+    const char *position;
+    ReplicationOp op;
+
+public:
+    explicit RecordReader(const char *record)
+        : position(record + sizeof(uint32_t) + 1), op(static_cast<ReplicationOp>(record[sizeof(uint32_t)])) {}
+
+    // Length of the record at 'data', or 0 if fewer than its full length is available
+    static size_t completeLength(const char *data, size_t available)
+    {
+        uint32_t length;
+        if (available < sizeof(length))
+        {
+            return 0;
+        }
+        memcpy(&length, data, sizeof(length));
+        return length <= available ? length : 0;
+    }
+
+    ReplicationOp getOp() const
+    {
+        return op;
+    }
+
+    template <typename T>
+    T get()
+    {
+        T value;
+        memcpy(&value, position, sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+
+    string getString()
+    {
+        uint32_t size = get<uint32_t>();
+        string value(position, size);
+        position += size;
+        return value;
+    }
+
+    template <typename T>
+    vector<T> getArray()
+    {
+        uint32_t size = get<uint32_t>();
+        vector<T> values(size);
+        memcpy(values.data(), position, size * sizeof(T));
+        position += size * sizeof(T);
+        return values;
+    }
+
+    vector<int> getInts()
+    {
+        return getArray<int>();
+    }
+};
+
+// Append-only byte log of every mutation since startup, in fixed chunks that never move.
+// One thread appends; the replication sender reads concurrently. The appender publishes
+// new bytes with a release store of the length, so appending takes no lock and no fence.
+// Without the fence a reader that goes to sleep just as bytes arrive can miss its wakeup;
+// every wait is timed, so that costs it at most one timeout.
+//
+// At most MAX_CHUNKS chunks are held, as a ring. While a standby is streaming, chunks it
+// has been sent are dropped as the appender moves on and their memory is reused for new
+// chunks. With no standby the log is kept from startup until the ring is full, then the
+// oldest chunk goes. A reader a whole ring behind makes the appender wait. Once anything
+// has been dropped a new standby can no longer be brought up from startup (see getStart);
+// it is sent a snapshot of the state instead, when the appender has a snapshotter.
+class ReplicationLog
+{
+public:
+    // Writes the whole state the log's records have built, onto a SNAPSHOT record
+    using Snapshotter = function<void(RecordWriter &)>;
+
+private:
+    static const size_t CHUNK_SIZE = 1 << 20;
+    static const size_t MAX_CHUNKS = 1 << 10; // 1 GB of log held at most
+    static const size_t NO_READER = SIZE_MAX;
+
+    unique_ptr<unique_ptr<char[]>[]> chunks{new unique_ptr<char[]>[MAX_CHUNKS]}; // chunk i at i % MAX_CHUNKS
+    vector<unique_ptr<char[]>> spareChunks; // dropped chunks, already paged in, for reuse
+    atomic<size_t> length{0};
+    atomic<size_t> start{0};             // first byte still held
+    atomic<size_t> readerAt{NO_READER};  // next byte the streaming reader needs
+    mutex trimLock;                      // orders dropping chunks against a reader attaching
+    RecordWriter writer; // used by the appending thread only
+
+    mutex waitLock;
+    condition_variable dataAvailable;
+    atomic<size_t> wakeAt{NO_READER}; // length at which a waiting reader is woken
+
+    Snapshotter snapshotter;            // set before any reader attaches
+    atomic<bool> snapshotWanted{false}; // a reader waits for the appender to take one
+    mutex snapshotLock;
+    condition_variable snapshotTaken;
+    vector<char> snapshot;      // finished SNAPSHOT record, handed to the reader
+    size_t snapshotAt = 0;      // log length it was taken at
+    bool snapshotReady = false;
+
+    // On the appending thread, between records, so the state matches the log's length
+    void takeSnapshot()
+    {
+        RecordWriter out;
+        out.start(ReplicationOp::SNAPSHOT);
+        snapshotter(out);
+        size_t size;
+        const char *record = out.finish(size);
+        size_t at = length.load(memory_order_relaxed);
+        lock_guard<mutex> guard(snapshotLock);
+        if (!snapshotWanted.load())
+        {
+            return; // the reader gave up meanwhile
+        }
+        {
+            lock_guard<mutex> trimGuard(trimLock);
+            readerAt.store(at); // nothing from here on may be dropped before the reader sends it
+        }
+        snapshot.assign(record, record + size);
+        snapshotAt = at;
+        snapshotReady = true;
+        snapshotWanted.store(false);
+        snapshotTaken.notify_one();
+    }
+
+    char *chunkAt(size_t offset) const
+    {
+        return chunks[(offset / CHUNK_SIZE) % MAX_CHUNKS].get();
+    }
+
+    // Gives the chunk starting at 'end' a slot and memory, dropping the chunks
+    // nobody needs any more
+    void makeRoom(size_t end)
+    {
+        size_t chunk = end / CHUNK_SIZE;
+        while (true)
+        {
+            {
+                lock_guard<mutex> guard(trimLock);
+                size_t first = start.load() / CHUNK_SIZE;
+                size_t reader = readerAt.load();
+                size_t keep = reader != NO_READER           ? reader / CHUNK_SIZE
+                              : chunk - first >= MAX_CHUNKS ? chunk - MAX_CHUNKS + 1
+                                                            : first; // first chunk still needed
+                if (keep > first)
+                {
+                    start.store(keep * CHUNK_SIZE);
+                    for (size_t i = first; i < keep; i++)
+                    {
+                        spareChunks.push_back(move(chunks[i % MAX_CHUNKS]));
+                    }
+                }
+                if (chunk - max(keep, first) < MAX_CHUNKS)
+                {
+                    unique_ptr<char[]> &slot = chunks[chunk % MAX_CHUNKS];
+                    if (!spareChunks.empty())
+                    {
+                        slot = move(spareChunks.back());
+                        spareChunks.pop_back();
+                    }
+                    else
+                    {
+                        slot.reset(new char[CHUNK_SIZE]);
+                    }
+                    return;
+                }
+            }
+            this_thread::sleep_for(chrono::microseconds(100)); // reader a whole ring behind
+        }
+    }
+
+public:
+    RecordWriter &beginRecord(ReplicationOp op)
+    {
+        if (snapshotWanted.load(memory_order_relaxed))
+        {
+            takeSnapshot();
+        }
+        writer.start(op);
+        return writer;
+    }
+
+    void commitRecord()
+    {
+        size_t size;
+        const char *record = writer.finish(size);
+        append(record, size);
+    }
+
+    void append(const char *data, size_t size)
+    {
+        size_t end = length.load(memory_order_relaxed);
+        while (size > 0)
+        {
+            size_t offset = end % CHUNK_SIZE;
+            if (offset == 0)
+            {
+                makeRoom(end);
+            }
+            size_t part = min(size, CHUNK_SIZE - offset);
+            memcpy(chunkAt(end) + offset, data, part);
+            end += part;
+            data += part;
+            size -= part;
+        }
+        length.store(end, memory_order_release);
+        // One wakeup per wait, however many records arrive before the reader runs
+        if (end >= wakeAt.load(memory_order_relaxed) && wakeAt.exchange(NO_READER) != NO_READER)
+        {
+            lock_guard<mutex> guard(waitLock);
+            dataAvailable.notify_one();
+        }
+    }
+
+    size_t size() const
+    {
+        return length.load(memory_order_acquire);
+    }
+
+    // First byte still held; 0 until anything has been dropped
+    size_t getStart() const
+    {
+        return start.load();
+    }
+
+    // Registers the streaming reader at byte 0; false if that byte has been dropped
+    bool attachReader()
+    {
+        lock_guard<mutex> guard(trimLock);
+        if (start.load() > 0)
+        {
+            return false;
+        }
+        readerAt.store(0);
+        return true;
+    }
+
+    void setSnapshotter(Snapshotter write)
+    {
+        snapshotter = move(write);
+    }
+
+    // Registers the streaming reader at the point a snapshot of the state is taken,
+    // for when byte 0 has been dropped. The appender takes it before its next record,
+    // so this waits for the next mutation; false without a snapshotter, or once
+    // 'cancelled' returns true. 'offset' is where the log continues after 'record'.
+    template <typename Cancelled>
+    bool attachReaderWithSnapshot(vector<char> &record, size_t &offset, Cancelled cancelled)
+    {
+        if (!snapshotter)
+        {
+            return false;
+        }
+        unique_lock<mutex> guard(snapshotLock);
+        snapshotReady = false;
+        snapshotWanted.store(true);
+        while (!snapshotTaken.wait_for(guard, chrono::milliseconds(50), [this]
+                                       { return snapshotReady; }))
+        {
+            if (cancelled())
+            {
+                snapshotWanted.store(false); // under snapshotLock, so the appender sees it
+                return false;
+            }
+        }
+        record.swap(snapshot);
+        snapshot.clear();
+        offset = snapshotAt;
+        return true;
+    }
+
+    // The reader needs nothing before 'offset' any more
+    void advanceReader(size_t offset)
+    {
+        readerAt.store(offset);
+    }
+
+    void detachReader()
+    {
+        readerAt.store(NO_READER);
+    }
+
+    // Contiguous bytes available from 'offset' (within one chunk); 0 if there is nothing new
+    size_t read(size_t offset, const char *&data) const
+    {
+        size_t end = length.load(memory_order_acquire);
+        if (offset >= end)
+        {
+            return 0;
+        }
+        data = chunkAt(offset) + offset % CHUNK_SIZE;
+        return min(end - offset, CHUNK_SIZE - offset % CHUNK_SIZE);
+    }
+
+    // Block until the log reaches 'target' bytes or the timeout passes (see the class
+    // comment: a wakeup can be missed, so keep the timeout short where latency matters)
+    void waitForData(size_t target, chrono::microseconds timeout)
+    {
+        unique_lock<mutex> guard(waitLock);
+        wakeAt.store(target);
+        dataAvailable.wait_for(guard, timeout, [this, target]
+                               { return length.load() >= target; });
+        wakeAt.store(NO_READER);
+    }
+};
+
+#endif // REPLICATIONLOG_H
@@ -0,0 +1,207 @@
+#ifndef REPLICATIONPRIMARY_H
+#define REPLICATIONPRIMARY_H
+
+#include <bits/stdc++.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "ReplicationLog.cpp"
+using namespace std;
+
+// Streams the ReplicationLog to a standby over a local (Unix domain) socket.
+// A background thread sends whatever has accumulated since its last write, so the
+// booking thread only ever appends to memory and never waits for the standby
+// (unless it falls a whole log ring behind, see ReplicationLog).
+class ReplicationPrimary
+{
+private:
+    static const size_t SEND_BYTES = 1 << 20;
+    static constexpr chrono::microseconds GATHER_TIME{5000}; // most a record waits for its batch, and so the most the standby lags
+    ReplicationLog &log;
+    string socketPath;
+    int listenFd = -1;
+    thread sender;
+    atomic<bool> stopping{false};
+    atomic<size_t> ackedBytes{0};
+    atomic<int64_t> ackOrigin{0}; // log offset minus stream offset: non-zero after a snapshot
+    atomic<bool> streaming{false}; // a standby is attached and being fed
+
+    int acceptStandby()
+    {
+        pollfd pending = {listenFd, POLLIN, 0};
+        if (poll(&pending, 1, 100) <= 0)
+        {
+            return -1;
+        }
+        return accept(listenFd, nullptr, nullptr);
+    }
+
+    // The standby acknowledges how many bytes it has applied
+    void readAcks(int fd)
+    {
+        uint64_t applied;
+        while (recv(fd, &applied, sizeof(applied), MSG_DONTWAIT) == sizeof(applied))
+        {
+            ackedBytes = applied;
+        }
+    }
+
+    bool sendAll(int fd, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+            if (written <= 0)
+            {
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    // Send the whole log from the start (a new standby starts from the seed data), then follow it.
+    // If the start has been dropped, send a snapshot of the state and the log from there on.
+    // Bytes are sent in batches of at least SEND_BYTES, or whatever arrived within
+    // GATHER_TIME, so a busy primary pays for one wakeup and one send per batch, not per record.
+    void streamTo(int fd)
+    {
+        ackedBytes = 0;
+        ackOrigin = 0;
+        size_t sent = 0;
+        if (!log.attachReader())
+        {
+            vector<char> snapshot;
+            if (!log.attachReaderWithSnapshot(snapshot, sent, [this]
+                                              { return stopping.load(); }))
+            {
+                RecordWriter refusal;
+                refusal.start(ReplicationOp::LOG_TRIMMED);
+                size_t size;
+                const char *record = refusal.finish(size);
+                send(fd, record, size, MSG_NOSIGNAL);
+                return;
+            }
+            ackOrigin = int64_t(sent) - int64_t(snapshot.size());
+            if (!sendAll(fd, snapshot.data(), snapshot.size()))
+            {
+                log.detachReader();
+                return;
+            }
+        }
+        streaming = true;
+        bool gathered = false;
+        while (true)
+        {
+            const char *data;
+            size_t available = log.read(sent, data);
+            if (available == 0)
+            {
+                if (stopping)
+                {
+                    break; // fully drained
+                }
+                readAcks(fd);
+                log.waitForData(sent + 1, GATHER_TIME); // short: the append may not wake us
+                continue;
+            }
+            if (!gathered && !stopping && log.size() - sent < SEND_BYTES)
+            {
+                log.waitForData(sent + SEND_BYTES, GATHER_TIME);
+                gathered = true;
+                continue;
+            }
+            ssize_t written = send(fd, data, available, MSG_NOSIGNAL);
+            if (written <= 0)
+            {
+                break; // standby went away; wait for the next one
+            }
+            sent += written;
+            log.advanceReader(sent);
+            gathered = false;
+        }
+        log.detachReader();
+        streaming = false;
+    }
+
+    void run()
+    {
+        while (!stopping)
+        {
+            int fd = acceptStandby();
+            if (fd < 0)
+            {
+                continue;
+            }
+            streamTo(fd);
+            close(fd);
+        }
+    }
+
+public:
+    ReplicationPrimary(ReplicationLog &log, const string &socketPath)
+        : log(log), socketPath(socketPath) {}
+
+    ~ReplicationPrimary()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path))
+        {
+            return false;
+        }
+        strcpy(address.sun_path, socketPath.c_str());
+        unlink(socketPath.c_str());
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0 ||
+            bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+            listen(listenFd, 1) < 0)
+        {
+            if (listenFd >= 0)
+            {
+                close(listenFd);
+                listenFd = -1;
+            }
+            return false;
+        }
+        sender = thread(&ReplicationPrimary::run, this);
+        return true;
+    }
+
+    // Flush everything logged so far to a connected standby, then shut down
+    void stop()
+    {
+        if (listenFd < 0)
+        {
+            return;
+        }
+        stopping = true;
+        sender.join();
+        close(listenFd);
+        listenFd = -1;
+        unlink(socketPath.c_str());
+    }
+
+    bool hasStandby() const
+    {
+        return streaming;
+    }
+
+    // Bytes logged but not yet applied by the standby
+    size_t getReplicationLag() const
+    {
+        size_t logged = log.size();
+        size_t applied = size_t(max<int64_t>(0, int64_t(ackedBytes) + ackOrigin));
+        return logged - min(logged, applied);
+    }
+};
+
+#endif // REPLICATIONPRIMARY_H
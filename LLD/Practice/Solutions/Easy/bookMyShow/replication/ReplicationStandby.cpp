@@ -0,0 +1,114 @@
+#ifndef REPLICATIONSTANDBY_H
+#define REPLICATIONSTANDBY_H
+
+#include <bits/stdc++.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "ReplicationLog.cpp"
+using namespace std;
+
+// Follows a ReplicationPrimary: applies each record as soon as it is complete and
+// acknowledges progress, so when the primary disappears only the bytes already in
+// the socket are left to apply before promotion.
+class ReplicationStandby
+{
+private:
+    string socketPath;
+    bool refused = false;
+
+    int connectToPrimary()
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path))
+        {
+            return -1;
+        }
+        strcpy(address.sun_path, socketPath.c_str());
+
+        while (true)
+        {
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+            {
+                return -1;
+            }
+            if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0)
+            {
+                return fd;
+            }
+            close(fd);
+            this_thread::sleep_for(chrono::milliseconds(100)); // primary not up yet
+        }
+    }
+
+public:
+    explicit ReplicationStandby(const string &socketPath) : socketPath(socketPath) {}
+
+    // True if the primary had already dropped the start of its log and could not
+    // send a snapshot instead, so this standby could not follow it; it must not
+    // take over either
+    bool wasRefused() const
+    {
+        return refused;
+    }
+
+    // Blocks until the primary's stream ends. Each applied record is also appended to
+    // 'localLog' so this process can serve its own standby once promoted.
+    // Returns the number of records applied.
+    template <typename ApplyRecord>
+    size_t follow(ApplyRecord apply, ReplicationLog &localLog)
+    {
+        int fd = connectToPrimary();
+        if (fd < 0)
+        {
+            return 0;
+        }
+
+        vector<char> buffer(1 << 16);
+        size_t filled = 0;
+        size_t appliedBytes = 0;
+        size_t records = 0;
+        while (true)
+        {
+            if (filled == buffer.size())
+            {
+                buffer.resize(buffer.size() * 2); // a record larger than the buffer
+            }
+            ssize_t received = recv(fd, buffer.data() + filled, buffer.size() - filled, 0);
+            if (received <= 0)
+            {
+                break; // primary gone; a trailing partial record was never committed
+            }
+            filled += received;
+
+            size_t consumed = 0;
+            size_t length;
+            while ((length = RecordReader::completeLength(buffer.data() + consumed, filled - consumed)) > 0)
+            {
+                RecordReader record(buffer.data() + consumed);
+                if (record.getOp() == ReplicationOp::LOG_TRIMMED)
+                {
+                    refused = true;
+                    close(fd);
+                    return records;
+                }
+                apply(record);
+                consumed += length;
+                records++;
+            }
+            localLog.append(buffer.data(), consumed);
+            appliedBytes += consumed;
+            memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+            filled -= consumed;
+
+            uint64_t ack = appliedBytes;
+            send(fd, &ack, sizeof(ack), MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+        close(fd);
+        return records;
+    }
+};
+
+#endif // REPLICATIONSTANDBY_H
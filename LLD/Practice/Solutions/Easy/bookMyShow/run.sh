@@ -1,7 +1,7 @@
 #!/bin/bash
 
 echo "🔧 Compiling bookMyShow..."
-g++ -std=c++17 -o bookMyShow main.cpp
+g++ -std=c++17 -O2 -pthread -o bookMyShow main.cpp
 
 if [ $? -eq 0 ]; then
     echo "✅ Compilation successful!"
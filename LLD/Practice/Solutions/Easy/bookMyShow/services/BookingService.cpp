@@ -4,14 +4,20 @@
 #include <iostream>
 #include <sstream>
 #include <map>
-#include "../enums/city.cpp"
+#include "../city/CityRegistry.cpp"
+#include "../controllers/BookingController.cpp"
 #include "../controllers/MovieController.cpp"
 #include "../controllers/TheatreController.cpp"
 #include "../movie/movie.cpp"
+#include "../query/ShowQueryEngine.cpp"
+#include "../replication/ReplicationLog.cpp"
+#include "../replication/ReplicationPrimary.cpp"
+#include "../replication/ReplicationStandby.cpp"
 #include "../theatre/show.cpp"
 #include "../theatre/theatre.cpp"
 #include "../utils/BookingDataFactory.cpp"
 #include "PaymentService.cpp"
+#include "ScheduleAdminService.cpp"
 
 using namespace std;
 
@@ -22,9 +28,19 @@ private:
 
     MovieController movieController;
     TheatreController theatreController;
+    // Both must follow theatreController (they use its SeatInventory / ShowTable)
+    BookingController bookingController;
+    ShowQueryEngine showQueryEngine;
+
+    // Hot-standby replication (see startReplicationPrimary / runAsStandby)
+    ReplicationLog replicationLog;
+    unique_ptr<ReplicationPrimary> replicationPrimary;
+    bool replicating = false;
 
     // ✅ Private constructor
-    BookingService() {}
+    BookingService()
+        : bookingController(theatreController.getSeatInventory()),
+          showQueryEngine(theatreController.getShowTable(), theatreController.getSeatInventory()) {}
 
     // Helper to generate random UUID-like string
     string generateUUID()
@@ -64,7 +80,7 @@ public:
 
         while (continueBooking)
         {
-            City userCity = selectCity();
+            CityId userCity = selectCity();
             Movie *selectedMovie = selectMovie(userCity);
             if (selectedMovie == nullptr)
             {
@@ -72,38 +88,48 @@ public:
                 continue;
             }
             Show selectedShow = selectShow(userCity, selectedMovie);
+            if (selectedShow.getInventorySlot() < 0)
+            {
+                continue; // no scheduled show was selected
+            }
             bookSeat(selectedShow);
 
-            cout << "Do you want to book another ticket? (yes/no): ";
             string response;
-            cin >> response;
-            for (auto &c : response)
-                c = tolower(c); // lowercase
+            while (true)
+            {
+                cout << "Do you want to book another ticket? (yes/no/cancel): ";
+                cin >> response;
+                for (auto &c : response)
+                    c = tolower(c); // lowercase
+                if (response != "cancel")
+                    break;
+                cancelBookingFlow();
+            }
             continueBooking = (response == "yes");
         }
 
         printSuccess("Thank you for using BookMyShow! 🎬 Have a great day!");
     }
 
-    City selectCity()
+    CityId selectCity()
     {
         printSection("🏙️ Select Your City");
-        vector<City> cities = values(); // assume you implemented values() in City enum
-        for (size_t i = 0; i < cities.size(); i++)
+        int cityCount = CityRegistry::size(); // ids are dense: 0..cityCount-1
+        for (CityId id = 0; id < cityCount; id++)
         {
-            cout << "   " << (i + 1) << ". " << toString(cities[i]) << endl;
+            cout << "   " << (id + 1) << ". " << CityRegistry::getCityName(id) << endl;
         }
-        return cities[getUserChoice(1, cities.size()) - 1];
+        return getUserChoice(1, cityCount) - 1;
     }
 
-    Movie *selectMovie(City city)
+    Movie *selectMovie(CityId city)
     {
-        vector<Movie *> movies = movieController.getMoviesByCity(city);
-        printSection("🎥 Available Movies in " + toString(city));
+        const vector<Movie *> &movies = movieController.getMoviesByCity(city);
+        printSection("🎥 Available Movies in " + CityRegistry::getCityName(city));
 
         if (movies.empty())
         {
-            cout << "❌ No movies available in " << toString(city) << endl;
+            cout << "❌ No movies available in " << CityRegistry::getCityName(city) << endl;
             return nullptr;
         }
 
@@ -114,12 +140,12 @@ public:
         return movies[getUserChoice(1, movies.size()) - 1];
     }
 
-    Show selectShow(City city, Movie *movie)
+    Show selectShow(CityId city, Movie *movie)
     {
         map<Theatre *, vector<Show>> showsMap = theatreController.getAllShow(movie, city);
 
         vector<Show> availableShows;
-        printSection("🎭 Available Shows for " + movie->getMovieName() + " in " + toString(city));
+        printSection("🎭 Available Shows for " + movie->getMovieName() + " in " + CityRegistry::getCityName(city));
         int index = 1;
         for (auto &entry : showsMap)
         {
@@ -135,7 +161,7 @@ public:
 
         if (availableShows.empty())
         {
-            cout << "❌ No shows available for " << movie->getMovieName() << " in " << toString(city) << endl;
+            cout << "❌ No shows available for " << movie->getMovieName() << " in " << CityRegistry::getCityName(city) << endl;
             // Return a default show or handle this case
             Show defaultShow;
             return defaultShow;
@@ -146,35 +172,59 @@ public:
 
     void bookSeat(Show show)
     {
-        printSection("💺 Select Your Seat (1-100)");
-        int seatNumber = getUserChoice(1, 100);
-        vector<int> &bookedSeats = show.getBookedSeatIds();
+        SeatInventory &inventory = theatreController.getSeatInventory();
+        printSection("💺 Select Your Seat (1-" + to_string(inventory.getSeatsPerShow()) + ")");
+        int seatNumber = getUserChoice(1, inventory.getSeatsPerShow());
 
-        if (find(bookedSeats.begin(), bookedSeats.end(), seatNumber) != bookedSeats.end())
+        double price = SeatLayout::getPrice(show.getBasePrice(), SeatLayout::getCategory(seatNumber, inventory.getSeatsPerShow()));
+        string bookingRef = generateUUID();
+        int bookingId = bookingController.holdSeats(show, {seatNumber}, price, bookingRef, time(nullptr));
+        if (bookingId < 0)
         {
             cout << "❌ Seat already booked! Please try another seat." << endl;
             bookSeat(show);
+            return;
+        }
+
+        PaymentService paymentService;
+        bool paymentSuccess = paymentService.processPayment(price);
+
+        if (paymentSuccess && bookingController.confirmBooking(bookingId, time(nullptr)))
+        {
+            printSuccess("✅ Booking Successful! Enjoy your movie! 🍿");
+            generateTicket(show, seatNumber, bookingRef);
         }
         else
         {
-            bookedSeats.push_back(seatNumber);
-            PaymentService paymentService;
-            bool paymentSuccess = paymentService.processPayment(250); // Example amount
+            cout << "❌ Payment failed! Please try again." << endl;
+            bookingController.releaseHold(bookingId);
+        }
+    }
 
-            if (paymentSuccess)
-            {
-                printSuccess("✅ Booking Successful! Enjoy your movie! 🍿");
-                generateTicket(show, seatNumber);
-            }
-            else
-            {
-                cout << "❌ Payment failed! Please try again." << endl;
-                bookedSeats.erase(remove(bookedSeats.begin(), bookedSeats.end(), seatNumber), bookedSeats.end());
-            }
+    void cancelBookingFlow()
+    {
+        printSection("🧾 Cancel a Booking");
+        cout << "👉 Enter Booking ID: ";
+        string bookingRef;
+        cin >> bookingRef;
+
+        Booking *booking = bookingController.findBookingByRef(bookingRef);
+        if (booking == nullptr)
+        {
+            cout << "❌ No booking found with ID " << bookingRef << endl;
+            return;
         }
+
+        double refund = bookingController.cancelBooking(booking->getBookingId(), time(nullptr));
+        if (refund < 0)
+        {
+            cout << "❌ This booking can no longer be cancelled." << endl;
+            return;
+        }
+        printSuccess("Booking cancelled. ₹" + to_string(static_cast<int>(refund)) + " will be refunded.");
     }
 
-    void generateTicket(Show show, int seatNumber)
+    void generateTicket(Show show, int seatNumber, const string &bookingRef)
     {
         cout << "\n========================================" << endl;
         cout << "🎟️       MOVIE TICKET CONFIRMATION       🎟️" << endl;
@@ -185,7 +235,7 @@ public:
         cout << "----------------------------------------" << endl;
         time_t t = time(nullptr);
         cout << "📅 Date: " << put_time(localtime(&t), "%Y-%m-%d") << endl;
-        cout << "🆔 Booking ID: " << generateUUID() << endl;
+        cout << "🆔 Booking ID: " << bookingRef << endl;
         cout << "========================================" << endl;
         cout << "🎉 Enjoy your movie! 🍿 Have a great time!" << endl;
         cout << "========================================\n"
@@ -228,9 +278,165 @@ public:
              << endl;
     }
 
+    // Direct access for tools that drive bookings without the interactive session
+    BookingController &getBookingController()
+    {
+        return bookingController;
+    }
+
+    TheatreController &getTheatreController()
+    {
+        return theatreController;
+    }
+
+    // Filtered show discovery over every scheduled show, cheapest first
+    vector<ShowMatch> searchShows(const ShowQuery &query)
+    {
+        return showQueryEngine.search(query);
+    }
+
+    // Only Admin - publish a batch of show inserts/removals atomically
+    ScheduleChangeResult applyScheduleChanges(const vector<ScheduleChange> &changes)
+    {
+        if (replicating)
+        {
+            RecordWriter &record = replicationLog.beginRecord(ReplicationOp::SCHEDULE_CHANGES);
+            record.put<uint32_t>(changes.size());
+            for (const ScheduleChange &change : changes)
+            {
+                record.put<ScheduleChange>(change);
+            }
+            replicationLog.commitRecord();
+        }
+        ScheduleAdminService scheduleAdmin(movieController, theatreController);
+        ScheduleChangeResult result = scheduleAdmin.applyChangeSet(changes);
+        bookingController.detachSlots(result.releasedSlots);
+        return result;
+    }
+
+    // Log every booking mutation and stream it to a standby connected on socketPath
+    bool startReplicationPrimary(const string &socketPath)
+    {
+        replicationLog.setSnapshotter([this](RecordWriter &out)
+                                      { writeSnapshot(out); });
+        replicationPrimary.reset(new ReplicationPrimary(replicationLog, socketPath));
+        if (!replicationPrimary->start())
+        {
+            cout << "❌ Could not listen for a standby on " << socketPath << endl;
+            replicationPrimary.reset();
+            return false;
+        }
+        replicating = true;
+        bookingController.setReplicationLog(&replicationLog);
+        cout << "📡 Replicating bookings to standby on " << socketPath << endl;
+        return true;
+    }
+
+    bool hasStandby() const
+    {
+        return replicationPrimary && replicationPrimary->hasStandby();
+    }
+
+    // Flush the remaining stream to the standby before exiting
+    void stopReplication()
+    {
+        if (replicationPrimary)
+        {
+            replicationPrimary->stop();
+        }
+    }
+
+    // Mirror a primary's bookings until it goes away, then take over as primary.
+    // False if the primary could not bring this standby up to date.
+    bool runAsStandby(const string &socketPath)
+    {
+        cout << "🛰️ Standby: following primary on " << socketPath << "..." << endl;
+        bookingController.setReplicaMode(true);
+        ReplicationStandby standby(socketPath);
+        size_t applied = standby.follow([this](RecordReader &record)
+                                        { replayRecord(record); },
+                                        replicationLog);
+        bookingController.setReplicaMode(false);
+        if (standby.wasRefused())
+        {
+            cout << "❌ The primary no longer holds its log from startup; this standby cannot follow it" << endl;
+            return false;
+        }
+
+        cout << "⚠️ Primary lost after " << applied << " replicated operations - promoting standby" << endl;
+        startReplicationPrimary(socketPath); // the next standby can attach here
+        bookingController.advanceClock(time(nullptr)); // expire holds that ran out meanwhile
+        return true;
+    }
+
+    // Everything the log has built on top of the seed data, for a standby that
+    // joins after the start of the log was dropped
+    void writeSnapshot(RecordWriter &out)
+    {
+        theatreController.saveTo(out);
+        movieController.saveTo(out);
+        bookingController.saveTo(out);
+    }
+
+    void replayRecord(RecordReader &record)
+    {
+        switch (record.getOp())
+        {
+        case ReplicationOp::HOLD_SEATS:
+        {
+            int64_t now = record.get<int64_t>();
+            Show show;
+            show.setShowId(record.get<int32_t>());
+            show.setInventorySlot(record.get<int32_t>());
+            double price = record.get<double>();
+            string bookingRef = record.getString();
+            vector<int> seats = record.getInts();
+            bookingController.holdSeats(show, seats, price, bookingRef, now);
+            break;
+        }
+        case ReplicationOp::CONFIRM_BOOKING:
+        {
+            int bookingId = record.get<int32_t>();
+            bookingController.confirmBooking(bookingId, record.get<int64_t>());
+            break;
+        }
+        case ReplicationOp::RELEASE_HOLD:
+            bookingController.releaseHold(record.get<int32_t>());
+            break;
+        case ReplicationOp::CANCEL_SEATS:
+        {
+            int bookingId = record.get<int32_t>();
+            int64_t now = record.get<int64_t>();
+            bookingController.cancelSeats(bookingId, record.getInts(), now);
+            break;
+        }
+        case ReplicationOp::ADVANCE_CLOCK:
+            bookingController.advanceClock(record.get<int64_t>());
+            break;
+        case ReplicationOp::LOG_TRIMMED:
+            break; // handled by ReplicationStandby
+        case ReplicationOp::SNAPSHOT:
+            theatreController.loadFrom(record, movieController);
+            movieController.loadFrom(record);
+            bookingController.loadFrom(record);
+            break;
+        case ReplicationOp::SCHEDULE_CHANGES:
+        {
+            vector<ScheduleChange> changes(record.get<uint32_t>());
+            for (ScheduleChange &change : changes)
+            {
+                change = record.get<ScheduleChange>();
+            }
+            applyScheduleChanges(changes);
+            break;
+        }
+        }
+    }
+
     void initialize()
     {
         cout << "🔧 Initializing BookMyShow system..." << endl;
+        BookingDataFactory::createCities();
         BookingDataFactory::createMovies(movieController);
         BookingDataFactory::createTheatres(movieController, theatreController);
         cout << "✅ System initialized successfully!" << endl;
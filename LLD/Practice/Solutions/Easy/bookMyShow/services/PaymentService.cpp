@@ -15,6 +15,14 @@ public:
         // Simulate success
         return true;
     }
+
+    bool processRefund(double amount)
+    {
+        cout << "💸 Refunding ₹" << amount << " to the original payment method..." << endl;
+
+        // Simulate success
+        return true;
+    }
 };
 
 #endif // PAYMENTSERVICE_H
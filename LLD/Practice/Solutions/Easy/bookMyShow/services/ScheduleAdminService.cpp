@@ -0,0 +1,145 @@
+#ifndef SCHEDULEADMINSERVICE_H
+#define SCHEDULEADMINSERVICE_H
+
+#include <bits/stdc++.h>
+#include "../city/CityRegistry.cpp"
+#include "../controllers/MovieController.cpp"
+#include "../controllers/TheatreController.cpp"
+#include "../theatre/ScheduleChange.cpp"
+using namespace std;
+
+// Only Admin - applies whole schedule change sets (e.g. next week's shows) atomically
+class ScheduleAdminService
+{
+private:
+    MovieController &movieController;
+    TheatreController &theatreController;
+
+    string validate(const ScheduleChange &change, Movie *&movie)
+    {
+        movie = nullptr;
+        Theatre *theatre = theatreController.getTheatreById(change.theatreId);
+        if (theatre == nullptr)
+        {
+            return "unknown theatre " + to_string(change.theatreId);
+        }
+        if (change.op == ScheduleOp::REMOVE_SHOW)
+        {
+            Theatre *owner = theatreController.getShowOwner(change.showId);
+            if (owner == nullptr)
+            {
+                return "cannot remove unknown show " + to_string(change.showId);
+            }
+            if (owner != theatre)
+            {
+                return "show " + to_string(change.showId) + " is not in theatre " + to_string(change.theatreId);
+            }
+            // Its inventory slot is recycled, so bookings and holds on it must be gone first
+            if (theatreController.hasOccupiedSeats(change.showId))
+            {
+                return "show " + to_string(change.showId) + " still has booked or held seats";
+            }
+            return "";
+        }
+        if (theatreController.hasShow(change.showId))
+        {
+            return "show " + to_string(change.showId) + " already exists";
+        }
+        movie = movieController.getMovieById(change.movieId);
+        if (movie == nullptr)
+        {
+            return "unknown movie " + to_string(change.movieId);
+        }
+        if (!theatreController.hasScreen(theatre, change.screenId))
+        {
+            return "unknown screen " + to_string(change.screenId) + " in theatre " + to_string(change.theatreId);
+        }
+        if (change.startTime < 0 || change.startTime > 23)
+        {
+            return "invalid start time " + to_string(change.startTime);
+        }
+        if (change.basePrice < 0)
+        {
+            return "invalid base price " + to_string(change.basePrice);
+        }
+        return "";
+    }
+
+public:
+    ScheduleAdminService(MovieController &movieController, TheatreController &theatreController)
+        : movieController(movieController), theatreController(theatreController) {}
+
+    // Validate the whole batch first; nothing is applied if any entry is invalid
+    ScheduleChangeResult applyChangeSet(vector<ScheduleChange> changes)
+    {
+        ScheduleChangeResult result;
+
+        sort(changes.begin(), changes.end(),
+             [](const ScheduleChange &a, const ScheduleChange &b)
+             {
+                 return tie(a.theatreId, a.op, a.startTime, a.showId) <
+                        tie(b.theatreId, b.op, b.startTime, b.showId);
+             });
+
+        vector<Movie *> movies(changes.size());
+        unordered_set<int> seenShowIds;
+        seenShowIds.reserve(changes.size());
+        for (size_t i = 0; i < changes.size(); i++)
+        {
+            string error = validate(changes[i], movies[i]);
+            if (error.empty() && !seenShowIds.insert(changes[i].showId).second)
+            {
+                error = "show " + to_string(changes[i].showId) + " appears twice in the change set";
+            }
+            if (!error.empty())
+            {
+                result.error = error;
+                return result;
+            }
+        }
+        // Counted only once the whole set is known to apply
+        result.showsAdded = static_cast<int>(count_if(changes.begin(), changes.end(), [](const ScheduleChange &c)
+                                                      { return c.op == ScheduleOp::ADD_SHOW; }));
+        result.showsRemoved = static_cast<int>(changes.size()) - result.showsAdded;
+
+        // Movies losing a show, by city, to unlist where no show of theirs is left
+        set<pair<CityId, int>> shrinking;
+        for (const ScheduleChange &change : changes)
+        {
+            if (change.op == ScheduleOp::REMOVE_SHOW)
+            {
+                Theatre *theatre = theatreController.getTheatreById(change.theatreId);
+                shrinking.insert({theatre->getCity(), theatreController.getShowMovieId(change.showId)});
+            }
+        }
+
+        result.releasedSlots = theatreController.applyScheduleBatch(changes, movies);
+
+        for (auto &listing : shrinking)
+        {
+            if (!theatreController.cityRunsMovie(listing.first, listing.second))
+            {
+                movieController.removeMovieFromCity(movieController.getMovieById(listing.second), listing.first);
+            }
+        }
+
+        // List each newly scheduled movie in its city once per distinct (city, movie)
+        set<pair<CityId, Movie *>> listings;
+        for (size_t i = 0; i < changes.size(); i++)
+        {
+            if (movies[i] != nullptr)
+            {
+                listings.insert({theatreController.getTheatreById(changes[i].theatreId)->getCity(), movies[i]});
+            }
+        }
+        for (auto &listing : listings)
+        {
+            movieController.ensureMovieInCity(listing.second, listing.first);
+        }
+
+        result.applied = true;
+        return result;
+    }
+};
+
+#endif // SCHEDULEADMINSERVICE_H
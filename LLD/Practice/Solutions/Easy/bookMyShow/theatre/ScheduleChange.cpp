@@ -0,0 +1,34 @@
+#ifndef SCHEDULECHANGE_H
+#define SCHEDULECHANGE_H
+
+#include <bits/stdc++.h>
+using namespace std;
+
+enum class ScheduleOp
+{
+    REMOVE_SHOW, // sorts before ADD_SHOW: a change set removes, freeing slots, then adds
+    ADD_SHOW
+};
+
+// One entry of an admin schedule change set
+struct ScheduleChange
+{
+    ScheduleOp op;
+    int showId;
+    int theatreId;
+    int screenId;  // ADD_SHOW only
+    int movieId;   // ADD_SHOW only
+    int startTime; // ADD_SHOW only, hour of day
+    int basePrice = 0; // ADD_SHOW only, 0 = SeatLayout::DEFAULT_BASE_PRICE
+};
+
+struct ScheduleChangeResult
+{
+    bool applied = false;
+    int showsAdded = 0;
+    int showsRemoved = 0;
+    string error; // first validation failure when not applied
+    vector<int> releasedSlots; // inventory slots of the removed shows; the set's own additions may reuse them
+};
+
+#endif // SCHEDULECHANGE_H
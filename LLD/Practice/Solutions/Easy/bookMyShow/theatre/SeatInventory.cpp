@@ -0,0 +1,176 @@
+#ifndef SEATINVENTORY_H
+#define SEATINVENTORY_H
+
+#include <bits/stdc++.h>
+#include "SeatLayout.cpp"
+using namespace std;
+
+// Seat occupancy for every show, kept in one pooled bitmap.
+// Each show owns a fixed-size slot of words; slots of removed shows are recycled.
+class SeatInventory
+{
+private:
+    int seatsPerShow;
+    int wordsPerSlot;
+    vector<uint64_t> occupied; // slot-major bitmap, bit (seat - 1) set = booked
+    vector<int> freeSeats;     // free seat count per slot
+    vector<int> freeByCategory[SeatLayout::CATEGORY_COUNT]; // free seats per slot, one column per category
+    vector<int> freeSlots;     // recycled slots, reused before growing
+
+    uint64_t &word(int slot, int seatNumber)
+    {
+        return occupied[size_t(slot) * wordsPerSlot + (seatNumber - 1) / 64];
+    }
+
+    static uint64_t bit(int seatNumber)
+    {
+        return uint64_t(1) << ((seatNumber - 1) % 64);
+    }
+
+    int &freeInCategory(int slot, int seatNumber)
+    {
+        return freeByCategory[static_cast<int>(SeatLayout::getCategory(seatNumber, seatsPerShow))][slot];
+    }
+
+    void resetSlot(int slot)
+    {
+        freeSeats[slot] = seatsPerShow;
+        for (int c = 0; c < SeatLayout::CATEGORY_COUNT; c++)
+        {
+            freeByCategory[c][slot] = SeatLayout::getCategoryCapacity(static_cast<SeatCategory>(c), seatsPerShow);
+        }
+    }
+
+public:
+    explicit SeatInventory(int seatsPerShow = 100)
+        : seatsPerShow(seatsPerShow), wordsPerSlot((seatsPerShow + 63) / 64) {}
+
+    int getSeatsPerShow() const
+    {
+        return seatsPerShow;
+    }
+
+    // Allocate 'count' empty slots at once: recycled slots first, then a single resize for the rest
+    vector<int> allocateSlots(int count)
+    {
+        vector<int> slots;
+        slots.reserve(count);
+        while (count > 0 && !freeSlots.empty())
+        {
+            slots.push_back(freeSlots.back());
+            freeSlots.pop_back();
+            count--;
+        }
+        int first = static_cast<int>(freeSeats.size());
+        occupied.resize(occupied.size() + size_t(count) * wordsPerSlot, 0);
+        freeSeats.resize(freeSeats.size() + count);
+        for (int c = 0; c < SeatLayout::CATEGORY_COUNT; c++)
+        {
+            freeByCategory[c].resize(freeSeats.size());
+        }
+        for (int i = 0; i < count; i++)
+        {
+            resetSlot(first + i);
+            slots.push_back(first + i);
+        }
+        return slots;
+    }
+
+    void releaseSlots(const vector<int> &slots)
+    {
+        for (int slot : slots)
+        {
+            fill_n(occupied.begin() + size_t(slot) * wordsPerSlot, wordsPerSlot, 0);
+            resetSlot(slot);
+            freeSlots.push_back(slot);
+        }
+    }
+
+    bool isValidSeat(int seatNumber) const
+    {
+        return seatNumber >= 1 && seatNumber <= seatsPerShow;
+    }
+
+    bool isBooked(int slot, int seatNumber)
+    {
+        return (word(slot, seatNumber) & bit(seatNumber)) != 0;
+    }
+
+    // Returns false if the seat is already taken
+    bool bookSeat(int slot, int seatNumber)
+    {
+        uint64_t &w = word(slot, seatNumber);
+        if (w & bit(seatNumber))
+        {
+            return false;
+        }
+        w |= bit(seatNumber);
+        freeSeats[slot]--;
+        freeInCategory(slot, seatNumber)--;
+        return true;
+    }
+
+    // Returns false if the seat was not booked
+    bool releaseSeat(int slot, int seatNumber)
+    {
+        uint64_t &w = word(slot, seatNumber);
+        if (!(w & bit(seatNumber)))
+        {
+            return false;
+        }
+        w &= ~bit(seatNumber);
+        freeSeats[slot]++;
+        freeInCategory(slot, seatNumber)++;
+        return true;
+    }
+
+    int getFreeSeatCount(int slot) const
+    {
+        return freeSeats[slot];
+    }
+
+    int getFreeSeatCount(int slot, SeatCategory category) const
+    {
+        return freeByCategory[static_cast<int>(category)][slot];
+    }
+
+    // Raw copy of every slot, for a replication snapshot (Writer is a RecordWriter)
+    template <typename Writer>
+    void saveTo(Writer &out) const
+    {
+        out.putArray(occupied);
+        out.putArray(freeSeats);
+        for (const vector<int> &column : freeByCategory)
+        {
+            out.putArray(column);
+        }
+        out.putArray(freeSlots);
+    }
+
+    // Replaces every slot with a snapshot taken with the same seatsPerShow
+    template <typename Reader>
+    void loadFrom(Reader &in)
+    {
+        occupied = in.template getArray<uint64_t>();
+        freeSeats = in.template getArray<int>();
+        for (vector<int> &column : freeByCategory)
+        {
+            column = in.template getArray<int>();
+        }
+        freeSlots = in.template getArray<int>();
+    }
+
+    // Whole column of free counts, indexed by slot
+    const vector<int> &getFreeColumn() const
+    {
+        return freeSeats;
+    }
+
+    // Whole column of free counts for one category, indexed by slot
+    const vector<int> &getFreeColumn(SeatCategory category) const
+    {
+        return freeByCategory[static_cast<int>(category)];
+    }
+};
+
+#endif // SEATINVENTORY_H
@@ -0,0 +1,55 @@
+#ifndef SEATLAYOUT_H
+#define SEATLAYOUT_H
+
+#include <bits/stdc++.h>
+#include "../enums/seatCategory.cpp"
+using namespace std;
+
+// Every screen is laid out front to back: 60% SILVER, 30% GOLD, 10% PLATINUM.
+// A show has one base (SILVER) price; the other categories are fixed multiples of it.
+class SeatLayout
+{
+public:
+    static const int CATEGORY_COUNT = 3;
+    static const int DEFAULT_BASE_PRICE = 250;
+
+    static SeatCategory getCategory(int seatNumber, int seatsPerShow)
+    {
+        if (seatNumber <= seatsPerShow * 6 / 10)
+        {
+            return SeatCategory::SILVER;
+        }
+        if (seatNumber <= seatsPerShow * 9 / 10)
+        {
+            return SeatCategory::GOLD;
+        }
+        return SeatCategory::PLATINUM;
+    }
+
+    static int getCategoryCapacity(SeatCategory category, int seatsPerShow)
+    {
+        switch (category)
+        {
+        case SeatCategory::SILVER:
+            return seatsPerShow * 6 / 10;
+        case SeatCategory::GOLD:
+            return seatsPerShow * 9 / 10 - seatsPerShow * 6 / 10;
+        default:
+            return seatsPerShow - seatsPerShow * 9 / 10;
+        }
+    }
+
+    // Price in percent of the base price
+    static int getPriceMultiplier(SeatCategory category)
+    {
+        static const int multipliers[CATEGORY_COUNT] = {100, 140, 200};
+        return multipliers[static_cast<int>(category)];
+    }
+
+    static int getPrice(int basePrice, SeatCategory category)
+    {
+        return basePrice * getPriceMultiplier(category) / 100;
+    }
+};
+
+#endif // SEATLAYOUT_H
@@ -3,7 +3,7 @@
 
 #include <bits/stdc++.h>
 #include "screen.cpp"
-#include "../enums/city.cpp"
+#include "../city/CityRegistry.cpp"
 #include "show.cpp"
 #include "theatre.cpp"
 using namespace std;
@@ -12,7 +12,7 @@ class TheatreFactory
 {
 public:
     // Only Admin
-    static Theatre createTheatre(int theatreId, const string &name, City city, const vector<Show> &shows)
+    static Theatre createTheatre(int theatreId, const string &name, CityId city, const vector<Show> &shows)
     {
         Theatre theatre;
         theatre.setTheatreId(theatreId);
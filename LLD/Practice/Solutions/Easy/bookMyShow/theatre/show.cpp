@@ -4,6 +4,7 @@
 #include <bits/stdc++.h>
 #include "../movie/movie.cpp"
 #include "screen.cpp"
+#include "SeatLayout.cpp"
 using namespace std;
 
 class Show
@@ -13,13 +14,15 @@ private:
     Movie *movie;   // Could use shared_ptr<Movie>
     Screen *screen; // Could use shared_ptr<Screen>
     int showStartTime;
-    vector<int> bookedSeatIds;
+    int basePrice;     // SILVER price, see SeatLayout for the other categories
+    int inventorySlot; // occupancy slot in the SeatInventory, -1 until scheduled
 
 public:
     // Constructors
-    Show() : showId(0), movie(nullptr), screen(nullptr), showStartTime(0) {}
-    Show(int id, Movie *m, Screen *s, int startTime)
-        : showId(id), movie(m), screen(s), showStartTime(startTime) {}
+    Show() : showId(0), movie(nullptr), screen(nullptr), showStartTime(0),
+             basePrice(SeatLayout::DEFAULT_BASE_PRICE), inventorySlot(-1) {}
+    Show(int id, Movie *m, Screen *s, int startTime, int price = SeatLayout::DEFAULT_BASE_PRICE)
+        : showId(id), movie(m), screen(s), showStartTime(startTime), basePrice(price), inventorySlot(-1) {}
 
     // Getters & Setters
     int getShowId() const
@@ -62,14 +65,24 @@ public:
         showStartTime = startTime;
     }
 
-    vector<int> &getBookedSeatIds()
+    int getBasePrice() const
     {
-        return bookedSeatIds;
+        return basePrice;
     }
 
-    void setBookedSeatIds(const vector<int> &seats)
+    void setBasePrice(int price)
     {
-        bookedSeatIds = seats;
+        basePrice = price;
+    }
+
+    int getInventorySlot() const
+    {
+        return inventorySlot;
+    }
+
+    void setInventorySlot(int slot)
+    {
+        inventorySlot = slot;
     }
 };
 
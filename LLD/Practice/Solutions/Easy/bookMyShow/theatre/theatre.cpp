@@ -3,7 +3,7 @@
 
 #include <bits/stdc++.h>
 #include "screen.cpp"
-#include "../enums/city.cpp"
+#include "../city/CityRegistry.cpp"
 #include "show.cpp"
 using namespace std;
 
@@ -12,15 +12,15 @@ class Theatre
     int theatreId;
     string address;
     string theatreName;
-    City city;
+    CityId city;
     vector<Screen> screens;
     vector<Show> shows;
 
 public:
     // Constructors
-    Theatre() : theatreId(0), city() {}
-    Theatre(int id, const string &name, const string &addr, City c)
-        : theatreId(id), theatreName(name), address(addr), city(c) {}
+    Theatre() : theatreId(0), city(INVALID_CITY) {}
+    Theatre(int id, const string &name, const string &addr, CityId c)
+        : theatreId(id), address(addr), theatreName(name), city(c) {}
 
     // Getters & Setters
     int getTheatreId() const
@@ -53,12 +53,12 @@ public:
         theatreName = name;
     }
 
-    City getCity() const
+    CityId getCity() const
     {
         return city;
     }
 
-    void setCity(City c)
+    void setCity(CityId c)
     {
         city = c;
     }
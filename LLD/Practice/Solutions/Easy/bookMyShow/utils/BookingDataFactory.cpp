@@ -7,7 +7,7 @@
 #include "../theatre/screen.cpp"
 #include "../theatre/show.cpp"
 #include "../theatre/seat.cpp"
-#include "../enums/city.cpp"
+#include "../city/CityRegistry.cpp"
 #include "../controllers/MovieController.cpp"
 #include "../controllers/TheatreController.cpp"
 #include "../theatre/TheatreFactory.cpp"
@@ -23,6 +23,8 @@ public:
 
     static vector<Seat> createSeats();
 
+    static void createCities();
+
     static vector<Movie *> createMovies(MovieController &movieController);
 
     static void createTheatres(MovieController &movieController, TheatreController &theatreController);
@@ -61,15 +63,26 @@ vector<Seat> BookingDataFactory::createSeats()
     return seats;
 }
 
+void BookingDataFactory::createCities()
+{
+    for (const char *name : {"Bangalore", "Mumbai", "Chennai", "Delhi"})
+    {
+        CityRegistry::registerCity(name);
+    }
+}
+
 vector<Movie *> BookingDataFactory::createMovies(MovieController &movieController)
 {
     Movie *barbie = MovieFactory::createMovie(1, "BARBIE", 128);
     Movie *oppenheimer = MovieFactory::createMovie(2, "OPPENHEIMER", 180);
 
-    movieController.addMovie(barbie, City::Bangalore);
-    movieController.addMovie(barbie, City::Delhi);
-    movieController.addMovie(oppenheimer, City::Bangalore);
-    movieController.addMovie(oppenheimer, City::Delhi);
+    CityId bangalore = CityRegistry::findCity("Bangalore");
+    CityId delhi = CityRegistry::findCity("Delhi");
+
+    movieController.addMovie(barbie, bangalore);
+    movieController.addMovie(barbie, delhi);
+    movieController.addMovie(oppenheimer, bangalore);
+    movieController.addMovie(oppenheimer, delhi);
 
     return {barbie, oppenheimer};
 }
@@ -79,19 +92,22 @@ void BookingDataFactory::createTheatres(MovieController &movieController, Theatr
     Movie *barbie = movieController.getMovieByName("BARBIE");
     Movie *oppenheimer = movieController.getMovieByName("OPPENHEIMER");
 
+    CityId bangalore = CityRegistry::findCity("Bangalore");
+    CityId delhi = CityRegistry::findCity("Delhi");
+
     // Create theatres dynamically to avoid scope issues
     Theatre *inox = new Theatre();
     *inox = TheatreFactory::createTheatre(
-        1, "INOX", City::Bangalore,
+        1, "INOX", bangalore,
         {createShow(1, barbie, 10), createShow(2, oppenheimer, 18)});
 
     Theatre *pvr = new Theatre();
     *pvr = TheatreFactory::createTheatre(
-        2, "PVR", City::Delhi,
+        2, "PVR", delhi,
         {createShow(3, barbie, 14), createShow(4, oppenheimer, 20)});
 
-    theatreController.addTheatre(inox, City::Bangalore);
-    theatreController.addTheatre(pvr, City::Delhi);
+    theatreController.addTheatre(inox, bangalore);
+    theatreController.addTheatre(pvr, delhi);
 }
 
 #endif // BOOKINGDATAFACTORY_H
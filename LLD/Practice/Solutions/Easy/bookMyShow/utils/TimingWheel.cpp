@@ -0,0 +1,244 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <bits/stdc++.h>
+using namespace std;
+
+// Hierarchical timing wheel: 4 levels x 64 slots of 1-second ticks (~194 days of range).
+// schedule() and cancel() are O(1); advance() only touches occupied slots and
+// cascades a higher-level slot once per wrap of the level below it.
+class TimingWheel
+{
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const int64_t SLOT_MASK = SLOTS - 1;
+
+    struct Timer
+    {
+        int64_t expiry;
+        uint64_t payload;
+        int prev, next;
+        int level, slot; // level < 0 when the timer is not linked
+    };
+
+    vector<Timer> timers;    // pooled timer nodes, addressed by timer id
+    vector<int> freeTimers;  // recycled timer ids
+    int heads[LEVELS][SLOTS];
+    uint64_t occupancy[LEVELS]; // bit s set = slot s of that level is non-empty
+    int64_t currentTick;
+    size_t activeTimers;
+
+    // Timers due before 'earliest' are placed at 'earliest'
+    void link(int id, int64_t earliest)
+    {
+        Timer &timer = timers[id];
+        int64_t expiry = max(timer.expiry, earliest);
+        int level = 0;
+        // Lowest level whose rotation still contains the expiry
+        while (level < LEVELS - 1 &&
+               (expiry >> (SLOT_BITS * (level + 1))) != (currentTick >> (SLOT_BITS * (level + 1))))
+        {
+            level++;
+        }
+        int slot = (expiry >> (SLOT_BITS * level)) & SLOT_MASK;
+        timer.level = level;
+        timer.slot = slot;
+        timer.prev = -1;
+        timer.next = heads[level][slot];
+        if (timer.next >= 0)
+        {
+            timers[timer.next].prev = id;
+        }
+        heads[level][slot] = id;
+        occupancy[level] |= uint64_t(1) << slot;
+    }
+
+    void unlink(int id)
+    {
+        Timer &timer = timers[id];
+        if (timer.prev >= 0)
+        {
+            timers[timer.prev].next = timer.next;
+        }
+        else
+        {
+            heads[timer.level][timer.slot] = timer.next;
+        }
+        if (timer.next >= 0)
+        {
+            timers[timer.next].prev = timer.prev;
+        }
+        if (heads[timer.level][timer.slot] < 0)
+        {
+            occupancy[timer.level] &= ~(uint64_t(1) << timer.slot);
+        }
+        timer.level = -1;
+    }
+
+    // Detach a whole slot, collecting its timer ids into 'ids'
+    void takeSlot(int level, int slot, vector<int> &ids)
+    {
+        ids.clear();
+        for (int id = heads[level][slot]; id >= 0; id = timers[id].next)
+        {
+            ids.push_back(id);
+        }
+        heads[level][slot] = -1;
+        occupancy[level] &= ~(uint64_t(1) << slot);
+        for (int id : ids)
+        {
+            timers[id].level = -1;
+        }
+    }
+
+    void release(int id)
+    {
+        freeTimers.push_back(id);
+        activeTimers--;
+    }
+
+public:
+    explicit TimingWheel(int64_t startTick = 0) : currentTick(startTick), activeTimers(0)
+    {
+        for (int level = 0; level < LEVELS; level++)
+        {
+            fill(begin(heads[level]), end(heads[level]), -1);
+            occupancy[level] = 0;
+        }
+    }
+
+    int64_t now() const
+    {
+        return currentTick;
+    }
+
+    size_t size() const
+    {
+        return activeTimers;
+    }
+
+    // Raw copy of the wheel, for a replication snapshot (Writer is a RecordWriter).
+    // Timer ids and the order timers fire in survive the round trip.
+    template <typename Writer>
+    void saveTo(Writer &out) const
+    {
+        out.putArray(timers);
+        out.putArray(freeTimers);
+        for (int level = 0; level < LEVELS; level++)
+        {
+            out.putArray(vector<int>(begin(heads[level]), end(heads[level])));
+            out.template put<uint64_t>(occupancy[level]);
+        }
+        out.template put<int64_t>(currentTick);
+        out.template put<uint64_t>(activeTimers);
+    }
+
+    template <typename Reader>
+    void loadFrom(Reader &in)
+    {
+        timers = in.template getArray<Timer>();
+        freeTimers = in.template getArray<int>();
+        for (int level = 0; level < LEVELS; level++)
+        {
+            vector<int> levelHeads = in.template getArray<int>();
+            copy(levelHeads.begin(), levelHeads.end(), heads[level]);
+            occupancy[level] = in.template get<uint64_t>();
+        }
+        currentTick = in.template get<int64_t>();
+        activeTimers = in.template get<uint64_t>();
+    }
+
+    // Returns a timer id that stays valid until the timer fires or is cancelled
+    int schedule(int64_t expiry, uint64_t payload)
+    {
+        int id;
+        if (!freeTimers.empty())
+        {
+            id = freeTimers.back();
+            freeTimers.pop_back();
+        }
+        else
+        {
+            id = static_cast<int>(timers.size());
+            timers.push_back(Timer());
+        }
+        timers[id].expiry = expiry;
+        timers[id].payload = payload;
+        activeTimers++;
+        link(id, currentTick + 1); // the current tick has already been processed
+        return id;
+    }
+
+    bool cancel(int id)
+    {
+        if (id < 0 || id >= static_cast<int>(timers.size()) || timers[id].level < 0)
+        {
+            return false;
+        }
+        unlink(id);
+        release(id);
+        return true;
+    }
+
+    // Move the clock to 'tick', calling onExpire(payload) for every timer that is due
+    template <typename Callback>
+    void advance(int64_t tick, Callback &&onExpire)
+    {
+        if (activeTimers == 0)
+        {
+            currentTick = max(currentTick, tick); // nothing can fire, jump straight there
+            return;
+        }
+        vector<int> due;
+        while (currentTick < tick)
+        {
+            // Next tick worth visiting: an occupied level-0 slot in this rotation, or the next wrap
+            int position = currentTick & SLOT_MASK;
+            uint64_t ahead = position == SLOT_MASK ? 0 : occupancy[0] & (~uint64_t(0) << (position + 1));
+            int64_t next = ahead ? (currentTick & ~SLOT_MASK) + __builtin_ctzll(ahead)
+                                 : (currentTick | SLOT_MASK) + 1;
+            if (next > tick)
+            {
+                currentTick = tick;
+                break;
+            }
+            currentTick = next;
+
+            // On a wrap, pull the matching slot of each higher level down (highest first)
+            if ((currentTick & SLOT_MASK) == 0)
+            {
+                int top = 1;
+                while (top < LEVELS - 1 && (currentTick & ((int64_t(1) << (SLOT_BITS * (top + 1))) - 1)) == 0)
+                {
+                    top++;
+                }
+                for (int level = top; level >= 1; level--)
+                {
+                    int slot = (currentTick >> (SLOT_BITS * level)) & SLOT_MASK;
+                    takeSlot(level, slot, due);
+                    for (int id : due)
+                    {
+                        link(id, currentTick);
+                    }
+                }
+            }
+
+            takeSlot(0, currentTick & SLOT_MASK, due);
+            for (int id : due)
+            {
+                if (timers[id].expiry > currentTick)
+                {
+                    link(id, currentTick + 1); // parked early because it was beyond the top level's range
+                    continue;
+                }
+                uint64_t payload = timers[id].payload;
+                release(id);
+                onExpire(payload);
+            }
+        }
+    }
+};
+
+#endif // TIMINGWHEEL_H
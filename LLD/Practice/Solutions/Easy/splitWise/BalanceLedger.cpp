@@ -0,0 +1,272 @@
+#ifndef BALANCELEDGER_H
+#define BALANCELEDGER_H
+
+#include <bits/stdc++.h>
+#include "Money.cpp"
+#include "Currency.cpp"
+#include "BinaryIO.cpp"
+using namespace std;
+
+using UserId = uint32_t;
+
+// Pending balance changes, e.g. one worker's slice of a bulk import. Appending
+// is a plain push_back; compact() sorts by currency and pair and folds each
+// pair's changes in a currency into one, ready for ShardedLedger::merge.
+class PartialLedger
+{
+    struct Delta
+    {
+        uint64_t key; // lo << 32 | hi, as in BalanceLedger
+        int64_t cents; // what hi owes lo
+        CurrencyId currency;
+    };
+
+    vector<Delta> deltas;
+
+public:
+    // 'debtor' now owes 'creditor' 'amount' more
+    void addDebt(UserId creditor, UserId debtor, Money amount, CurrencyId currency = HOME_CURRENCY)
+    {
+        if (creditor == debtor)
+            return;
+        if (creditor < debtor)
+            deltas.push_back(Delta{(uint64_t(creditor) << 32) | debtor, amount.getCents(), currency});
+        else
+            deltas.push_back(Delta{(uint64_t(debtor) << 32) | creditor, -amount.getCents(), currency});
+    }
+
+    void compact()
+    {
+        sort(deltas.begin(), deltas.end(), [](const Delta &a, const Delta &b)
+             { return a.currency != b.currency ? a.currency < b.currency : a.key < b.key; });
+        size_t out = 0;
+        for (size_t i = 0; i < deltas.size();)
+        {
+            Delta folded = deltas[i++];
+            while (i < deltas.size() && deltas[i].key == folded.key && deltas[i].currency == folded.currency)
+                folded.cents += deltas[i++].cents;
+            if (folded.cents != 0)
+                deltas[out++] = folded;
+        }
+        deltas.resize(out);
+        deltas.shrink_to_fit();
+    }
+
+    // Calls f(lo, hi, change, currency) per pair and currency; one call per
+    // pair and currency once compacted
+    template <class F>
+    void forEachChange(F f) const
+    {
+        for (const Delta &delta : deltas)
+            f(UserId(delta.key >> 32), UserId(delta.key), Money(delta.cents), delta.currency);
+    }
+
+    size_t size() const
+    {
+        return deltas.size();
+    }
+};
+
+// Net balance of every pair of users in one currency, stored once per
+// unordered pair in an open-addressing table keyed by the packed (lo, hi) ids.
+// Sign convention: the entry for (lo, hi) is what hi owes lo; negative means lo owes hi.
+class BalanceLedger
+{
+    struct Entry
+    {
+        uint64_t key; // lo << 32 | hi, EMPTY_KEY if unused
+        Money balance;
+    };
+
+    static const uint64_t EMPTY_KEY = ~uint64_t(0);
+
+    vector<Entry> table; // power-of-two capacity, linear probing, at most half full
+    size_t pairCount;
+    bool trackCounterparties;
+    vector<vector<UserId>> counterparties; // per user, every user they share a pair with
+
+    static uint64_t packKey(UserId lo, UserId hi)
+    {
+        return (uint64_t(lo) << 32) | hi;
+    }
+
+    size_t slotOf(uint64_t key) const
+    {
+        // Fibonacci hashing; table.size() is a power of two
+        return (key * 0x9E3779B97F4A7C15ULL) >> (64 - __builtin_ctzll(table.size()));
+    }
+
+    void grow(size_t capacity)
+    {
+        vector<Entry> old(capacity, Entry{EMPTY_KEY, Money()});
+        old.swap(table);
+        for (const Entry &entry : old)
+        {
+            if (entry.key != EMPTY_KEY)
+            {
+                size_t slot = slotOf(entry.key);
+                while (table[slot].key != EMPTY_KEY)
+                {
+                    slot = (slot + 1) & (table.size() - 1);
+                }
+                table[slot] = entry;
+            }
+        }
+    }
+
+    // Entry for the pair, created with a zero balance on first use
+    Entry &entryFor(UserId lo, UserId hi)
+    {
+        uint64_t key = packKey(lo, hi);
+        size_t slot = slotOf(key);
+        while (table[slot].key != EMPTY_KEY)
+        {
+            if (table[slot].key == key)
+            {
+                return table[slot];
+            }
+            slot = (slot + 1) & (table.size() - 1);
+        }
+
+        if ((pairCount + 1) * 2 > table.size())
+        {
+            grow(table.size() * 2);
+            return entryFor(lo, hi);
+        }
+        pairCount++;
+        table[slot] = Entry{key, Money()};
+        if (!trackCounterparties)
+            return table[slot];
+        size_t users = max(lo, hi) + 1;
+        if (counterparties.size() < users)
+        {
+            counterparties.resize(users);
+        }
+        counterparties[lo].push_back(hi);
+        counterparties[hi].push_back(lo);
+        return table[slot];
+    }
+
+    const Entry *findEntry(UserId lo, UserId hi) const
+    {
+        uint64_t key = packKey(lo, hi);
+        size_t slot = slotOf(key);
+        while (table[slot].key != EMPTY_KEY)
+        {
+            if (table[slot].key == key)
+            {
+                return &table[slot];
+            }
+            slot = (slot + 1) & (table.size() - 1);
+        }
+        return nullptr;
+    }
+
+public:
+    // Without counterparty tracking getCounterparties() is always empty; for
+    // owners that keep their own (ShardedLedger)
+    explicit BalanceLedger(bool trackCounterparties = true)
+        : table(16, Entry{EMPTY_KEY, Money()}), pairCount(0), trackCounterparties(trackCounterparties) {}
+
+    // 'debtor' now owes 'creditor' 'amount' more
+    void addDebt(UserId creditor, UserId debtor, Money amount)
+    {
+        if (creditor == debtor)
+            return;
+        if (creditor < debtor)
+            entryFor(creditor, debtor).balance += amount;
+        else
+            entryFor(debtor, creditor).balance -= amount;
+    }
+
+    // Room for 'pairs' pairs without growing
+    void reserve(size_t pairs)
+    {
+        size_t capacity = table.size();
+        while (pairs * 2 > capacity)
+            capacity *= 2;
+        if (capacity > table.size())
+            grow(capacity);
+    }
+
+    // Applies the changes made in 'currency'; the others belong to other ledgers
+    void merge(const PartialLedger &changes, CurrencyId currency = HOME_CURRENCY)
+    {
+        reserve(pairCount + changes.size());
+        changes.forEachChange([&](UserId lo, UserId hi, Money change, CurrencyId changeCurrency)
+                              {
+            if (changeCurrency == currency)
+                addDebt(lo, hi, change); });
+    }
+
+    // What 'other' owes 'user' (negative: what 'user' owes 'other')
+    Money getBalance(UserId user, UserId other) const
+    {
+        const Entry *entry = user < other ? findEntry(user, other) : findEntry(other, user);
+        if (!entry)
+            return Money();
+        return user < other ? entry->balance : -entry->balance;
+    }
+
+    // Whether the pair has an entry, even one that has come back to zero
+    bool hasPair(UserId user, UserId other) const
+    {
+        return (user < other ? findEntry(user, other) : findEntry(other, user)) != nullptr;
+    }
+
+    // Every user 'user' has ever shared an expense with
+    const vector<UserId> &getCounterparties(UserId user) const
+    {
+        static const vector<UserId> none;
+        return user < counterparties.size() ? counterparties[user] : none;
+    }
+
+    // Calls f(lo, hi, balance) for every pair with a non-zero balance (what hi owes lo)
+    template <class F>
+    void forEachBalance(F f) const
+    {
+        for (const Entry &entry : table)
+        {
+            if (entry.key != EMPTY_KEY && !entry.balance.isZero())
+                f(UserId(entry.key >> 32), UserId(entry.key), entry.balance);
+        }
+    }
+
+    size_t size() const
+    {
+        return pairCount;
+    }
+
+    size_t memoryBytes() const
+    {
+        size_t bytes = table.capacity() * sizeof(Entry) + counterparties.capacity() * sizeof(vector<UserId>);
+        for (const auto &list : counterparties)
+            bytes += list.capacity() * sizeof(UserId);
+        return bytes;
+    }
+
+    void save(BinaryWriter &out) const
+    {
+        out.putArray(table);
+        out.put<uint64_t>(pairCount);
+        out.put<uint64_t>(counterparties.size());
+        for (const auto &list : counterparties)
+            out.putArray(list);
+    }
+
+    // Replaces the contents with what save() wrote
+    bool load(BinaryReader &in)
+    {
+        in.getArray(table);
+        pairCount = in.get<uint64_t>();
+        uint64_t users = in.get<uint64_t>();
+        if (!in.ok() || users > in.remaining() || table.empty() || (table.size() & (table.size() - 1)))
+            return false;
+        counterparties.assign(users, vector<UserId>());
+        for (auto &list : counterparties)
+            in.getArray(list);
+        return in.ok();
+    }
+};
+
+#endif // BALANCELEDGER_H
@@ -0,0 +1,247 @@
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <bits/stdc++.h>
+#include <unistd.h>
+using namespace std;
+
+// CRC-32C (Castagnoli): the crc32 instruction where the CPU has it,
+// otherwise table driven, eight bytes per step
+class Crc32c
+{
+    using Tables = array<array<uint32_t, 256>, 8>;
+
+    static Tables build()
+    {
+        Tables tables;
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+            tables[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            for (size_t k = 1; k < 8; k++)
+                tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xff];
+        }
+        return tables;
+    }
+
+#if defined(__x86_64__)
+    // The SSE4.2 crc32 instruction computes the same polynomial
+    __attribute__((target("sse4.2"))) static uint32_t extendHardware(uint32_t crc, const uint8_t *in, size_t length)
+    {
+        uint64_t state = ~crc;
+        for (; length >= 8; length -= 8, in += 8)
+        {
+            uint64_t word;
+            memcpy(&word, in, 8);
+            state = __builtin_ia32_crc32di(state, word);
+        }
+        crc = uint32_t(state);
+        for (; length > 0; length--)
+            crc = __builtin_ia32_crc32qi(crc, *in++);
+        return ~crc;
+    }
+#endif
+
+public:
+    // CRC of 'data' appended to whatever 'crc' covered so far (0 to start)
+    static uint32_t extend(uint32_t crc, const void *data, size_t length)
+    {
+#if defined(__x86_64__)
+        static const bool hardware = __builtin_cpu_supports("sse4.2");
+        if (hardware)
+            return extendHardware(crc, static_cast<const uint8_t *>(data), length);
+#endif
+        static const Tables tables = build();
+        const uint8_t *in = static_cast<const uint8_t *>(data);
+        crc = ~crc;
+        for (; length >= 8; length -= 8, in += 8)
+        {
+            uint64_t word;
+            memcpy(&word, in, 8); // little-endian
+            word ^= crc;
+            crc = tables[7][word & 0xff] ^ tables[6][(word >> 8) & 0xff] ^ tables[5][(word >> 16) & 0xff] ^
+                  tables[4][(word >> 24) & 0xff] ^ tables[3][(word >> 32) & 0xff] ^ tables[2][(word >> 40) & 0xff] ^
+                  tables[1][(word >> 48) & 0xff] ^ tables[0][word >> 56];
+        }
+        for (; length > 0; length--)
+            crc = tables[0][(crc ^ *in++) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+};
+
+// Packs values into a byte buffer, in memory only or streamed out to a file
+// descriptor. Values are raw little-endian; arrays and strings are length
+// prefixed.
+class BinaryWriter
+{
+    static const size_t FLUSH_BYTES = 1 << 20;
+
+    string buffer;
+    int fd;
+    uint32_t crc; // of everything flushed to fd
+    bool failed;
+
+    void writeOut(const char *data, size_t length)
+    {
+        crc = Crc32c::extend(crc, data, length);
+        while (length > 0 && !failed)
+        {
+            ssize_t done = ::write(fd, data, length);
+            if (done < 0 && errno == EINTR)
+                continue;
+            failed = done <= 0;
+            if (!failed)
+            {
+                data += done;
+                length -= done;
+            }
+        }
+    }
+
+    void flush()
+    {
+        writeOut(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+public:
+    // Memory only; see data()
+    BinaryWriter() : fd(-1), crc(0), failed(false) {}
+
+    explicit BinaryWriter(int fd) : fd(fd), crc(0), failed(fd < 0) {}
+
+    void write(const void *data, size_t length)
+    {
+        if (fd >= 0 && length >= FLUSH_BYTES)
+        {
+            flush();
+            writeOut(static_cast<const char *>(data), length);
+            return;
+        }
+        buffer.append(static_cast<const char *>(data), length);
+        if (fd >= 0 && buffer.size() >= FLUSH_BYTES)
+            flush();
+    }
+
+    template <class T>
+    void put(const T &value)
+    {
+        static_assert(is_trivially_copyable<T>::value, "raw copy only");
+        write(&value, sizeof(T));
+    }
+
+    // vector or string: u64 count, then the elements
+    template <class C>
+    void putArray(const C &values)
+    {
+        put<uint64_t>(values.size());
+        write(values.data(), values.size() * sizeof(*values.data()));
+    }
+
+    // Short text: u32 length, then the bytes
+    void putString(string_view text)
+    {
+        put<uint32_t>(text.size());
+        write(text.data(), text.size());
+    }
+
+    // File: writes the rest, appends the CRC of everything and syncs to disk
+    bool finish()
+    {
+        if (fd < 0)
+            return false;
+        flush();
+        uint32_t total = crc;
+        writeOut(reinterpret_cast<const char *>(&total), sizeof(total));
+        return !failed && fsync(fd) == 0;
+    }
+
+    // Memory only: what has been written since the last clear()
+    const string &data() const { return buffer; }
+
+    void clear() { buffer.clear(); }
+
+    bool ok() const { return !failed; }
+};
+
+// Reads what BinaryWriter wrote, from memory. Any read past the end (a
+// truncated or corrupt input) fails the reader; check ok() before trusting
+// what came out.
+class BinaryReader
+{
+    const char *position;
+    const char *end;
+    bool failed;
+
+public:
+    BinaryReader(const char *data, size_t length) : position(data), end(data + length), failed(false) {}
+
+    bool read(void *out, size_t length)
+    {
+        if (failed || size_t(end - position) < length)
+        {
+            failed = true;
+            return false;
+        }
+        if (length > 0) // an empty array's data() may be null
+            memcpy(out, position, length);
+        position += length;
+        return true;
+    }
+
+    template <class T>
+    T get()
+    {
+        static_assert(is_trivially_copyable<T>::value, "raw copy only");
+        T value{};
+        read(&value, sizeof(T));
+        return value;
+    }
+
+    template <class C>
+    bool getArray(C &values)
+    {
+        uint64_t count = get<uint64_t>();
+        if (failed || count > remaining() / sizeof(*values.data()))
+        {
+            failed = true;
+            return false;
+        }
+        values.resize(count);
+        return read(values.data(), count * sizeof(*values.data()));
+    }
+
+    string getString()
+    {
+        uint32_t length = get<uint32_t>();
+        if (failed || length > remaining())
+        {
+            failed = true;
+            return string();
+        }
+        string text(position, length);
+        position += length;
+        return text;
+    }
+
+    size_t remaining() const { return end - position; }
+
+    bool ok() const { return !failed; }
+
+    // Whole file written by BinaryWriter::finish(): do the contents match the trailing CRC?
+    static bool verify(const char *data, size_t length)
+    {
+        if (length < sizeof(uint32_t))
+            return false;
+        uint32_t stored;
+        memcpy(&stored, data + length - sizeof(stored), sizeof(stored));
+        return Crc32c::extend(0, data, length - sizeof(stored)) == stored;
+    }
+};
+
+#endif // BINARYIO_H
@@ -0,0 +1,495 @@
+#ifndef BULKIMPORTER_H
+#define BULKIMPORTER_H
+
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "User.cpp"
+#include "ExpenseStore.cpp"
+#include "BalanceLedger.cpp"
+#include "Currency.cpp"
+using namespace std;
+
+// One parsed expense; its shares live in the owning chunk's share array
+struct ImportedExpense
+{
+    string_view description; // points into the mapped input
+    UserId paidBy;
+    Money amount;
+    ExpenseType type;
+    int64_t timestamp;   // Unix seconds; 0 if the file gives none
+    CurrencyId currency; // HOME_CURRENCY if the file gives none
+    uint32_t shareBegin;
+    uint32_t shareCount;
+};
+
+// Everything one worker produced for its slice of the input, in input order
+struct ImportChunk
+{
+    vector<ImportedExpense> rows;
+    vector<pair<UserId, Money>> shares;
+    PartialLedger ledger; // this chunk's settlements only, merged at the end
+    size_t rejected = 0;
+};
+
+// Read-only memory map of a whole file
+class MappedFile
+{
+    const char *data;
+    size_t length;
+
+public:
+    explicit MappedFile(const string &path) : data(nullptr), length(0)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const char *>(mapped);
+                length = info.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (data)
+            munmap(const_cast<char *>(data), length);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const { return data != nullptr; }
+    const char *begin() const { return data; }
+    const char *end() const { return data + length; }
+    size_t size() const { return length; }
+};
+
+// Parses expense files in parallel chunks.
+//
+// CSV, one expense per line, with an optional Unix timestamp and currency
+// code after the participants (either may be left empty):
+//   description,paidBy,amount,TYPE,participants[,timestamp[,currency]]
+//   Dinner,U1,300.00,EQUAL,U1;U2;U3
+//   Movie,U2,100,EXACT,U1=60.00;U2=40.00,1700000000
+//   Rent,U3,1000,PERCENT,U1=33.33;U2=33.33;U3=33.34,1700000000,EUR
+//
+// Binary ("SWB1" or "SWB2", then packed little-endian records, users as
+// internal ids):
+//   u32 paidBy | i64 amountCents | u8 type | u8 descriptionLength | u16 count |
+//   [SWB2 only: i64 timestamp | u8 currency] |
+//   description bytes | count x u32 user | count x i64 value (not for EQUAL;
+//   cents for EXACT, basis points for PERCENT)
+// A timestamp of 0 means the time of the import.
+class BulkImporter
+{
+public:
+    using UserResolver = function<UserId(string_view)>; // INVALID_USER if unknown
+    static const UserId INVALID_USER = UINT32_MAX;
+
+private:
+    // Flat open-addressing map from id strings (views into the input) to users
+    class TokenCache
+    {
+        struct Slot
+        {
+            size_t hash;
+            string_view token; // empty if unused
+            UserId user;
+        };
+
+        vector<Slot> slots;
+        size_t used;
+
+    public:
+        TokenCache() : slots(1024), used(0) {}
+
+        UserId *find(string_view token)
+        {
+            size_t hash = std::hash<string_view>()(token);
+            for (size_t slot = hash & (slots.size() - 1);; slot = (slot + 1) & (slots.size() - 1))
+            {
+                if (slots[slot].token.empty())
+                    return nullptr;
+                if (slots[slot].hash == hash && slots[slot].token == token)
+                    return &slots[slot].user;
+            }
+        }
+
+        void insert(string_view token, UserId user)
+        {
+            if (token.empty())
+                return;
+            if ((used + 1) * 2 > slots.size())
+            {
+                vector<Slot> old(slots.size() * 2);
+                old.swap(slots);
+                for (const Slot &entry : old)
+                {
+                    if (!entry.token.empty())
+                        place(entry);
+                }
+            }
+            place(Slot{std::hash<string_view>()(token), token, user});
+            used++;
+        }
+
+    private:
+        void place(const Slot &entry)
+        {
+            size_t slot = entry.hash & (slots.size() - 1);
+            while (!slots[slot].token.empty())
+                slot = (slot + 1) & (slots.size() - 1);
+            slots[slot] = entry;
+        }
+    };
+
+    // Next field up to 'separator' (or the end); advances 'text' past it
+    static string_view nextField(string_view &text, char separator)
+    {
+        size_t cut = text.find(separator);
+        string_view field = text.substr(0, cut);
+        text.remove_prefix(cut == string_view::npos ? text.size() : cut + 1);
+        return field;
+    }
+
+    // Fills the chunk's shares for one expense from raw values (cents for
+    // EXACT, basis points for PERCENT) and checks the sums. Settles into the
+    // chunk ledger on success.
+    static bool finishExpense(ImportChunk &chunk, ImportedExpense &row, const vector<UserId> &users, const vector<int64_t> &values)
+    {
+        size_t count = users.size();
+        vector<Money> &amounts = scratchAmounts(count);
+        if (!ExpenseStore::splitShares(row.amount, row.type, values.data(), count, amounts.data()))
+            return false;
+
+        row.shareBegin = chunk.shares.size();
+        row.shareCount = count;
+        for (size_t i = 0; i < count; i++)
+        {
+            chunk.shares.emplace_back(users[i], amounts[i]);
+            chunk.ledger.addDebt(row.paidBy, users[i], amounts[i], row.currency);
+        }
+        chunk.rows.push_back(row);
+        return true;
+    }
+
+    static void parseCsvChunk(const char *begin, const char *end, const UserResolver &resolve, TokenCache &resolved, ImportChunk &chunk)
+    {
+        // Each worker resolves a given user id string once
+        auto lookup = [&](string_view token)
+        {
+            UserId *cached = resolved.find(token);
+            if (cached)
+                return *cached;
+            UserId user = resolve(token);
+            resolved.insert(token, user);
+            return user;
+        };
+
+        vector<UserId> users;
+        vector<int64_t> values;
+        const char *line = begin;
+        while (line < end)
+        {
+            const char *newline = static_cast<const char *>(memchr(line, '\n', end - line));
+            const char *lineEnd = newline ? newline : end;
+            string_view text(line, lineEnd - line);
+            line = lineEnd + 1;
+            if (!text.empty() && text.back() == '\r')
+                text.remove_suffix(1);
+            if (text.empty())
+                continue;
+
+            ImportedExpense row;
+            row.description = nextField(text, ',');
+            string_view payer = nextField(text, ',');
+            string_view amount = nextField(text, ',');
+            string_view type = nextField(text, ',');
+            string_view participants = nextField(text, ',');
+            string_view timestamp = nextField(text, ',');
+            string_view currency = nextField(text, ',');
+            int64_t cents;
+            row.paidBy = lookup(payer);
+            row.timestamp = 0;
+            row.currency = currency.empty() ? HOME_CURRENCY : Currency::find(currency);
+            if (row.paidBy == INVALID_USER || !parseCents(amount, cents) || !parseType(type, row.type) ||
+                (!timestamp.empty() && !parseTimestamp(timestamp, row.timestamp)) || row.currency == Currency::INVALID || !text.empty())
+            {
+                chunk.rejected++;
+                continue;
+            }
+            row.amount = Money(cents);
+
+            users.clear();
+            values.clear();
+            bool valid = true;
+            while (valid && !participants.empty())
+            {
+                string_view participant = nextField(participants, ';');
+                if (row.type != ExpenseType::EQUAL)
+                {
+                    string_view user = nextField(participant, '=');
+                    int64_t value = 0;
+                    valid = parseCents(participant, value);
+                    values.push_back(value);
+                    participant = user;
+                }
+                UserId user = lookup(participant);
+                valid = valid && user != INVALID_USER;
+                users.push_back(user);
+            }
+            if (!valid || !finishExpense(chunk, row, users, values))
+                chunk.rejected++;
+        }
+    }
+
+    struct BinaryHeader
+    {
+        uint32_t paidBy;
+        int64_t amount;
+        uint8_t type;
+        uint8_t descriptionLength;
+        uint16_t count;
+    };
+    static const size_t BINARY_HEADER_BYTES = 16;
+    static const size_t DATED_HEADER_BYTES = 25; // SWB2: plus timestamp and currency
+
+    static BinaryHeader readHeader(const char *record)
+    {
+        BinaryHeader header;
+        memcpy(&header.paidBy, record, 4);
+        memcpy(&header.amount, record + 4, 8);
+        header.type = uint8_t(record[12]);
+        header.descriptionLength = uint8_t(record[13]);
+        memcpy(&header.count, record + 14, 2);
+        return header;
+    }
+
+    // Bytes taken by the record at 'record', or 0 if it runs past 'end'
+    static size_t recordBytes(const char *record, const char *end, size_t headerBytes)
+    {
+        if (size_t(end - record) < headerBytes)
+            return 0;
+        BinaryHeader header = readHeader(record);
+        size_t bytes = headerBytes + header.descriptionLength + header.count * 4 +
+                       (header.type == uint8_t(ExpenseType::EQUAL) ? 0 : header.count * 8);
+        return bytes <= size_t(end - record) ? bytes : 0;
+    }
+
+    static void parseBinaryChunk(const char *begin, const char *end, size_t headerBytes, size_t userCount, ImportChunk &chunk)
+    {
+        vector<UserId> users;
+        vector<int64_t> values;
+        for (const char *record = begin; record < end;)
+        {
+            size_t bytes = recordBytes(record, end, headerBytes);
+            if (!bytes)
+            {
+                chunk.rejected++;
+                break;
+            }
+            BinaryHeader header = readHeader(record);
+            ImportedExpense row;
+            row.timestamp = 0;
+            row.currency = HOME_CURRENCY;
+            if (headerBytes == DATED_HEADER_BYTES)
+            {
+                memcpy(&row.timestamp, record + BINARY_HEADER_BYTES, 8);
+                row.currency = CurrencyId(record[BINARY_HEADER_BYTES + 8]);
+            }
+            const char *cursor = record + headerBytes;
+            record += bytes;
+
+            row.description = string_view(cursor, header.descriptionLength);
+            cursor += header.descriptionLength;
+            row.paidBy = header.paidBy;
+            row.amount = Money(header.amount);
+            row.type = ExpenseType(header.type);
+            if (header.paidBy >= userCount || header.type > uint8_t(ExpenseType::PERCENT) || row.currency >= Currency::COUNT)
+            {
+                chunk.rejected++;
+                continue;
+            }
+
+            users.resize(header.count);
+            memcpy(users.data(), cursor, header.count * 4);
+            cursor += header.count * 4;
+            values.resize(row.type == ExpenseType::EQUAL ? 0 : header.count);
+            memcpy(values.data(), cursor, values.size() * 8);
+
+            bool valid = all_of(users.begin(), users.end(), [&](UserId user)
+                                { return user < userCount; });
+            if (!valid || !finishExpense(chunk, row, users, values))
+                chunk.rejected++;
+        }
+    }
+
+    static vector<Money> &scratchAmounts(size_t count)
+    {
+        static thread_local vector<Money> amounts;
+        if (amounts.size() < count)
+            amounts.resize(count);
+        return amounts;
+    }
+
+    template <class Parse>
+    static void runWorkers(size_t chunks, Parse parse)
+    {
+        vector<thread> pool;
+        for (size_t i = 1; i < chunks; i++)
+        {
+            pool.emplace_back(parse, i);
+        }
+        parse(0);
+        for (thread &t : pool)
+        {
+            t.join();
+        }
+    }
+
+    // Parses the ranges between 'cuts' 'threads' at a time and hands each chunk to
+    // 'consume' in file order, so only one round of chunks is ever in memory
+    template <class Parse>
+    static void parseRounds(const vector<const char *> &cuts, size_t threads, Parse parse, const function<void(ImportChunk &)> &consume)
+    {
+        size_t count = cuts.size() - 1;
+        for (size_t first = 0; first < count; first += threads)
+        {
+            vector<ImportChunk> chunks(min(threads, count - first));
+            runWorkers(chunks.size(), [&](size_t i)
+                       { parse(i, cuts[first + i], cuts[first + i + 1], chunks[i]);
+                         chunks[i].ledger.compact(); });
+            for (ImportChunk &chunk : chunks)
+            {
+                consume(chunk);
+            }
+        }
+    }
+
+    static size_t chunkBytes(const MappedFile &file, size_t threads)
+    {
+        return max<size_t>(1, min(file.size() / threads + 1, ROUND_BYTES / threads));
+    }
+
+public:
+    // Cents with at most two decimals: "12", "12.5", "12.50"; no more than
+    // Money::MAX_EXPENSE_CENTS
+    static bool parseCents(string_view text, int64_t &cents)
+    {
+        if (text.empty())
+            return false;
+        int64_t whole = 0;
+        size_t i = 0;
+        while (i < text.size() && text[i] >= '0' && text[i] <= '9')
+        {
+            if (whole > Money::MAX_EXPENSE_CENTS / Money::CENTS_PER_UNIT)
+                return false; // checked before the next digit so 'whole' never overflows
+            whole = whole * 10 + (text[i++] - '0');
+        }
+        if (i == 0)
+            return false;
+        int64_t fraction = 0;
+        if (i < text.size())
+        {
+            if (text[i++] != '.' || i == text.size() || text.size() - i > 2)
+                return false;
+            size_t digits = text.size() - i;
+            for (; i < text.size(); i++)
+            {
+                if (text[i] < '0' || text[i] > '9')
+                    return false;
+                fraction = fraction * 10 + (text[i] - '0');
+            }
+            if (digits == 1)
+                fraction *= 10;
+        }
+        cents = whole * Money::CENTS_PER_UNIT + fraction;
+        return cents <= Money::MAX_EXPENSE_CENTS;
+    }
+
+    // Unix seconds, digits only
+    static bool parseTimestamp(string_view text, int64_t &seconds)
+    {
+        auto parsed = from_chars(text.data(), text.data() + text.size(), seconds);
+        return parsed.ec == errc() && parsed.ptr == text.data() + text.size() && seconds >= 0;
+    }
+
+    static bool parseType(string_view text, ExpenseType &type)
+    {
+        if (text == "EQUAL")
+            type = ExpenseType::EQUAL;
+        else if (text == "EXACT")
+            type = ExpenseType::EXACT;
+        else if (text == "PERCENT")
+            type = ExpenseType::PERCENT;
+        else
+            return false;
+        return true;
+    }
+
+    static const size_t ROUND_BYTES = 128 << 20; // input parsed per round; bounds how much parsed data is held at once
+
+    static bool isBinary(const MappedFile &file)
+    {
+        return file.size() >= 4 && (memcmp(file.begin(), "SWB1", 4) == 0 || memcmp(file.begin(), "SWB2", 4) == 0);
+    }
+
+    // Cuts the file at line boundaries into chunks parsed 'threads' at a time.
+    // 'resolve' is called concurrently and must only read.
+    static void parseCsv(const MappedFile &file, const UserResolver &resolve, size_t threads, const function<void(ImportChunk &)> &consume)
+    {
+        threads = max<size_t>(1, threads);
+        size_t step = chunkBytes(file, threads);
+        vector<const char *> cuts = {file.begin()};
+        while (cuts.back() < file.end())
+        {
+            const char *cut = cuts.back() + min<size_t>(step, file.end() - cuts.back());
+            const char *newline = static_cast<const char *>(memchr(cut, '\n', file.end() - cut));
+            cuts.push_back(newline ? newline + 1 : file.end());
+        }
+
+        // One cache per worker, kept across rounds; the cached views stay valid
+        // while the file is mapped
+        vector<TokenCache> caches(threads);
+        parseRounds(cuts, threads, [&](size_t worker, const char *begin, const char *end, ImportChunk &chunk)
+                    { parseCsvChunk(begin, end, resolve, caches[worker], chunk); },
+                    consume);
+    }
+
+    // Record boundaries are found with one quick walk over the headers
+    static void parseBinary(const MappedFile &file, size_t userCount, size_t threads, const function<void(ImportChunk &)> &consume)
+    {
+        threads = max<size_t>(1, threads);
+        size_t step = chunkBytes(file, threads);
+        size_t headerBytes = file.begin()[3] == '2' ? DATED_HEADER_BYTES : BINARY_HEADER_BYTES;
+        vector<const char *> cuts = {file.begin() + 4};
+        for (const char *record = cuts[0]; record < file.end();)
+        {
+            size_t bytes = recordBytes(record, file.end(), headerBytes);
+            if (!bytes)
+                break;
+            record += bytes;
+            if (size_t(record - cuts.back()) >= step)
+                cuts.push_back(record);
+        }
+        if (cuts.back() != file.end())
+            cuts.push_back(file.end());
+
+        parseRounds(cuts, threads, [&](size_t, const char *begin, const char *end, ImportChunk &chunk)
+                    { parseBinaryChunk(begin, end, headerBytes, userCount, chunk); },
+                    consume);
+    }
+};
+
+#endif // BULKIMPORTER_H
@@ -0,0 +1,349 @@
+#ifndef COMMANDPROCESSOR_H
+#define COMMANDPROCESSOR_H
+
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "SplitSystem.cpp"
+#include "BulkImporter.cpp"
+#include "ReportWriter.cpp"
+using namespace std;
+
+// Replays text commands against a SplitwiseSystem, one per line:
+//   EXPENSE u1 1000 4 u1 u2 u3 u4 EQUAL
+//   EXPENSE u1 1250 2 u2 u3 EXACT 370 880
+//   EXPENSE u4 1200 4 u1 u2 u3 u4 PERCENT 40 20 20 20
+//   SHOW u1        balances involving u1, e.g. "u2 owes u1: 250.00"
+//   SHOW           every balance
+// Users are named by the log and registered on first sight, once the line
+// naming them has parsed. Blank lines and lines starting with '#' are
+// skipped, and a line that is not a valid command is echoed back as
+// "Invalid command: ...".
+//
+// Lines are parsed as string_views over the input (mapped, or read a block
+// at a time), never copied. Expenses collect in a batch that goes into the
+// system in one step, before the next SHOW reads it, and output collects in
+// a buffer written out 64 KB at a time.
+//
+// Parsing and resolving names alone runs at about 2.4M commands/s on one
+// core, but a whole replay runs at 130k-210k/s, well short of millions: the
+// rest is the system's own work for each expense (ledger, timeline and
+// history index) and SHOW's output. See README.md for the measurements.
+class CommandProcessor
+{
+public:
+    struct Result
+    {
+        size_t commands = 0;
+        size_t expenses = 0; // added
+        size_t invalid = 0;  // malformed lines, unknown commands, shares that don't add up
+    };
+
+private:
+    static const size_t BATCH_ROWS = 4096;
+    static const size_t READ_BYTES = 1 << 20;
+    static const size_t OUTPUT_BYTES = 64 << 10; // handed to the writer in pieces this big
+    static const size_t MAX_PARTICIPANTS = 1 << 16;
+
+    // A name the log has used. The hash is kept so a probe reads the name
+    // only when the hashes match, and the id so a hit needs no User.
+    struct NameSlot
+    {
+        uint64_t hash; // never 0 for a name; 0 if the slot is unused
+        string_view name; // points at the User's stored name
+        User *user;
+        UserId id;
+    };
+
+    SplitwiseSystem &system;
+    ReportWriter writer;
+    ReportBuffer output;
+    vector<NameSlot> users; // power-of-two capacity, linear probing, at most half full
+    size_t userCount;
+    SplitwiseSystem::ExpenseBatch batch;
+    vector<string_view> names; // one line's participants, before they are resolved
+    vector<int64_t> values;
+    Result result;
+
+    static bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+    // Next token of the line, advancing past it; empty at the end
+    static string_view nextToken(string_view &line)
+    {
+        size_t start = 0;
+        while (start < line.size() && isBlank(line[start]))
+            start++;
+        size_t end = start;
+        while (end < line.size() && !isBlank(line[end]))
+            end++;
+        string_view token = line.substr(start, end - start);
+        line.remove_prefix(end);
+        return token;
+    }
+
+    static bool parseCount(string_view token, size_t &count)
+    {
+        auto parsed = from_chars(token.data(), token.data() + token.size(), count);
+        return parsed.ec == errc() && parsed.ptr == token.data() + token.size();
+    }
+
+    static uint64_t hashOf(string_view name)
+    {
+        return hash<string_view>()(name) | 1;
+    }
+
+    // The slot holding 'name', else the empty slot where it would go
+    size_t slotOf(string_view name, uint64_t hash) const
+    {
+        // Fibonacci hashing; users.size() is a power of two
+        size_t slot = (hash * 0x9E3779B97F4A7C15ULL) >> (64 - __builtin_ctzll(users.size()));
+        while (users[slot].hash != 0 && (users[slot].hash != hash || users[slot].name != name))
+            slot = (slot + 1) & (users.size() - 1);
+        return slot;
+    }
+
+    void grow()
+    {
+        vector<NameSlot> old(users.size() * 2, NameSlot{0, string_view(), nullptr, 0});
+        old.swap(users);
+        for (const NameSlot &entry : old)
+        {
+            if (entry.hash != 0)
+                users[slotOf(entry.name, entry.hash)] = entry;
+        }
+    }
+
+    // Registers a name on first sight; only for a line that has parsed in
+    // full, so a bad line leaves no users behind
+    UserId userNamed(string_view name)
+    {
+        uint64_t hash = hashOf(name);
+        size_t slot = slotOf(name, hash);
+        if (users[slot].hash == 0)
+        {
+            if ((userCount + 1) * 2 > users.size())
+            {
+                grow();
+                slot = slotOf(name, hash);
+            }
+            User *user = system.registerUser(string(name), "");
+            users[slot] = NameSlot{hash, string_view(user->getName()), user, user->getId()};
+            userCount++;
+        }
+        return users[slot].id;
+    }
+
+    // EXPENSE payer amount count user... TYPE [value...]: values are amounts
+    // for EXACT and percentages for PERCENT, each with up to two decimals
+    bool expense(string_view line)
+    {
+        string_view payerName = nextToken(line);
+        int64_t cents;
+        size_t count;
+        if (payerName.empty() || !BulkImporter::parseCents(nextToken(line), cents) || !parseCount(nextToken(line), count) ||
+            count == 0 || count > MAX_PARTICIPANTS)
+            return false;
+        names.clear();
+        for (size_t i = 0; i < count; i++)
+        {
+            names.push_back(nextToken(line));
+            if (names.back().empty())
+                return false;
+        }
+        ExpenseType type;
+        if (!BulkImporter::parseType(nextToken(line), type))
+            return false;
+        values.clear();
+        for (size_t i = 0; type != ExpenseType::EQUAL && i < count; i++)
+        {
+            int64_t value; // cents, or basis points: "33.33" percent is 3333
+            if (!BulkImporter::parseCents(nextToken(line), value))
+                return false;
+            values.push_back(value);
+        }
+        if (!nextToken(line).empty())
+            return false;
+        size_t begin = batch.shareAmounts.size();
+        batch.shareAmounts.resize(begin + count);
+        if (!ExpenseStore::splitShares(Money(cents), type, values.data(), count, batch.shareAmounts.data() + begin))
+        {
+            batch.shareAmounts.resize(begin);
+            return false;
+        }
+
+        UserId payer = userNamed(payerName);
+        for (string_view name : names)
+            batch.shareUsers.push_back(userNamed(name));
+        batch.rows.push_back(SplitwiseSystem::ExpenseBatch::Row{string_view(), payer, Money(cents), HOME_CURRENCY, type,
+                                                                NO_GROUP, SplitwiseSystem::currentTime(), begin, count});
+        if (batch.rows.size() >= BATCH_ROWS)
+            flush();
+        return true;
+    }
+
+    void owes(string_view debtor, string_view creditor, Money amount)
+    {
+        output.append(debtor);
+        output.append(" owes ");
+        output.append(creditor);
+        output.append(": ");
+        output.appendMoney(amount);
+        output.append('\n');
+    }
+
+    // SHOW [user]
+    bool show(string_view line)
+    {
+        string_view name = nextToken(line);
+        if (!nextToken(line).empty())
+            return false;
+        flush();
+        size_t before = output.size();
+        if (name.empty())
+        {
+            for (const auto &[creditor, debtor, amount] : system.getAllBalances())
+                owes(debtor->getName(), creditor->getName(), amount);
+        }
+        else if (const NameSlot &known = users[slotOf(name, hashOf(name))]; known.hash != 0)
+        {
+            for (const auto &[other, amount] : system.getBalances(known.user->getUserId()))
+            {
+                if (Money() < amount)
+                    owes(other->getName(), name, amount);
+                else if (amount < Money())
+                    owes(name, other->getName(), -amount);
+            }
+        }
+        if (output.size() == before)
+            output.append("No balances\n");
+        drain();
+        return true;
+    }
+
+    void runLine(string_view line)
+    {
+        string_view rest = line;
+        string_view command = nextToken(rest);
+        if (command.empty() || command[0] == '#')
+            return;
+        result.commands++;
+        bool valid = command == "EXPENSE" ? expense(rest) : command == "SHOW" ? show(rest)
+                                                                              : false;
+        if (valid)
+            return;
+        result.invalid++;
+        output.append("Invalid command: ");
+        output.append(line);
+        output.append('\n');
+        drain();
+    }
+
+    // Every whole line of 'text'
+    void runText(string_view text)
+    {
+        const char *cursor = text.data();
+        const char *end = text.data() + text.size();
+        while (cursor < end)
+        {
+            const char *newline = static_cast<const char *>(memchr(cursor, '\n', end - cursor));
+            const char *lineEnd = newline ? newline : end;
+            string_view line(cursor, lineEnd - cursor);
+            cursor = lineEnd + 1;
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            runLine(line);
+        }
+    }
+
+    // Reads 'fd' to the end a block at a time; a line cut by a block
+    // boundary is carried over to the next
+    void runStream(int fd)
+    {
+        vector<char> buffer(READ_BYTES);
+        size_t held = 0;
+        for (;;)
+        {
+            if (held == buffer.size())
+                buffer.resize(buffer.size() * 2); // one line longer than the buffer
+            ssize_t got = read(fd, buffer.data() + held, buffer.size() - held);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                break;
+            size_t filled = held + got;
+            const char *last = static_cast<const char *>(memrchr(buffer.data() + held, '\n', got));
+            if (!last)
+            {
+                held = filled;
+                continue;
+            }
+            size_t cut = last - buffer.data() + 1;
+            runText(string_view(buffer.data(), cut));
+            held = filled - cut;
+            memmove(buffer.data(), buffer.data() + cut, held);
+        }
+        runText(string_view(buffer.data(), held));
+    }
+
+    void flush()
+    {
+        if (batch.rows.empty())
+            return;
+        size_t added = system.addResolvedExpenses(batch);
+        result.expenses += added;
+        result.invalid += batch.rows.size() - added;
+        batch.rows.clear();
+        batch.shareUsers.clear();
+        batch.shareAmounts.clear();
+    }
+
+    void drain()
+    {
+        if (output.size() < OUTPUT_BYTES)
+            return;
+        writer.write(output);
+        output.clear();
+    }
+
+public:
+    // Output goes to 'outputPath', "-" for stdout
+    explicit CommandProcessor(SplitwiseSystem &system, const string &outputPath = "-")
+        : system(system), writer(outputPath, ReportFormat::CSV), users(1024, NameSlot{0, string_view(), nullptr, 0}), userCount(0) {}
+
+    // Runs every command in 'path' ("-" for stdin) and writes out everything
+    // the commands printed
+    Result run(const string &path)
+    {
+        if (path == "-")
+        {
+            runStream(STDIN_FILENO);
+        }
+        else
+        {
+            MappedFile file(path);
+            if (file.isOpen())
+            {
+                runText(string_view(file.begin(), file.size()));
+            }
+            else
+            {
+                // Empty, or not a regular file (a pipe, a device)
+                int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd >= 0)
+                {
+                    runStream(fd);
+                    close(fd);
+                }
+            }
+        }
+        flush();
+        writer.write(output);
+        output.clear();
+        writer.finish();
+        return result;
+    }
+
+    bool ok() const { return writer.ok(); }
+};
+
+#endif // COMMANDPROCESSOR_H
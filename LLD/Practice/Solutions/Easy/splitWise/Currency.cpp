@@ -0,0 +1,50 @@
+#ifndef CURRENCY_H
+#define CURRENCY_H
+
+#include <bits/stdc++.h>
+using namespace std;
+
+// Index into Currency's code table
+using CurrencyId = uint8_t;
+const CurrencyId HOME_CURRENCY = 0; // USD; what callers that never name a currency get
+
+// The currencies expenses can be in (ISO 4217). Every amount is kept in
+// hundredths of its currency's unit, as Money is, whatever the currency's
+// usual minor unit.
+class Currency
+{
+    static constexpr array<const char *, 32> CODES = {
+        "USD", "EUR", "GBP", "JPY", "CNY", "INR", "AUD", "CAD", "CHF", "HKD", "SGD",
+        "SEK", "NOK", "DKK", "NZD", "KRW", "MXN", "BRL", "ZAR", "TRY", "PLN", "THB",
+        "IDR", "MYR", "PHP", "AED", "SAR", "ILS", "CZK", "HUF", "TWD", "VND"};
+
+public:
+    static const size_t COUNT = CODES.size(); // at most 64: sets of currencies are bitmasks
+    static const CurrencyId INVALID = UINT8_MAX;
+
+    static CurrencyId find(string_view code)
+    {
+        for (size_t i = 0; i < COUNT; i++)
+        {
+            if (code == CODES[i])
+                return CurrencyId(i);
+        }
+        return INVALID;
+    }
+
+    static const char *code(CurrencyId currency) { return CODES[currency]; }
+
+    // Printed before an amount: "$" at home, the code elsewhere
+    static string prefix(CurrencyId currency)
+    {
+        return currency == HOME_CURRENCY ? "$" : string(CODES[currency]) + " ";
+    }
+
+    // For totals that were always printed bare: nothing at home, the code elsewhere
+    static string label(CurrencyId currency)
+    {
+        return currency == HOME_CURRENCY ? "" : string(CODES[currency]) + " ";
+    }
+};
+
+#endif // CURRENCY_H
@@ -0,0 +1,221 @@
+#ifndef DEBTSIMPLIFIER_H
+#define DEBTSIMPLIFIER_H
+
+#include <bits/stdc++.h>
+#include "BalanceLedger.cpp"
+#include "Currency.cpp"
+using namespace std;
+
+struct Settlement
+{
+    UserId from; // pays
+    UserId to;   // receives
+    Money amount;
+    CurrencyId currency = HOME_CURRENCY;
+};
+
+// Turns the pairwise ledger into a short "who pays whom" plan that leaves every
+// user with the same net balance, one currency at a time. Users only ever pay someone in their own
+// connected component of the debt graph, and components are solved in parallel.
+class DebtSimplifier
+{
+    struct Member
+    {
+        UserId user;
+        int64_t net; // cents; positive means the user is owed money
+    };
+
+    // Components up to this size are solved exactly (2^n subset DP)
+    static const size_t EXACT_LIMIT = 12;
+
+    static UserId findRoot(vector<UserId> &parent, UserId user)
+    {
+        while (parent[user] != user)
+        {
+            parent[user] = parent[parent[user]];
+            user = parent[user];
+        }
+        return user;
+    }
+
+    // Largest creditor takes from largest debtor until both sides are settled;
+    // at most n - 1 transfers
+    static void settleGreedy(const Member *members, size_t count, vector<Settlement> &plan)
+    {
+        priority_queue<pair<int64_t, UserId>> creditors, debtors;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (members[i].net > 0)
+                creditors.emplace(members[i].net, members[i].user);
+            else if (members[i].net < 0)
+                debtors.emplace(-members[i].net, members[i].user);
+        }
+
+        while (!creditors.empty() && !debtors.empty())
+        {
+            auto credit = creditors.top();
+            auto debt = debtors.top();
+            creditors.pop();
+            debtors.pop();
+
+            int64_t amount = min(credit.first, debt.first);
+            plan.push_back(Settlement{debt.second, credit.second, Money(amount)});
+            if (credit.first > amount)
+                creditors.emplace(credit.first - amount, credit.second);
+            if (debt.first > amount)
+                debtors.emplace(debt.first - amount, debt.second);
+        }
+    }
+
+    // Minimum plan: split the members into as many zero-sum groups as possible
+    // (each group of k needs k - 1 transfers), then settle each group greedily
+    static void settleExact(const Member *members, size_t count, vector<Settlement> &plan)
+    {
+        size_t full = (size_t(1) << count) - 1;
+        vector<int64_t> sum(full + 1, 0);
+        vector<uint8_t> groups(full + 1, 0);
+        for (size_t mask = 1; mask <= full; mask++)
+        {
+            size_t low = __builtin_ctzll(mask);
+            sum[mask] = sum[mask & (mask - 1)] + members[low].net;
+
+            uint8_t best = 0;
+            for (size_t rest = mask; rest; rest &= rest - 1)
+            {
+                best = max(best, groups[mask ^ (rest & -rest)]);
+            }
+            groups[mask] = best + (sum[mask] == 0 ? 1 : 0);
+        }
+
+        // Walk back from the full set; every zero-sum prefix closes a group
+        vector<Member> group;
+        for (size_t mask = full; mask;)
+        {
+            size_t pick = 0;
+            for (size_t rest = mask; rest; rest &= rest - 1)
+            {
+                size_t bit = rest & -rest;
+                if (!pick || groups[mask ^ bit] > groups[mask ^ pick])
+                    pick = bit;
+            }
+            mask ^= pick;
+            group.push_back(members[__builtin_ctzll(pick)]);
+            if (sum[mask] == 0)
+            {
+                settleGreedy(group.data(), group.size(), plan);
+                group.clear();
+            }
+        }
+    }
+
+    static void settleMembers(const Member *members, size_t count, vector<Settlement> &plan)
+    {
+        if (count <= EXACT_LIMIT)
+            settleExact(members, count, plan);
+        else
+            settleGreedy(members, count, plan);
+    }
+
+public:
+    // Plan for users whose nets in 'currency' are already known and sum to
+    // zero (e.g. a group)
+    static void settleNets(const vector<pair<UserId, Money>> &nets, CurrencyId currency, vector<Settlement> &plan)
+    {
+        vector<Member> members;
+        for (const auto &entry : nets)
+        {
+            if (!entry.second.isZero())
+                members.push_back(Member{entry.first, entry.second.getCents()});
+        }
+        size_t first = plan.size();
+        settleMembers(members.data(), members.size(), plan);
+        for (size_t i = first; i < plan.size(); i++)
+            plan[i].currency = currency;
+    }
+
+    // Ledger: anything with forEachBalance(currency, f(lo, hi, balance)), e.g. ShardedLedger
+    template <class Ledger>
+    static vector<Settlement> simplify(const Ledger &ledger, CurrencyId currency, size_t userCount, size_t threads = thread::hardware_concurrency())
+    {
+        // Net balances and connected components in one pass over the ledger
+        vector<int64_t> net(userCount, 0);
+        vector<UserId> parent(userCount);
+        iota(parent.begin(), parent.end(), 0);
+        ledger.forEachBalance(currency, [&](UserId lo, UserId hi, Money balance)
+                              {
+            net[lo] += balance.getCents();
+            net[hi] -= balance.getCents();
+            UserId a = findRoot(parent, lo), b = findRoot(parent, hi);
+            if (a != b)
+                parent[max(a, b)] = min(a, b); });
+
+        // Bucket unsettled users by component (counting sort, ordered by user id)
+        vector<uint32_t> componentOf(userCount, UINT32_MAX);
+        vector<size_t> start;
+        for (UserId user = 0; user < userCount; user++)
+        {
+            if (net[user] == 0)
+                continue;
+            UserId root = findRoot(parent, user);
+            if (componentOf[root] == UINT32_MAX)
+            {
+                componentOf[root] = start.size();
+                start.push_back(0);
+            }
+            start[componentOf[root]]++;
+        }
+        size_t components = start.size();
+        size_t offset = 0;
+        for (size_t &begin : start)
+        {
+            size_t size = begin;
+            begin = offset;
+            offset += size;
+        }
+        start.push_back(offset);
+
+        vector<Member> members(offset);
+        vector<size_t> fill(start.begin(), start.end() - 1);
+        for (UserId user = 0; user < userCount; user++)
+        {
+            if (net[user] != 0)
+                members[fill[componentOf[findRoot(parent, user)]]++] = Member{user, net[user]};
+        }
+
+        // Workers pull components off a shared counter
+        vector<vector<Settlement>> plans(components);
+        atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            for (size_t c = next++; c < components; c = next++)
+            {
+                settleMembers(&members[start[c]], start[c + 1] - start[c], plans[c]);
+            }
+        };
+
+        threads = max<size_t>(1, min(threads, components));
+        vector<thread> pool;
+        for (size_t i = 1; i < threads; i++)
+        {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (thread &t : pool)
+        {
+            t.join();
+        }
+
+        vector<Settlement> plan;
+        size_t total = 0;
+        for (const auto &part : plans)
+            total += part.size();
+        plan.reserve(total);
+        for (const auto &part : plans)
+            plan.insert(plan.end(), part.begin(), part.end());
+        for (Settlement &settlement : plan)
+            settlement.currency = currency;
+        return plan;
+    }
+};
+
+#endif // DEBTSIMPLIFIER_H
@@ -1,72 +1,61 @@
+#ifndef EXPENSE_H
+#define EXPENSE_H
+
 #include <bits/stdc++.h>
+#include "User.cpp"
+#include "ExpenseStore.cpp"
 using namespace std;
 
-enum class ExpenseType
-{
-    EQUAL,
-    EXACT,
-    PERCENT
-};
-
+// Handle to one expense in an ExpenseStore. Cheap to copy; a default
+// constructed Expense is "no expense" (e.g. a rejected addExpense). Ids are
+// never reused, so a handle never comes to mean another expense; once its
+// expense is deleted only getId/getExpenseId/exists may be called.
 class Expense
 {
-    string expenceId;
-    string paidBy;
-    string description;
-    double totalAmount;
-    ExpenseType expenseType;
-    vector<string> involvedUsers;
-    map<string, double> shares; // userId-> shared amount for this expense
+    const ExpenseStore *store;
+    ExpenseId id;
 
 public:
-    Expense(const string &id, const string &description, const string &paidBy, double amount, ExpenseType type, const vector<string> &users)
-    {
-        this->expenceId = id;
-        this->paidBy = paidBy;
-        this->totalAmount = amount;
-        this->expenseType = type;
-        this->involvedUsers = users;
-        this->description = description;
-
-        if (expenseType == ExpenseType::EQUAL)
-        {
-            calculateEqualShares();
-        }
-    }
+    Expense() : store(nullptr), id(0) {}
+    Expense(const ExpenseStore *store, ExpenseId id) : store(store), id(id) {}
 
-    string getExpenseId() { return expenceId; }
+    explicit operator bool() const { return store != nullptr; }
 
-    string getPaidBy() { return paidBy; }
+    ExpenseId getId() const { return id; }
 
-    auto getShares() { return shares; }
+    // False once the expense has been deleted
+    bool exists() const { return store != nullptr && store->contains(id); }
 
-    vector<string> getParticipants()
-    {
-        return involvedUsers;
-    }
+    // External id, e.g. "E3"
+    string getExpenseId() const { return "E" + to_string(id + 1); }
 
-    void setShares(map<string, double> &share)
-    {
-        this->shares = share;
-    }
+    UserId getPaidBy() const { return store->getPaidBy(id); }
 
-    void calculateEqualShares()
-    {
-        double splitAmount = totalAmount / involvedUsers.size();
+    string_view getDescription() const { return store->getDescription(id); }
 
-        for (auto &user : involvedUsers)
-        {
-            shares[user] = splitAmount;
-        }
-    }
+    Money getTotalAmount() const { return store->getAmount(id); }
+
+    CurrencyId getCurrency() const { return store->getCurrency(id); }
+
+    ExpenseType getType() const { return store->getType(id); }
 
-    void displayInfo()
+    GroupId getGroupId() const { return store->getGroupId(id); }
+
+    int64_t getTimestamp() const { return store->getTimestamp(id); }
+
+    Span<UserId> getParticipants() const { return store->getParticipants(id); }
+
+    // Parallel to getParticipants(); empty until EXACT/PERCENT shares are set
+    Span<Money> getShareAmounts() const { return store->getShareAmounts(id); }
+
+    // 'directory' maps internal ids back to users for display
+    void displayInfo(const vector<User *> &directory) const
     {
-        cout << "Expense ID: " << expenceId << "\n";
-        cout << "Paid by: " << paidBy << "\n";
-        cout << "description: " << description << "\n";
+        cout << "Expense ID: " << getExpenseId() << "\n";
+        cout << "Paid by: " << directory[getPaidBy()]->getUserId() << "\n";
+        cout << "description: " << getDescription() << "\n";
         std::cout << "Expense Type: ";
-        switch (expenseType)
+        switch (getType())
         {
         case ExpenseType::EQUAL:
             std::cout << "Equal";
@@ -78,17 +67,24 @@ public:
             std::cout << "Percent";
             break;
         }
-        cout << "Total Amount: " << totalAmount << "\n";
+        cout << "Total Amount: ";
+        if (getCurrency() != HOME_CURRENCY)
+            cout << Currency::code(getCurrency()) << " ";
+        cout << getTotalAmount() << "\n";
         cout << "Involved Users: ";
-        for (const auto &user : involvedUsers)
+        Span<UserId> participants = getParticipants();
+        for (UserId user : participants)
         {
-            cout << user << " ";
+            cout << directory[user]->getUserId() << " ";
         }
         cout << "\n";
         cout << "Shares: ";
-        for (auto &share : shares)
+        Span<Money> shares = getShareAmounts();
+        for (size_t i = 0; i < shares.size(); i++)
         {
-            cout << share.first << ": $" << fixed << setprecision(2) << share.second << endl;
+            cout << directory[participants[i]]->getUserId() << ": " << Currency::prefix(getCurrency()) << shares[i] << endl;
         }
     }
-};
\ No newline at end of file
+};
+
+#endif // EXPENSE_H
@@ -0,0 +1,505 @@
+#ifndef EXPENSESTORE_H
+#define EXPENSESTORE_H
+
+#include <bits/stdc++.h>
+#include "Money.cpp"
+#include "Group.cpp"
+#include "Currency.cpp"
+#include "BinaryIO.cpp"
+#include "Pools.cpp"
+using namespace std;
+
+// Dense internal id: index into the expense store's columns
+using ExpenseId = uint32_t;
+
+enum class ExpenseType : uint8_t
+{
+    EQUAL,
+    EXACT,
+    PERCENT
+};
+
+// Where an expense's shares stand; one byte per expense
+enum class ExpenseStatus : uint8_t
+{
+    SHARES_PENDING, // EXACT/PERCENT amounts arrive after the expense
+    SHARES_SET,
+    DELETED // the row is free: its expense is gone, the id stays taken
+};
+
+// Read-only view of 'count' contiguous values
+template <class T>
+class Span
+{
+    const T *first;
+    size_t count;
+
+public:
+    Span() : first(nullptr), count(0) {}
+    Span(const T *first, size_t count) : first(first), count(count) {}
+    Span(const vector<T> &values) : first(values.data()), count(values.size()) {}
+
+    const T *begin() const { return first; }
+    const T *end() const { return first + count; }
+    const T *data() const { return first; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T &operator[](size_t i) const { return first[i]; }
+};
+
+// Every expense, stored column by column. Fixed-width fields live in one
+// vector each, indexed by row; participants, share amounts and descriptions
+// live in arenas shared by all rows. ExpenseIds are handed out in order and
+// never reused; 'rows' maps each to its row. A deleted expense's row goes on
+// a free list for the next expense added, and the arena space it held goes
+// back to a RangePool for the next expense of the same size, so a store that
+// sees steady deletes stops growing instead of leaking their space.
+class ExpenseStore
+{
+    static constexpr uint32_t NO_ROW = UINT32_MAX;
+
+    vector<uint32_t> rows;     // by ExpenseId: its row; NO_ROW once deleted
+    vector<uint32_t> freeRows; // rows of deleted expenses; the last freed is reused first
+
+    vector<UserId> payers;
+    vector<Money> amounts;
+    vector<CurrencyId> currencies;
+    vector<ExpenseType> types;
+    vector<ExpenseStatus> statuses;
+    vector<GroupId> groupIds;
+    vector<int64_t> timestamps;
+    vector<uint64_t> shareBegin; // into shareUsers/shareAmounts
+    vector<uint32_t> shareCount;
+    vector<uint64_t> descriptionBegin; // into descriptions
+    vector<uint32_t> descriptionLength;
+
+    vector<UserId> shareUsers;  // participants of every expense
+    vector<Money> shareAmounts; // parallel to shareUsers
+    string descriptions;
+    RangePool sharePool;       // free ranges of shareUsers/shareAmounts
+    RangePool descriptionPool; // free ranges of descriptions
+
+    uint32_t rowOf(ExpenseId id) const { return rows[id]; }
+
+    // Room for the row's 'count' shares: a pooled range of that length if
+    // there is one, else fresh space at the end of the arena
+    void placeShares(uint32_t row, size_t count)
+    {
+        uint64_t begin;
+        if (!sharePool.take(count, begin))
+        {
+            begin = shareUsers.size();
+            shareUsers.resize(begin + count);
+            shareAmounts.resize(begin + count);
+        }
+        shareBegin[row] = begin;
+        shareCount[row] = count;
+    }
+
+    void placeDescription(uint32_t row, string_view description)
+    {
+        uint64_t begin;
+        if (descriptionPool.take(description.size(), begin))
+            descriptions.replace(begin, description.size(), description.data(), description.size());
+        else
+        {
+            begin = descriptions.size();
+            descriptions.append(description);
+        }
+        descriptionBegin[row] = begin;
+        descriptionLength[row] = description.size();
+    }
+
+    // A row for a new expense: the most recently freed one, else a new one
+    // at the end of every column
+    uint32_t takeRow()
+    {
+        if (!freeRows.empty())
+        {
+            uint32_t row = freeRows.back();
+            freeRows.pop_back();
+            return row;
+        }
+        size_t row = payers.size();
+        payers.resize(row + 1);
+        amounts.resize(row + 1);
+        currencies.resize(row + 1);
+        types.resize(row + 1);
+        statuses.resize(row + 1);
+        groupIds.resize(row + 1);
+        timestamps.resize(row + 1);
+        shareBegin.resize(row + 1);
+        shareCount.resize(row + 1);
+        descriptionBegin.resize(row + 1);
+        descriptionLength.resize(row + 1);
+        return row;
+    }
+
+    // The new expense, with its shares placed but not yet written
+    ExpenseId append(string_view description, UserId payer, Money amount, CurrencyId currency, ExpenseType type, GroupId group, int64_t timestamp, size_t participants)
+    {
+        ExpenseId id = rows.size();
+        uint32_t row = takeRow();
+        rows.push_back(row);
+        payers[row] = payer;
+        amounts[row] = amount;
+        currencies[row] = currency;
+        types[row] = type;
+        statuses[row] = ExpenseStatus::SHARES_PENDING;
+        groupIds[row] = group;
+        timestamps[row] = timestamp;
+        placeShares(row, participants);
+        placeDescription(row, description);
+        return id;
+    }
+
+    // Replaces the row's participants and amounts; in place when the count is
+    // unchanged, otherwise the old range goes back to the pool
+    void writeShares(uint32_t row, const UserId *users, const Money *values, size_t count)
+    {
+        if (count != shareCount[row])
+        {
+            sharePool.give(shareBegin[row], shareCount[row]);
+            placeShares(row, count);
+        }
+        copy(users, users + count, shareUsers.begin() + shareBegin[row]);
+        copy(values, values + count, shareAmounts.begin() + shareBegin[row]);
+        statuses[row] = ExpenseStatus::SHARES_SET;
+    }
+
+    // The current save() layout
+    bool loadRows(BinaryReader &in)
+    {
+        in.getArray(payers);
+        in.getArray(amounts);
+        in.getArray(currencies);
+        in.getArray(types);
+        in.getArray(statuses);
+        in.getArray(groupIds);
+        in.getArray(timestamps);
+        in.getArray(shareBegin);
+        in.getArray(shareCount);
+        in.getArray(descriptionBegin);
+        in.getArray(descriptionLength);
+        in.getArray(shareUsers);
+        in.getArray(shareAmounts);
+        in.getArray(descriptions);
+        in.getArray(rows);
+        in.getArray(freeRows);
+        if (!sharePool.load(in) || !descriptionPool.load(in))
+            return false;
+        size_t count = payers.size();
+        if (amounts.size() != count || currencies.size() != count || types.size() != count || statuses.size() != count ||
+            groupIds.size() != count || timestamps.size() != count || shareBegin.size() != count ||
+            shareCount.size() != count || descriptionBegin.size() != count || descriptionLength.size() != count ||
+            freeRows.size() > count || shareAmounts.size() != shareUsers.size())
+            return false;
+        for (uint32_t row : rows)
+        {
+            if (row != NO_ROW && row >= count)
+                return false;
+        }
+        return true;
+    }
+
+    static vector<Money> &scratchAmounts(size_t count)
+    {
+        static thread_local vector<Money> values;
+        if (values.size() < count)
+            values.resize(count);
+        return values;
+    }
+
+public:
+    // EQUAL expenses are split right away; EXACT/PERCENT wait for their shares
+    ExpenseId add(string_view description, UserId payer, Money amount, CurrencyId currency, ExpenseType type, Span<UserId> participants, GroupId group, int64_t timestamp)
+    {
+        ExpenseId id = append(description, payer, amount, currency, type, group, timestamp, participants.size());
+        uint32_t row = rowOf(id);
+        copy(participants.begin(), participants.end(), shareUsers.begin() + shareBegin[row]);
+        if (type == ExpenseType::EQUAL && !participants.empty())
+        {
+            // 100.00 / 3 is 33.34, 33.33, 33.33
+            Money::splitEqual(amount, participants.size(), &shareAmounts[shareBegin[row]]);
+            statuses[row] = ExpenseStatus::SHARES_SET;
+        }
+        return id;
+    }
+
+    // Shares already computed and validated elsewhere (bulk import)
+    ExpenseId addWithShares(string_view description, UserId payer, Money amount, CurrencyId currency, ExpenseType type, const pair<UserId, Money> *shares, size_t count, GroupId group, int64_t timestamp)
+    {
+        ExpenseId id = append(description, payer, amount, currency, type, group, timestamp, count);
+        uint32_t row = rowOf(id);
+        for (size_t i = 0; i < count; i++)
+        {
+            shareUsers[shareBegin[row] + i] = shares[i].first;
+            shareAmounts[shareBegin[row] + i] = shares[i].second;
+        }
+        statuses[row] = ExpenseStatus::SHARES_SET;
+        return id;
+    }
+
+    // Shares as separate columns; also computed and validated elsewhere
+    ExpenseId addWithShares(string_view description, UserId payer, Money amount, CurrencyId currency, ExpenseType type, Span<UserId> users, Span<Money> values, GroupId group, int64_t timestamp)
+    {
+        ExpenseId id = append(description, payer, amount, currency, type, group, timestamp, users.size());
+        uint32_t row = rowOf(id);
+        writeShares(row, users.data(), values.data(), users.size());
+        return id;
+    }
+
+    // Within Money::MAX_EXPENSE_CENTS either way
+    static bool isExpenseAmount(Money amount)
+    {
+        return amount.getCents() >= -Money::MAX_EXPENSE_CENTS && amount.getCents() <= Money::MAX_EXPENSE_CENTS;
+    }
+
+    // Share amounts for 'count' participants from raw values: cents for EXACT,
+    // basis points for PERCENT, unused for EQUAL. False unless the amount is
+    // an expense amount, every value is in range and they add up to the
+    // total (or to 100%).
+    static bool splitShares(Money amount, ExpenseType type, const int64_t *values, size_t count, Money *out)
+    {
+        if (count == 0 || !isExpenseAmount(amount))
+            return false;
+        if (type == ExpenseType::EQUAL)
+        {
+            Money::splitEqual(amount, count, out);
+            return true;
+        }
+        int64_t limit = type == ExpenseType::EXACT ? amount.getCents() : Money::FULL_BASIS_POINTS;
+        int64_t sum = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (values[i] < 0 || values[i] > limit)
+                return false;
+            sum += values[i];
+        }
+        if (sum != limit)
+            return false;
+        if (type == ExpenseType::EXACT)
+        {
+            for (size_t i = 0; i < count; i++)
+                out[i] = Money(values[i]);
+            return true;
+        }
+        vector<int32_t> basisPoints(values, values + count);
+        Money::splitByBasisPoints(amount, basisPoints.data(), count, out);
+        return true;
+    }
+
+    // EXACT: the shares must add up to the total to the cent
+    bool setExactShares(ExpenseId id, const vector<pair<UserId, Money>> &exact)
+    {
+        Money sum;
+        vector<UserId> users;
+        vector<Money> values;
+        users.reserve(exact.size());
+        values.reserve(exact.size());
+        for (const auto &share : exact)
+        {
+            sum += share.second;
+            users.push_back(share.first);
+            values.push_back(share.second);
+        }
+        if (sum != getAmount(id))
+            return false;
+
+        writeShares(rowOf(id), users.data(), values.data(), users.size());
+        return true;
+    }
+
+    // PERCENT: basis points (33.33% = 3333) must add up to 100%
+    bool setPercentShares(ExpenseId id, const vector<pair<UserId, int32_t>> &percents)
+    {
+        int64_t sum = 0;
+        vector<UserId> users;
+        vector<int32_t> basisPoints;
+        users.reserve(percents.size());
+        basisPoints.reserve(percents.size());
+        for (const auto &percent : percents)
+        {
+            if (percent.second < 0)
+                return false;
+            sum += percent.second;
+            users.push_back(percent.first);
+            basisPoints.push_back(percent.second);
+        }
+        if (sum != Money::FULL_BASIS_POINTS)
+            return false;
+
+        vector<Money> &values = scratchAmounts(users.size());
+        Money::splitByBasisPoints(getAmount(id), basisPoints.data(), users.size(), values.data());
+        writeShares(rowOf(id), users.data(), values.data(), users.size());
+        return true;
+    }
+
+    // Everything but the description, with shares computed and validated
+    // elsewhere; an edit
+    void replace(ExpenseId id, UserId payer, Money amount, CurrencyId currency, ExpenseType type, GroupId group, int64_t timestamp, Span<UserId> users, Span<Money> values)
+    {
+        uint32_t row = rowOf(id);
+        payers[row] = payer;
+        amounts[row] = amount;
+        currencies[row] = currency;
+        types[row] = type;
+        groupIds[row] = group;
+        timestamps[row] = timestamp;
+        writeShares(row, users.data(), values.data(), users.size());
+    }
+
+    // The id is never handed out again; its row and arena space are, to
+    // later expenses
+    void remove(ExpenseId id)
+    {
+        uint32_t row = rowOf(id);
+        sharePool.give(shareBegin[row], shareCount[row]);
+        descriptionPool.give(descriptionBegin[row], descriptionLength[row]);
+        shareCount[row] = 0;
+        descriptionLength[row] = 0;
+        statuses[row] = ExpenseStatus::DELETED;
+        freeRows.push_back(row);
+        rows[id] = NO_ROW;
+    }
+
+    // Ids handed out so far, deleted ones included
+    size_t size() const { return rows.size(); }
+
+    // Expenses not deleted
+    size_t liveCount() const { return payers.size() - freeRows.size(); }
+
+    // Only an expense that exists may be read
+    bool contains(ExpenseId id) const { return id < rows.size() && rows[id] != NO_ROW; }
+
+    UserId getPaidBy(ExpenseId id) const { return payers[rowOf(id)]; }
+
+    Money getAmount(ExpenseId id) const { return amounts[rowOf(id)]; }
+
+    CurrencyId getCurrency(ExpenseId id) const { return currencies[rowOf(id)]; }
+
+    ExpenseType getType(ExpenseId id) const { return types[rowOf(id)]; }
+
+    GroupId getGroupId(ExpenseId id) const { return groupIds[rowOf(id)]; }
+
+    int64_t getTimestamp(ExpenseId id) const { return timestamps[rowOf(id)]; }
+
+    string_view getDescription(ExpenseId id) const
+    {
+        uint32_t row = rowOf(id);
+        return string_view(descriptions).substr(descriptionBegin[row], descriptionLength[row]);
+    }
+
+    Span<UserId> getParticipants(ExpenseId id) const
+    {
+        uint32_t row = rowOf(id);
+        return Span<UserId>(shareUsers.data() + shareBegin[row], shareCount[row]);
+    }
+
+    // Empty until an EXACT/PERCENT expense gets its shares
+    Span<Money> getShareAmounts(ExpenseId id) const
+    {
+        uint32_t row = rowOf(id);
+        if (statuses[row] != ExpenseStatus::SHARES_SET)
+            return Span<Money>();
+        return Span<Money>(shareAmounts.data() + shareBegin[row], shareCount[row]);
+    }
+
+    size_t memoryBytes() const
+    {
+        return (rows.capacity() + freeRows.capacity()) * sizeof(uint32_t) +
+               payers.capacity() * sizeof(UserId) + amounts.capacity() * sizeof(Money) + currencies.capacity() +
+               types.capacity() * sizeof(ExpenseType) + statuses.capacity() + groupIds.capacity() * sizeof(GroupId) +
+               timestamps.capacity() * sizeof(int64_t) + shareBegin.capacity() * sizeof(uint64_t) +
+               shareCount.capacity() * sizeof(uint32_t) + descriptionBegin.capacity() * sizeof(uint64_t) +
+               descriptionLength.capacity() * sizeof(uint32_t) + shareUsers.capacity() * sizeof(UserId) +
+               shareAmounts.capacity() * sizeof(Money) + descriptions.capacity() + sharePool.memoryBytes() +
+               descriptionPool.memoryBytes();
+    }
+
+    // Arena entries given up for good: left by deletes and edits, too long to pool
+    size_t getStaleShares() const { return sharePool.getStale(); }
+
+    // Arena entries free for the next expense of the same size
+    size_t getPooledShares() const { return sharePool.getPooled(); }
+
+    void save(BinaryWriter &out) const
+    {
+        out.putArray(payers);
+        out.putArray(amounts);
+        out.putArray(currencies);
+        out.putArray(types);
+        out.putArray(statuses);
+        out.putArray(groupIds);
+        out.putArray(timestamps);
+        out.putArray(shareBegin);
+        out.putArray(shareCount);
+        out.putArray(descriptionBegin);
+        out.putArray(descriptionLength);
+        out.putArray(shareUsers);
+        out.putArray(shareAmounts);
+        out.putArray(descriptions);
+        out.putArray(rows);
+        out.putArray(freeRows);
+        sharePool.save(out);
+        descriptionPool.save(out);
+    }
+
+    // Replaces the contents with what save() wrote. Older stores ('withRows'
+    // false) had a row per id and descriptions back to back; stores saved
+    // before expenses had currencies are all in the home currency.
+    bool load(BinaryReader &in, bool withCurrencies, bool withRows)
+    {
+        if (withRows)
+            return loadRows(in);
+        in.getArray(payers);
+        in.getArray(amounts);
+        in.getArray(types);
+        in.getArray(statuses);
+        in.getArray(groupIds);
+        in.getArray(timestamps);
+        in.getArray(shareBegin);
+        in.getArray(shareCount);
+        vector<uint64_t> descriptionEnd; // a text started where the previous one ended
+        in.getArray(descriptionEnd);
+        in.getArray(shareUsers);
+        in.getArray(shareAmounts);
+        in.getArray(descriptions);
+        uint64_t staleShares = in.get<uint64_t>();
+        size_t count = payers.size();
+        if (withCurrencies)
+            in.getArray(currencies);
+        else
+            currencies.assign(count, HOME_CURRENCY);
+        if (!in.ok() || amounts.size() != count || currencies.size() != count || types.size() != count || statuses.size() != count ||
+            groupIds.size() != count || timestamps.size() != count || shareBegin.size() != count ||
+            shareCount.size() != count || descriptionEnd.size() != count || shareAmounts.size() != shareUsers.size())
+            return false;
+
+        descriptionBegin.resize(count);
+        descriptionLength.resize(count);
+        rows.resize(count);
+        freeRows.clear();
+        sharePool.reset(staleShares);
+        descriptionPool.reset(0);
+        for (size_t row = 0; row < count; row++)
+        {
+            descriptionBegin[row] = row ? descriptionEnd[row - 1] : 0;
+            descriptionLength[row] = descriptionEnd[row] - descriptionBegin[row];
+            rows[row] = row;
+        }
+        // Deleted expenses free their rows, lowest reused first
+        for (size_t row = count; row-- > 0;)
+        {
+            if (statuses[row] != ExpenseStatus::DELETED)
+                continue;
+            descriptionPool.give(descriptionBegin[row], descriptionLength[row]);
+            descriptionLength[row] = 0;
+            rows[row] = NO_ROW;
+            freeRows.push_back(row);
+        }
+        return true;
+    }
+};
+
+#endif // EXPENSESTORE_H
@@ -0,0 +1,571 @@
+#ifndef EXPENSETIMELINE_H
+#define EXPENSETIMELINE_H
+
+#include <bits/stdc++.h>
+#include "User.cpp"
+#include "ExpenseStore.cpp"
+#include "BinaryIO.cpp"
+using namespace std;
+
+// What a user paid and owed over a stretch of time, in one currency
+struct Statement
+{
+    Money paid;          // expenses the user paid for
+    Money owed;          // the user's own shares
+    size_t expenses = 0; // paid for or shared
+
+    // Positive: the others owe the user
+    Money net() const { return paid - owed; }
+};
+
+// Expenses by calendar month (UTC), for the whole system and for each user.
+// A user's months carry running totals of what they paid and owed, so a
+// statement for [from, to) is the difference of two running totals, and only
+// the expenses inside the two edge months are read one by one. Within a
+// month expenses are kept in (timestamp, id) order. Each currency keeps its
+// own user timelines, so running totals never mix currencies.
+//
+// The system-wide log of a month is split into runs of up to 2 * RUN_SIZE
+// ids, so adding or removing an old expense moves one run, not the month.
+// A user's entries stay in one array: an edit that adds or drops a user
+// moves only that user's later entries and months.
+//
+// Reads shares from the store, so every change to an expense's payer or
+// shares goes remove(id), change the store, add(id).
+class ExpenseTimeline
+{
+    static const size_t RUN_SIZE = 512;
+
+    struct Month
+    {
+        int32_t month; // months since January 1970
+        uint32_t end;  // one past the month's last entry in 'ids'
+        Money paid;    // running totals through the end of the month
+        Money owed;
+    };
+
+    struct UserTimeline
+    {
+        vector<Month> months;
+        vector<ExpenseId> ids;        // every month's entries, back to back
+        int64_t latest = INT64_MIN;   // timestamp of ids.back(), so appends need not look it up
+    };
+
+    // What one user paid and owed in one expense
+    struct Contribution
+    {
+        UserId user;
+        Money paid;
+        Money owed;
+    };
+
+    // One month's expenses, the runs back to back in (timestamp, id) order;
+    // no run is empty
+    struct MonthLog
+    {
+        vector<vector<ExpenseId>> runs;
+        size_t count = 0;
+    };
+
+    const ExpenseStore &store;
+    vector<vector<UserTimeline>> timelines; // [currency][user]
+    map<int32_t, MonthLog> byMonth;         // every expense
+    int32_t currentMonth;                   // the month most expenses land in, and its log
+    MonthLog *currentLog;
+    vector<Contribution> scratch;
+    vector<Contribution> edited; // between beginEdit and finishEdit
+
+    bool earlier(ExpenseId a, ExpenseId b) const
+    {
+        int64_t first = store.getTimestamp(a), second = store.getTimestamp(b);
+        return first < second || (first == second && a < b);
+    }
+
+    // Where 'id' goes in a sorted run; nearly always the end
+    ExpenseId *insertionPoint(ExpenseId *first, ExpenseId *last, ExpenseId id) const
+    {
+        if (first == last || earlier(last[-1], id))
+            return last;
+        return upper_bound(first, last, id, [this](ExpenseId a, ExpenseId b)
+                           { return earlier(a, b); });
+    }
+
+    ExpenseId *find(ExpenseId *first, ExpenseId *last, ExpenseId id) const
+    {
+        ExpenseId *at = lower_bound(first, last, id, [this](ExpenseId a, ExpenseId b)
+                                    { return earlier(a, b); });
+        return at != last && *at == id ? at : nullptr;
+    }
+
+    // The run 'id' belongs in: the first that ends after it, else the last
+    size_t runOf(const MonthLog &log, ExpenseId id) const
+    {
+        size_t run = partition_point(log.runs.begin(), log.runs.end(), [&](const vector<ExpenseId> &ids)
+                                     { return earlier(ids.back(), id); }) -
+                     log.runs.begin();
+        return min(run, log.runs.size() - 1);
+    }
+
+    void insertInto(MonthLog &log, ExpenseId id)
+    {
+        log.count++;
+        if (log.runs.empty() || (earlier(log.runs.back().back(), id) && log.runs.back().size() >= RUN_SIZE))
+        {
+            log.runs.emplace_back();
+            log.runs.back().reserve(RUN_SIZE);
+            log.runs.back().push_back(id);
+            return;
+        }
+        size_t run = runOf(log, id);
+        vector<ExpenseId> &ids = log.runs[run];
+        ids.insert(ids.begin() + (insertionPoint(ids.data(), ids.data() + ids.size(), id) - ids.data()), id);
+        if (ids.size() > 2 * RUN_SIZE)
+        {
+            vector<ExpenseId> upper(ids.begin() + RUN_SIZE, ids.end());
+            ids.resize(RUN_SIZE);
+            log.runs.insert(log.runs.begin() + run + 1, move(upper));
+        }
+    }
+
+    bool eraseFrom(MonthLog &log, ExpenseId id)
+    {
+        if (log.runs.empty())
+            return false;
+        size_t run = runOf(log, id);
+        vector<ExpenseId> &ids = log.runs[run];
+        ExpenseId *at = find(ids.data(), ids.data() + ids.size(), id);
+        if (!at)
+            return false;
+        ids.erase(ids.begin() + (at - ids.data()));
+        if (ids.empty())
+            log.runs.erase(log.runs.begin() + run);
+        log.count--;
+        return true;
+    }
+
+    // Payer and participants once each
+    void contributions(ExpenseId id, vector<Contribution> &out) const
+    {
+        out.clear();
+        Span<UserId> participants = store.getParticipants(id);
+        Span<Money> amounts = store.getShareAmounts(id);
+        Money total;
+        for (size_t i = 0; i < participants.size(); i++)
+        {
+            Money owed = amounts.empty() ? Money() : amounts[i];
+            out.push_back(Contribution{participants[i], Money(), owed});
+            total += owed;
+        }
+        out.push_back(Contribution{store.getPaidBy(id), total, Money()});
+
+        sort(out.begin(), out.end(), [](const Contribution &a, const Contribution &b)
+             { return a.user < b.user; });
+        size_t kept = 0;
+        for (size_t i = 0; i < out.size(); i++)
+        {
+            if (kept && out[kept - 1].user == out[i].user)
+            {
+                out[kept - 1].paid += out[i].paid;
+                out[kept - 1].owed += out[i].owed;
+            }
+            else
+            {
+                out[kept++] = out[i];
+            }
+        }
+        out.resize(kept);
+    }
+
+    // One user's part in one expense, for the edge months of a statement
+    void addContribution(ExpenseId id, UserId user, Statement &totals, int sign) const
+    {
+        Span<UserId> participants = store.getParticipants(id);
+        Span<Money> amounts = store.getShareAmounts(id);
+        bool payer = store.getPaidBy(id) == user;
+        for (size_t i = 0; i < amounts.size(); i++)
+        {
+            if (payer)
+                totals.paid += sign > 0 ? amounts[i] : -amounts[i];
+            if (participants[i] == user)
+                totals.owed += sign > 0 ? amounts[i] : -amounts[i];
+        }
+    }
+
+    // Index of the user's entry for 'month', created if missing
+    static size_t monthSlot(UserTimeline &timeline, int32_t month)
+    {
+        vector<Month> &months = timeline.months;
+        if (months.empty() || months.back().month < month)
+        {
+            Month added{month, uint32_t(timeline.ids.size()), Money(), Money()};
+            if (!months.empty())
+            {
+                added.paid = months.back().paid;
+                added.owed = months.back().owed;
+            }
+            months.push_back(added);
+            return months.size() - 1;
+        }
+        auto at = lower_bound(months.begin(), months.end(), month, [](const Month &entry, int32_t value)
+                              { return entry.month < value; });
+        if (at->month != month)
+        {
+            // Backdated: opens with the previous month's running totals
+            Month added{month, 0, Money(), Money()};
+            if (at != months.begin())
+                added = Month{month, at[-1].end, at[-1].paid, at[-1].owed};
+            at = months.insert(at, added);
+        }
+        return at - months.begin();
+    }
+
+    const UserTimeline *timelineOf(CurrencyId currency, UserId user) const
+    {
+        if (currency >= timelines.size() || user >= timelines[currency].size())
+            return nullptr;
+        return &timelines[currency][user];
+    }
+
+    void post(CurrencyId currency, UserId user, ExpenseId id, int64_t timestamp, int32_t month, Money paid, Money owed)
+    {
+        if (timelines.size() <= currency)
+            timelines.resize(currency + 1);
+        vector<UserTimeline> &users = timelines[currency];
+        if (users.size() <= user)
+            users.resize(user + 1);
+        UserTimeline &timeline = users[user];
+        if (timeline.ids.empty())
+            timeline.ids.reserve(8);
+        bool newest = timestamp > timeline.latest || (timestamp == timeline.latest && !timeline.ids.empty() && id > timeline.ids.back());
+        // (an edit can leave an emptied month after the newest entry)
+        if (newest && (timeline.months.empty() || month >= timeline.months.back().month))
+        {
+            monthSlot(timeline, month);
+            Month &last = timeline.months.back();
+            last.end++;
+            last.paid += paid;
+            last.owed += owed;
+            timeline.ids.push_back(id);
+            timeline.latest = timestamp;
+            return;
+        }
+        size_t slot = monthSlot(timeline, month);
+        ExpenseId *first = timeline.ids.data() + (slot ? timeline.months[slot - 1].end : 0);
+        ExpenseId *at = insertionPoint(first, timeline.ids.data() + timeline.months[slot].end, id);
+        timeline.ids.insert(timeline.ids.begin() + (at - timeline.ids.data()), id);
+        for (size_t i = slot; i < timeline.months.size(); i++)
+        {
+            timeline.months[i].end++;
+            timeline.months[i].paid += paid;
+            timeline.months[i].owed += owed;
+        }
+    }
+
+    void unpost(CurrencyId currency, UserId user, ExpenseId id, int32_t month, Money paid, Money owed)
+    {
+        if (!timelineOf(currency, user))
+            return;
+        UserTimeline &timeline = timelines[currency][user];
+        vector<Month> &months = timeline.months;
+        auto entry = lower_bound(months.begin(), months.end(), month, [](const Month &existing, int32_t value)
+                                 { return existing.month < value; });
+        if (entry == months.end() || entry->month != month)
+            return;
+        size_t slot = entry - months.begin();
+        ExpenseId *first = timeline.ids.data() + (slot ? months[slot - 1].end : 0);
+        ExpenseId *at = find(first, timeline.ids.data() + months[slot].end, id);
+        if (!at)
+            return;
+        timeline.ids.erase(timeline.ids.begin() + (at - timeline.ids.data()));
+        for (size_t i = slot; i < months.size(); i++)
+        {
+            months[i].end--;
+            months[i].paid -= paid;
+            months[i].owed -= owed;
+        }
+        if (timeline.ids.empty())
+            timeline.latest = INT64_MIN;
+        else
+            timeline.latest = store.getTimestamp(timeline.ids.back());
+    }
+
+    // Running totals only: the user's entry for the expense stays where it is
+    void shift(CurrencyId currency, UserId user, int32_t month, Money paid, Money owed)
+    {
+        if (!timelineOf(currency, user))
+            return;
+        vector<Month> &months = timelines[currency][user].months;
+        auto entry = lower_bound(months.begin(), months.end(), month, [](const Month &existing, int32_t value)
+                                 { return existing.month < value; });
+        for (; entry != months.end(); ++entry)
+        {
+            entry->paid += paid;
+            entry->owed += owed;
+        }
+    }
+
+public:
+    explicit ExpenseTimeline(const ExpenseStore &store) : store(store), currentMonth(0), currentLog(nullptr) {}
+
+    ExpenseTimeline(const ExpenseTimeline &) = delete;
+    ExpenseTimeline &operator=(const ExpenseTimeline &) = delete;
+
+    // Months since January 1970 of a Unix time, in UTC
+    static int32_t monthOf(int64_t seconds)
+    {
+        int64_t days = seconds / 86400 - (seconds % 86400 < 0);
+        // Civil date from a day count (H. Hinnant's algorithm)
+        days += 719468;
+        int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        int64_t dayOfEra = days - era * 146097;
+        int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        int64_t shifted = (5 * dayOfYear + 2) / 153; // March is 0
+        int64_t month = shifted < 10 ? shifted + 3 : shifted - 9;
+        int64_t year = yearOfEra + era * 400 + (month <= 2);
+        return int32_t((year - 1970) * 12 + month - 1);
+    }
+
+    // The expense, as the store has it now
+    void add(ExpenseId id)
+    {
+        int64_t timestamp = store.getTimestamp(id);
+        int32_t month = monthOf(timestamp);
+        if (!currentLog || month != currentMonth)
+        {
+            currentMonth = month;
+            currentLog = &byMonth[month];
+        }
+        insertInto(*currentLog, id);
+        contributions(id, scratch);
+        CurrencyId currency = store.getCurrency(id);
+        for (const Contribution &part : scratch)
+        {
+            post(currency, part.user, id, timestamp, month, part.paid, part.owed);
+        }
+    }
+
+    // Starts over from every expense in the store
+    void rebuild()
+    {
+        timelines.clear();
+        byMonth.clear();
+        currentLog = nullptr;
+        for (ExpenseId id = 0; id < store.size(); id++)
+        {
+            if (store.contains(id))
+                add(id);
+        }
+    }
+
+    // Undoes add(id); the store must still hold what it held then
+    void remove(ExpenseId id)
+    {
+        int32_t month = monthOf(store.getTimestamp(id));
+        auto log = byMonth.find(month);
+        if (log == byMonth.end() || !eraseFrom(log->second, id))
+            return;
+        contributions(id, scratch);
+        CurrencyId currency = store.getCurrency(id);
+        for (const Contribution &part : scratch)
+        {
+            unpost(currency, part.user, id, month, part.paid, part.owed);
+        }
+    }
+
+    // An edit that keeps the expense's timestamp and currency: beginEdit(id)
+    // before the store changes it, finishEdit(id) after. Users in it before
+    // and after keep their entries and only their running totals move, so
+    // the month's log and their id lists are left alone.
+    void beginEdit(ExpenseId id)
+    {
+        contributions(id, edited);
+    }
+
+    void finishEdit(ExpenseId id)
+    {
+        int64_t timestamp = store.getTimestamp(id);
+        int32_t month = monthOf(timestamp);
+        CurrencyId currency = store.getCurrency(id);
+        contributions(id, scratch);
+        // Both sorted by user
+        size_t before = 0, after = 0;
+        while (before < edited.size() || after < scratch.size())
+        {
+            if (after == scratch.size() || (before < edited.size() && edited[before].user < scratch[after].user))
+            {
+                const Contribution &part = edited[before++];
+                unpost(currency, part.user, id, month, part.paid, part.owed);
+            }
+            else if (before == edited.size() || scratch[after].user < edited[before].user)
+            {
+                const Contribution &part = scratch[after++];
+                post(currency, part.user, id, timestamp, month, part.paid, part.owed);
+            }
+            else
+            {
+                const Contribution &was = edited[before++], &now = scratch[after++];
+                shift(currency, now.user, month, now.paid - was.paid, now.owed - was.owed);
+            }
+        }
+    }
+
+    // The user's totals over every expense in 'currency' timestamped before 't'
+    Statement before(UserId user, CurrencyId currency, int64_t t) const
+    {
+        Statement totals;
+        if (!timelineOf(currency, user))
+            return totals;
+        const UserTimeline &timeline = timelines[currency][user];
+        const vector<Month> &months = timeline.months;
+        int32_t month = monthOf(t);
+        size_t slot = lower_bound(months.begin(), months.end(), month, [](const Month &entry, int32_t value)
+                                  { return entry.month < value; }) -
+                      months.begin();
+        if (slot > 0)
+            totals = Statement{months[slot - 1].paid, months[slot - 1].owed, months[slot - 1].end};
+        if (slot == months.size() || months[slot].month != month)
+            return totals;
+
+        // 't' falls inside this month: read whichever side of it is shorter
+        const ExpenseId *first = timeline.ids.data() + totals.expenses;
+        const ExpenseId *last = timeline.ids.data() + months[slot].end;
+        const ExpenseId *cut = partition_point(first, last, [&](ExpenseId id)
+                                               { return store.getTimestamp(id) < t; });
+        if (cut - first <= last - cut)
+        {
+            for (const ExpenseId *id = first; id < cut; id++)
+                addContribution(*id, user, totals, 1);
+        }
+        else
+        {
+            totals.paid = months[slot].paid;
+            totals.owed = months[slot].owed;
+            for (const ExpenseId *id = cut; id < last; id++)
+                addContribution(*id, user, totals, -1);
+        }
+        totals.expenses = cut - timeline.ids.data();
+        return totals;
+    }
+
+    // The user's totals over expenses in 'currency' timestamped in [from, to)
+    Statement statement(UserId user, CurrencyId currency, int64_t from, int64_t to) const
+    {
+        if (from >= to)
+            return Statement();
+        Statement end = before(user, currency, to);
+        Statement start = before(user, currency, from);
+        return Statement{end.paid - start.paid, end.owed - start.owed, end.expenses - start.expenses};
+    }
+
+    // Calls f(id) for every expense timestamped in [from, to), oldest first
+    template <class F>
+    void forEachBetween(int64_t from, int64_t to, F f) const
+    {
+        if (from >= to)
+            return;
+        int32_t lastMonth = monthOf(to - 1);
+        for (auto log = byMonth.lower_bound(monthOf(from)); log != byMonth.end() && log->first <= lastMonth; ++log)
+        {
+            const vector<vector<ExpenseId>> &runs = log->second.runs;
+            auto run = partition_point(runs.begin(), runs.end(), [&](const vector<ExpenseId> &ids)
+                                       { return store.getTimestamp(ids.back()) < from; });
+            for (; run != runs.end() && store.getTimestamp(run->front()) < to; ++run)
+            {
+                auto first = partition_point(run->begin(), run->end(), [&](ExpenseId id)
+                                             { return store.getTimestamp(id) < from; });
+                auto last = partition_point(first, run->end(), [&](ExpenseId id)
+                                            { return store.getTimestamp(id) < to; });
+                for (auto id = first; id != last; ++id)
+                    f(*id);
+            }
+        }
+    }
+
+    void save(BinaryWriter &out) const
+    {
+        out.put<uint64_t>(byMonth.size());
+        for (const auto &log : byMonth)
+        {
+            // One array per month, as if the runs were never split
+            out.put(log.first);
+            out.put<uint64_t>(log.second.count);
+            for (const vector<ExpenseId> &ids : log.second.runs)
+                out.write(ids.data(), ids.size() * sizeof(ExpenseId));
+        }
+        out.put<uint64_t>(timelines.size());
+        for (const vector<UserTimeline> &users : timelines)
+        {
+            out.put<uint64_t>(users.size());
+            for (const UserTimeline &timeline : users)
+            {
+                out.putArray(timeline.months);
+                out.putArray(timeline.ids);
+                out.put(timeline.latest);
+            }
+        }
+    }
+
+    // Replaces the contents with what save() wrote
+    bool load(BinaryReader &in)
+    {
+        byMonth.clear();
+        currentLog = nullptr;
+        uint64_t count = in.get<uint64_t>();
+        if (!in.ok() || count > in.remaining())
+            return false;
+        vector<ExpenseId> ids;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            int32_t month = in.get<int32_t>();
+            if (!in.getArray(ids))
+                return false;
+            MonthLog &log = byMonth[month];
+            for (size_t at = 0; at < ids.size(); at += RUN_SIZE)
+                log.runs.emplace_back(ids.begin() + at, ids.begin() + min(ids.size(), at + RUN_SIZE));
+            log.count = ids.size();
+        }
+        count = in.get<uint64_t>();
+        if (!in.ok() || count > Currency::COUNT)
+            return false;
+        timelines.assign(count, vector<UserTimeline>());
+        for (vector<UserTimeline> &users : timelines)
+        {
+            count = in.get<uint64_t>();
+            if (!in.ok() || count > in.remaining())
+                return false;
+            users.assign(count, UserTimeline());
+            for (UserTimeline &timeline : users)
+            {
+                in.getArray(timeline.months);
+                in.getArray(timeline.ids);
+                timeline.latest = in.get<int64_t>();
+                if (!in.ok() || (!timeline.months.empty() && timeline.months.back().end != timeline.ids.size()))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    size_t memoryBytes() const
+    {
+        size_t bytes = 0;
+        for (const vector<UserTimeline> &users : timelines)
+        {
+            bytes += users.capacity() * sizeof(UserTimeline);
+            for (const UserTimeline &timeline : users)
+            {
+                bytes += timeline.months.capacity() * sizeof(Month) + timeline.ids.capacity() * sizeof(ExpenseId);
+            }
+        }
+        for (const auto &log : byMonth)
+        {
+            bytes += log.second.runs.capacity() * sizeof(vector<ExpenseId>) + 48; // plus the tree node
+            for (const vector<ExpenseId> &ids : log.second.runs)
+                bytes += ids.capacity() * sizeof(ExpenseId);
+        }
+        return bytes;
+    }
+};
+
+#endif // EXPENSETIMELINE_H
@@ -0,0 +1,110 @@
+#ifndef FXTABLE_H
+#define FXTABLE_H
+
+#include <bits/stdc++.h>
+#include "Money.cpp"
+#include "ExpenseStore.cpp"
+#include "Currency.cpp"
+#include "BinaryIO.cpp"
+using namespace std;
+
+// One published set of exchange rates. Immutable once built, so readers share
+// it without locking; every update builds the next version. The rate between
+// every pair of currencies is worked out up front, so a conversion is one
+// multiply and a round to the nearest hundredth.
+class FxTable
+{
+    static const size_t COUNT = Currency::COUNT;
+
+    uint64_t version;
+    array<double, COUNT> unitsPerHome;      // 0: no rate published yet
+    array<double, COUNT * COUNT> matrix;    // [from * COUNT + to]; 0 if either side has no rate
+
+    void build()
+    {
+        for (size_t from = 0; from < COUNT; from++)
+        {
+            for (size_t to = 0; to < COUNT; to++)
+            {
+                bool known = unitsPerHome[from] > 0 && unitsPerHome[to] > 0;
+                matrix[from * COUNT + to] = from == to ? 1 : known ? unitsPerHome[to] / unitsPerHome[from] : 0;
+            }
+        }
+    }
+
+    // Halves away from zero, as Money::fromDouble. copysign instead of a sign
+    // test: balances come in both signs at random, and a branch here
+    // mispredicts on half of them.
+    static int64_t round(double cents)
+    {
+        return int64_t(cents + copysign(0.5, cents));
+    }
+
+public:
+    // Version 0: only the home currency
+    FxTable() : version(0)
+    {
+        unitsPerHome.fill(0);
+        unitsPerHome[HOME_CURRENCY] = 1;
+        build();
+    }
+
+    // 'previous' with 'changes' (units of the currency per home unit) applied
+    FxTable(const FxTable &previous, const vector<pair<CurrencyId, double>> &changes)
+        : version(previous.version + 1), unitsPerHome(previous.unitsPerHome)
+    {
+        for (const auto &change : changes)
+        {
+            if (change.first != HOME_CURRENCY)
+                unitsPerHome[change.first] = change.second;
+        }
+        build();
+    }
+
+    uint64_t getVersion() const { return version; }
+
+    bool hasRate(CurrencyId currency) const { return unitsPerHome[currency] > 0; }
+
+    double rate(CurrencyId from, CurrencyId to) const { return matrix[from * COUNT + to]; }
+
+    Money convert(Money amount, CurrencyId from, CurrencyId to) const
+    {
+        if (from == to)
+            return amount;
+        return Money(round(amount.getCents() * rate(from, to)));
+    }
+
+    // Adds amounts[i] converted to out[i], for every i; one rate for the whole
+    // array and no branches in the loop, so it vectorizes. Each amount is
+    // rounded on its own, as convert() would.
+    void convertAdd(Span<Money> amounts, CurrencyId from, CurrencyId to, Money *out) const
+    {
+        if (from == to)
+        {
+            for (size_t i = 0; i < amounts.size(); i++)
+                out[i] += amounts[i];
+            return;
+        }
+        double factor = rate(from, to);
+        for (size_t i = 0; i < amounts.size(); i++)
+        {
+            out[i] += Money(round(amounts[i].getCents() * factor));
+        }
+    }
+
+    void save(BinaryWriter &out) const
+    {
+        out.put(version);
+        out.put(unitsPerHome);
+    }
+
+    bool load(BinaryReader &in)
+    {
+        version = in.get<uint64_t>();
+        unitsPerHome = in.get<array<double, COUNT>>();
+        build();
+        return in.ok();
+    }
+};
+
+#endif // FXTABLE_H
@@ -0,0 +1,203 @@
+#ifndef GROUP_H
+#define GROUP_H
+
+#include <bits/stdc++.h>
+#include "Money.cpp"
+#include "Currency.cpp"
+#include "NetRanking.cpp"
+#include "BinaryIO.cpp"
+using namespace std;
+
+// Dense internal id: index into SplitwiseSystem's group table
+using GroupId = uint32_t;
+const GroupId NO_GROUP = UINT32_MAX;
+
+// A trip/flat/etc. Keeps every member's net balance within the group up to
+// date on each expense, so summaries never rescan the group's expenses; one
+// set of nets per currency the group has spent in, ranked so the biggest
+// debtors and creditors come straight out. Membership and nets are guarded by
+// the group's own lock.
+class Group
+{
+    GroupId id;
+    string groupId; // external id, e.g. "G2"
+    string name;
+    vector<UserId> members;
+    vector<NetRanking> nets;                    // [currency]: slots are indexes into members; positive: the member is owed money
+    uint64_t spent;                             // bit per currency the group has spent in
+    unordered_map<UserId, uint32_t> memberSlot; // user → index into members, and slot in each nets[currency]
+    mutable mutex lock;
+
+    // Called with the lock held
+    NetRanking &netsIn(CurrencyId currency)
+    {
+        if (nets.size() <= currency)
+            nets.resize(currency + 1);
+        spent |= uint64_t(1) << currency;
+        return nets[currency];
+    }
+
+    // Called with the lock held
+    int64_t netOf(uint32_t slot, CurrencyId currency) const
+    {
+        return currency < nets.size() ? nets[currency].net(slot) : 0;
+    }
+
+public:
+    Group(GroupId id, const string &groupId, const string &name) : spent(0)
+    {
+        this->id = id;
+        this->groupId = groupId;
+        this->name = name;
+    }
+
+    GroupId getId() const { return id; }
+
+    const string &getGroupId() const { return groupId; }
+
+    const string &getName() const { return name; }
+
+    vector<UserId> getMembers() const
+    {
+        lock_guard<mutex> guard(lock);
+        return members;
+    }
+
+    bool isMember(UserId user) const
+    {
+        lock_guard<mutex> guard(lock);
+        return memberSlot.count(user) > 0;
+    }
+
+    void addMember(UserId user)
+    {
+        lock_guard<mutex> guard(lock);
+        if (memberSlot.count(user))
+            return;
+        memberSlot[user] = members.size();
+        members.push_back(user);
+    }
+
+    Money getNet(UserId user, CurrencyId currency) const
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = memberSlot.find(user);
+        return it != memberSlot.end() ? Money(netOf(it->second, currency)) : Money();
+    }
+
+    // Bit per currency the group has spent in
+    uint64_t getCurrencies() const
+    {
+        lock_guard<mutex> guard(lock);
+        return spent;
+    }
+
+    // 'debtor' now owes 'creditor' 'amount' more within this group
+    void addDebt(UserId creditor, UserId debtor, Money amount, CurrencyId currency)
+    {
+        addDebts(creditor, &debtor, &amount, 1, currency);
+    }
+
+    // debtors[i] now owes 'creditor' amounts[i] more, for every i, in one step
+    void addDebts(UserId creditor, const UserId *debtors, const Money *amounts, size_t count, CurrencyId currency)
+    {
+        lock_guard<mutex> guard(lock);
+        NetRanking &net = netsIn(currency);
+        int64_t credited = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (debtors[i] == creditor)
+                continue;
+            credited += amounts[i].getCents();
+            net.add(memberSlot.at(debtors[i]), -amounts[i].getCents());
+        }
+        net.add(memberSlot.at(creditor), credited);
+    }
+
+    // Every member with their net balance in 'currency', in join order
+    vector<pair<UserId, Money>> getNets(CurrencyId currency) const
+    {
+        lock_guard<mutex> guard(lock);
+        vector<pair<UserId, Money>> result;
+        result.reserve(members.size());
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            result.emplace_back(members[i], Money(netOf(i, currency)));
+        }
+        return result;
+    }
+
+    // The k members owed the most in 'currency' ('creditors'), or owing the
+    // most, with their nets, largest first; O(k log k)
+    vector<pair<UserId, Money>> top(size_t k, bool creditors, CurrencyId currency) const
+    {
+        lock_guard<mutex> guard(lock);
+        vector<pair<UserId, Money>> ranked;
+        if (currency >= nets.size())
+            return ranked;
+        const NetRanking *ranking = &nets[currency];
+        NetRanking::top(&ranking, 1, creditors, k, [&](uint32_t, uint32_t slot, int64_t net)
+                        { ranked.emplace_back(members[slot], Money(net)); });
+        return ranked;
+    }
+
+    void save(BinaryWriter &out) const
+    {
+        lock_guard<mutex> guard(lock);
+        out.put(id);
+        out.putString(groupId);
+        out.putString(name);
+        out.putArray(members);
+        out.put<uint64_t>(nets.size());
+        vector<Money> values;
+        for (size_t c = 0; c < nets.size(); c++)
+        {
+            values.clear();
+            if (spent & (uint64_t(1) << c))
+            {
+                for (size_t i = 0; i < members.size(); i++)
+                    values.push_back(Money(nets[c].net(i)));
+            }
+            out.putArray(values);
+        }
+    }
+
+    // Replaces the contents with what save() wrote. Groups saved before
+    // expenses had currencies hold one set of nets, in the home currency.
+    bool load(BinaryReader &in, bool perCurrency)
+    {
+        lock_guard<mutex> guard(lock);
+        id = in.get<GroupId>();
+        groupId = in.getString();
+        name = in.getString();
+        in.getArray(members);
+        uint64_t count = perCurrency ? in.get<uint64_t>() : 1;
+        if (!in.ok() || count > Currency::COUNT)
+            return false;
+        nets.assign(count, NetRanking());
+        spent = 0;
+        vector<Money> values;
+        vector<int64_t> cents;
+        for (size_t c = 0; c < count; c++)
+        {
+            in.getArray(values);
+            if (values.empty())
+                continue;
+            if (values.size() != members.size())
+                return false;
+            cents.clear();
+            for (Money value : values)
+                cents.push_back(value.getCents());
+            nets[c].assign(cents);
+            spent |= uint64_t(1) << c;
+        }
+        if (!in.ok())
+            return false;
+        memberSlot.clear();
+        for (size_t i = 0; i < members.size(); i++)
+            memberSlot[members[i]] = i;
+        return true;
+    }
+};
+
+#endif // GROUP_H
@@ -0,0 +1,169 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "BinaryIO.cpp"
+using namespace std;
+
+// What a journal record holds; the first byte of every payload
+enum class JournalRecord : uint8_t
+{
+    USER = 1,     // userId, name, email
+    GROUP,        // groupId, name, members
+    GROUP_MEMBER, // group, user
+    EXPENSE,      // payer, amount, type, group, timestamp, description, participants, currency
+    SHARES,       // expense, (user, cents or basis points) per share
+    SETTLE,       // expense
+    PAYMENT,      // group, from, to, amount, currency
+    IMPORTED,     // payer, amount, type, timestamp, description, (user, cents) per share, currency
+    EXPENSES,     // count, then per expense: payer, amount, type, group, timestamp, description, (user, cents) per share; then every currency
+    FX_RATES,     // (currency, units per home unit) per changed rate
+    EDIT,         // expense, payer, amount, type, group, timestamp, participants, share amounts, currency
+    DELETE        // expense
+};
+// Records written before expenses had currencies end where the currency
+// would start; replay reads those as the home currency.
+
+// Append-only log of state changes. Each record is
+//   u32 payloadLength | u32 crc32c(payload) | payload
+// Appends fill an in-memory batch; the append that fills it to batchBytes
+// writes and fsyncs it (as does sync()), so a crash loses at most the
+// records appended since the last sync.
+// A torn or corrupt record ends the log: replay stops there.
+// A failed write or fsync is latched: every later sync() reports it, since
+// the disk can no longer be trusted to hold what was acknowledged. Bytes a
+// failed write did not take stay queued and are tried again next sync.
+class Journal
+{
+    int fd;
+    mutex appendLock; // guards pending
+    mutex writeLock;  // one batch goes to disk at a time; taken before appendLock
+    string pending;
+    size_t batchBytes;
+    atomic<uint64_t> totalBytes; // on disk plus pending
+    atomic<uint64_t> syncs;
+    atomic<bool> failed;
+
+    static int openForAppend(const string &path)
+    {
+        return open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+
+public:
+    // Appends to 'path' (created if missing); a batch is due every 'batchBytes'
+    Journal(const string &path, size_t batchBytes) : fd(openForAppend(path)), batchBytes(batchBytes), totalBytes(0), syncs(0), failed(false)
+    {
+        struct stat info;
+        if (fd >= 0 && fstat(fd, &info) == 0)
+            totalBytes = info.st_size;
+    }
+
+    ~Journal()
+    {
+        sync();
+        if (fd >= 0)
+            close(fd);
+    }
+
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+
+    // False once a sync has failed; the record is still queued
+    bool append(string_view payload)
+    {
+        uint32_t header[2] = {uint32_t(payload.size()), Crc32c::extend(0, payload.data(), payload.size())};
+        bool due;
+        {
+            lock_guard<mutex> guard(appendLock);
+            pending.append(reinterpret_cast<const char *>(header), sizeof(header));
+            pending.append(payload.data(), payload.size());
+            totalBytes += sizeof(header) + payload.size();
+            due = pending.size() >= batchBytes;
+        }
+        return due ? sync() : !failed;
+    }
+
+    // Writes everything appended so far and waits for the disk; false if
+    // this or any earlier write or fsync failed
+    bool sync()
+    {
+        lock_guard<mutex> writing(writeLock);
+        string batch;
+        {
+            lock_guard<mutex> guard(appendLock);
+            batch.swap(pending);
+        }
+        if (fd < 0 || batch.empty())
+            return fd >= 0 && !failed;
+        const char *data = batch.data();
+        size_t length = batch.size();
+        while (length > 0)
+        {
+            ssize_t done = ::write(fd, data, length);
+            if (done < 0 && errno == EINTR)
+                continue;
+            if (done <= 0)
+            {
+                // Put back what the disk did not take, ahead of anything appended since
+                lock_guard<mutex> guard(appendLock);
+                pending.insert(0, data, length);
+                failed = true;
+                return false;
+            }
+            data += done;
+            length -= done;
+        }
+        syncs++;
+        if (fdatasync(fd) != 0)
+            failed = true;
+        return !failed;
+    }
+
+    bool hasFailed() const { return failed; }
+
+    // Continues in a new file; the old one is synced and closed first
+    bool rotate(const string &path)
+    {
+        sync();
+        lock_guard<mutex> writing(writeLock);
+        int next = openForAppend(path);
+        if (next < 0)
+            return false;
+        if (fd >= 0)
+            close(fd);
+        fd = next;
+        totalBytes = 0;
+        return true;
+    }
+
+    uint64_t size() const { return totalBytes; }
+
+    uint64_t getSyncs() const { return syncs; }
+
+    // Calls f(BinaryReader &payload) for each intact record in order and
+    // returns the length of the intact prefix
+    template <class F>
+    static size_t replay(const char *data, size_t length, F f)
+    {
+        size_t offset = 0;
+        uint32_t header[2];
+        while (length - offset >= sizeof(header))
+        {
+            memcpy(header, data + offset, sizeof(header));
+            const char *payload = data + offset + sizeof(header);
+            if (header[0] > length - offset - sizeof(header) || Crc32c::extend(0, payload, header[0]) != header[1])
+                break;
+            BinaryReader reader(payload, header[0]);
+            f(reader);
+            offset += sizeof(header) + header[0];
+        }
+        return offset;
+    }
+};
+
+#endif // JOURNAL_H
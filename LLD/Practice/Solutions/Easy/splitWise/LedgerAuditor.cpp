@@ -0,0 +1,97 @@
+#ifndef LEDGERAUDITOR_H
+#define LEDGERAUDITOR_H
+
+#include <bits/stdc++.h>
+using namespace std;
+
+// What one audit pass found. Indexes are the lowest that failed, or NONE.
+struct AuditReport
+{
+    static constexpr size_t NONE = SIZE_MAX;
+
+    bool ok = true;
+    size_t divergentShard = NONE;  // ledger shard whose tables disagree with its rolling checksum
+    size_t divergentStripe = NONE; // net stripe that does
+    bool netsBalance = true;       // every currency's nets added up to zero
+    size_t badExpense = NONE;      // ExpenseId whose shares do not add up to its amount
+    size_t shards = 0;             // checked
+    size_t pairs = 0;
+    size_t expenses = 0;
+    double seconds = 0;
+};
+
+// Runs audit passes on a thread of its own until stopped, pacing itself to a
+// share of one core: after a pass that took t it waits t × (1 / budget - 1),
+// so a budget of 0.01 costs about 1% of a core however big the ledger gets.
+// Keeps the latest report; 'onDivergence' hears about every failed one.
+class LedgerAuditor
+{
+    thread worker;
+    mutable mutex lock;
+    condition_variable wake;
+    bool stopping;
+    AuditReport latest;
+    size_t passes;
+
+public:
+    LedgerAuditor() : stopping(false), passes(0) {}
+
+    ~LedgerAuditor() { stop(); }
+
+    LedgerAuditor(const LedgerAuditor &) = delete;
+    LedgerAuditor &operator=(const LedgerAuditor &) = delete;
+
+    // Restarts it if it is already running
+    void start(double budget, function<AuditReport()> pass, function<void(const AuditReport &)> onDivergence)
+    {
+        stop();
+        budget = min(max(budget, 1e-6), 1.0);
+        worker = thread([this, budget, pass, onDivergence]
+                        {
+            unique_lock<mutex> guard(lock);
+            while (!stopping)
+            {
+                guard.unlock();
+                auto started = chrono::steady_clock::now();
+                AuditReport report = pass();
+                auto took = chrono::steady_clock::now() - started;
+                if (!report.ok && onDivergence)
+                    onDivergence(report);
+                guard.lock();
+                latest = report;
+                passes++;
+                wake.wait_for(guard, took * (1 / budget - 1), [this]
+                              { return stopping; });
+            } });
+    }
+
+    // Waits for a pass under way to finish
+    void stop()
+    {
+        if (!worker.joinable())
+            return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+        stopping = false;
+    }
+
+    bool running() const { return worker.joinable(); }
+
+    AuditReport lastReport() const
+    {
+        lock_guard<mutex> guard(lock);
+        return latest;
+    }
+
+    size_t passCount() const
+    {
+        lock_guard<mutex> guard(lock);
+        return passes;
+    }
+};
+
+#endif // LEDGERAUDITOR_H
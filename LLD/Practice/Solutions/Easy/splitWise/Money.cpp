@@ -0,0 +1,109 @@
+#ifndef MONEY_H
+#define MONEY_H
+
+#include <bits/stdc++.h>
+using namespace std;
+
+// Amount in minor units (cents). All arithmetic is integer so splits and
+// balances are exact and identical on every run.
+class Money
+{
+    int64_t cents;
+
+public:
+    static const int64_t CENTS_PER_UNIT = 100;
+    static const int32_t FULL_BASIS_POINTS = 10000; // 100.00%
+    // Largest expense amount, either sign: 9 trillion units. Thousands of
+    // expenses this big still add up to a balance that fits in 64 bits.
+    static const int64_t MAX_EXPENSE_CENTS = 900000000000000;
+
+    constexpr Money() : cents(0) {}
+    constexpr explicit Money(int64_t cents) : cents(cents) {}
+
+    // Rounds to the nearest cent, halves away from zero
+    static Money fromDouble(double amount)
+    {
+        return Money(llround(amount * CENTS_PER_UNIT));
+    }
+
+    // Percent with up to two decimals, e.g. 33.33 -> 3333
+    static int32_t toBasisPoints(double percent)
+    {
+        return int32_t(llround(percent * 100));
+    }
+
+    int64_t getCents() const { return cents; }
+
+    bool isZero() const { return cents == 0; }
+
+    Money operator+(Money other) const { return Money(cents + other.cents); }
+    Money operator-(Money other) const { return Money(cents - other.cents); }
+    Money operator-() const { return Money(-cents); }
+    Money &operator+=(Money other)
+    {
+        cents += other.cents;
+        return *this;
+    }
+    Money &operator-=(Money other)
+    {
+        cents -= other.cents;
+        return *this;
+    }
+    bool operator==(Money other) const { return cents == other.cents; }
+    bool operator!=(Money other) const { return cents != other.cents; }
+    bool operator<(Money other) const { return cents < other.cents; }
+
+    string toString() const
+    {
+        int64_t whole = cents / CENTS_PER_UNIT;
+        int64_t fraction = llabs(cents % CENTS_PER_UNIT);
+        string text = (cents < 0 && whole == 0) ? "-" : "";
+        text += to_string(whole);
+        text += '.';
+        text += char('0' + fraction / 10);
+        text += char('0' + fraction % 10);
+        return text;
+    }
+
+    // Splits 'total' into 'count' shares; the leftover cents go one each to the
+    // first shares, so 100.00 / 3 is 33.34, 33.33, 33.33. Branch-free so the
+    // loop vectorizes.
+    static void splitEqual(Money total, size_t count, Money *out)
+    {
+        int64_t base = total.cents / int64_t(count);
+        int64_t remainder = total.cents - base * int64_t(count); // same sign as total
+        int64_t step = remainder < 0 ? -1 : 1;
+        size_t extra = size_t(llabs(remainder));
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i].cents = base + (i < extra ? step : 0);
+        }
+    }
+
+    // Splits 'total' by basis points that sum to FULL_BASIS_POINTS. Each share is
+    // rounded down; the leftover cents go one each to the first shares.
+    // total * basisPoints is taken in 128 bits, so any total splits exactly.
+    static void splitByBasisPoints(Money total, const int32_t *basisPoints, size_t count, Money *out)
+    {
+        int64_t assigned = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i].cents = int64_t(__int128(total.cents) * basisPoints[i] / FULL_BASIS_POINTS);
+            assigned += out[i].cents;
+        }
+        int64_t remainder = total.cents - assigned;
+        int64_t step = remainder < 0 ? -1 : 1;
+        size_t extra = size_t(llabs(remainder));
+        for (size_t i = 0; i < count && i < extra; i++)
+        {
+            out[i].cents += step;
+        }
+    }
+};
+
+inline ostream &operator<<(ostream &out, Money amount)
+{
+    return out << amount.toString();
+}
+
+#endif // MONEY_H
@@ -0,0 +1,187 @@
+#ifndef NETRANKING_H
+#define NETRANKING_H
+
+#include <bits/stdc++.h>
+#include "Money.cpp"
+using namespace std;
+
+// Net balance per slot (a user, a group member), kept ranked: slots owed
+// money sit in one indexed max-heap, slots that owe in another, and each slot
+// knows its place in its heap. A change is O(log n); a net is O(1); the k
+// largest creditors or debtors come out in O(k log k) by walking the heap
+// from its root, since a node's children are never larger than it.
+// Not thread-safe; the owner locks.
+class NetRanking
+{
+    // The weight rides along with the slot, so a sift reads one array
+    struct Entry
+    {
+        int64_t weight; // |net|
+        uint32_t slot;
+    };
+
+    vector<int64_t> nets;      // by slot, in cents; positive: the slot is owed money
+    vector<uint32_t> position; // by slot: index into the heap its sign puts it in; unused while zero
+    vector<Entry> creditors;   // slots with a positive net, largest first
+    vector<Entry> debtors;     // slots with a negative net, largest debt first
+
+    vector<Entry> &heapOf(int64_t net) { return net > 0 ? creditors : debtors; }
+
+    void place(vector<Entry> &heap, size_t at, Entry entry)
+    {
+        heap[at] = entry;
+        position[entry.slot] = at;
+    }
+
+    void siftUp(vector<Entry> &heap, size_t at)
+    {
+        Entry entry = heap[at];
+        while (at > 0 && heap[(at - 1) / 2].weight < entry.weight)
+        {
+            place(heap, at, heap[(at - 1) / 2]);
+            at = (at - 1) / 2;
+        }
+        place(heap, at, entry);
+    }
+
+    void siftDown(vector<Entry> &heap, size_t at)
+    {
+        Entry entry = heap[at];
+        for (size_t child = 2 * at + 1; child < heap.size(); child = 2 * at + 1)
+        {
+            if (child + 1 < heap.size() && heap[child].weight < heap[child + 1].weight)
+                child++;
+            if (heap[child].weight <= entry.weight)
+                break;
+            place(heap, at, heap[child]);
+            at = child;
+        }
+        place(heap, at, entry);
+    }
+
+    void insert(vector<Entry> &heap, uint32_t slot, int64_t weight)
+    {
+        heap.push_back(Entry{weight, slot});
+        siftUp(heap, heap.size() - 1);
+    }
+
+    void erase(vector<Entry> &heap, uint32_t slot)
+    {
+        size_t at = position[slot];
+        Entry last = heap.back();
+        heap.pop_back();
+        if (at == heap.size())
+            return;
+        place(heap, at, last);
+        siftUp(heap, at);
+        siftDown(heap, position[last.slot]);
+    }
+
+    // Floyd's bottom-up build, O(n)
+    void heapify(vector<Entry> &heap)
+    {
+        for (size_t at = 0; at < heap.size(); at++)
+            position[heap[at].slot] = at;
+        for (size_t at = heap.size() / 2; at-- > 0;)
+            siftDown(heap, at);
+    }
+
+public:
+    // The slot's net changes by 'delta' cents
+    void add(uint32_t slot, int64_t delta)
+    {
+        if (delta == 0)
+            return;
+        if (slot >= nets.size())
+        {
+            nets.resize(slot + 1, 0);
+            position.resize(slot + 1, 0);
+        }
+        int64_t before = nets[slot];
+        int64_t after = before + delta;
+        bool sameSide = (before > 0 && after > 0) || (before < 0 && after < 0);
+        nets[slot] = after;
+        int64_t weight = after < 0 ? -after : after;
+        if (sameSide)
+        {
+            vector<Entry> &heap = heapOf(after);
+            size_t at = position[slot];
+            bool grew = weight > heap[at].weight;
+            heap[at].weight = weight;
+            if (grew)
+                siftUp(heap, at);
+            else
+                siftDown(heap, at);
+            return;
+        }
+        if (before != 0)
+            erase(heapOf(before), slot);
+        if (after != 0)
+            insert(heapOf(after), slot, weight);
+    }
+
+    int64_t net(uint32_t slot) const { return slot < nets.size() ? nets[slot] : 0; }
+
+    // Slots that have ever been given a net
+    size_t size() const { return nets.size(); }
+
+    // Replaces every net at once, ranking them in O(n)
+    void assign(const vector<int64_t> &values)
+    {
+        nets = values;
+        position.assign(nets.size(), 0);
+        creditors.clear();
+        debtors.clear();
+        for (uint32_t slot = 0; slot < nets.size(); slot++)
+        {
+            if (nets[slot] != 0)
+                heapOf(nets[slot]).push_back(Entry{nets[slot] < 0 ? -nets[slot] : nets[slot], slot});
+        }
+        heapify(creditors);
+        heapify(debtors);
+    }
+
+    // Calls f(ranking, slot, net) for the k slots with the largest credit
+    // ('creditorsFirst') or debt across every ranking, largest first, ties in
+    // no particular order. O(count + k log(count + k)).
+    template <class F>
+    static void top(const NetRanking *const *rankings, size_t count, bool creditorsFirst, size_t k, F f)
+    {
+        struct Candidate
+        {
+            int64_t weight;
+            uint32_t ranking;
+            uint32_t at; // index into that ranking's heap
+            bool operator<(const Candidate &other) const { return weight < other.weight; }
+        };
+        auto heapOf = [&](uint32_t r) -> const vector<Entry> &
+        { return creditorsFirst ? rankings[r]->creditors : rankings[r]->debtors; };
+
+        priority_queue<Candidate> frontier;
+        auto push = [&](uint32_t r, size_t at)
+        {
+            const vector<Entry> &heap = heapOf(r);
+            if (at < heap.size())
+                frontier.push(Candidate{heap[at].weight, r, uint32_t(at)});
+        };
+        for (uint32_t r = 0; r < count; r++)
+            push(r, 0);
+        for (size_t emitted = 0; emitted < k && !frontier.empty(); emitted++)
+        {
+            Candidate best = frontier.top();
+            frontier.pop();
+            uint32_t slot = heapOf(best.ranking)[best.at].slot;
+            f(best.ranking, slot, rankings[best.ranking]->nets[slot]);
+            push(best.ranking, 2 * size_t(best.at) + 1);
+            push(best.ranking, 2 * size_t(best.at) + 2);
+        }
+    }
+
+    size_t memoryBytes() const
+    {
+        return nets.capacity() * sizeof(int64_t) + position.capacity() * sizeof(uint32_t) +
+               (creditors.capacity() + debtors.capacity()) * sizeof(Entry);
+    }
+};
+
+#endif // NETRANKING_H
@@ -0,0 +1,143 @@
+#ifndef POOLS_H
+#define POOLS_H
+
+#include <bits/stdc++.h>
+#include "BinaryIO.cpp"
+using namespace std;
+
+// Owns objects of one type, SLAB_SIZE of them per allocation. Objects never
+// move, so a pointer to one stays valid for the pool's lifetime; there is no
+// per-object free. Tearing the pool down runs the destructors in place and
+// then releases one block per slab, not one per object.
+template <class T, size_t SLAB_SIZE = 4096>
+class SlabPool
+{
+    vector<T *> slabs;
+    size_t count; // objects created, in the order they were created
+
+    T *at(size_t i) const { return slabs[i / SLAB_SIZE] + i % SLAB_SIZE; }
+
+public:
+    SlabPool() : count(0) {}
+
+    ~SlabPool() { clear(); }
+
+    SlabPool(const SlabPool &) = delete;
+    SlabPool &operator=(const SlabPool &) = delete;
+
+    template <class... Args>
+    T *create(Args &&...args)
+    {
+        if (count == slabs.size() * SLAB_SIZE)
+            slabs.push_back(static_cast<T *>(::operator new(SLAB_SIZE * sizeof(T))));
+        T *object = at(count);
+        new (object) T(forward<Args>(args)...);
+        count++;
+        return object;
+    }
+
+    T &operator[](size_t i) const { return *at(i); }
+
+    size_t size() const { return count; }
+
+    void clear()
+    {
+        if constexpr (!is_trivially_destructible_v<T>)
+        {
+            for (size_t i = 0; i < count; i++)
+                at(i)->~T();
+        }
+        for (T *slab : slabs)
+            ::operator delete(slab);
+        slabs.clear();
+        count = 0;
+    }
+
+    size_t slabCount() const { return slabs.size(); }
+
+    size_t memoryBytes() const { return slabs.size() * SLAB_SIZE * sizeof(T) + slabs.capacity() * sizeof(T *); }
+};
+
+// Free space in an append-only arena, kept by length: a range given back is
+// handed out again to the next request for exactly that length. Lengths of
+// CLASSES and up are rare enough not to be worth pooling; they are only
+// counted, as stale.
+class RangePool
+{
+public:
+    static const size_t CLASSES = 64;
+
+private:
+    array<vector<uint64_t>, CLASSES> freeRanges; // by length: where free ranges start
+    uint64_t pooled;                             // arena entries waiting in freeRanges
+    uint64_t stale;                              // arena entries given back but never reused
+
+public:
+    RangePool() : pooled(0), stale(0) {}
+
+    // A free range of 'length' into 'begin'; false if there is none
+    bool take(size_t length, uint64_t &begin)
+    {
+        if (length == 0 || length >= CLASSES || freeRanges[length].empty())
+            return false;
+        begin = freeRanges[length].back();
+        freeRanges[length].pop_back();
+        pooled -= length;
+        return true;
+    }
+
+    void give(uint64_t begin, size_t length)
+    {
+        if (length == 0)
+            return;
+        if (length >= CLASSES)
+        {
+            stale += length;
+            return;
+        }
+        freeRanges[length].push_back(begin);
+        pooled += length;
+    }
+
+    uint64_t getPooled() const { return pooled; }
+
+    uint64_t getStale() const { return stale; }
+
+    size_t memoryBytes() const
+    {
+        size_t bytes = 0;
+        for (const vector<uint64_t> &ranges : freeRanges)
+            bytes += ranges.capacity() * sizeof(uint64_t);
+        return bytes;
+    }
+
+    void save(BinaryWriter &out) const
+    {
+        out.put(stale);
+        for (const vector<uint64_t> &ranges : freeRanges)
+            out.putArray(ranges);
+    }
+
+    bool load(BinaryReader &in)
+    {
+        stale = in.get<uint64_t>();
+        pooled = 0;
+        for (size_t length = 0; length < CLASSES; length++)
+        {
+            in.getArray(freeRanges[length]);
+            pooled += freeRanges[length].size() * length;
+        }
+        return in.ok();
+    }
+
+    // Forgets every free range; what they held becomes stale
+    void reset(uint64_t staleEntries)
+    {
+        for (vector<uint64_t> &ranges : freeRanges)
+            ranges.clear();
+        pooled = 0;
+        stale = staleEntries;
+    }
+};
+
+#endif // POOLS_H
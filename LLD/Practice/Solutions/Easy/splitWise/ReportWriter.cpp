@@ -0,0 +1,298 @@
+#ifndef REPORTWRITER_H
+#define REPORTWRITER_H
+
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Money.cpp"
+using namespace std;
+
+enum class ReportFormat : uint8_t
+{
+    CSV, // header line, then one line per record
+    JSON // one array of objects
+};
+
+// Report text under construction. Numbers are formatted by hand (no locale,
+// no streams) and the buffer keeps its capacity across clear(), so a worker
+// reuses one buffer for every chunk it formats.
+class ReportBuffer
+{
+    string text;
+
+public:
+    void append(string_view part) { text.append(part.data(), part.size()); }
+
+    void append(char c) { text.push_back(c); }
+
+    void appendUnsigned(uint64_t value)
+    {
+        char digits[20];
+        size_t length = 0;
+        do
+        {
+            digits[sizeof(digits) - ++length] = char('0' + value % 10);
+            value /= 10;
+        } while (value);
+        text.append(digits + sizeof(digits) - length, length);
+    }
+
+    void appendInt(int64_t value)
+    {
+        if (value < 0)
+        {
+            text.push_back('-');
+            appendUnsigned(uint64_t(0) - uint64_t(value));
+            return;
+        }
+        appendUnsigned(uint64_t(value));
+    }
+
+    // Two decimals, as Money::toString
+    void appendMoney(Money amount)
+    {
+        int64_t cents = amount.getCents();
+        uint64_t magnitude = cents < 0 ? uint64_t(0) - uint64_t(cents) : uint64_t(cents);
+        if (cents < 0)
+            text.push_back('-');
+        appendUnsigned(magnitude / Money::CENTS_PER_UNIT);
+        uint64_t fraction = magnitude % Money::CENTS_PER_UNIT;
+        char tail[3] = {'.', char('0' + fraction / 10), char('0' + fraction % 10)};
+        text.append(tail, sizeof(tail));
+    }
+
+    // Quoted only when it has to be (RFC 4180)
+    void appendCsvField(string_view field)
+    {
+        if (field.find_first_of(",\"\r\n") == string_view::npos)
+        {
+            append(field);
+            return;
+        }
+        text.push_back('"');
+        for (char c : field)
+        {
+            if (c == '"')
+                text.push_back('"');
+            text.push_back(c);
+        }
+        text.push_back('"');
+    }
+
+    void appendJsonString(string_view value)
+    {
+        static const char HEX[] = "0123456789abcdef";
+        text.push_back('"');
+        size_t plain = 0; // start of the run of characters that need no escape
+        for (size_t i = 0; i < value.size(); i++)
+        {
+            unsigned char c = value[i];
+            if (c >= 0x20 && c != '"' && c != '\\')
+                continue;
+            text.append(value.data() + plain, i - plain);
+            plain = i + 1;
+            text.push_back('\\');
+            switch (c)
+            {
+            case '"':
+            case '\\':
+                text.push_back(char(c));
+                break;
+            case '\n':
+                text.push_back('n');
+                break;
+            case '\r':
+                text.push_back('r');
+                break;
+            case '\t':
+                text.push_back('t');
+                break;
+            default:
+                text.append("u00");
+                text.push_back(HEX[c >> 4]);
+                text.push_back(HEX[c & 15]);
+            }
+        }
+        text.append(value.data() + plain, value.size() - plain);
+        text.push_back('"');
+    }
+
+    // Starts a JSON record: every record opens with a separator, and
+    // ReportWriter drops the one in front of the first record it writes
+    void beginJsonRecord() { text.append(",\n{", 3); }
+
+    // "name": inside a JSON object
+    void appendJsonKey(string_view name)
+    {
+        text.push_back('"');
+        append(name);
+        text.append("\":", 2);
+    }
+
+    const string &data() const { return text; }
+
+    size_t size() const { return text.size(); }
+
+    void clear() { text.clear(); }
+};
+
+// Streams a report to a file, or to stdout for "-". Output collects in a
+// large buffer and goes out in FLUSH_BYTES writes, so a report of any size
+// costs a handful of syscalls per megabyte.
+class ReportWriter
+{
+    static const size_t FLUSH_BYTES = 1 << 20;
+
+    int fd;
+    bool ownsFd;
+    bool failed;
+    ReportFormat format;
+    bool anyRecord; // JSON: whether a record has been written, so the next needs its separator
+    bool finished;
+    uint64_t bytes;
+    ReportBuffer buffer;
+
+    void writeOut(const char *data, size_t length)
+    {
+        bytes += length;
+        while (length > 0 && !failed)
+        {
+            ssize_t done = ::write(fd, data, length);
+            if (done < 0 && errno == EINTR)
+                continue;
+            failed = done <= 0;
+            if (!failed)
+            {
+                data += done;
+                length -= done;
+            }
+        }
+    }
+
+    void flush()
+    {
+        writeOut(buffer.data().data(), buffer.size());
+        buffer.clear();
+    }
+
+public:
+    ReportWriter(const string &path, ReportFormat format)
+        : fd(path == "-" ? STDOUT_FILENO : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)),
+          ownsFd(path != "-"), failed(fd < 0), format(format), anyRecord(false), finished(false), bytes(0)
+    {
+        // Anything already printed through the streams goes out first
+        if (!ownsFd)
+        {
+            cout.flush();
+            fflush(stdout);
+        }
+    }
+
+    ~ReportWriter()
+    {
+        finish();
+        if (ownsFd && fd >= 0)
+            close(fd);
+    }
+
+    ReportWriter(const ReportWriter &) = delete;
+    ReportWriter &operator=(const ReportWriter &) = delete;
+
+    ReportFormat getFormat() const { return format; }
+
+    // CSV: the header line. JSON: opens the array.
+    void begin(string_view csvHeader)
+    {
+        if (format == ReportFormat::CSV)
+        {
+            buffer.append(csvHeader);
+            buffer.append('\n');
+        }
+        else
+        {
+            buffer.append('[');
+        }
+    }
+
+    // Records formatted elsewhere, e.g. by a worker
+    void write(const ReportBuffer &records)
+    {
+        string_view text = records.data();
+        if (text.empty() || failed)
+            return;
+        if (format == ReportFormat::JSON && !anyRecord)
+            text.remove_prefix(1); // no separator before the first record
+        anyRecord = true;
+        if (text.size() >= FLUSH_BYTES)
+        {
+            flush();
+            writeOut(text.data(), text.size());
+            return;
+        }
+        buffer.append(text);
+        if (buffer.size() >= FLUSH_BYTES)
+            flush();
+    }
+
+    // Formats chunks 0..count-1 with format(chunk, out), 'threads' chunks at
+    // a time, each into its own buffer, and writes them in chunk order. Only
+    // one round of chunks is held at once, and the buffers are reused.
+    template <class Format>
+    void writeChunks(size_t count, size_t threads, Format formatChunk)
+    {
+        writeChunks(count, threads, formatChunk, []
+                    { return 0; });
+    }
+
+    // The same, holding whatever lockRound() returns while a round is
+    // formatted and releasing it before the round is written
+    template <class Format, class LockRound>
+    void writeChunks(size_t count, size_t threads, Format formatChunk, LockRound lockRound)
+    {
+        threads = max<size_t>(1, min(threads, count));
+        vector<ReportBuffer> round(threads);
+        for (size_t first = 0; first < count && !failed; first += threads)
+        {
+            size_t chunks = min(threads, count - first);
+            {
+                [[maybe_unused]] auto held = lockRound();
+                vector<thread> pool;
+                for (size_t i = 1; i < chunks; i++)
+                {
+                    pool.emplace_back([&, i]
+                                      { round[i].clear();
+                                        formatChunk(first + i, round[i]); });
+                }
+                round[0].clear();
+                formatChunk(first, round[0]);
+                for (thread &t : pool)
+                {
+                    t.join();
+                }
+            }
+            for (size_t i = 0; i < chunks; i++)
+            {
+                write(round[i]);
+            }
+        }
+    }
+
+    // JSON: closes the array. Then writes out whatever is left; false if any
+    // write failed. Safe to call more than once.
+    bool finish()
+    {
+        if (finished || failed)
+            return !failed;
+        finished = true;
+        if (format == ReportFormat::JSON)
+            buffer.append("\n]\n");
+        flush();
+        return !failed;
+    }
+
+    uint64_t bytesWritten() const { return bytes + buffer.size(); }
+
+    bool ok() const { return !failed; }
+};
+
+#endif // REPORTWRITER_H
@@ -0,0 +1,690 @@
+#ifndef SHARDEDLEDGER_H
+#define SHARDEDLEDGER_H
+
+#include <bits/stdc++.h>
+#include "Money.cpp"
+#include "ExpenseStore.cpp"
+#include "BalanceLedger.cpp"
+#include "Currency.cpp"
+#include "NetRanking.cpp"
+using namespace std;
+
+// BalanceLedger split into SHARD_COUNT shards by pair, each behind its own
+// reader/writer lock, so expenses touching different pairs settle in
+// parallel. Every change set (one expense, one edit) holds all of its shards
+// at once, and balance reads take every shard shared, so a reader never sees
+// half an expense.
+//
+// Each shard keeps one BalanceLedger per currency it has seen; a pair always
+// lands in the same shard whatever the currency. Balances in different
+// currencies are never added together here (see FxTable).
+//
+// Every user's net balance is kept ranked alongside (see NetRanking), in
+// stripes by user. Each change set moves the nets it touches with all of
+// their stripes held at once, so net and top-k reads, which take only net
+// stripes, never see part of an expense either.
+//
+// Each shard and net stripe also keeps a rolling checksum of its contents,
+// moved by every change under the same lock, so audit() can check one shard
+// at a time against its table instead of replaying history.
+//
+// Lock order: shards in ascending index, then at most one counterparty
+// stripe, or net stripes in ascending index.
+class ShardedLedger
+{
+public:
+    static const size_t SHARD_COUNT = 64;
+
+private:
+    struct alignas(64) Shard
+    {
+        mutable shared_mutex lock;
+        vector<BalanceLedger> ledgers; // [currency]; grown on first use
+        uint64_t checksum = 0;         // sum of pairWeight × balance over the entries, mod 2^64
+
+        // Called with the lock held exclusively
+        BalanceLedger &ledgerIn(CurrencyId currency)
+        {
+            while (ledgers.size() <= currency)
+                ledgers.emplace_back(false);
+            return ledgers[currency];
+        }
+
+        // Called with the lock held
+        const BalanceLedger *findLedger(CurrencyId currency) const
+        {
+            return currency < ledgers.size() ? &ledgers[currency] : nullptr;
+        }
+
+        // Whether the pair has an entry in any currency but 'except'
+        bool pairElsewhere(UserId a, UserId b, CurrencyId except) const
+        {
+            for (size_t c = 0; c < ledgers.size(); c++)
+            {
+                if (c != except && ledgers[c].hasPair(a, b))
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    // Counterparty lists, striped by user so new pairs in different shards
+    // can record themselves without a global lock. A counterparty is listed
+    // once however many currencies the pair holds balances in.
+    struct alignas(64) Stripe
+    {
+        mutex lock;
+        vector<vector<UserId>> lists; // user / SHARD_COUNT → counterparties
+        vector<uint64_t> currencies;  // parallel to lists: bit per currency the user holds a balance in
+    };
+
+    // Nets of the users in one stripe, slot = user / SHARD_COUNT
+    struct alignas(64) NetStripe
+    {
+        mutex lock;
+        vector<NetRanking> rankings; // [currency]; grown on first use
+        uint64_t checksum = 0;       // sum of userWeight × net, mod 2^64
+
+        NetRanking &rankingIn(CurrencyId currency)
+        {
+            if (rankings.size() <= currency)
+                rankings.resize(currency + 1);
+            return rankings[currency];
+        }
+    };
+
+    struct NetChange
+    {
+        UserId user;
+        CurrencyId currency;
+        int64_t cents; // added to the user's net
+    };
+
+    array<Shard, SHARD_COUNT> shards;
+    mutable array<Stripe, SHARD_COUNT> stripes;
+    mutable array<NetStripe, SHARD_COUNT> netStripes;
+    atomic<uint64_t> usedCurrencies; // bit per currency any pair holds a balance in
+
+    friend struct AuditTamper; // test.cpp: breaks state behind audit()'s back
+
+    static size_t shardOf(UserId a, UserId b)
+    {
+        // Mixed separately from BalanceLedger's slot hash, which uses the high bits
+        uint64_t key = a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDULL;
+        key ^= key >> 33;
+        return key & (SHARD_COUNT - 1);
+    }
+
+    static uint64_t mix(uint64_t key)
+    {
+        key ^= key >> 31;
+        key *= 0xBF58476D1CE4E5B9ULL;
+        key ^= key >> 27;
+        key *= 0x94D049BB133111EBULL;
+        return key ^ (key >> 31);
+    }
+
+    // A checksum is a sum of weight × cents, so a change moves it by weight ×
+    // change. Weights are odd, so no change to one entry can cancel out.
+    static uint64_t pairWeight(UserId lo, UserId hi, CurrencyId currency)
+    {
+        return mix(((uint64_t(lo) << 32) | hi) + (uint64_t(currency) + 1) * 0x9E3779B97F4A7C15ULL) | 1;
+    }
+
+    static uint64_t userWeight(UserId user, CurrencyId currency)
+    {
+        return mix(user + (uint64_t(currency) + 1) * 0xD6E8FEB86659FD93ULL) | 1;
+    }
+
+    // What the shard's checksum should be, worked out from its tables; also
+    // false through 'placed' if a pair sits in the wrong shard
+    uint64_t tableChecksum(const Shard &shard, size_t index, size_t &pairs, bool &placed) const
+    {
+        uint64_t sum = 0;
+        for (size_t c = 0; c < shard.ledgers.size(); c++)
+        {
+            pairs += shard.ledgers[c].size();
+            shard.ledgers[c].forEachBalance([&](UserId lo, UserId hi, Money balance)
+                                            {
+                placed = placed && lo < hi && shardOf(lo, hi) == index;
+                sum += pairWeight(lo, hi, CurrencyId(c)) * uint64_t(balance.getCents()); });
+        }
+        return sum;
+    }
+
+    static uint64_t rankingChecksum(const NetStripe &stripe, size_t index, array<int64_t, Currency::COUNT> &totals)
+    {
+        uint64_t sum = 0;
+        for (size_t c = 0; c < stripe.rankings.size(); c++)
+        {
+            const NetRanking &ranking = stripe.rankings[c];
+            for (uint32_t slot = 0; slot < ranking.size(); slot++)
+            {
+                int64_t net = ranking.net(slot);
+                totals[c] += net;
+                sum += userWeight(UserId(slot) * SHARD_COUNT + index, CurrencyId(c)) * uint64_t(net);
+            }
+        }
+        return sum;
+    }
+
+    void addCounterparty(UserId user, UserId other, CurrencyId currency, bool listed)
+    {
+        Stripe &stripe = stripes[user % SHARD_COUNT];
+        lock_guard<mutex> guard(stripe.lock);
+        addCounterpartyLocked(stripe, user, other, currency, listed);
+    }
+
+    // 'listed': the pair already holds a balance in another currency
+    static void addCounterpartyLocked(Stripe &stripe, UserId user, UserId other, CurrencyId currency, bool listed)
+    {
+        size_t slot = user / SHARD_COUNT;
+        if (stripe.lists.size() <= slot)
+        {
+            stripe.lists.resize(slot + 1);
+            stripe.currencies.resize(slot + 1);
+        }
+        if (!listed)
+            stripe.lists[slot].push_back(other);
+        stripe.currencies[slot] |= uint64_t(1) << currency;
+    }
+
+    // Records a pair that just got its first entry in 'currency'. Called with
+    // the pair's shard held exclusively; 'lockStripes' is false when the
+    // caller holds every shard, so no one else can be touching the stripes.
+    void recordNewPair(const Shard &shard, UserId a, UserId b, CurrencyId currency, bool lockStripes)
+    {
+        bool listed = shard.pairElsewhere(a, b, currency);
+        if (lockStripes)
+        {
+            addCounterparty(a, b, currency, listed);
+            addCounterparty(b, a, currency, listed);
+        }
+        else
+        {
+            addCounterpartyLocked(stripes[a % SHARD_COUNT], a, b, currency, listed);
+            addCounterpartyLocked(stripes[b % SHARD_COUNT], b, a, currency, listed);
+        }
+        usedCurrencies.fetch_or(uint64_t(1) << currency, memory_order_relaxed);
+    }
+
+    // Called with the pair's shard held exclusively
+    void addDebtLocked(Shard &shard, UserId creditor, UserId debtor, Money amount, CurrencyId currency)
+    {
+        BalanceLedger &ledger = shard.ledgerIn(currency);
+        size_t pairs = ledger.size();
+        ledger.addDebt(creditor, debtor, amount);
+        if (creditor < debtor)
+            shard.checksum += pairWeight(creditor, debtor, currency) * uint64_t(amount.getCents());
+        else
+            shard.checksum -= pairWeight(debtor, creditor, currency) * uint64_t(amount.getCents());
+        if (ledger.size() != pairs)
+            recordNewPair(shard, creditor, debtor, currency, true);
+    }
+
+    // Moves every net a change set touches, with all of their stripes held
+    // at once. Called with the change set's shards held exclusively.
+    void applyNets(const NetChange *changes, size_t count)
+    {
+        uint64_t held = 0;
+        for (size_t i = 0; i < count; i++)
+            held |= uint64_t(1) << (changes[i].user % SHARD_COUNT);
+        for (uint64_t bits = held; bits; bits &= bits - 1)
+            netStripes[__builtin_ctzll(bits)].lock.lock();
+        for (size_t i = 0; i < count; i++)
+        {
+            const NetChange &change = changes[i];
+            NetStripe &stripe = netStripes[change.user % SHARD_COUNT];
+            stripe.rankingIn(change.currency).add(change.user / SHARD_COUNT, change.cents);
+            stripe.checksum += userWeight(change.user, change.currency) * uint64_t(change.cents);
+        }
+        for (uint64_t bits = held; bits; bits &= bits - 1)
+            netStripes[__builtin_ctzll(bits)].lock.unlock();
+    }
+
+    // Works every net out again from the balances; after load()
+    void rebuildNets()
+    {
+        for (size_t currency = 0; currency < Currency::COUNT; currency++)
+        {
+            array<vector<int64_t>, SHARD_COUNT> values;
+            bool any = false;
+            auto netOf = [&](UserId user) -> int64_t &
+            {
+                vector<int64_t> &nets = values[user % SHARD_COUNT];
+                if (nets.size() <= user / SHARD_COUNT)
+                    nets.resize(user / SHARD_COUNT + 1, 0);
+                return nets[user / SHARD_COUNT];
+            };
+            for (const Shard &shard : shards)
+            {
+                const BalanceLedger *ledger = shard.findLedger(CurrencyId(currency));
+                if (!ledger)
+                    continue;
+                ledger->forEachBalance([&](UserId lo, UserId hi, Money balance)
+                                       {
+                    any = true;
+                    netOf(lo) += balance.getCents();
+                    netOf(hi) -= balance.getCents(); });
+            }
+            for (size_t i = 0; i < SHARD_COUNT; i++)
+            {
+                if (any)
+                    netStripes[i].rankingIn(CurrencyId(currency)).assign(values[i]);
+                else if (currency < netStripes[i].rankings.size())
+                    netStripes[i].rankings[currency] = NetRanking();
+            }
+        }
+        array<int64_t, Currency::COUNT> totals{};
+        for (size_t i = 0; i < SHARD_COUNT; i++)
+            netStripes[i].checksum = rankingChecksum(netStripes[i], i, totals);
+    }
+
+    template <class F>
+    void withAllShared(F f) const
+    {
+        for (const Shard &shard : shards)
+            shard.lock.lock_shared();
+        f();
+        for (const Shard &shard : shards)
+            shard.lock.unlock_shared();
+    }
+
+public:
+    // One user's balances in every currency they hold one in, as of a single
+    // point in time. Row r holds what each counterparty owes the user in
+    // currencies[r], so a whole row converts at one rate.
+    struct UserBalances
+    {
+        vector<UserId> counterparties; // ascending
+        vector<CurrencyId> currencies; // ascending
+        vector<Money> amounts;         // [row * counterparties.size() + i]
+
+        Span<Money> row(size_t r) const
+        {
+            return Span<Money>(amounts.data() + r * counterparties.size(), counterparties.size());
+        }
+    };
+
+    ShardedLedger() : usedCurrencies(0) {}
+
+    // 'debtor' now owes 'creditor' 'amount' more
+    void addDebt(UserId creditor, UserId debtor, Money amount, CurrencyId currency = HOME_CURRENCY)
+    {
+        if (creditor == debtor)
+            return;
+        Shard &shard = shards[shardOf(creditor, debtor)];
+        unique_lock<shared_mutex> guard(shard.lock);
+        addDebtLocked(shard, creditor, debtor, amount, currency);
+        NetChange nets[2] = {{creditor, currency, amount.getCents()}, {debtor, currency, -amount.getCents()}};
+        applyNets(nets, 2);
+    }
+
+    // debtors[i] now owes 'creditor' amounts[i] more, for every i, atomically
+    // with respect to readers
+    void addDebts(UserId creditor, Span<UserId> debtors, Span<Money> amounts, CurrencyId currency = HOME_CURRENCY)
+    {
+        uint64_t held = 0; // bit per shard; SHARD_COUNT == 64
+        for (size_t i = 0; i < amounts.size(); i++)
+        {
+            if (debtors[i] != creditor)
+                held |= uint64_t(1) << shardOf(creditor, debtors[i]);
+        }
+        for (uint64_t bits = held; bits; bits &= bits - 1)
+            shards[__builtin_ctzll(bits)].lock.lock();
+        for (size_t i = 0; i < amounts.size(); i++)
+        {
+            if (debtors[i] != creditor)
+                addDebtLocked(shards[shardOf(creditor, debtors[i])], creditor, debtors[i], amounts[i], currency);
+        }
+        vector<NetChange> nets;
+        nets.reserve(amounts.size() + 1);
+        int64_t credited = 0;
+        for (size_t i = 0; i < amounts.size(); i++)
+        {
+            if (debtors[i] == creditor)
+                continue;
+            credited += amounts[i].getCents();
+            nets.push_back(NetChange{debtors[i], currency, -amounts[i].getCents()});
+        }
+        nets.push_back(NetChange{creditor, currency, credited});
+        applyNets(nets.data(), nets.size());
+        for (uint64_t bits = held; bits; bits &= bits - 1)
+            shards[__builtin_ctzll(bits)].lock.unlock();
+    }
+
+    // Applies a batch of changes (an import chunk, a batch of expenses), with
+    // every shard it touches held at once. Changes are bucketed by shard first
+    // so each shard's table is filled in one pass. When that is every shard no
+    // one else can be touching the stripes, so their locks are skipped.
+    void merge(const PartialLedger &changes)
+    {
+        array<size_t, SHARD_COUNT + 1> start{};
+        changes.forEachChange([&](UserId lo, UserId hi, Money, CurrencyId)
+                              { start[shardOf(lo, hi) + 1]++; });
+        uint64_t held = 0;
+        for (size_t i = 0; i < SHARD_COUNT; i++)
+        {
+            if (start[i + 1])
+                held |= uint64_t(1) << i;
+            start[i + 1] += start[i];
+        }
+        bool everyShard = held == ~uint64_t(0);
+
+        struct Change
+        {
+            UserId lo, hi;
+            Money amount;
+            CurrencyId currency;
+        };
+        vector<Change> bucketed(changes.size());
+        array<size_t, SHARD_COUNT> fill;
+        copy(start.begin(), start.end() - 1, fill.begin());
+        changes.forEachChange([&](UserId lo, UserId hi, Money change, CurrencyId currency)
+                              { bucketed[fill[shardOf(lo, hi)]++] = Change{lo, hi, change, currency}; });
+
+        for (uint64_t bits = held; bits; bits &= bits - 1)
+            shards[__builtin_ctzll(bits)].lock.lock();
+        for (uint64_t bits = held; bits; bits &= bits - 1)
+        {
+            size_t i = __builtin_ctzll(bits);
+            Shard &shard = shards[i];
+            // Compacted changes come ordered by currency, so each shard's
+            // bucket is too: one reserve per currency run
+            for (size_t c = start[i]; c < start[i + 1];)
+            {
+                CurrencyId currency = bucketed[c].currency;
+                size_t runEnd = c;
+                while (runEnd < start[i + 1] && bucketed[runEnd].currency == currency)
+                    runEnd++;
+                BalanceLedger &ledger = shard.ledgerIn(currency);
+                ledger.reserve(ledger.size() + runEnd - c);
+                for (; c < runEnd; c++)
+                {
+                    const Change &change = bucketed[c];
+                    size_t pairs = ledger.size();
+                    ledger.addDebt(change.lo, change.hi, change.amount);
+                    shard.checksum += pairWeight(change.lo, change.hi, currency) * uint64_t(change.amount.getCents());
+                    if (ledger.size() != pairs)
+                        recordNewPair(shard, change.lo, change.hi, currency, !everyShard);
+                }
+            }
+        }
+        vector<NetChange> nets;
+        nets.reserve(2 * bucketed.size());
+        for (const Change &change : bucketed)
+        {
+            nets.push_back(NetChange{change.lo, change.currency, change.amount.getCents()});
+            nets.push_back(NetChange{change.hi, change.currency, -change.amount.getCents()});
+        }
+        applyNets(nets.data(), nets.size());
+        for (uint64_t bits = held; bits; bits &= bits - 1)
+            shards[__builtin_ctzll(bits)].lock.unlock();
+    }
+
+    // What 'other' owes 'user' in 'currency' (negative: what 'user' owes 'other')
+    Money getBalance(UserId user, UserId other, CurrencyId currency = HOME_CURRENCY) const
+    {
+        const Shard &shard = shards[shardOf(user, other)];
+        shared_lock<shared_mutex> guard(shard.lock);
+        const BalanceLedger *ledger = shard.findLedger(currency);
+        return ledger ? ledger->getBalance(user, other) : Money();
+    }
+
+    // Every counterparty of 'user' with what they owe 'user' in each currency
+    // the user holds a balance in, as of a single point in time
+    UserBalances snapshot(UserId user) const
+    {
+        UserBalances balances;
+        withAllShared([&]
+                      {
+            uint64_t held;
+            {
+                Stripe &stripe = stripes[user % SHARD_COUNT];
+                lock_guard<mutex> guard(stripe.lock);
+                size_t slot = user / SHARD_COUNT;
+                if (slot >= stripe.lists.size())
+                    return;
+                balances.counterparties = stripe.lists[slot];
+                held = stripe.currencies[slot];
+            }
+            sort(balances.counterparties.begin(), balances.counterparties.end());
+            size_t count = balances.counterparties.size();
+            for (uint64_t bits = held; bits; bits &= bits - 1)
+                balances.currencies.push_back(CurrencyId(__builtin_ctzll(bits)));
+            balances.amounts.resize(balances.currencies.size() * count);
+            for (size_t r = 0; r < balances.currencies.size(); r++)
+            {
+                Money *row = balances.amounts.data() + r * count;
+                for (size_t i = 0; i < count; i++)
+                {
+                    UserId other = balances.counterparties[i];
+                    const BalanceLedger *ledger = shards[shardOf(user, other)].findLedger(balances.currencies[r]);
+                    row[i] = ledger ? ledger->getBalance(user, other) : Money();
+                }
+            } });
+        return balances;
+    }
+
+    // What everyone owes 'user' minus what 'user' owes everyone, in 'currency'; O(1)
+    Money getNet(UserId user, CurrencyId currency = HOME_CURRENCY) const
+    {
+        NetStripe &stripe = netStripes[user % SHARD_COUNT];
+        lock_guard<mutex> guard(stripe.lock);
+        return Money(currency < stripe.rankings.size() ? stripe.rankings[currency].net(user / SHARD_COUNT) : 0);
+    }
+
+    // The k users owed the most in 'currency' ('creditors'), or owing the
+    // most, with their nets, largest first; all as of one point in time.
+    // O(SHARD_COUNT + k log k).
+    vector<pair<UserId, Money>> top(size_t k, bool creditors, CurrencyId currency = HOME_CURRENCY) const
+    {
+        vector<pair<UserId, Money>> ranked;
+        array<const NetRanking *, SHARD_COUNT> rankings;
+        array<uint32_t, SHARD_COUNT> stripeOf;
+        size_t count = 0;
+        for (NetStripe &stripe : netStripes)
+            stripe.lock.lock();
+        for (uint32_t i = 0; i < SHARD_COUNT; i++)
+        {
+            if (currency < netStripes[i].rankings.size())
+            {
+                rankings[count] = &netStripes[i].rankings[currency];
+                stripeOf[count++] = i;
+            }
+        }
+        NetRanking::top(rankings.data(), count, creditors, k, [&](uint32_t r, uint32_t slot, int64_t net)
+                        { ranked.emplace_back(UserId(slot) * SHARD_COUNT + stripeOf[r], Money(net)); });
+        for (NetStripe &stripe : netStripes)
+            stripe.lock.unlock();
+        return ranked;
+    }
+
+    // Bit per currency any pair has ever held a balance in
+    uint64_t getCurrencies() const
+    {
+        return usedCurrencies.load(memory_order_relaxed);
+    }
+
+    // Bytes held by the tables, counterparty lists and nets, from their
+    // capacities. Tables and lists are counted with every shard held shared,
+    // as a merge over every shard writes the lists without their stripe
+    // locks; the nets stripe by stripe.
+    size_t memoryBytes() const
+    {
+        size_t bytes = 0;
+        withAllShared([&]
+                      {
+            for (const Shard &shard : shards)
+            {
+                for (const BalanceLedger &ledger : shard.ledgers)
+                    bytes += ledger.memoryBytes();
+            }
+            for (Stripe &stripe : stripes)
+            {
+                lock_guard<mutex> guard(stripe.lock);
+                bytes += stripe.lists.capacity() * sizeof(vector<UserId>) + stripe.currencies.capacity() * sizeof(uint64_t);
+                for (const vector<UserId> &list : stripe.lists)
+                    bytes += list.capacity() * sizeof(UserId);
+            } });
+        for (NetStripe &stripe : netStripes)
+        {
+            lock_guard<mutex> guard(stripe.lock);
+            for (const NetRanking &ranking : stripe.rankings)
+                bytes += ranking.memoryBytes();
+        }
+        return bytes;
+    }
+
+    // Calls f(lo, hi, balance) for every pair with a non-zero balance in
+    // 'currency' (what hi owes lo), with all shards held shared
+    template <class F>
+    void forEachBalance(CurrencyId currency, F f) const
+    {
+        withAllShared([&]
+                      {
+            for (const Shard &shard : shards)
+            {
+                if (const BalanceLedger *ledger = shard.findLedger(currency))
+                    ledger->forEachBalance(f);
+            } });
+    }
+
+    // Calls f(ledgers) with all shards held shared; ledgers[i] is shard i's
+    // ledger in 'currency', or null. Several threads may read them at once.
+    template <class F>
+    void withLedgers(CurrencyId currency, F f) const
+    {
+        withAllShared([&]
+                      {
+            array<const BalanceLedger *, SHARD_COUNT> ledgers;
+            for (size_t i = 0; i < SHARD_COUNT; i++)
+                ledgers[i] = shards[i].findLedger(currency);
+            f(ledgers); });
+    }
+
+    void save(BinaryWriter &out) const
+    {
+        withAllShared([&]
+                      {
+            for (const Shard &shard : shards)
+            {
+                out.put<uint64_t>(shard.ledgers.size());
+                for (const BalanceLedger &ledger : shard.ledgers)
+                    ledger.save(out);
+            }
+            for (const Stripe &stripe : stripes)
+            {
+                out.put<uint64_t>(stripe.lists.size());
+                for (const auto &list : stripe.lists)
+                    out.putArray(list);
+                out.putArray(stripe.currencies);
+            } });
+    }
+
+    // Replaces the contents with what save() wrote; not safe alongside other
+    // calls. Ledgers saved before balances had currencies hold one ledger per
+    // shard, in the home currency.
+    bool load(BinaryReader &in, bool perCurrency)
+    {
+        uint64_t used = 0;
+        for (Shard &shard : shards)
+        {
+            uint64_t count = perCurrency ? in.get<uint64_t>() : 1;
+            if (!in.ok() || count > Currency::COUNT)
+                return false;
+            shard.ledgers.clear();
+            for (size_t c = 0; c < count; c++)
+            {
+                if (!shard.ledgerIn(CurrencyId(c)).load(in))
+                    return false;
+                if (shard.ledgers[c].size())
+                    used |= uint64_t(1) << c;
+            }
+            // The snapshot is the new baseline
+            size_t pairs = 0;
+            bool placed = true;
+            shard.checksum = tableChecksum(shard, &shard - shards.data(), pairs, placed);
+        }
+        for (Stripe &stripe : stripes)
+        {
+            uint64_t users = in.get<uint64_t>();
+            if (!in.ok() || users > in.remaining())
+                return false;
+            stripe.lists.assign(users, vector<UserId>());
+            for (auto &list : stripe.lists)
+                in.getArray(list);
+            if (perCurrency)
+            {
+                in.getArray(stripe.currencies);
+                if (stripe.currencies.size() != users)
+                    return false;
+            }
+            else
+            {
+                stripe.currencies.assign(users, 0);
+                for (size_t slot = 0; slot < users; slot++)
+                {
+                    if (!stripe.lists[slot].empty())
+                        stripe.currencies[slot] = uint64_t(1) << HOME_CURRENCY;
+                }
+            }
+        }
+        usedCurrencies = used;
+        if (!in.ok())
+            return false;
+        rebuildNets();
+        return true;
+    }
+
+    // Checks shard 'index' against its rolling checksum, with only that shard
+    // held shared. False if its tables have drifted from the changes applied
+    // to it, or hold a pair that belongs in another shard. 'pairs' counts the
+    // entries read.
+    bool auditShard(size_t index, size_t &pairs) const
+    {
+        const Shard &shard = shards[index];
+        shared_lock<shared_mutex> guard(shard.lock);
+        bool placed = true;
+        return tableChecksum(shard, index, pairs, placed) == shard.checksum && placed;
+    }
+
+    // Checks every net stripe against its rolling checksum, with all of them
+    // held at once, and that each currency's nets add up to zero. The first
+    // stripe found wrong goes to 'divergent' (SHARD_COUNT if none).
+    bool auditNets(size_t &divergent, bool &balanced) const
+    {
+        array<int64_t, Currency::COUNT> totals{};
+        divergent = SHARD_COUNT;
+        for (NetStripe &stripe : netStripes)
+            stripe.lock.lock();
+        for (size_t i = 0; i < SHARD_COUNT; i++)
+        {
+            if (rankingChecksum(netStripes[i], i, totals) != netStripes[i].checksum && divergent == SHARD_COUNT)
+                divergent = i;
+        }
+        for (NetStripe &stripe : netStripes)
+            stripe.lock.unlock();
+        balanced = all_of(totals.begin(), totals.end(), [](int64_t total)
+                          { return total == 0; });
+        return divergent == SHARD_COUNT && balanced;
+    }
+
+    // Pairs with an entry, counted once per currency
+    size_t size() const
+    {
+        size_t pairs = 0;
+        withAllShared([&]
+                      {
+            for (const Shard &shard : shards)
+            {
+                for (const BalanceLedger &ledger : shard.ledgers)
+                    pairs += ledger.size();
+            } });
+        return pairs;
+    }
+};
+
+#endif // SHARDEDLEDGER_H
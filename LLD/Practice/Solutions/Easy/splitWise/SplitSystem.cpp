@@ -1,159 +1,2229 @@
+#ifndef SPLITSYSTEM_H
+#define SPLITSYSTEM_H
+
 #include <bits/stdc++.h>
 #include "User.cpp"
+#include "Group.cpp"
+#include "ExpenseStore.cpp"
 #include "Expense.cpp"
+#include "BalanceLedger.cpp"
+#include "ShardedLedger.cpp"
+#include "DebtSimplifier.cpp"
+#include "BulkImporter.cpp"
+#include "UserExpenseIndex.cpp"
+#include "ExpenseTimeline.cpp"
+#include "Currency.cpp"
+#include "FxTable.cpp"
+#include "BinaryIO.cpp"
+#include "Journal.cpp"
+#include "ReportWriter.cpp"
+#include "Pools.cpp"
+#include "LedgerAuditor.cpp"
 using namespace std;
 
+// Safe to call from any number of threads. Locks, always taken in this order:
+//   checkpointLock shared by every change, exclusive while a snapshot is written
+//   expenseLock    the expense store, its per-user index and its timeline
+//   directoryLock  users, groups and their external-id indexes; held only
+//                  inside findUser/getUser/findGroup/getGroup and friends, so
+//                  never while taking another lock; exportExpenses takes it
+//                  shared with expenseLock held
+//   group / ledger shard locks, inside Group and ShardedLedger
+//   fxLock         swapping in a new rate table; taken on its own
+// audit() takes expenseLock, each shard and the net stripes one at a time,
+// never together.
+// Expense handles read the store without a lock, so inspect them only while
+// no other thread is adding expenses.
+//
+// Users and groups live in slab pools the system owns, and expenses in the
+// columnar store, which reuses the rows of deleted ones; tearing a system down
+// frees a few large blocks rather than an object at a time.
+//
+// With openStorage() every change is also written to a journal, and
+// checkpoints write a snapshot so a restart replays only the journal tail.
+//
+// Every expense is in one currency (the home currency, shown as "$", unless
+// the caller names another) and balances are kept per currency. Queries that
+// want one figure convert at query time with the current FxTable.
 class SplitwiseSystem
 {
 
-    vector<User *> users;
-    vector<Expense *> expenses;
-    int userIdCounter;
-    int expenseIdCounter;
+    SlabPool<User> userPool;    // owns every User; they never move
+    SlabPool<Group> groupPool;  // owns every Group
+    vector<User *> users;       // indexed by UserId
+    ExpenseStore expenses;      // columnar, indexed by ExpenseId
+    UserExpenseIndex expenseIndex; // UserId → ids of the expenses they paid for or share
+    ExpenseTimeline timeline;      // the same expenses by month, with per-user running totals
+    vector<Group *> groups;     // indexed by GroupId
+    unordered_map<string, UserId> userIndex;       // external id ("U17") → UserId
+    unordered_map<string, GroupId> groupIndex;     // external id ("G2") → GroupId
+    ShardedLedger ledger; // every pairwise balance, stored once per pair and currency
+    shared_ptr<const FxTable> fxRates; // current version; replaced whole, under fxLock
+    atomic<uint32_t> userIdCounter;
+    atomic<uint32_t> groupIdCounter;
+    mutable shared_mutex checkpointLock;
+    mutable shared_mutex expenseLock;
+    mutable shared_mutex directoryLock;
+    mutable mutex fxLock;
+
+    unique_ptr<Journal> journal; // null unless openStorage() succeeded
+    string storageDirectory;
+    uint64_t generation;      // of the current snapshot and journal file
+    uint64_t checkpointBytes; // journal size that triggers a checkpoint
+    LedgerAuditor auditor;    // idle unless startAuditor() was called
+
+    friend struct AuditTamper; // test.cpp: breaks state behind audit()'s back
+
+    static constexpr uint32_t SNAPSHOT_MAGIC = 0x34535753;    // "SWS4"
+    static constexpr uint32_t SNAPSHOT_MAGIC_V3 = 0x33535753; // "SWS3", saved before expense rows were reused
+    static constexpr uint32_t SNAPSHOT_MAGIC_V2 = 0x32535753; // "SWS2", saved before expenses had currencies
+    static constexpr uint32_t SNAPSHOT_MAGIC_V1 = 0x31535753; // "SWS1", saved without the timeline as well
+
+    // Held by every public call that changes state, so a checkpoint never sees
+    // one half done. On the way out it writes a full journal batch and
+    // checkpoints once the journal has grown past checkpointBytes.
+    class Mutation
+    {
+        SplitwiseSystem &system;
+        shared_lock<shared_mutex> guard;
+
+    public:
+        explicit Mutation(SplitwiseSystem &system) : system(system), guard(system.checkpointLock) {}
+
+        ~Mutation()
+        {
+            guard.unlock();
+            system.afterMutation();
+        }
+    };
+
+    // An expense's payer, group and shares, copied out of the store so they
+    // can be settled after expenseLock is released
+    struct ShareSet
+    {
+        UserId paidBy;
+        GroupId group;
+        CurrencyId currency;
+        vector<UserId> users;  // every participant
+        vector<Money> amounts; // parallel to users; empty until shares are set
+    };
 
 public:
-    SplitwiseSystem()
+    SplitwiseSystem() : timeline(expenses), fxRates(make_shared<FxTable>())
     {
         userIdCounter = 1;
-        expenseIdCounter = 1;
+        groupIdCounter = 1;
+        generation = 0;
+        checkpointBytes = 0;
+    }
+
+    ~SplitwiseSystem() { stopAuditor(); }
+
+    // Makes the system durable under 'directory' (created if missing): loads
+    // the latest snapshot, replays the journal written after it, and journals
+    // every change from here on. 'batchBytes' of journal are written and
+    // fsynced together. Call once, on a fresh system, before sharing it
+    // between threads; false means the directory could not be used.
+    bool openStorage(const string &directory, size_t batchBytes = 1 << 20, uint64_t checkpointBytes = uint64_t(256) << 20)
+    {
+        if (journal || (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST))
+            return false;
+        storageDirectory = directory;
+        this->checkpointBytes = checkpointBytes;
+        {
+            MappedFile snapshot(snapshotPath());
+            if (snapshot.isOpen() && !loadSnapshot(snapshot))
+                return false;
+        }
+
+        string path = journalPath(generation);
+        {
+            MappedFile log(path);
+            if (log.isOpen())
+            {
+                size_t intact = Journal::replay(log.begin(), log.size(), [this](BinaryReader &record)
+                                                { applyRecord(record); });
+                // Drop a torn last batch so new records follow intact ones
+                if (intact < log.size() && truncate(path.c_str(), intact) != 0)
+                    return false;
+            }
+        }
+        // Left behind when a checkpoint stopped between snapshot and cleanup
+        if (generation > 0)
+            unlink(journalPath(generation - 1).c_str());
+
+        journal = make_unique<Journal>(path, batchBytes);
+        return journal->isOpen();
+    }
+
+    // Writes a snapshot of everything and starts an empty journal after it.
+    // Changes wait while it runs.
+    bool checkpoint()
+    {
+        unique_lock<shared_mutex> guard(checkpointLock);
+        return writeCheckpoint();
+    }
+
+    // Forces the journal batch written so far to disk
+    bool syncJournal()
+    {
+        return journal && journal->sync();
+    }
+
+    // A journal write or fsync has failed: changes since then may not
+    // survive a restart. Stays set for the life of the system.
+    bool storageFailed() const
+    {
+        return journal && journal->hasFailed();
     }
 
-    // Register User
+    // Register User. The User belongs to the system and stays put for as
+    // long as the system lives.
     User *registerUser(string name, string email)
     {
-        auto userId = generateUserId();
-        User *user = new User(userId, name, email);
-        users.push_back(user);
-        return user;
+        Mutation mutation(*this);
+        return insertUser(generateUserId(), name, email);
     }
 
-    Expense *addExpense(string description, string paidBy, double amount, vector<string> &involvedUsers, ExpenseType type = ExpenseType::EQUAL)
+    Expense addExpense(string description, string paidBy, double amount, vector<string> &involvedUsers, ExpenseType type = ExpenseType::EQUAL)
     {
-        if (!findUser(paidBy))
-            return nullptr;
+        return addExpense(description, paidBy, Money::fromDouble(amount), involvedUsers, type);
+    }
 
-        string expenseId = generateExpenseId();
-        Expense *expense = new Expense(expenseId, description, paidBy, amount, type, involvedUsers);
-        expenses.push_back(expense);
+    Expense addExpense(string description, string paidBy, Money amount, vector<string> &involvedUsers, ExpenseType type = ExpenseType::EQUAL)
+    {
+        return createExpense(nullptr, description, paidBy, amount, HOME_CURRENCY, involvedUsers, type);
+    }
 
-        if (type == ExpenseType::EQUAL)
+    // 'currency': ISO code, e.g. "EUR"; 'amount' is in that currency
+    Expense addExpense(string description, string paidBy, double amount, const string &currency, vector<string> &involvedUsers, ExpenseType type = ExpenseType::EQUAL)
+    {
+        CurrencyId id = currencyOf(currency);
+        if (id == Currency::INVALID)
+            return Expense();
+        return createExpense(nullptr, description, paidBy, Money::fromDouble(amount), id, involvedUsers, type);
+    }
+
+    Group *createGroup(string name, const vector<string> &memberIds)
+    {
+        Mutation mutation(*this);
+        vector<UserId> members;
+        members.reserve(memberIds.size());
+        for (const string &userId : memberIds)
+        {
+            User *member = findUser(userId);
+            if (!member)
+                return nullptr;
+            members.push_back(member->getId());
+        }
+
+        return insertGroup(generateGroupId(), name, members);
+    }
+
+    bool addGroupMember(const string &groupId, const string &userId)
+    {
+        Mutation mutation(*this);
+        Group *group = findGroup(groupId);
+        User *user = findUser(userId);
+        if (!group || !user)
+            return false;
+        addMemberToGroup(group, user->getId());
+        return true;
+    }
+
+    // Payer and every participant must belong to the group
+    Expense addGroupExpense(const string &groupId, string description, string paidBy, double amount, vector<string> &involvedUsers, ExpenseType type = ExpenseType::EQUAL)
+    {
+        Group *group = findGroup(groupId);
+        if (!group)
+            return Expense();
+        return createExpense(group, description, paidBy, Money::fromDouble(amount), HOME_CURRENCY, involvedUsers, type);
+    }
+
+    Expense addGroupExpense(const string &groupId, string description, string paidBy, double amount, const string &currency, vector<string> &involvedUsers, ExpenseType type = ExpenseType::EQUAL)
+    {
+        Group *group = findGroup(groupId);
+        CurrencyId id = currencyOf(currency);
+        if (!group || id == Currency::INVALID)
+            return Expense();
+        return createExpense(group, description, paidBy, Money::fromDouble(amount), id, involvedUsers, type);
+    }
+
+    // One expense for addExpenses()
+    struct ExpenseRequest
+    {
+        string description;
+        string paidBy;
+        Money amount;
+        string currency;        // ISO code, e.g. "EUR"; empty for the home currency
+        ExpenseType type = ExpenseType::EQUAL;
+        vector<string> users;   // participants
+        vector<int64_t> values; // parallel to users: cents (EXACT) or basis points (PERCENT); unused for EQUAL
+        string groupId;         // empty unless it is a group expense
+        int64_t timestamp = 0;  // when it happened, in Unix seconds; 0 for now
+    };
+
+    // Expenses with their users resolved and their shares worked out, ready
+    // to be stored and settled together; built by prepareBatch, or by a
+    // caller that resolves users itself (see addResolvedExpenses)
+    struct ExpenseBatch
+    {
+        struct Row
         {
-            settleExpense(expenseId);
+            string_view description; // into the request or the journal record
+            UserId paidBy;
+            Money amount;
+            CurrencyId currency;
+            ExpenseType type;
+            GroupId group;
+            int64_t timestamp;
+            size_t shareBegin; // into shareUsers/shareAmounts
+            size_t shareCount;
+        };
+
+        vector<Row> rows;
+        vector<UserId> shareUsers;
+        vector<Money> shareAmounts;
+
+        Span<UserId> usersOf(const Row &row) const { return Span<UserId>(shareUsers.data() + row.shareBegin, row.shareCount); }
+        Span<Money> amountsOf(const Row &row) const { return Span<Money>(shareAmounts.data() + row.shareBegin, row.shareCount); }
+    };
+
+    // Adds many expenses, shares included, in one go: ids are resolved under a
+    // single lock, the batch is stored and journaled in one step, and each pair
+    // of users gets the batch's summed change in one sorted pass over the
+    // ledger. Returns a handle per request, empty where the request was
+    // rejected (unknown user, group or currency, a non-member, no participants,
+    // shares that don't add up); the others are added regardless.
+    vector<Expense> addExpenses(Span<ExpenseRequest> requests)
+    {
+        Mutation mutation(*this);
+        ExpenseBatch batch;
+        vector<size_t> accepted = prepareBatch(requests, batch);
+        ExpenseId first = insertExpenses(batch);
+        vector<Expense> added(requests.size());
+        for (size_t row = 0; row < accepted.size(); row++)
+        {
+            added[accepted[row]] = Expense(&expenses, first + row);
         }
+        return added;
+    }
 
-        return expense;
+    // addExpenses for a batch whose users are already internal ids, e.g. a
+    // command log replayed by CommandProcessor; a row with an unknown user or
+    // group, or shares that don't add up, is dropped. Returns how many were
+    // added.
+    size_t addResolvedExpenses(const ExpenseBatch &batch)
+    {
+        Mutation mutation(*this);
+        size_t users = userCount();
+        size_t groupCount;
+        {
+            shared_lock<shared_mutex> guard(directoryLock);
+            groupCount = groups.size();
+        }
+        auto valid = [&](const ExpenseBatch::Row &row)
+        {
+            Money sum;
+            for (Money share : batch.amountsOf(row))
+                sum += share;
+            Span<UserId> participants = batch.usersOf(row);
+            return row.paidBy < users && row.currency < Currency::COUNT && sum == row.amount && row.shareCount > 0 &&
+                   ExpenseStore::isExpenseAmount(row.amount) &&
+                   (row.group == NO_GROUP || row.group < groupCount) &&
+                   all_of(participants.begin(), participants.end(), [&](UserId user)
+                          { return user < users && inGroup(row.group, user); }) &&
+                   inGroup(row.group, row.paidBy);
+        };
+        if (all_of(batch.rows.begin(), batch.rows.end(), valid))
+        {
+            insertExpenses(batch);
+            return batch.rows.size();
+        }
+        ExpenseBatch kept;
+        for (const ExpenseBatch::Row &row : batch.rows)
+        {
+            if (!valid(row))
+                continue;
+            ExpenseBatch::Row copy = row;
+            copy.shareBegin = kept.shareUsers.size();
+            Span<UserId> participants = batch.usersOf(row);
+            Span<Money> amounts = batch.amountsOf(row);
+            kept.shareUsers.insert(kept.shareUsers.end(), participants.begin(), participants.end());
+            kept.shareAmounts.insert(kept.shareAmounts.end(), amounts.begin(), amounts.end());
+            kept.rows.push_back(copy);
+        }
+        insertExpenses(kept);
+        return kept.rows.size();
     }
 
-    void settleExpense(string expenseId)
+    void settleExpense(const string &expenseId)
     {
-        Expense *expense = findExpense(expenseId);
+        Mutation mutation(*this);
+        Expense expense = findExpense(expenseId);
         if (!expense)
             return;
+        settleShares(expense.getId());
+    }
+
+    void settleExpense(ExpenseId expenseId)
+    {
+        Mutation mutation(*this);
+        settleShares(expenseId);
+    }
 
-        const string &paidBy = expense->getPaidBy();
-        const auto &shares = expense->getShares();
+    // What 'otherUserId' owes 'userId' in 'currency', unconverted (negative:
+    // what userId owes otherUserId)
+    Money getBalance(const string &userId, const string &otherUserId, const string &currency = "") const
+    {
+        User *user = findUser(userId);
+        User *other = findUser(otherUserId);
+        CurrencyId id = currencyOf(currency);
+        if (!user || !other || id == Currency::INVALID)
+            return Money();
+        return ledger.getBalance(user->getId(), other->getId(), id);
+    }
 
-        for (const auto &share : shares)
+    // Everyone the user shares a balance with and what they owe the user in
+    // every currency, converted to 'displayCurrency' with the current rates.
+    // Taken at a single point in time (no expense is ever half included).
+    // Balances in a currency with no published rate are left out.
+    vector<pair<User *, Money>> getBalances(const string &userId, const string &displayCurrency = "") const
+    {
+        vector<pair<User *, Money>> balances;
+        User *user = findUser(userId);
+        CurrencyId display = currencyOf(displayCurrency);
+        if (!user || display == Currency::INVALID)
+            return balances;
+        ShardedLedger::UserBalances held = ledger.snapshot(user->getId());
+        vector<Money> totals = convertBalances(held, display);
+        balances.reserve(totals.size());
+        shared_lock<shared_mutex> guard(directoryLock);
+        for (size_t i = 0; i < totals.size(); i++)
+        {
+            balances.emplace_back(users[held.counterparties[i]], totals[i]);
+        }
+        return balances;
+    }
+
+    // Every non-zero balance in 'currency' as (creditor, debtor, what the
+    // debtor owes), by creditor then debtor, as of a single point in time
+    vector<tuple<User *, User *, Money>> getAllBalances(const string &currency = "") const
+    {
+        vector<tuple<UserId, UserId, Money>> owed;
+        CurrencyId id = currencyOf(currency);
+        if (id == Currency::INVALID)
+            return {};
+        ledger.forEachBalance(id, [&](UserId lo, UserId hi, Money balance)
+                              {
+            if (Money() < balance)
+                owed.emplace_back(lo, hi, balance);
+            else
+                owed.emplace_back(hi, lo, -balance); });
+        sort(owed.begin(), owed.end(), [](const auto &a, const auto &b)
+             { return get<0>(a) != get<0>(b) ? get<0>(a) < get<0>(b) : get<1>(a) < get<1>(b); });
+        vector<tuple<User *, User *, Money>> balances;
+        balances.reserve(owed.size());
+        shared_lock<shared_mutex> guard(directoryLock);
+        for (const auto &entry : owed)
+            balances.emplace_back(users[get<0>(entry)], users[get<1>(entry)], get<2>(entry));
+        return balances;
+    }
+
+    // Publishes a new version of the rate table. Each entry is a currency code
+    // and how many units of it one unit of the home currency buys; rates not
+    // named keep their value. Queries already running finish on the version
+    // they started with. False, and nothing changes, on an unknown code or a
+    // rate that isn't a positive number.
+    bool setExchangeRates(const vector<pair<string, double>> &rates)
+    {
+        Mutation mutation(*this);
+        vector<pair<CurrencyId, double>> changes;
+        changes.reserve(rates.size());
+        for (const auto &rate : rates)
+        {
+            CurrencyId currency = Currency::find(rate.first);
+            if (currency == Currency::INVALID || !(rate.second > 0) || !isfinite(rate.second))
+                return false;
+            changes.emplace_back(currency, rate.second);
+        }
+        publishRates(changes);
+        return true;
+    }
+
+    // The current rate table; stays valid, unchanged, however many versions follow
+    shared_ptr<const FxTable> getExchangeRates() const
+    {
+        lock_guard<mutex> guard(fxLock);
+        return fxRates;
+    }
+
+    // What everyone owes the user minus what the user owes, in 'currency',
+    // unconverted; O(1)
+    Money getNetBalance(const string &userId, const string &currency = "") const
+    {
+        User *user = findUser(userId);
+        CurrencyId id = currencyOf(currency);
+        if (!user || id == Currency::INVALID)
+            return Money();
+        return ledger.getNet(user->getId(), id);
+    }
+
+    // The k users who owe the most in 'currency', with their (negative) nets,
+    // biggest debt first; O(k log k) however many users there are
+    vector<pair<User *, Money>> getTopDebtors(size_t k, const string &currency = "") const
+    {
+        return rankedUsers(k, false, currency);
+    }
+
+    // The k users owed the most in 'currency', with their nets, largest first
+    vector<pair<User *, Money>> getTopCreditors(size_t k, const string &currency = "") const
+    {
+        return rankedUsers(k, true, currency);
+    }
+
+    // The same within a group, over members' nets in the group
+    vector<pair<User *, Money>> getGroupTopDebtors(const string &groupId, size_t k, const string &currency = "") const
+    {
+        return rankedMembers(groupId, k, false, currency);
+    }
+
+    vector<pair<User *, Money>> getGroupTopCreditors(const string &groupId, size_t k, const string &currency = "") const
+    {
+        return rankedMembers(groupId, k, true, currency);
+    }
+
+    void displayLeaderboard(size_t k, const string &currency = "") const
+    {
+        string prefix = Currency::label(currencyOf(currency));
+        cout << "\nTop debtors:\n";
+        for (const auto &entry : getTopDebtors(k, currency))
+            cout << "  " << entry.first->getUserId() << " owes " << prefix << -entry.second << "\n";
+        cout << "Top creditors:\n";
+        for (const auto &entry : getTopCreditors(k, currency))
+            cout << "  " << entry.first->getUserId() << " is owed " << prefix << entry.second << "\n";
+    }
+
+    void showAllBalances(const string &displayCurrency = "") const
+    {
+        cout << "\nAll Balances:" << endl;
+        for (const auto &user : userDirectory())
+        {
+            displayBalances(user, displayCurrency);
+        }
+    }
+
+    void displayBalances(const User *user, const string &displayCurrency = "") const
+    {
+        string prefix = Currency::label(currencyOf(displayCurrency));
+        cout << "Balance sheet for " << user->getName() << " (" << user->getUserId() << "):\n";
+        for (const auto &balance : getBalances(user->getUserId(), displayCurrency))
+        {
+            cout << "  With " << balance.first->getUserId() << ": " << prefix << balance.second << "\n";
+        }
+    }
+
+    struct ImportResult
+    {
+        size_t imported = 0;
+        size_t rejected = 0; // malformed rows, unknown users, shares that don't add up
+    };
+
+    // Bulk load of historical expenses from a CSV or binary file (see
+    // BulkImporter for the formats). Chunks are parsed and settled into
+    // per-chunk partial ledgers in parallel, then merged here in file order.
+    // Rows keep their own timestamp and currency; a row without a timestamp
+    // is dated now.
+    ImportResult importExpenses(const string &path, size_t threads = thread::hardware_concurrency())
+    {
+        Mutation mutation(*this);
+        ImportResult result;
+        MappedFile file(path);
+        if (!file.isOpen())
+            return result;
+
+        // Chunks arrive in file order, so expense ids follow the file
+        int64_t now = currentTime();
+        auto apply = [&](ImportChunk &chunk)
+        {
+            {
+                unique_lock<shared_mutex> guard(expenseLock);
+                for (const ImportedExpense &row : chunk.rows)
+                {
+                    int64_t timestamp = row.timestamp ? row.timestamp : now;
+                    ExpenseId id = expenses.addWithShares(row.description, row.paidBy, row.amount, row.currency, row.type,
+                                                          chunk.shares.data() + row.shareBegin, row.shareCount, NO_GROUP, timestamp);
+                    expenseIndex.add(id, row.paidBy, expenses.getParticipants(id));
+                    timeline.add(id);
+                    journalRecord(JournalRecord::IMPORTED, [&](BinaryWriter &record)
+                                  {
+                        const pair<UserId, Money> *shares = chunk.shares.data() + row.shareBegin;
+                        record.put(row.paidBy);
+                        record.put(row.amount);
+                        record.put(row.type);
+                        record.put(timestamp);
+                        record.putString(row.description);
+                        record.put<uint64_t>(row.shareCount);
+                        for (size_t i = 0; i < row.shareCount; i++)
+                            record.put(shares[i].first);
+                        record.put<uint64_t>(row.shareCount);
+                        for (size_t i = 0; i < row.shareCount; i++)
+                            record.put(shares[i].second);
+                        record.put(row.currency); });
+                }
+            }
+            ledger.merge(chunk.ledger);
+            result.imported += chunk.rows.size();
+            result.rejected += chunk.rejected;
+        };
+
+        if (BulkImporter::isBinary(file))
         {
-            if (share.first != paidBy)
+            BulkImporter::parseBinary(file, userCount(), threads, apply);
+        }
+        else
+        {
+            auto resolve = [this](string_view userId)
             {
-                // Update balances for both users
-                User *payer = findUser(paidBy);
-                User *participant = findUser(share.first);
+                User *user = findUser(userId);
+                return user ? user->getId() : BulkImporter::INVALID_USER;
+            };
+            BulkImporter::parseCsv(file, resolve, threads, apply);
+        }
+        return result;
+    }
+
+    struct ExportResult
+    {
+        bool ok = false; // false if the file could not be written
+        size_t rows = 0;
+        uint64_t bytes = 0;
+    };
+
+    // Streams every non-zero balance to 'path' ("-" for stdout), one record
+    // per pair and currency: what the debtor owes the creditor. Each currency
+    // is taken at a single point in time: its balances are copied with the
+    // shards held, then formatted in parallel and written without them.
+    ExportResult exportBalances(const string &path, ReportFormat format = ReportFormat::CSV, size_t threads = thread::hardware_concurrency())
+    {
+        struct Owed
+        {
+            UserId creditor;
+            UserId debtor;
+            Money amount;
+        };
+        ExportResult result;
+        ReportWriter writer(path, format);
+        writer.begin("creditor,debtor,currency,amount");
+        for (uint64_t bits = ledger.getCurrencies(); bits && writer.ok(); bits &= bits - 1)
+        {
+            CurrencyId currency = CurrencyId(__builtin_ctzll(bits));
+            vector<vector<Owed>> byShard;
+            ledger.withLedgers(currency, [&](const auto &shards)
+                               {
+                byShard.resize(shards.size());
+                for (size_t shard = 0; shard < shards.size(); shard++)
+                {
+                    if (!shards[shard])
+                        continue;
+                    byShard[shard].reserve(shards[shard]->size());
+                    shards[shard]->forEachBalance([&](UserId lo, UserId hi, Money balance)
+                                                  {
+                        if (Money() < balance)
+                            byShard[shard].push_back(Owed{lo, hi, balance});
+                        else
+                            byShard[shard].push_back(Owed{hi, lo, -balance}); });
+                } });
+            // Every user in a balance was registered before it, so a copy
+            // taken now covers them all
+            vector<User *> directory = userDirectory();
+            writer.writeChunks(byShard.size(), threads, [&](size_t shard, ReportBuffer &out)
+                               {
+                for (const Owed &owed : byShard[shard])
+                    appendBalance(out, format, directory[owed.creditor]->getUserId(), directory[owed.debtor]->getUserId(), currency, owed.amount); });
+            for (const vector<Owed> &rows : byShard)
+                result.rows += rows.size();
+        }
+        result.ok = writer.finish();
+        result.bytes = writer.bytesWritten();
+        return result;
+    }
 
-                if (payer && participant)
+    // Streams every expense still standing, oldest id first, with its shares
+    // ("U1=60.00;U2=40.00" in CSV, as importExpenses reads them). Formatted
+    // in chunks in parallel, a round of chunks at a time under expenseLock;
+    // the lock is let go while each round is written, so expenses added
+    // meanwhile are left out and ones edited meanwhile may show either way.
+    ExportResult exportExpenses(const string &path, ReportFormat format = ReportFormat::CSV, size_t threads = thread::hardware_concurrency())
+    {
+        const size_t CHUNK = 8192;
+        ExportResult result;
+        ReportWriter writer(path, format);
+        writer.begin("expense,description,paid_by,amount,currency,type,group,timestamp,shares");
+        size_t count;
+        {
+            shared_lock<shared_mutex> guard(expenseLock);
+            count = expenses.size();
+        }
+        vector<User *> directory;
+        vector<Group *> groupTable;
+        atomic<size_t> rows(0);
+        auto lockRound = [&]
+        {
+            shared_lock<shared_mutex> guard(expenseLock);
+            // An edit may have brought in users or groups newer than the last copy
+            directory = userDirectory();
+            groupTable = groupDirectory();
+            return guard;
+        };
+        writer.writeChunks((count + CHUNK - 1) / CHUNK, threads, [&](size_t chunk, ReportBuffer &out)
+                           {
+            size_t written = 0;
+            for (ExpenseId id = chunk * CHUNK; id < min(count, (chunk + 1) * CHUNK); id++)
+            {
+                if (expenses.contains(id))
                 {
-                    payer->updateBalance(share.first, share.second);
-                    participant->updateBalance(paidBy, -share.second);
+                    appendExpense(out, format, id, directory, groupTable);
+                    written++;
                 }
             }
+            rows += written; }, lockRound);
+        result.ok = writer.finish();
+        result.rows = rows;
+        result.bytes = writer.bytesWritten();
+        return result;
+    }
+
+    // Streams every user's statement for [from, to) in 'currency' (see
+    // getStatement), in registration order. The statements are all worked
+    // out at one point in time under expenseLock, then formatted in parallel
+    // and written without it.
+    ExportResult exportStatements(const string &path, int64_t from, int64_t to, ReportFormat format = ReportFormat::CSV,
+                                  const string &currency = "", size_t threads = thread::hardware_concurrency())
+    {
+        const size_t CHUNK = 4096;
+        ExportResult result;
+        CurrencyId id = currencyOf(currency);
+        if (id == Currency::INVALID)
+            return result;
+        ReportWriter writer(path, format);
+        writer.begin("user,currency,expenses,paid,owed,net");
+        vector<User *> directory;
+        vector<Statement> statements;
+        {
+            shared_lock<shared_mutex> guard(expenseLock);
+            directory = userDirectory();
+            statements.reserve(directory.size());
+            for (UserId user = 0; user < directory.size(); user++)
+                statements.push_back(timeline.statement(user, id, from, to));
         }
+        writer.writeChunks((directory.size() + CHUNK - 1) / CHUNK, threads, [&](size_t chunk, ReportBuffer &out)
+                           {
+            for (UserId user = chunk * CHUNK; user < min(directory.size(), (chunk + 1) * CHUNK); user++)
+                appendStatement(out, format, directory[user]->getUserId(), id, statements[user]); });
+        result.ok = writer.finish();
+        result.rows = directory.size();
+        result.bytes = writer.bytesWritten();
+        return result;
     }
 
-    void showAllBalances() const
+    // Bytes held by each part of the system, from container capacities;
+    // names, emails and allocator overhead are not counted
+    struct MemoryUsage
     {
-        cout << "\nAll Balances:" << endl;
-        for (const auto &user : users)
+        size_t directory = 0; // users, groups and the tables indexing them
+        size_t expenses = 0;  // the columnar store
+        size_t history = 0;   // per-user expense index
+        size_t timeline = 0;  // by month, with running totals
+        size_t ledger = 0;    // balances, counterparty lists and nets
+
+        size_t total() const { return directory + expenses + history + timeline + ledger; }
+    };
+
+    MemoryUsage memoryUsage() const
+    {
+        MemoryUsage usage;
+        {
+            shared_lock<shared_mutex> guard(directoryLock);
+            usage.directory = userPool.memoryBytes() + groupPool.memoryBytes() +
+                              (users.capacity() + groups.capacity()) * sizeof(void *) +
+                              userIndex.bucket_count() * sizeof(void *) + userIndex.size() * sizeof(pair<string, UserId>) +
+                              groupIndex.bucket_count() * sizeof(void *) + groupIndex.size() * sizeof(pair<string, GroupId>);
+        }
+        {
+            shared_lock<shared_mutex> guard(expenseLock);
+            usage.expenses = expenses.memoryBytes();
+            usage.history = expenseIndex.memoryBytes();
+            usage.timeline = timeline.memoryBytes();
+        }
+        usage.ledger = ledger.memoryBytes();
+        return usage;
+    }
+
+    // Checks the invariants without stopping changes: each ledger shard
+    // against its rolling checksum, each user's net against the net stripes'
+    // checksums (and that every currency's nets add up to zero), and that
+    // every expense's shares add up to its amount. Shards and chunks of
+    // expenses are checked on 'threads' threads, each under its own lock only.
+    AuditReport audit(size_t threads = thread::hardware_concurrency()) const
+    {
+        const size_t CHUNK = 65536;
+        auto started = chrono::steady_clock::now();
+        AuditReport report;
+        size_t expenseCount;
+        {
+            shared_lock<shared_mutex> guard(expenseLock);
+            expenseCount = expenses.size();
+        }
+        size_t chunks = (expenseCount + CHUNK - 1) / CHUNK;
+        size_t tasks = ShardedLedger::SHARD_COUNT + chunks;
+        vector<uint8_t> shardOk(ShardedLedger::SHARD_COUNT, 1);
+        vector<size_t> badInChunk(chunks, AuditReport::NONE);
+        atomic<size_t> pairs(0);
+        atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            for (size_t task = next++; task < tasks; task = next++)
+            {
+                if (task < ShardedLedger::SHARD_COUNT)
+                {
+                    size_t read = 0;
+                    shardOk[task] = ledger.auditShard(task, read);
+                    pairs += read;
+                    continue;
+                }
+                size_t chunk = task - ShardedLedger::SHARD_COUNT;
+                shared_lock<shared_mutex> guard(expenseLock);
+                for (ExpenseId id = chunk * CHUNK; id < min(expenseCount, (chunk + 1) * CHUNK); id++)
+                {
+                    if (!expenses.contains(id))
+                        continue;
+                    Money sum;
+                    Span<Money> shares = expenses.getShareAmounts(id);
+                    for (Money share : shares)
+                        sum += share;
+                    if (!shares.empty() && sum != expenses.getAmount(id))
+                    {
+                        badInChunk[chunk] = id;
+                        break;
+                    }
+                }
+            }
+        };
+        threads = max<size_t>(1, min(threads, tasks));
+        vector<thread> pool;
+        for (size_t i = 1; i < threads; i++)
+        {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (thread &t : pool)
+        {
+            t.join();
+        }
+
+        size_t stripe;
+        ledger.auditNets(stripe, report.netsBalance);
+        if (stripe != ShardedLedger::SHARD_COUNT)
+            report.divergentStripe = stripe;
+        for (size_t i = 0; i < shardOk.size() && report.divergentShard == AuditReport::NONE; i++)
+        {
+            if (!shardOk[i])
+                report.divergentShard = i;
+        }
+        for (size_t i = 0; i < chunks && report.badExpense == AuditReport::NONE; i++)
+            report.badExpense = badInChunk[i];
+        report.ok = report.divergentShard == AuditReport::NONE && report.divergentStripe == AuditReport::NONE &&
+                    report.netsBalance && report.badExpense == AuditReport::NONE;
+        report.shards = ShardedLedger::SHARD_COUNT;
+        report.pairs = pairs;
+        report.expenses = expenseCount;
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        return report;
+    }
+
+    // Audits over and over in the background, spending at most 'budget' of
+    // one core on it (see LedgerAuditor); a pass on n threads counts n times
+    // over. 'onDivergence' is called on the auditor's thread with every
+    // report that finds a problem.
+    void startAuditor(double budget = 0.01, size_t threads = 1, function<void(const AuditReport &)> onDivergence = nullptr)
+    {
+        threads = max<size_t>(1, threads);
+        auditor.start(budget / threads, [this, threads]
+                      { return audit(threads); }, onDivergence);
+    }
+
+    void stopAuditor() { auditor.stop(); }
+
+    // The background auditor's latest report; empty until auditPasses() > 0
+    AuditReport lastAudit() const { return auditor.lastReport(); }
+
+    size_t auditPasses() const { return auditor.passCount(); }
+
+    // Short list of transfers that settles every balance (see DebtSimplifier);
+    // each currency is settled in that currency
+    vector<Settlement> simplifyDebts() const
+    {
+        vector<Settlement> plan;
+        size_t count = userCount();
+        for (uint64_t bits = ledger.getCurrencies(); bits; bits &= bits - 1)
+        {
+            vector<Settlement> part = DebtSimplifier::simplify(ledger, CurrencyId(__builtin_ctzll(bits)), count);
+            plan.insert(plan.end(), part.begin(), part.end());
+        }
+        return plan;
+    }
+
+    void showSettlementPlan() const
+    {
+        cout << "\nSettlement Plan:" << endl;
+        for (const Settlement &settlement : simplifyDebts())
         {
-            user->displayBalances();
+            cout << "  " << getUser(settlement.from)->getUserId() << " pays " << getUser(settlement.to)->getUserId() << ": "
+                 << Currency::label(settlement.currency) << settlement.amount << "\n";
         }
     }
 
+    // EXACT: amounts per user, must sum to the total. PERCENT: percentages per
+    // user (up to two decimals), must sum to 100. Returns false if rejected.
     bool setExpenseShares(string expenseId, map<std::string, double> &shares)
     {
-        Expense *expense = findExpense(expenseId);
+        Mutation mutation(*this);
+        Expense expense = findExpense(expenseId);
         if (!expense)
             return false;
-
-        expense->setShares(shares);
-        settleExpense(expenseId);
-        return true;
+        vector<UserId> shareUsers;
+        vector<int64_t> values; // cents (EXACT) or basis points (PERCENT)
+        for (const auto &share : shares)
+        {
+            User *user = findUser(share.first);
+            if (!user)
+                return false;
+            shareUsers.push_back(user->getId());
+            if (expense.getType() == ExpenseType::EXACT)
+                values.push_back(Money::fromDouble(share.second).getCents());
+            else
+                values.push_back(Money::toBasisPoints(share.second));
+        }
+        return changeShares(expense.getId(), shareUsers, values);
     }
 
-    void displayUserExpenses(const std::string &userId) const
+    // Turns the expense into what 'request' describes: payer, amount,
+    // currency, group, participants and split. It keeps its id and
+    // description, and its timestamp unless the request gives one. Only the
+    // difference from the old shares reaches the ledger, the groups and the
+    // statements. Nothing in an edit grows with the number of expenses: it is
+    // O(participants), plus, for each user it adds or drops, a move of that
+    // user's later timeline entries and one block of their history. False,
+    // and nothing changes, if the expense is gone or addExpenses would reject
+    // the request.
+    bool editExpense(const string &expenseId, const ExpenseRequest &request)
     {
-        User *user = findUser(userId);
-        if (!user)
-            return;
+        Mutation mutation(*this);
+        ExpenseBatch batch;
+        if (prepareBatch(Span<ExpenseRequest>(&request, 1), batch).empty())
+            return false;
+        ExpenseId id;
+        {
+            shared_lock<shared_mutex> guard(expenseLock);
+            if (!parseExpenseId(expenseId, id))
+                return false;
+        }
+        const ExpenseBatch::Row &row = batch.rows[0];
+        return replaceExpense(id, row.paidBy, row.amount, row.currency, row.type, row.group, request.timestamp,
+                              batch.usersOf(row), batch.amountsOf(row));
+    }
 
-        std::cout << "\nExpenses for " << user->getName() << ":" << std::endl;
-        for (const auto &expense : expenses)
+    // Takes the expense's shares back out of every balance, group and
+    // statement. Costs what an edit dropping every participant would, plus
+    // one run of its month's log. Its id is never reused.
+    bool deleteExpense(const string &expenseId)
+    {
+        Mutation mutation(*this);
+        ExpenseId id;
         {
-            if (expense->getPaidBy() == userId ||
-                std::find(expense->getParticipants().begin(),
-                          expense->getParticipants().end(),
-                          userId) != expense->getParticipants().end())
-            {
-                expense->displayInfo();
-                std::cout << "------------------------" << std::endl;
-            }
+            shared_lock<shared_mutex> guard(expenseLock);
+            if (!parseExpenseId(expenseId, id))
+                return false;
         }
+        return removeExpense(id);
     }
 
-    void displayExpenses() const
+    // One page of the user's expenses, newest first. Start with a fresh
+    // HistoryCursor and pass it back for each following page.
+    vector<Expense> getUserExpenses(const string &userId, HistoryCursor &cursor, size_t limit) const
     {
-        cout << "\nAll Expenses:" << endl;
-        for (const auto &expense : expenses)
+        vector<Expense> page;
+        User *user = findUser(userId);
+        if (!user)
         {
-            expense->displayInfo();
-            cout << "------------------------" << endl;
+            cursor.done = true;
+            return page;
+        }
+        shared_lock<shared_mutex> guard(expenseLock);
+        for (ExpenseId id : expenseIndex.page(user->getId(), cursor, limit))
+        {
+            page.emplace_back(&expenses, id);
         }
+        return page;
     }
-    
-    //*************************************************Helpers*************************************************//
 
-    string generateUserId()
+    // What the user paid and owed in expenses in 'currency' timestamped in
+    // [from, to), in Unix seconds. Costs two running-total lookups plus the
+    // user's expenses in the two edge months, however long the range.
+    Statement getStatement(const string &userId, int64_t from, int64_t to, const string &currency = "") const
     {
-        return "U" + to_string(userIdCounter++);
+        User *user = findUser(userId);
+        CurrencyId id = currencyOf(currency);
+        if (!user || id == Currency::INVALID)
+            return Statement();
+        shared_lock<shared_mutex> guard(expenseLock);
+        return timeline.statement(user->getId(), id, from, to);
     }
 
-    string generateExpenseId()
+    // Every expense timestamped in [from, to), oldest first
+    vector<Expense> getExpensesBetween(int64_t from, int64_t to) const
     {
-        return "E" + to_string(expenseIdCounter++);
+        vector<Expense> found;
+        shared_lock<shared_mutex> guard(expenseLock);
+        timeline.forEachBetween(from, to, [&](ExpenseId id)
+                                { found.emplace_back(&expenses, id); });
+        return found;
     }
 
-    User *findUser(const std::string &userId) const
+    void displayStatement(const string &userId, int64_t from, int64_t to, const string &currency = "") const
     {
-        auto it = find_if(users.begin(), users.end(),
-                          [userId](User *user)
-                          { return user->getUserId() == userId; });
-        return it != users.end() ? *it : nullptr;
+        Statement statement = getStatement(userId, from, to, currency);
+        string prefix = Currency::label(currencyOf(currency));
+        cout << "Statement for " << userId << ": " << statement.expenses << " expenses, paid " << prefix << statement.paid
+             << ", owed " << prefix << statement.owed << ", net " << prefix << statement.net() << "\n";
     }
-    Expense *findExpense(const std::string &expenseId) const
+
+    // Each member's net within the group, per currency the group has spent
+    // in; O(members) per currency
+    void displayGroupSummary(const string &groupId) const
     {
-        auto it = std::find_if(expenses.begin(), expenses.end(),
-                               [expenseId](Expense *expense)
-                               { return expense->getExpenseId() == expenseId; });
-        return it != expenses.end() ? *it : nullptr;
+        Group *group = findGroup(groupId);
+        if (!group)
+            return;
+
+        cout << "\nGroup " << group->getName() << " (" << group->getGroupId() << "):\n";
+        uint64_t currencies = group->getCurrencies();
+        for (uint64_t bits = currencies ? currencies : uint64_t(1) << HOME_CURRENCY; bits; bits &= bits - 1)
+        {
+            CurrencyId currency = CurrencyId(__builtin_ctzll(bits));
+            if (currencies & (currencies - 1))
+                cout << " In " << Currency::code(currency) << ":\n";
+            string prefix = Currency::label(currency);
+            for (const auto &member : group->getNets(currency))
+            {
+                const string &userId = getUser(member.first)->getUserId();
+                if (member.second.isZero())
+                    cout << "  " << userId << " is settled up\n";
+                else if (member.second < Money())
+                    cout << "  " << userId << " owes " << prefix << -member.second << "\n";
+                else
+                    cout << "  " << userId << " is owed " << prefix << member.second << "\n";
+            }
+        }
     }
 
-    void displayUsers() const
+    // Records the transfers that bring every member of the group to zero, in
+    // each currency the group has spent in
+    vector<Settlement> settleUpGroup(const string &groupId)
     {
-        std::cout << "\nRegistered Users:" << std::endl;
-        for (const auto &user : users)
+        Group *group = findGroup(groupId);
+        if (!group)
+            return {};
+
+        Mutation mutation(*this);
+        vector<Settlement> plan;
+        for (uint64_t bits = group->getCurrencies(); bits; bits &= bits - 1)
         {
-            user->displayInfo();
-            std::cout << "------------------------" << std::endl;
+            CurrencyId currency = CurrencyId(__builtin_ctzll(bits));
+            DebtSimplifier::settleNets(group->getNets(currency), currency, plan);
+        }
+        for (const Settlement &payment : plan)
+        {
+            recordPayment(group, payment);
         }
+        return plan;
     }
-};
\ No newline at end of file
+
+    void displayUserExpenses(const std::string &userId) const
+    {
+        User *user = findUser(userId);
+        if (!user)
+            return;
+
+        vector<User *> directory = userDirectory();
+        shared_lock<shared_mutex> guard(expenseLock);
+        std::cout << "\nExpenses for " << user->getName() << ":" << std::endl;
+        auto show = [&](ExpenseId expenseId)
+        {
+            Expense(&expenses, expenseId).displayInfo(directory);
+            std::cout << "------------------------" << std::endl;
+        };
+        expenseIndex.forEachExpense(user->getId(), show);
+    }
+
+    void displayExpenses() const
+    {
+        vector<User *> directory = userDirectory();
+        shared_lock<shared_mutex> guard(expenseLock);
+        cout << "\nAll Expenses:" << endl;
+        for (ExpenseId expenseId = 0; expenseId < expenses.size(); expenseId++)
+        {
+            if (!expenses.contains(expenseId))
+                continue;
+            Expense(&expenses, expenseId).displayInfo(directory);
+            cout << "------------------------" << endl;
+        }
+    }
+
+    //*************************************************Helpers*************************************************//
+
+    string generateUserId()
+    {
+        return "U" + to_string(userIdCounter.fetch_add(1));
+    }
+
+    string generateGroupId()
+    {
+        return "G" + to_string(groupIdCounter.fetch_add(1));
+    }
+
+    static int64_t currentTime()
+    {
+        return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Empty means the home currency; Currency::INVALID for an unknown code
+    static CurrencyId currencyOf(const string &code)
+    {
+        return code.empty() ? HOME_CURRENCY : Currency::find(code);
+    }
+
+    // Sums what each counterparty owes in every currency, converted to
+    // 'display': one pass with one rate per currency row, all from the same
+    // version of the rate table
+    vector<Money> convertBalances(const ShardedLedger::UserBalances &held, CurrencyId display) const
+    {
+        shared_ptr<const FxTable> rates = getExchangeRates();
+        vector<Money> totals(held.counterparties.size());
+        for (size_t r = 0; r < held.currencies.size(); r++)
+        {
+            CurrencyId currency = held.currencies[r];
+            if (currency == display || (rates->hasRate(currency) && rates->hasRate(display)))
+                rates->convertAdd(held.row(r), currency, display, totals.data());
+        }
+        return totals;
+    }
+
+    vector<pair<User *, Money>> rankedUsers(size_t k, bool creditors, const string &currency) const
+    {
+        CurrencyId id = currencyOf(currency);
+        if (id == Currency::INVALID)
+            return {};
+        return toUsers(ledger.top(k, creditors, id));
+    }
+
+    vector<pair<User *, Money>> rankedMembers(const string &groupId, size_t k, bool creditors, const string &currency) const
+    {
+        Group *group = findGroup(groupId);
+        CurrencyId id = currencyOf(currency);
+        if (!group || id == Currency::INVALID)
+            return {};
+        return toUsers(group->top(k, creditors, id));
+    }
+
+    vector<pair<User *, Money>> toUsers(const vector<pair<UserId, Money>> &entries) const
+    {
+        vector<pair<User *, Money>> result;
+        result.reserve(entries.size());
+        shared_lock<shared_mutex> guard(directoryLock);
+        for (const auto &entry : entries)
+        {
+            result.emplace_back(users[entry.first], entry.second);
+        }
+        return result;
+    }
+
+    // One report record each, for the export calls
+    static void appendBalance(ReportBuffer &out, ReportFormat format, const string &creditor, const string &debtor, CurrencyId currency, Money amount)
+    {
+        if (format == ReportFormat::CSV)
+        {
+            out.appendCsvField(creditor);
+            out.append(',');
+            out.appendCsvField(debtor);
+            out.append(',');
+            out.append(Currency::code(currency));
+            out.append(',');
+            out.appendMoney(amount);
+            out.append('\n');
+            return;
+        }
+        out.beginJsonRecord();
+        out.appendJsonKey("creditor");
+        out.appendJsonString(creditor);
+        out.append(',');
+        out.appendJsonKey("debtor");
+        out.appendJsonString(debtor);
+        out.append(',');
+        out.appendJsonKey("currency");
+        out.appendJsonString(Currency::code(currency));
+        out.append(',');
+        out.appendJsonKey("amount");
+        out.appendMoney(amount);
+        out.append('}');
+    }
+
+    // Caller holds expenseLock
+    void appendExpense(ReportBuffer &out, ReportFormat format, ExpenseId id, const vector<User *> &directory, const vector<Group *> &groupTable) const
+    {
+        static const char *const TYPES[] = {"EQUAL", "EXACT", "PERCENT"};
+        GroupId group = expenses.getGroupId(id);
+        string_view groupId = group != NO_GROUP ? string_view(groupTable[group]->getGroupId()) : string_view();
+        Span<UserId> participants = expenses.getParticipants(id);
+        Span<Money> shares = expenses.getShareAmounts(id);
+        if (format == ReportFormat::CSV)
+        {
+            out.append('E');
+            out.appendUnsigned(uint64_t(id) + 1);
+            out.append(',');
+            out.appendCsvField(expenses.getDescription(id));
+            out.append(',');
+            out.appendCsvField(directory[expenses.getPaidBy(id)]->getUserId());
+            out.append(',');
+            out.appendMoney(expenses.getAmount(id));
+            out.append(',');
+            out.append(Currency::code(expenses.getCurrency(id)));
+            out.append(',');
+            out.append(TYPES[size_t(expenses.getType(id))]);
+            out.append(',');
+            out.appendCsvField(groupId);
+            out.append(',');
+            out.appendInt(expenses.getTimestamp(id));
+            out.append(',');
+            for (size_t i = 0; i < shares.size(); i++)
+            {
+                if (i > 0)
+                    out.append(';');
+                out.append(directory[participants[i]]->getUserId());
+                out.append('=');
+                out.appendMoney(shares[i]);
+            }
+            out.append('\n');
+            return;
+        }
+        out.beginJsonRecord();
+        out.appendJsonKey("expense");
+        out.append("\"E");
+        out.appendUnsigned(uint64_t(id) + 1);
+        out.append("\",");
+        out.appendJsonKey("description");
+        out.appendJsonString(expenses.getDescription(id));
+        out.append(',');
+        out.appendJsonKey("paid_by");
+        out.appendJsonString(directory[expenses.getPaidBy(id)]->getUserId());
+        out.append(',');
+        out.appendJsonKey("amount");
+        out.appendMoney(expenses.getAmount(id));
+        out.append(',');
+        out.appendJsonKey("currency");
+        out.appendJsonString(Currency::code(expenses.getCurrency(id)));
+        out.append(',');
+        out.appendJsonKey("type");
+        out.appendJsonString(TYPES[size_t(expenses.getType(id))]);
+        out.append(',');
+        out.appendJsonKey("group");
+        if (group != NO_GROUP)
+            out.appendJsonString(groupId);
+        else
+            out.append("null");
+        out.append(',');
+        out.appendJsonKey("timestamp");
+        out.appendInt(expenses.getTimestamp(id));
+        out.append(',');
+        out.appendJsonKey("shares");
+        out.append('[');
+        for (size_t i = 0; i < shares.size(); i++)
+        {
+            if (i > 0)
+                out.append(',');
+            out.append('{');
+            out.appendJsonKey("user");
+            out.appendJsonString(directory[participants[i]]->getUserId());
+            out.append(',');
+            out.appendJsonKey("amount");
+            out.appendMoney(shares[i]);
+            out.append('}');
+        }
+        out.append("]}");
+    }
+
+    static void appendStatement(ReportBuffer &out, ReportFormat format, const string &userId, CurrencyId currency, const Statement &statement)
+    {
+        if (format == ReportFormat::CSV)
+        {
+            out.appendCsvField(userId);
+            out.append(',');
+            out.append(Currency::code(currency));
+            out.append(',');
+            out.appendUnsigned(statement.expenses);
+            out.append(',');
+            out.appendMoney(statement.paid);
+            out.append(',');
+            out.appendMoney(statement.owed);
+            out.append(',');
+            out.appendMoney(statement.net());
+            out.append('\n');
+            return;
+        }
+        out.beginJsonRecord();
+        out.appendJsonKey("user");
+        out.appendJsonString(userId);
+        out.append(',');
+        out.appendJsonKey("currency");
+        out.appendJsonString(Currency::code(currency));
+        out.append(',');
+        out.appendJsonKey("expenses");
+        out.appendUnsigned(statement.expenses);
+        out.append(',');
+        out.appendJsonKey("paid");
+        out.appendMoney(statement.paid);
+        out.append(',');
+        out.appendJsonKey("owed");
+        out.appendMoney(statement.owed);
+        out.append(',');
+        out.appendJsonKey("net");
+        out.appendMoney(statement.net());
+        out.append('}');
+    }
+
+    Expense createExpense(Group *group, const string &description, const string &paidBy, Money amount, CurrencyId currency, const vector<string> &involvedUsers, ExpenseType type)
+    {
+        Mutation mutation(*this);
+        User *payer = findUser(paidBy);
+        if (!payer || (group && !group->isMember(payer->getId())) || !ExpenseStore::isExpenseAmount(amount))
+            return Expense();
+
+        vector<UserId> participants;
+        participants.reserve(involvedUsers.size());
+        for (const string &userId : involvedUsers)
+        {
+            User *participant = findUser(userId);
+            if (!participant || (group && !group->isMember(participant->getId())))
+                return Expense();
+            participants.push_back(participant->getId());
+        }
+
+        ExpenseId id = insertExpense(description, payer->getId(), amount, currency, type, participants,
+                                     group ? group->getId() : NO_GROUP, currentTime());
+        return Expense(&expenses, id);
+    }
+
+    // Resolves and validates every request and splits its shares into 'batch';
+    // returns the index of the request behind each row
+    vector<size_t> prepareBatch(Span<ExpenseRequest> requests, ExpenseBatch &batch) const
+    {
+        vector<size_t> accepted;
+        vector<UserId> participants;
+        int64_t now = currentTime();
+        batch.rows.reserve(requests.size());
+        shared_lock<shared_mutex> guard(directoryLock);
+        for (size_t r = 0; r < requests.size(); r++)
+        {
+            const ExpenseRequest &request = requests[r];
+            CurrencyId currency = currencyOf(request.currency);
+            if (currency == Currency::INVALID || (request.type != ExpenseType::EQUAL && request.values.size() != request.users.size()))
+                continue;
+            Group *group = nullptr;
+            if (!request.groupId.empty())
+            {
+                auto it = groupIndex.find(request.groupId);
+                if (it == groupIndex.end())
+                    continue;
+                group = groups[it->second];
+            }
+            User *payer = lookupUser(request.paidBy);
+            if (!payer || (group && !group->isMember(payer->getId())))
+                continue;
+
+            participants.clear();
+            for (const string &userId : request.users)
+            {
+                User *participant = lookupUser(userId);
+                if (!participant || (group && !group->isMember(participant->getId())))
+                    break;
+                participants.push_back(participant->getId());
+            }
+            size_t begin = batch.shareAmounts.size();
+            batch.shareAmounts.resize(begin + participants.size());
+            if (participants.size() != request.users.size() ||
+                !ExpenseStore::splitShares(request.amount, request.type, request.values.data(), participants.size(), batch.shareAmounts.data() + begin))
+            {
+                batch.shareAmounts.resize(begin);
+                continue;
+            }
+            batch.shareUsers.insert(batch.shareUsers.end(), participants.begin(), participants.end());
+            batch.rows.push_back(ExpenseBatch::Row{request.description, payer->getId(), request.amount, currency, request.type,
+                                                   group ? group->getId() : NO_GROUP, request.timestamp ? request.timestamp : now,
+                                                   begin, participants.size()});
+            accepted.push_back(r);
+        }
+        return accepted;
+    }
+
+    // Caller holds expenseLock
+    ShareSet copyShares(ExpenseId id) const
+    {
+        Span<UserId> participants = expenses.getParticipants(id);
+        Span<Money> amounts = expenses.getShareAmounts(id);
+        return ShareSet{expenses.getPaidBy(id), expenses.getGroupId(id), expenses.getCurrency(id),
+                        vector<UserId>(participants.begin(), participants.end()),
+                        vector<Money>(amounts.begin(), amounts.end())};
+    }
+
+    bool inGroup(GroupId group, UserId user) const
+    {
+        return group == NO_GROUP || getGroup(group)->isMember(user);
+    }
+
+    // Keeps the index in step after an edit changed who pays for or shares
+    // the expense. Caller holds expenseLock exclusively.
+    void reindexParticipants(ExpenseId id, const ShareSet &previous, const ShareSet &current)
+    {
+        auto involved = [](const ShareSet &shares, UserId user)
+        {
+            return user == shares.paidBy || find(shares.users.begin(), shares.users.end(), user) != shares.users.end();
+        };
+        if (!involved(current, previous.paidBy))
+            expenseIndex.removeEntry(previous.paidBy, id);
+        for (UserId user : previous.users)
+        {
+            if (user != previous.paidBy && !involved(current, user))
+                expenseIndex.removeEntry(user, id);
+        }
+        if (!involved(previous, current.paidBy))
+            expenseIndex.addEntry(current.paidBy, id);
+        for (UserId user : current.users)
+        {
+            if (user != current.paidBy && !involved(previous, user))
+                expenseIndex.addEntry(user, id);
+        }
+    }
+
+    // Moves the ledger and the groups from one version of an expense's shares
+    // to another. A pair in both versions gets one update, by the difference,
+    // and the ledger takes the whole change at once.
+    void applyChange(const ShareSet &previous, const ShareSet &current)
+    {
+        PartialLedger changes;
+        for (size_t i = 0; i < previous.amounts.size(); i++)
+        {
+            changes.addDebt(previous.paidBy, previous.users[i], -previous.amounts[i], previous.currency);
+        }
+        for (size_t i = 0; i < current.amounts.size(); i++)
+        {
+            changes.addDebt(current.paidBy, current.users[i], current.amounts[i], current.currency);
+        }
+        changes.compact();
+        if (changes.size())
+            ledger.merge(changes);
+
+        if (previous.group != NO_GROUP && !previous.amounts.empty())
+        {
+            vector<Money> reversed;
+            reversed.reserve(previous.amounts.size());
+            for (Money amount : previous.amounts)
+            {
+                reversed.push_back(-amount);
+            }
+            getGroup(previous.group)->addDebts(previous.paidBy, previous.users.data(), reversed.data(), reversed.size(), previous.currency);
+        }
+        if (current.group != NO_GROUP && !current.amounts.empty())
+            getGroup(current.group)->addDebts(current.paidBy, current.users.data(), current.amounts.data(), current.amounts.size(), current.currency);
+    }
+
+    // shareUsers[i] now owes 'paidBy' shareAmounts[i] more, in the ledger and the group
+    void applyShares(UserId paidBy, GroupId groupId, CurrencyId currency, Span<UserId> shareUsers, Span<Money> shareAmounts)
+    {
+        // One ledger entry covers both users' view of the balance
+        ledger.addDebts(paidBy, shareUsers, shareAmounts, currency);
+        if (groupId != NO_GROUP)
+            getGroup(groupId)->addDebts(paidBy, shareUsers.data(), shareAmounts.data(), shareAmounts.size(), currency);
+    }
+
+    User *findUser(const std::string &userId) const
+    {
+        shared_lock<shared_mutex> guard(directoryLock);
+        return lookupUser(userId);
+    }
+    User *findUser(string_view userId) const
+    {
+        shared_lock<shared_mutex> guard(directoryLock);
+        return lookupUser(userId);
+    }
+    // Ids we generated ("U17") map straight to their slot; anything else goes
+    // through the index. Caller holds directoryLock.
+    User *lookupUser(string_view userId) const
+    {
+        if (userId.size() > 1 && userId.size() < 12 && userId[0] == 'U')
+        {
+            size_t number = 0;
+            bool digits = true;
+            for (size_t i = 1; i < userId.size() && digits; i++)
+            {
+                digits = userId[i] >= '0' && userId[i] <= '9';
+                number = number * 10 + (userId[i] - '0');
+            }
+            if (digits && number >= 1 && number <= users.size() && users[number - 1]->getUserId() == userId)
+                return users[number - 1];
+        }
+        auto it = userIndex.find(string(userId));
+        return it != userIndex.end() ? users[it->second] : nullptr;
+    }
+    // Expense ids are always "E<n>", n = ExpenseId + 1, so no index is needed
+    Expense findExpense(const std::string &expenseId) const
+    {
+        shared_lock<shared_mutex> guard(expenseLock);
+        ExpenseId id;
+        if (!parseExpenseId(expenseId, id))
+            return Expense();
+        return Expense(&expenses, id);
+    }
+    // Caller holds expenseLock
+    bool parseExpenseId(const std::string &expenseId, ExpenseId &id) const
+    {
+        if (expenseId.size() < 2 || expenseId.size() > 11 || expenseId[0] != 'E' || expenseId[1] == '0')
+            return false;
+        uint64_t number = 0;
+        for (size_t i = 1; i < expenseId.size(); i++)
+        {
+            if (expenseId[i] < '0' || expenseId[i] > '9')
+                return false;
+            number = number * 10 + (expenseId[i] - '0');
+        }
+        if (number > expenses.size())
+            return false;
+        id = ExpenseId(number - 1);
+        return expenses.contains(id);
+    }
+    User *getUser(UserId id) const
+    {
+        shared_lock<shared_mutex> guard(directoryLock);
+        return id < users.size() ? users[id] : nullptr;
+    }
+    size_t userCount() const
+    {
+        shared_lock<shared_mutex> guard(directoryLock);
+        return users.size();
+    }
+    // Copy of the user table, for displays that look up many users
+    vector<User *> userDirectory() const
+    {
+        shared_lock<shared_mutex> guard(directoryLock);
+        return users;
+    }
+    vector<Group *> groupDirectory() const
+    {
+        shared_lock<shared_mutex> guard(directoryLock);
+        return groups;
+    }
+    Group *findGroup(const std::string &groupId) const
+    {
+        shared_lock<shared_mutex> guard(directoryLock);
+        auto it = groupIndex.find(groupId);
+        return it != groupIndex.end() ? groups[it->second] : nullptr;
+    }
+    Group *getGroup(GroupId id) const
+    {
+        shared_lock<shared_mutex> guard(directoryLock);
+        return groups[id];
+    }
+
+    void displayUsers() const
+    {
+        std::cout << "\nRegistered Users:" << std::endl;
+        for (const auto &user : userDirectory())
+        {
+            user->displayInfo();
+            std::cout << "------------------------" << std::endl;
+        }
+    }
+
+    //*************************************************State changes*************************************************//
+    // Everything below both serves the public calls and replays the journal;
+    // each journals itself when a journal is open.
+
+    User *insertUser(const string &userId, const string &name, const string &email)
+    {
+        unique_lock<shared_mutex> guard(directoryLock);
+        journalRecord(JournalRecord::USER, [&](BinaryWriter &record)
+                      {
+            record.putString(userId);
+            record.putString(name);
+            record.putString(email); });
+        UserId id = users.size();
+        User *user = userPool.create(id, userId, name, email);
+        users.push_back(user);
+        userIndex[user->getUserId()] = id;
+        return user;
+    }
+
+    Group *insertGroup(const string &groupId, const string &name, const vector<UserId> &members)
+    {
+        unique_lock<shared_mutex> guard(directoryLock);
+        journalRecord(JournalRecord::GROUP, [&](BinaryWriter &record)
+                      {
+            record.putString(groupId);
+            record.putString(name);
+            record.putArray(members); });
+        GroupId id = groups.size();
+        Group *group = groupPool.create(id, groupId, name);
+        for (UserId member : members)
+        {
+            group->addMember(member);
+        }
+        groups.push_back(group);
+        groupIndex[group->getGroupId()] = id;
+        return group;
+    }
+
+    void addMemberToGroup(Group *group, UserId user)
+    {
+        // Journaled first: expenses that rely on the membership must come after it
+        journalRecord(JournalRecord::GROUP_MEMBER, [&](BinaryWriter &record)
+                      {
+            record.put(group->getId());
+            record.put(user); });
+        group->addMember(user);
+    }
+
+    ExpenseId insertExpense(string_view description, UserId payer, Money amount, CurrencyId currency, ExpenseType type, const vector<UserId> &participants, GroupId group, int64_t timestamp)
+    {
+        ExpenseId id;
+        ShareSet shares;
+        {
+            unique_lock<shared_mutex> guard(expenseLock);
+            id = expenses.add(description, payer, amount, currency, type, participants, group, timestamp);
+            expenseIndex.add(id, payer, participants);
+            timeline.add(id);
+            journalRecord(JournalRecord::EXPENSE, [&](BinaryWriter &record)
+                          {
+                record.put(payer);
+                record.put(amount);
+                record.put(type);
+                record.put(group);
+                record.put(timestamp);
+                record.putString(description);
+                record.putArray(participants);
+                record.put(currency); });
+            if (type == ExpenseType::EQUAL)
+                shares = copyShares(id);
+        }
+        if (type == ExpenseType::EQUAL)
+        {
+            applyShares(shares.paidBy, shares.group, shares.currency, shares.users, shares.amounts);
+        }
+        return id;
+    }
+
+    // Stores every row, then settles them all at once; returns the id of the
+    // first row, the others following in order
+    ExpenseId insertExpenses(const ExpenseBatch &batch)
+    {
+        ExpenseId first;
+        {
+            unique_lock<shared_mutex> guard(expenseLock);
+            first = expenses.size();
+            if (batch.rows.empty())
+                return first;
+            journalRecord(JournalRecord::EXPENSES, [&](BinaryWriter &record)
+                          {
+                record.put<uint64_t>(batch.rows.size());
+                for (const ExpenseBatch::Row &row : batch.rows)
+                {
+                    record.put(row.paidBy);
+                    record.put(row.amount);
+                    record.put(row.type);
+                    record.put(row.group);
+                    record.put(row.timestamp);
+                    record.putString(row.description);
+                    record.putArray(batch.usersOf(row));
+                    record.putArray(batch.amountsOf(row));
+                }
+                for (const ExpenseBatch::Row &row : batch.rows)
+                    record.put(row.currency); });
+            for (const ExpenseBatch::Row &row : batch.rows)
+            {
+                ExpenseId id = expenses.addWithShares(row.description, row.paidBy, row.amount, row.currency, row.type,
+                                                      batch.usersOf(row), batch.amountsOf(row), row.group, row.timestamp);
+                expenseIndex.add(id, row.paidBy, batch.usersOf(row));
+                timeline.add(id);
+            }
+        }
+
+        // A pair that shows up many times in the batch is updated once
+        PartialLedger changes;
+        for (const ExpenseBatch::Row &row : batch.rows)
+        {
+            Span<UserId> shareUsers = batch.usersOf(row);
+            Span<Money> shareAmounts = batch.amountsOf(row);
+            for (size_t i = 0; i < row.shareCount; i++)
+            {
+                changes.addDebt(row.paidBy, shareUsers[i], shareAmounts[i], row.currency);
+            }
+            if (row.group != NO_GROUP)
+                getGroup(row.group)->addDebts(row.paidBy, shareUsers.data(), shareAmounts.data(), row.shareCount, row.currency);
+        }
+        changes.compact();
+        ledger.merge(changes);
+        return first;
+    }
+
+    // values[i]: cents for EXACT, basis points for PERCENT
+    bool changeShares(ExpenseId id, const vector<UserId> &shareUsers, const vector<int64_t> &values)
+    {
+        ShareSet previous, current;
+        {
+            unique_lock<shared_mutex> guard(expenseLock);
+            if (!expenses.contains(id) || expenses.getType(id) == ExpenseType::EQUAL || shareUsers.size() != values.size())
+                return false;
+            for (UserId user : shareUsers)
+            {
+                if (!inGroup(expenses.getGroupId(id), user))
+                    return false;
+            }
+
+            bool accepted;
+            previous = copyShares(id);
+            if (expenses.getType(id) == ExpenseType::EXACT)
+            {
+                vector<pair<UserId, Money>> exact;
+                exact.reserve(shareUsers.size());
+                for (size_t i = 0; i < shareUsers.size(); i++)
+                {
+                    exact.emplace_back(shareUsers[i], Money(values[i]));
+                }
+                timeline.remove(id);
+                accepted = expenses.setExactShares(id, exact);
+            }
+            else
+            {
+                vector<pair<UserId, int32_t>> percents;
+                percents.reserve(shareUsers.size());
+                for (size_t i = 0; i < shareUsers.size(); i++)
+                {
+                    if (values[i] < 0 || values[i] > Money::FULL_BASIS_POINTS)
+                        return false;
+                    percents.emplace_back(shareUsers[i], int32_t(values[i]));
+                }
+                timeline.remove(id);
+                accepted = expenses.setPercentShares(id, percents);
+            }
+            timeline.add(id);
+            if (!accepted)
+                return false;
+            journalRecord(JournalRecord::SHARES, [&](BinaryWriter &record)
+                          {
+                record.put(id);
+                record.putArray(shareUsers);
+                record.putArray(values); });
+            current = copyShares(id);
+            reindexParticipants(id, previous, current);
+        }
+
+        // Shares already applied (if any) come off as the new ones go on, in
+        // one ledger update
+        vector<UserId> changedUsers(previous.users.begin(), previous.users.begin() + previous.amounts.size());
+        vector<Money> changedAmounts;
+        changedAmounts.reserve(previous.amounts.size() + current.amounts.size());
+        for (Money amount : previous.amounts)
+        {
+            changedAmounts.push_back(-amount);
+        }
+        changedUsers.insert(changedUsers.end(), current.users.begin(), current.users.end());
+        changedAmounts.insert(changedAmounts.end(), current.amounts.begin(), current.amounts.end());
+        applyShares(current.paidBy, current.group, current.currency, changedUsers, changedAmounts);
+        return true;
+    }
+
+    // 'timestamp' 0 keeps the expense's own
+    bool replaceExpense(ExpenseId id, UserId payer, Money amount, CurrencyId currency, ExpenseType type, GroupId group, int64_t timestamp,
+                        Span<UserId> shareUsers, Span<Money> shareAmounts)
+    {
+        ShareSet previous, current;
+        {
+            unique_lock<shared_mutex> guard(expenseLock);
+            if (!expenses.contains(id))
+                return false;
+            if (timestamp == 0)
+                timestamp = expenses.getTimestamp(id);
+            previous = copyShares(id);
+            bool inPlace = timestamp == expenses.getTimestamp(id) && currency == expenses.getCurrency(id);
+            if (inPlace)
+                timeline.beginEdit(id);
+            else
+                timeline.remove(id);
+            expenses.replace(id, payer, amount, currency, type, group, timestamp, shareUsers, shareAmounts);
+            if (inPlace)
+                timeline.finishEdit(id);
+            else
+                timeline.add(id);
+            journalRecord(JournalRecord::EDIT, [&](BinaryWriter &record)
+                          {
+                record.put(id);
+                record.put(payer);
+                record.put(amount);
+                record.put(type);
+                record.put(group);
+                record.put(timestamp);
+                record.putArray(shareUsers);
+                record.putArray(shareAmounts);
+                record.put(currency); });
+            current = copyShares(id);
+            reindexParticipants(id, previous, current);
+        }
+        applyChange(previous, current);
+        return true;
+    }
+
+    bool removeExpense(ExpenseId id)
+    {
+        ShareSet previous;
+        {
+            unique_lock<shared_mutex> guard(expenseLock);
+            if (!expenses.contains(id))
+                return false;
+            previous = copyShares(id);
+            timeline.remove(id);
+            expenses.remove(id);
+            journalRecord(JournalRecord::DELETE, [&](BinaryWriter &record)
+                          { record.put(id); });
+            expenseIndex.removeEntry(previous.paidBy, id);
+            for (UserId user : previous.users)
+            {
+                if (user != previous.paidBy)
+                    expenseIndex.removeEntry(user, id);
+            }
+        }
+        ShareSet none{previous.paidBy, NO_GROUP, previous.currency, {}, {}};
+        applyChange(previous, none);
+        return true;
+    }
+
+    void settleShares(ExpenseId id)
+    {
+        ShareSet shares;
+        {
+            shared_lock<shared_mutex> guard(expenseLock);
+            if (!expenses.contains(id))
+                return;
+            shares = copyShares(id);
+            journalRecord(JournalRecord::SETTLE, [&](BinaryWriter &record)
+                          { record.put(id); });
+        }
+        applyShares(shares.paidBy, shares.group, shares.currency, shares.users, shares.amounts);
+    }
+
+    void recordPayment(Group *group, const Settlement &payment)
+    {
+        journalRecord(JournalRecord::PAYMENT, [&](BinaryWriter &record)
+                      {
+            record.put(group->getId());
+            record.put(payment.from);
+            record.put(payment.to);
+            record.put(payment.amount);
+            record.put(payment.currency); });
+        // Paying back is a debt in the other direction
+        ledger.addDebt(payment.from, payment.to, payment.amount, payment.currency);
+        group->addDebt(payment.from, payment.to, payment.amount, payment.currency);
+    }
+
+    void publishRates(const vector<pair<CurrencyId, double>> &changes)
+    {
+        lock_guard<mutex> guard(fxLock);
+        journalRecord(JournalRecord::FX_RATES, [&](BinaryWriter &record)
+                      {
+            record.put<uint64_t>(changes.size());
+            for (const auto &change : changes)
+            {
+                record.put(change.first);
+                record.put(change.second);
+            } });
+        fxRates = make_shared<FxTable>(*fxRates, changes);
+    }
+
+    //*************************************************Storage*************************************************//
+
+    template <class F>
+    void journalRecord(JournalRecord type, F fill)
+    {
+        if (!journal)
+            return;
+        static thread_local BinaryWriter record;
+        record.clear();
+        record.put(type);
+        fill(record);
+        journal->append(record.data()); // a failure is latched; see storageFailed()
+    }
+
+    void afterMutation()
+    {
+        if (!journal)
+            return;
+        if (journal->size() >= checkpointBytes && !journal->hasFailed())
+        {
+            unique_lock<shared_mutex> guard(checkpointLock);
+            if (journal->size() >= checkpointBytes)
+                writeCheckpoint();
+        }
+    }
+
+    string snapshotPath() const
+    {
+        return storageDirectory + "/snapshot.bin";
+    }
+
+    string journalPath(uint64_t journalGeneration) const
+    {
+        return storageDirectory + "/journal-" + to_string(journalGeneration) + ".log";
+    }
+
+    // Caller holds checkpointLock exclusively. The snapshot becomes the
+    // current one by rename, and only then is the old journal dropped.
+    bool writeCheckpoint()
+    {
+        if (!journal || !journal->sync() || !writeSnapshot(generation + 1))
+            return false;
+        generation++;
+        if (!journal->rotate(journalPath(generation)))
+            return false;
+        unlink(journalPath(generation - 1).c_str());
+        return true;
+    }
+
+    bool writeSnapshot(uint64_t snapshotGeneration)
+    {
+        string path = snapshotPath();
+        string temporary = path + ".tmp";
+        int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+
+        BinaryWriter out(fd);
+        out.put(SNAPSHOT_MAGIC);
+        out.put(snapshotGeneration);
+        out.put(userIdCounter.load());
+        out.put(groupIdCounter.load());
+        {
+            shared_lock<shared_mutex> expenseGuard(expenseLock);
+            {
+                shared_lock<shared_mutex> directoryGuard(directoryLock);
+                out.put<uint64_t>(users.size());
+                for (const User *user : users)
+                {
+                    out.putString(user->getUserId());
+                    out.putString(user->getName());
+                    out.putString(user->getEmail());
+                }
+                out.put<uint64_t>(groups.size());
+                for (const Group *group : groups)
+                {
+                    group->save(out);
+                }
+            }
+            ledger.save(out);
+            expenses.save(out);
+            expenseIndex.save(out);
+            timeline.save(out);
+        }
+        getExchangeRates()->save(out);
+        bool written = out.finish();
+        close(fd);
+        if (!written || rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            unlink(temporary.c_str());
+            return false;
+        }
+        // Make the rename itself durable
+        int directory = open(storageDirectory.c_str(), O_RDONLY | O_CLOEXEC);
+        if (directory >= 0)
+        {
+            fsync(directory);
+            close(directory);
+        }
+        return true;
+    }
+
+    // Only on a fresh system, before the journal is open
+    bool loadSnapshot(const MappedFile &file)
+    {
+        if (!BinaryReader::verify(file.begin(), file.size()))
+            return false;
+        BinaryReader in(file.begin(), file.size() - sizeof(uint32_t));
+        uint32_t magic = in.get<uint32_t>();
+        if (magic != SNAPSHOT_MAGIC && magic != SNAPSHOT_MAGIC_V3 && magic != SNAPSHOT_MAGIC_V2 && magic != SNAPSHOT_MAGIC_V1)
+            return false;
+        bool perCurrency = magic == SNAPSHOT_MAGIC || magic == SNAPSHOT_MAGIC_V3;
+        generation = in.get<uint64_t>();
+        userIdCounter = in.get<uint32_t>();
+        groupIdCounter = in.get<uint32_t>();
+
+        uint64_t userCount = in.get<uint64_t>();
+        if (!in.ok() || userCount > in.remaining())
+            return false;
+        users.reserve(userCount);
+        userIndex.reserve(userCount);
+        for (UserId id = 0; id < userCount; id++)
+        {
+            string userId = in.getString();
+            string name = in.getString();
+            string email = in.getString();
+            users.push_back(userPool.create(id, userId, name, email));
+            userIndex[userId] = id;
+        }
+        uint64_t groupCount = in.get<uint64_t>();
+        if (!in.ok() || groupCount > in.remaining())
+            return false;
+        for (GroupId id = 0; id < groupCount; id++)
+        {
+            Group *group = groupPool.create(id, "", "");
+            groups.push_back(group);
+            if (!group->load(in, perCurrency))
+                return false;
+            groupIndex[group->getGroupId()] = id;
+        }
+        if (!ledger.load(in, perCurrency) || !expenses.load(in, perCurrency, magic == SNAPSHOT_MAGIC) || !expenseIndex.load(in))
+            return false;
+        if (!perCurrency)
+        {
+            // An SWS2 timeline, if any, is last and has no currencies; skip it
+            timeline.rebuild();
+            return in.ok();
+        }
+        auto rates = make_shared<FxTable>();
+        if (!timeline.load(in) || !rates->load(in))
+            return false;
+        fxRates = rates;
+        return in.remaining() == 0;
+    }
+
+    // Replays one journal record. Records passed their CRC, so anything out
+    // of range means a bug, not a torn write; such a record is skipped.
+    void applyRecord(BinaryReader &in)
+    {
+        JournalRecord type = in.get<JournalRecord>();
+        switch (type)
+        {
+        case JournalRecord::USER:
+        {
+            string userId = in.getString();
+            string name = in.getString();
+            string email = in.getString();
+            if (!in.ok())
+                return;
+            insertUser(userId, name, email);
+            userIdCounter = max<uint32_t>(userIdCounter, idNumber(userId) + 1);
+            break;
+        }
+        case JournalRecord::GROUP:
+        {
+            string groupId = in.getString();
+            string name = in.getString();
+            vector<UserId> members;
+            in.getArray(members);
+            if (!in.ok() || !knownUsers(members))
+                return;
+            insertGroup(groupId, name, members);
+            groupIdCounter = max<uint32_t>(groupIdCounter, idNumber(groupId) + 1);
+            break;
+        }
+        case JournalRecord::GROUP_MEMBER:
+        {
+            GroupId group = in.get<GroupId>();
+            UserId user = in.get<UserId>();
+            if (in.ok() && group < groups.size() && user < users.size())
+                addMemberToGroup(groups[group], user);
+            break;
+        }
+        case JournalRecord::EXPENSE:
+        {
+            UserId payer = in.get<UserId>();
+            Money amount = in.get<Money>();
+            ExpenseType expenseType = in.get<ExpenseType>();
+            GroupId group = in.get<GroupId>();
+            int64_t timestamp = in.get<int64_t>();
+            string description = in.getString();
+            vector<UserId> participants;
+            in.getArray(participants);
+            CurrencyId currency = in.remaining() ? in.get<CurrencyId>() : HOME_CURRENCY;
+            if (in.ok() && payer < users.size() && knownUsers(participants) && (group == NO_GROUP || group < groups.size()) && currency < Currency::COUNT)
+                insertExpense(description, payer, amount, currency, expenseType, participants, group, timestamp);
+            break;
+        }
+        case JournalRecord::SHARES:
+        {
+            ExpenseId id = in.get<ExpenseId>();
+            vector<UserId> shareUsers;
+            vector<int64_t> values;
+            in.getArray(shareUsers);
+            in.getArray(values);
+            if (in.ok() && knownUsers(shareUsers))
+                changeShares(id, shareUsers, values);
+            break;
+        }
+        case JournalRecord::SETTLE:
+        {
+            ExpenseId id = in.get<ExpenseId>();
+            if (in.ok())
+                settleShares(id);
+            break;
+        }
+        case JournalRecord::PAYMENT:
+        {
+            GroupId group = in.get<GroupId>();
+            Settlement payment;
+            payment.from = in.get<UserId>();
+            payment.to = in.get<UserId>();
+            payment.amount = in.get<Money>();
+            payment.currency = in.remaining() ? in.get<CurrencyId>() : HOME_CURRENCY;
+            if (in.ok() && group < groups.size() && payment.from < users.size() && payment.to < users.size() && payment.currency < Currency::COUNT)
+                recordPayment(groups[group], payment);
+            break;
+        }
+        case JournalRecord::IMPORTED:
+        {
+            UserId payer = in.get<UserId>();
+            Money amount = in.get<Money>();
+            ExpenseType expenseType = in.get<ExpenseType>();
+            int64_t timestamp = in.get<int64_t>();
+            string description = in.getString();
+            vector<UserId> shareUsers;
+            vector<Money> shareAmounts;
+            in.getArray(shareUsers);
+            in.getArray(shareAmounts);
+            CurrencyId currency = in.remaining() ? in.get<CurrencyId>() : HOME_CURRENCY; // older journals: home only
+            if (!in.ok() || payer >= users.size() || !knownUsers(shareUsers) || shareUsers.size() != shareAmounts.size() ||
+                currency >= Currency::COUNT)
+                return;
+            ExpenseId id = expenses.addWithShares(description, payer, amount, currency, expenseType, shareUsers, shareAmounts, NO_GROUP, timestamp);
+            expenseIndex.add(id, payer, shareUsers);
+            timeline.add(id);
+            ledger.addDebts(payer, shareUsers, shareAmounts, currency);
+            break;
+        }
+        case JournalRecord::EXPENSES:
+        {
+            uint64_t count = in.get<uint64_t>();
+            if (!in.ok() || count > in.remaining())
+                return;
+            ExpenseBatch batch;
+            vector<string> descriptions(count); // the rows' views point here
+            vector<UserId> shareUsers;
+            vector<Money> shareAmounts;
+            for (uint64_t i = 0; i < count; i++)
+            {
+                ExpenseBatch::Row row;
+                row.currency = HOME_CURRENCY;
+                row.paidBy = in.get<UserId>();
+                row.amount = in.get<Money>();
+                row.type = in.get<ExpenseType>();
+                row.group = in.get<GroupId>();
+                row.timestamp = in.get<int64_t>();
+                descriptions[i] = in.getString();
+                row.description = descriptions[i];
+                in.getArray(shareUsers);
+                in.getArray(shareAmounts);
+                if (!in.ok() || row.paidBy >= users.size() || !knownUsers(shareUsers) || shareUsers.size() != shareAmounts.size() ||
+                    (row.group != NO_GROUP && row.group >= groups.size()))
+                    return;
+                row.shareBegin = batch.shareUsers.size();
+                row.shareCount = shareUsers.size();
+                batch.shareUsers.insert(batch.shareUsers.end(), shareUsers.begin(), shareUsers.end());
+                batch.shareAmounts.insert(batch.shareAmounts.end(), shareAmounts.begin(), shareAmounts.end());
+                batch.rows.push_back(row);
+            }
+            if (in.remaining())
+            {
+                for (ExpenseBatch::Row &row : batch.rows)
+                {
+                    row.currency = in.get<CurrencyId>();
+                    if (row.currency >= Currency::COUNT)
+                        return;
+                }
+                if (!in.ok())
+                    return;
+            }
+            insertExpenses(batch);
+            break;
+        }
+        case JournalRecord::FX_RATES:
+        {
+            uint64_t count = in.get<uint64_t>();
+            if (!in.ok() || count > in.remaining())
+                return;
+            vector<pair<CurrencyId, double>> changes(count);
+            for (auto &change : changes)
+            {
+                change.first = in.get<CurrencyId>();
+                change.second = in.get<double>();
+                if (change.first >= Currency::COUNT)
+                    return;
+            }
+            if (in.ok())
+                publishRates(changes);
+            break;
+        }
+        case JournalRecord::EDIT:
+        {
+            ExpenseId id = in.get<ExpenseId>();
+            UserId payer = in.get<UserId>();
+            Money amount = in.get<Money>();
+            ExpenseType expenseType = in.get<ExpenseType>();
+            GroupId group = in.get<GroupId>();
+            int64_t timestamp = in.get<int64_t>();
+            vector<UserId> shareUsers;
+            vector<Money> shareAmounts;
+            in.getArray(shareUsers);
+            in.getArray(shareAmounts);
+            CurrencyId currency = in.get<CurrencyId>();
+            if (in.ok() && payer < users.size() && knownUsers(shareUsers) && shareUsers.size() == shareAmounts.size() &&
+                (group == NO_GROUP || group < groups.size()) && currency < Currency::COUNT)
+                replaceExpense(id, payer, amount, currency, expenseType, group, timestamp, shareUsers, shareAmounts);
+            break;
+        }
+        case JournalRecord::DELETE:
+        {
+            ExpenseId id = in.get<ExpenseId>();
+            if (in.ok())
+                removeExpense(id);
+            break;
+        }
+        }
+    }
+
+    bool knownUsers(const vector<UserId> &ids) const
+    {
+        for (UserId id : ids)
+        {
+            if (id >= users.size())
+                return false;
+        }
+        return true;
+    }
+
+    // 17 for "U17" or "G17"
+    static uint32_t idNumber(const string &id)
+    {
+        uint32_t number = 0;
+        for (size_t i = 1; i < id.size() && isdigit((unsigned char)id[i]); i++)
+            number = number * 10 + (id[i] - '0');
+        return number;
+    }
+};
+
+#endif // SPLITSYSTEM_H
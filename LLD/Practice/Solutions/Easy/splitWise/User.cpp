@@ -1,54 +1,44 @@
+#ifndef USER_H
+#define USER_H
+
 #include <bits/stdc++.h>
 
 using namespace std;
+
+// Dense internal id: index into SplitwiseSystem's user table
+using UserId = uint32_t;
+
 class User
 {
-    string userId;
+    UserId id;
+    string userId; // external id, e.g. "U17"
     string name;
     string email;
-    map<string, double> balanceSheet; // map of userId to balance
 
 public:
-    User(string id, string name, string email)
+    User(UserId id, string userId, string name, string email)
     {
-        this->userId = id;
+        this->id = id;
+        this->userId = userId;
         this->email = email;
         this->name = name;
     }
 
-    string getUserId()
-    {
-        return userId;
-    }
-
-    string getName() { return name; }
+    UserId getId() const { return id; }
 
-    double getBalanceWithUser(const string &userId) const
+    const string &getUserId() const
     {
-        auto it = balanceSheet.find(userId);
-        if (it != balanceSheet.end())
-        {
-            return it->second;
-        }
-        return 0.0;
+        return userId;
     }
 
-    void updateBalance(const string &userId, double amount)
-    {
-        balanceSheet[userId] += amount;
-    }
+    const string &getName() const { return name; }
 
-    void displayBalances() const
-    {
-        cout << "Balance sheet for " << name << " (" << userId << "):\n";
-        for (const auto &entry : balanceSheet)
-        {
-            cout << "  With " << entry.first << ": " << entry.second << "\n";
-        }
-    }
+    const string &getEmail() const { return email; }
 
     void displayInfo()
     {
         cout << "User Name: " << name << " | " << "userId: " << userId << "):\n";
     }
-};
\ No newline at end of file
+};
+
+#endif // USER_H
@@ -0,0 +1,351 @@
+#ifndef USEREXPENSEINDEX_H
+#define USEREXPENSEINDEX_H
+
+#include <bits/stdc++.h>
+#include "User.cpp"
+#include "ExpenseStore.cpp"
+using namespace std;
+
+// Where the next page of a user's history starts. Pages run newest first.
+struct HistoryCursor
+{
+    ExpenseId before = UINT32_MAX; // next page holds ids below this
+    bool done = false;
+};
+
+// Per-user posting lists of expense ids (payer or participant), in id order,
+// which is insertion order. Heavy users' older ids are packed into blocks of
+// BLOCK_SIZE delta-encoded varints with the first id of each block kept
+// uncompressed, so a cursor can still jump straight to its block. A block's
+// gaps run up to where the next block's start, so an edit that adds or
+// removes an old id re-encodes that one block and shifts the bytes after it.
+class UserExpenseIndex
+{
+    static const size_t BLOCK_SIZE = 128;
+
+    struct PostingList
+    {
+        vector<ExpenseId> blockFirst;  // first id of each sealed block
+        vector<uint32_t> blockOffset;  // start of each block's deltas in 'bytes'
+        vector<uint8_t> bytes;         // varint gaps for ids 2..BLOCK_SIZE of every block
+        ExpenseId sealedLast = 0;      // last id in the sealed blocks
+        vector<ExpenseId> tail;        // newest ids, not yet sealed
+        size_t sealedCount = 0;        // ids in the sealed blocks; not saved
+    };
+
+    vector<PostingList> lists; // indexed by UserId
+    size_t compressAfter;      // ids a user needs before blocks are sealed; 0 disables
+
+    static void putVarint(vector<uint8_t> &out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(uint8_t(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(uint8_t(value));
+    }
+
+    static uint32_t getVarint(const uint8_t *&in)
+    {
+        uint32_t value = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            uint8_t byte = *in++;
+            value |= uint32_t(byte & 0x7f) << shift;
+            if (byte < 0x80)
+                return value;
+        }
+    }
+
+    static size_t blockCount(const PostingList &list) { return list.blockFirst.size(); }
+
+    static size_t blockEnd(const PostingList &list, size_t block)
+    {
+        return block + 1 < blockCount(list) ? list.blockOffset[block + 1] : list.bytes.size();
+    }
+
+    static void decodeBlock(const PostingList &list, size_t block, vector<ExpenseId> &out)
+    {
+        out.clear();
+        const uint8_t *in = list.bytes.data() + list.blockOffset[block];
+        const uint8_t *end = list.bytes.data() + blockEnd(list, block);
+        ExpenseId id = list.blockFirst[block];
+        out.push_back(id);
+        while (in < end)
+        {
+            id += getVarint(in);
+            out.push_back(id);
+        }
+    }
+
+    // The sealed block an old id belongs in
+    static size_t blockOf(const PostingList &list, ExpenseId id)
+    {
+        size_t block = upper_bound(list.blockFirst.begin(), list.blockFirst.end(), id) - list.blockFirst.begin();
+        return block ? block - 1 : 0;
+    }
+
+    // Re-encodes one block as 'ids' (sorted; empty drops the block) in place,
+    // moving the bytes of the blocks after it
+    void rewriteBlock(PostingList &list, size_t block, size_t previousCount, const vector<ExpenseId> &ids)
+    {
+        vector<uint8_t> encoded;
+        for (size_t i = 1; i < ids.size(); i++)
+        {
+            putVarint(encoded, ids[i] - ids[i - 1]);
+        }
+        size_t begin = list.blockOffset[block], end = blockEnd(list, block);
+        list.bytes.erase(list.bytes.begin() + begin, list.bytes.begin() + end);
+        list.bytes.insert(list.bytes.begin() + begin, encoded.begin(), encoded.end());
+        for (size_t b = block + 1; b < blockCount(list); b++)
+        {
+            list.blockOffset[b] = list.blockOffset[b] + encoded.size() - (end - begin);
+        }
+        list.sealedCount = list.sealedCount + ids.size() - previousCount;
+        if (ids.empty())
+        {
+            list.blockFirst.erase(list.blockFirst.begin() + block);
+            list.blockOffset.erase(list.blockOffset.begin() + block);
+        }
+        else
+        {
+            list.blockFirst[block] = ids[0];
+        }
+        if (!blockCount(list))
+        {
+            list.sealedLast = 0;
+        }
+        else if (block + 1 >= blockCount(list))
+        {
+            vector<ExpenseId> last;
+            decodeBlock(list, blockCount(list) - 1, last);
+            list.sealedLast = last.back();
+        }
+    }
+
+    void sealBlocks(PostingList &list)
+    {
+        size_t sealed = 0;
+        while (list.tail.size() - sealed >= BLOCK_SIZE)
+        {
+            const ExpenseId *ids = list.tail.data() + sealed;
+            list.blockFirst.push_back(ids[0]);
+            list.blockOffset.push_back(list.bytes.size());
+            for (size_t i = 1; i < BLOCK_SIZE; i++)
+            {
+                putVarint(list.bytes, ids[i] - ids[i - 1]);
+            }
+            list.sealedLast = ids[BLOCK_SIZE - 1];
+            list.sealedCount += BLOCK_SIZE;
+            sealed += BLOCK_SIZE;
+        }
+        list.tail.erase(list.tail.begin(), list.tail.begin() + sealed);
+    }
+
+    void append(UserId user, ExpenseId id)
+    {
+        if (lists.size() <= user)
+            lists.resize(user + 1);
+        PostingList &list = lists[user];
+
+        bool sealed = blockCount(list) > 0;
+        if (list.tail.empty() ? (!sealed || id > list.sealedLast) : id > list.tail.back())
+        {
+            list.tail.push_back(id);
+        }
+        else if (sealed && id <= list.sealedLast)
+        {
+            // Older id (an edit added this user) that belongs in a sealed block
+            insertIntoBlocks(list, id);
+            return;
+        }
+        else
+        {
+            auto at = lower_bound(list.tail.begin(), list.tail.end(), id);
+            if (at != list.tail.end() && *at == id)
+                return;
+            list.tail.insert(at, id);
+        }
+
+        if (compressAfter && list.tail.size() >= (blockCount(list) ? BLOCK_SIZE : compressAfter))
+            sealBlocks(list);
+    }
+
+    void insertIntoBlocks(PostingList &list, ExpenseId id)
+    {
+        size_t block = blockOf(list, id);
+        vector<ExpenseId> ids;
+        decodeBlock(list, block, ids);
+        auto at = lower_bound(ids.begin(), ids.end(), id);
+        if (at != ids.end() && *at == id)
+            return;
+        ids.insert(at, id);
+        rewriteBlock(list, block, ids.size() - 1, ids);
+    }
+
+    template <class F>
+    static void forEach(const PostingList &list, F f)
+    {
+        vector<ExpenseId> block;
+        for (size_t b = 0; b < blockCount(list); b++)
+        {
+            decodeBlock(list, b, block);
+            for (ExpenseId id : block)
+                f(id);
+        }
+        for (ExpenseId id : list.tail)
+            f(id);
+    }
+
+public:
+    explicit UserExpenseIndex(size_t compressAfter = 1024) : compressAfter(compressAfter) {}
+
+    // Lists the expense under its payer and every participant, once each
+    void add(ExpenseId id, UserId payer, Span<UserId> participants)
+    {
+        append(payer, id);
+        for (UserId user : participants)
+        {
+            if (user != payer)
+                append(user, id);
+        }
+    }
+
+    // An edit brought the user into an existing expense
+    void addEntry(UserId user, ExpenseId id)
+    {
+        append(user, id);
+    }
+
+    // An edit (or delete) took the user out of the expense
+    void removeEntry(UserId user, ExpenseId id)
+    {
+        if (user >= lists.size())
+            return;
+        PostingList &list = lists[user];
+        auto at = lower_bound(list.tail.begin(), list.tail.end(), id);
+        if (at != list.tail.end() && *at == id)
+        {
+            list.tail.erase(at);
+            return;
+        }
+        if (!blockCount(list) || id > list.sealedLast || id < list.blockFirst[0])
+            return;
+
+        size_t block = blockOf(list, id);
+        vector<ExpenseId> ids;
+        decodeBlock(list, block, ids);
+        at = lower_bound(ids.begin(), ids.end(), id);
+        if (at == ids.end() || *at != id)
+            return;
+        ids.erase(at);
+        rewriteBlock(list, block, ids.size() + 1, ids);
+    }
+
+    // All of the user's expense ids, oldest first
+    template <class F>
+    void forEachExpense(UserId user, F f) const
+    {
+        if (user < lists.size())
+            forEach(lists[user], f);
+    }
+
+    // Up to 'limit' ids older than the cursor, newest first; advances the cursor.
+    // Only the tail and the block holding the cursor are touched.
+    vector<ExpenseId> page(UserId user, HistoryCursor &cursor, size_t limit) const
+    {
+        vector<ExpenseId> ids;
+        if (cursor.done || cursor.before == 0 || user >= lists.size())
+        {
+            cursor.done = true;
+            return ids;
+        }
+        const PostingList &list = lists[user];
+
+        auto tailEnd = lower_bound(list.tail.begin(), list.tail.end(), cursor.before);
+        for (auto it = tailEnd; it != list.tail.begin() && ids.size() < limit;)
+        {
+            ids.push_back(*--it);
+        }
+
+        if (ids.size() < limit && blockCount(list))
+        {
+            // Last block whose first id is below the cursor
+            size_t block = upper_bound(list.blockFirst.begin(), list.blockFirst.end(), cursor.before - 1) - list.blockFirst.begin();
+            vector<ExpenseId> decoded;
+            while (block-- > 0 && ids.size() < limit)
+            {
+                decodeBlock(list, block, decoded);
+                auto end = lower_bound(decoded.begin(), decoded.end(), cursor.before);
+                for (auto it = end; it != decoded.begin() && ids.size() < limit;)
+                {
+                    ids.push_back(*--it);
+                }
+            }
+        }
+
+        if (ids.size() < limit)
+            cursor.done = true;
+        if (!ids.empty())
+            cursor.before = ids.back();
+        return ids;
+    }
+
+    size_t count(UserId user) const
+    {
+        if (user >= lists.size())
+            return 0;
+        return lists[user].sealedCount + lists[user].tail.size();
+    }
+
+    size_t memoryBytes() const
+    {
+        size_t bytes = lists.capacity() * sizeof(PostingList);
+        for (const PostingList &list : lists)
+        {
+            bytes += list.blockFirst.capacity() * sizeof(ExpenseId) + list.blockOffset.capacity() * sizeof(uint32_t) +
+                     list.bytes.capacity() + list.tail.capacity() * sizeof(ExpenseId);
+        }
+        return bytes;
+    }
+
+    void save(BinaryWriter &out) const
+    {
+        out.put<uint64_t>(lists.size());
+        for (const PostingList &list : lists)
+        {
+            out.putArray(list.blockFirst);
+            out.putArray(list.blockOffset);
+            out.putArray(list.bytes);
+            out.put(list.sealedLast);
+            out.putArray(list.tail);
+        }
+    }
+
+    // Replaces the contents with what save() wrote
+    bool load(BinaryReader &in)
+    {
+        uint64_t count = in.get<uint64_t>();
+        if (!in.ok() || count > in.remaining())
+            return false;
+        lists.assign(count, PostingList());
+        for (PostingList &list : lists)
+        {
+            in.getArray(list.blockFirst);
+            in.getArray(list.blockOffset);
+            in.getArray(list.bytes);
+            list.sealedLast = in.get<ExpenseId>();
+            in.getArray(list.tail);
+            if (!in.ok() || list.blockOffset.size() != list.blockFirst.size())
+                return false;
+            // A block's first id, plus one per varint (each ends on a byte below 0x80)
+            list.sealedCount = blockCount(list);
+            for (uint8_t byte : list.bytes)
+                list.sealedCount += byte < 0x80;
+        }
+        return true;
+    }
+};
+
+#endif // USEREXPENSEINDEX_H
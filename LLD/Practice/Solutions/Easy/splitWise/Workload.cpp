@@ -0,0 +1,165 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <bits/stdc++.h>
+#include "ExpenseStore.cpp"
+using namespace std;
+
+// Shape of a synthetic workload. The same config always generates the same
+// users, groups and expenses, in the same order.
+struct WorkloadConfig
+{
+    uint64_t seed = 42;
+    size_t users = 100000;
+    size_t groups = 10000;
+    double groupSizeExponent = 2.0; // P(size >= s) ∝ s^(1 - exponent): most groups are small, a few are big
+    size_t maxGroupSize = 200;
+    size_t expenses = 1000000;
+    double groupShare = 0.4;  // of expenses made within a group
+    double equalShare = 0.6;  // of expenses split EQUAL
+    double exactShare = 0.25; // and EXACT; the rest are PERCENT
+    vector<double> participantWeights = {35, 25, 15, 10, 5, 4, 3, 3}; // relative odds of 2, 3, ... participants
+    size_t friendCircle = 64; // outside groups, people split with the users whose index is this close to theirs
+    int64_t start = 1700000000; // timestamps run from here, evenly over 'days'
+    int64_t days = 365;
+};
+
+// One generated expense; users are indexes into the workload's user list
+struct WorkloadExpense
+{
+    static const uint32_t NO_GROUP_INDEX = UINT32_MAX;
+
+    uint32_t payer;
+    uint32_t group; // index into groups, or NO_GROUP_INDEX
+    int64_t cents;
+    ExpenseType type;
+    vector<uint32_t> users;
+    vector<int64_t> values; // cents (EXACT) or basis points (PERCENT); empty for EQUAL
+    int64_t timestamp;
+};
+
+// Generates a WorkloadConfig's groups and then its expenses, one at a time.
+// Every draw comes from one seeded mt19937_64, so runs built against the
+// same standard library repeat exactly.
+class WorkloadGenerator
+{
+    WorkloadConfig config;
+    mt19937_64 random;
+    discrete_distribution<size_t> participants; // count - 2
+    vector<vector<uint32_t>> groupMembers;
+    vector<uint32_t> scratch;
+    size_t generated;
+
+    size_t below(size_t n) { return uniform_int_distribution<size_t>(0, n - 1)(random); }
+
+    double unit() { return uniform_real_distribution<double>(0, 1)(random); }
+
+    // Discrete Pareto from 2 up, by inverse transform
+    size_t groupSize()
+    {
+        double size = 2 * pow(1 - unit(), -1 / (config.groupSizeExponent - 1));
+        return size_t(min(size, double(min(config.maxGroupSize, config.users))));
+    }
+
+    // 'count' distinct entries of 'pool', in pool order
+    void sample(const vector<uint32_t> &pool, size_t count, vector<uint32_t> &out)
+    {
+        out.clear();
+        for (size_t i = 0, left = count; left > 0; i++)
+        {
+            if (below(pool.size() - i) < left)
+            {
+                out.push_back(pool[i]);
+                left--;
+            }
+        }
+    }
+
+    // 'parts' random non-negative integers adding up to 'total'
+    void splitRandomly(int64_t total, size_t parts, vector<int64_t> &out)
+    {
+        out.resize(parts);
+        vector<int64_t> cuts(parts - 1);
+        for (int64_t &cut : cuts)
+            cut = uniform_int_distribution<int64_t>(0, total)(random);
+        sort(cuts.begin(), cuts.end());
+        int64_t previous = 0;
+        for (size_t i = 0; i + 1 < parts; i++)
+        {
+            out[i] = cuts[i] - previous;
+            previous = cuts[i];
+        }
+        out[parts - 1] = total - previous;
+    }
+
+public:
+    explicit WorkloadGenerator(const WorkloadConfig &config)
+        : config(config), random(config.seed),
+          participants(config.participantWeights.begin(), config.participantWeights.end()), generated(0)
+    {
+        groupMembers.resize(config.users < 2 ? 0 : config.groups);
+        vector<uint32_t> everyone(config.users);
+        iota(everyone.begin(), everyone.end(), 0);
+        for (vector<uint32_t> &members : groupMembers)
+        {
+            // Drawn from a window of the user list, so sample() stays cheap
+            size_t size = groupSize();
+            size_t window = min(config.users, size * 8);
+            size_t first = below(config.users - window + 1);
+            scratch.assign(everyone.begin() + first, everyone.begin() + first + window);
+            sample(scratch, size, members);
+        }
+    }
+
+    const WorkloadConfig &getConfig() const { return config; }
+
+    const vector<vector<uint32_t>> &getGroups() const { return groupMembers; }
+
+    // The next expense into 'out'; false once config.expenses have been made
+    bool next(WorkloadExpense &out)
+    {
+        if (generated == config.expenses || config.users < 2)
+            return false;
+        size_t count = min(2 + participants(random), config.users);
+        out.group = WorkloadExpense::NO_GROUP_INDEX;
+        if (!groupMembers.empty() && unit() < config.groupShare)
+        {
+            out.group = uint32_t(below(groupMembers.size()));
+            const vector<uint32_t> &members = groupMembers[out.group];
+            sample(members, min(count, members.size()), out.users);
+        }
+        else
+        {
+            size_t window = min(config.users, max<size_t>(config.friendCircle, count));
+            size_t first = below(config.users - window + 1);
+            scratch.resize(window);
+            iota(scratch.begin(), scratch.end(), uint32_t(first));
+            sample(scratch, count, out.users);
+        }
+        out.payer = out.users[below(out.users.size())];
+
+        // Log-uniform from $1 to $1000
+        out.cents = int64_t(exp(log(100.0) + unit() * (log(100000.0) - log(100.0))));
+        double kind = unit();
+        out.values.clear();
+        if (kind < config.equalShare)
+        {
+            out.type = ExpenseType::EQUAL;
+        }
+        else if (kind < config.equalShare + config.exactShare)
+        {
+            out.type = ExpenseType::EXACT;
+            splitRandomly(out.cents, out.users.size(), out.values);
+        }
+        else
+        {
+            out.type = ExpenseType::PERCENT;
+            splitRandomly(10000, out.users.size(), out.values);
+        }
+        out.timestamp = config.start + int64_t(generated * (config.days * 86400.0 / config.expenses));
+        generated++;
+        return true;
+    }
+};
+
+#endif // WORKLOAD_H
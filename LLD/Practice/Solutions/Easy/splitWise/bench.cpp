@@ -0,0 +1,888 @@
+#include <bits/stdc++.h>
+#include <malloc.h>
+#include "SplitSystem.cpp"
+#include "Workload.cpp"
+using namespace std;
+
+// Benchmark over a generated workload (see WorkloadGenerator): ingest
+// throughput, balance and history query latencies, simplification time and
+// memory. Prints one JSON object, so runs on different builds can be diffed
+// or compared by a script. The defaults are 1M expenses across 100k users.
+//
+//   ./splitWiseBench [--users N] [--groups N] [--expenses N] [--days N] [--seed N]
+//                    [--queries N] [--batch N] [--out FILE]
+//                    [--baseline 0|1] [--threads N] [--mixed-ops N]
+//                    [--batch-sweep N,N,...] [--sweep-expenses N] [--edits N]
+//                    [--restart-expenses N] [--import-rows N]
+//
+// --baseline 1 also replays every share into per-user map<string, double>
+// balance sheets, written once per side as before the pairwise ledger, and
+// reports their update rate and heap use next to BalanceLedger's. It also
+// prints every balance and expense through showAllBalances and
+// displayExpenses into a file, for the report MB/s to be read against.
+//
+// Full scan: every ingested expense is read back through getExpensesBetween
+// (amount, participants and shares), reported as expenses per second
+// alongside the store's bytes per expense. --baseline 1 also builds the
+// same expenses as heap objects with vector<string> participants and
+// map<string, double> shares, as before ExpenseStore, and reports both
+// figures for them.
+//
+// Export: exportBalances and exportExpenses write the ingested ledger to a
+// file under /tmp as CSV and as JSON; each reports MB/s (10^6 bytes).
+//
+// Expenses are spread evenly over --days (default 365). yearly_statement_query
+// asks for a random user's statement over a random 365-day window; with
+// --days 3650 that is a year out of a 10-year ledger.
+//
+// edit_expense and delete_expense time --edits (default 10k) editExpense and
+// deleteExpense calls on random ingested expenses. An edit gives the expense
+// a freshly generated payer, amount, split and participants and keeps its
+// timestamp. Their latency should not grow with --expenses.
+//
+// After ingest, --sweep-expenses fresh expenses (default 50k) are added at
+// each --batch-sweep size (default 1,64,4096) to price one expense against
+// the size of the addExpenses call it arrives in.
+//
+// --threads N then runs --mixed-ops operations, one addExpenses of a single
+// expense to every three getBalances, on 1, 2, 4, ... N threads at once,
+// and reports the combined rate at each thread count.
+//
+// Every operator new in the process is counted. Each *_query, edit_expense
+// and delete_expense reports allocs_per_op, and registerUser and ingest
+// report allocations per user and per expense.
+//
+// audit_pass_s is one audit() over the whole system. The same mixed load on
+// --threads threads is then run three more times, the middle run with the
+// background auditor at its default 1% budget; auditor_overhead_pct is its
+// rate against the mean of the two runs either side.
+//
+// Restart time: --restart-expenses (default 200k) fresh expenses are added
+// to a durable system in a scratch directory under /tmp. It is then
+// reopened from the journal alone (restart_journal_s), checkpointed, and
+// reopened from the snapshot (restart_snapshot_s).
+//
+// Bulk import: --import-rows (default 1M) fresh expenses are written to a
+// CSV and an SWB2 binary file under /tmp, and each is imported into a
+// system holding only the users on 1, 2, 4, ... --threads threads (or the
+// hardware's), reporting rows per second at each count.
+
+using Clock = chrono::steady_clock;
+
+// Every operator new in the process; a section reads it before and after
+static atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void *block = malloc(size ? size : 1))
+        return block;
+    throw bad_alloc();
+}
+
+void *operator new(size_t size, align_val_t alignment)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    size_t align = size_t(alignment);
+    if (void *block = aligned_alloc(align, (max<size_t>(size, 1) + align - 1) / align * align))
+        return block;
+    throw bad_alloc();
+}
+
+// Not inlined, or GCC pairs the free() with the library's operator new and warns
+__attribute__((noinline)) void operator delete(void *block) noexcept { free(block); }
+__attribute__((noinline)) void operator delete(void *block, size_t) noexcept { free(block); }
+__attribute__((noinline)) void operator delete(void *block, align_val_t) noexcept { free(block); }
+__attribute__((noinline)) void operator delete(void *block, size_t, align_val_t) noexcept { free(block); }
+
+static double secondsSince(Clock::time_point started)
+{
+    return chrono::duration<double>(Clock::now() - started).count();
+}
+
+// Percentiles of one kind of query, in microseconds, and what it allocated
+struct Latency
+{
+    vector<double> samples;
+    uint64_t allocated = 0;
+
+    template <class F>
+    void time(F query)
+    {
+        uint64_t before = allocations.load(memory_order_relaxed);
+        auto started = Clock::now();
+        query();
+        samples.push_back(secondsSince(started) * 1e6);
+        allocated += allocations.load(memory_order_relaxed) - before;
+    }
+
+    double percentile(double p) const
+    {
+        vector<double> sorted = samples;
+        sort(sorted.begin(), sorted.end());
+        return sorted.empty() ? 0 : sorted[min(sorted.size() - 1, size_t(p * sorted.size()))];
+    }
+};
+
+// Bytes the heap has handed out and not had back
+static size_t heapInUse()
+{
+    return mallinfo2().uordblks;
+}
+
+// VmRSS or VmHWM (peak) from /proc, in bytes; 0 where there is no /proc
+static size_t residentBytes(const string &field)
+{
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+    {
+        if (line.compare(0, field.size() + 1, field + ":") == 0)
+            return stoull(line.substr(field.size() + 1)) * 1024;
+    }
+    return 0;
+}
+
+// One generated expense as an addExpenses request
+static void toRequest(const WorkloadExpense &expense, const vector<string> &userIds, const vector<string> &groupIds,
+                      SplitwiseSystem::ExpenseRequest &request)
+{
+    request.description = "Generated";
+    request.paidBy = userIds[expense.payer];
+    request.amount = Money(expense.cents);
+    request.type = expense.type;
+    request.users.clear();
+    for (uint32_t user : expense.users)
+        request.users.push_back(userIds[user]);
+    request.values = expense.values;
+    request.groupId = expense.group == WorkloadExpense::NO_GROUP_INDEX ? "" : groupIds[expense.group];
+    request.timestamp = expense.timestamp;
+}
+
+// 'ops' operations split over 'threads' threads, each adding one expense
+// (from 'requests', in order) for every three balance reads; ops per second
+static double runMixed(SplitwiseSystem &splitwise, const vector<string> &userIds,
+                       vector<SplitwiseSystem::ExpenseRequest> &requests, size_t ops, size_t threads, uint64_t seed)
+{
+    vector<thread> workers;
+    auto started = Clock::now();
+    for (size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]
+                             {
+            mt19937_64 picks(seed + t);
+            uniform_int_distribution<size_t> anyone(0, userIds.size() - 1);
+            size_t counterparties = 0;
+            for (size_t op = t; op < ops; op += threads)
+            {
+                if (op % 4 == 0)
+                    splitwise.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(&requests[op / 4], 1));
+                else
+                    counterparties += splitwise.getBalances(userIds[anyone(picks)]).size();
+            } });
+    }
+    for (thread &worker : workers)
+        worker.join();
+    double seconds = secondsSince(started);
+    return seconds > 0 ? ops / seconds : 0;
+}
+
+// 'rows' fresh expenses, outside groups, as BulkImporter's CSV (with
+// timestamps) and SWB2 binary; user i is the i-th registered
+static void writeImportFiles(const WorkloadConfig &config, size_t rows, const vector<string> &userIds,
+                             const string &csvPath, const string &binaryPath)
+{
+    WorkloadConfig fresh = config;
+    fresh.seed = config.seed + 400;
+    fresh.expenses = rows;
+    fresh.groups = 0;
+    WorkloadGenerator generator(fresh);
+    WorkloadExpense expense;
+    ofstream csv(csvPath), binary(binaryPath, ios::binary);
+    string line, record;
+    auto appendHundredths = [&](int64_t value)
+    {
+        char text[32];
+        line.append(text, snprintf(text, sizeof(text), "%lld.%02lld", (long long)(value / 100), (long long)(value % 100)));
+    };
+    auto put = [&](const auto &value)
+    { record.append(reinterpret_cast<const char *>(&value), sizeof(value)); };
+    binary << "SWB2";
+    while (generator.next(expense))
+    {
+        static const char *const TYPES[] = {"EQUAL", "EXACT", "PERCENT"};
+        line = "Imported,";
+        line += userIds[expense.payer];
+        line += ',';
+        appendHundredths(expense.cents);
+        line += ',';
+        line += TYPES[int(expense.type)];
+        line += ',';
+        for (size_t i = 0; i < expense.users.size(); i++)
+        {
+            line += i ? ";" : "";
+            line += userIds[expense.users[i]];
+            if (expense.type != ExpenseType::EQUAL)
+            {
+                line += '=';
+                appendHundredths(expense.values[i]);
+            }
+        }
+        line += ',';
+        line += to_string(expense.timestamp);
+        line += '\n';
+        csv << line;
+
+        record.clear();
+        put(expense.payer);
+        put(expense.cents);
+        put(uint8_t(expense.type));
+        put(uint8_t(8));
+        put(uint16_t(expense.users.size()));
+        put(expense.timestamp);
+        put(HOME_CURRENCY);
+        record += "Imported";
+        for (uint32_t user : expense.users)
+            put(user);
+        for (int64_t value : expense.values)
+            put(value);
+        binary << record;
+    }
+}
+
+class BenchReport
+{
+    ReportBuffer out;
+    bool first = true;
+
+    void key(string_view name)
+    {
+        if (!first)
+            out.append(',');
+        first = false;
+        out.append("\n  ");
+        out.appendJsonKey(name);
+        out.append(' ');
+    }
+
+public:
+    BenchReport() { out.append('{'); }
+
+    void add(string_view name, uint64_t value)
+    {
+        key(name);
+        out.appendUnsigned(value);
+    }
+
+    void add(string_view name, double value)
+    {
+        key(name);
+        char text[32];
+        out.append(string_view(text, snprintf(text, sizeof(text), "%.3f", value)));
+    }
+
+    void add(string_view name, const Latency &latency)
+    {
+        key(name);
+        double sum = accumulate(latency.samples.begin(), latency.samples.end(), 0.0);
+        char text[200];
+        out.append(string_view(text, snprintf(text, sizeof(text), "{\"count\": %zu, \"mean_us\": %.3f, \"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f, \"allocs_per_op\": %.3f}",
+                                              latency.samples.size(), latency.samples.empty() ? 0 : sum / latency.samples.size(),
+                                              latency.percentile(0.5), latency.percentile(0.9), latency.percentile(0.99), latency.percentile(1),
+                                              latency.samples.empty() ? 0 : double(latency.allocated) / latency.samples.size())));
+    }
+
+    string finish()
+    {
+        out.append("\n}\n");
+        return out.data();
+    }
+};
+
+int main(int argc, char **argv)
+{
+    WorkloadConfig config;
+    size_t queries = 10000;
+    size_t batchSize = 4096;
+    string outPath = "-";
+    bool baseline = false;
+    size_t maxThreads = 0;
+    size_t mixedOps = 400000;
+    vector<size_t> sweepSizes = {1, 64, 4096};
+    size_t sweepExpenses = 50000;
+    size_t edits = 10000;
+    size_t restartExpenses = 200000;
+    size_t importRows = 1000000;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string flag = argv[i];
+        string value = argv[i + 1];
+        if (flag == "--users")
+            config.users = stoull(value);
+        else if (flag == "--groups")
+            config.groups = stoull(value);
+        else if (flag == "--expenses")
+            config.expenses = stoull(value);
+        else if (flag == "--days")
+            config.days = max<int64_t>(1, stoll(value));
+        else if (flag == "--seed")
+            config.seed = stoull(value);
+        else if (flag == "--queries")
+            queries = stoull(value);
+        else if (flag == "--batch")
+            batchSize = max<size_t>(1, stoull(value));
+        else if (flag == "--out")
+            outPath = value;
+        else if (flag == "--baseline")
+            baseline = value != "0";
+        else if (flag == "--threads")
+            maxThreads = stoull(value);
+        else if (flag == "--mixed-ops")
+            mixedOps = stoull(value);
+        else if (flag == "--batch-sweep")
+        {
+            sweepSizes.clear();
+            for (size_t at = 0; at < value.size();)
+            {
+                size_t comma = min(value.find(',', at), value.size());
+                sweepSizes.push_back(max<size_t>(1, stoull(value.substr(at, comma - at))));
+                at = comma + 1;
+            }
+        }
+        else if (flag == "--sweep-expenses")
+            sweepExpenses = stoull(value);
+        else if (flag == "--edits")
+            edits = stoull(value);
+        else if (flag == "--restart-expenses")
+            restartExpenses = stoull(value);
+        else if (flag == "--import-rows")
+            importRows = stoull(value);
+        else
+        {
+            cerr << "Unknown option " << flag << endl;
+            return 2;
+        }
+    }
+    if (argc % 2 == 0)
+    {
+        cerr << "Missing value for " << argv[argc - 1] << endl;
+        return 2;
+    }
+
+    BenchReport report;
+    report.add("seed", uint64_t(config.seed));
+    report.add("users", uint64_t(config.users));
+    report.add("groups", uint64_t(config.groups));
+    report.add("expenses", uint64_t(config.expenses));
+    report.add("days", uint64_t(config.days));
+    report.add("batch", uint64_t(batchSize));
+
+    SplitwiseSystem splitwise;
+    auto started = Clock::now();
+    WorkloadGenerator generator(config);
+    report.add("generate_groups_s", secondsSince(started));
+
+    // Users and groups
+    started = Clock::now();
+    vector<string> userIds;
+    userIds.reserve(config.users);
+    uint64_t registerAllocations = 0;
+    for (size_t i = 0; i < config.users; i++)
+    {
+        string name = "User" + to_string(i), email = "user" + to_string(i) + "@example.com";
+        uint64_t before = allocations.load(memory_order_relaxed);
+        User *user = splitwise.registerUser(name, email);
+        registerAllocations += allocations.load(memory_order_relaxed) - before;
+        userIds.push_back(user->getUserId());
+    }
+    report.add("register_users_s", secondsSince(started));
+    report.add("register_user_allocs_per_op", config.users > 0 ? double(registerAllocations) / config.users : 0.0);
+
+    started = Clock::now();
+    vector<string> groupIds;
+    size_t groupMembers = 0;
+    for (const vector<uint32_t> &members : generator.getGroups())
+    {
+        vector<string> memberIds;
+        for (uint32_t member : members)
+            memberIds.push_back(userIds[member]);
+        groupMembers += members.size();
+        groupIds.push_back(splitwise.createGroup("Group" + to_string(groupIds.size()), memberIds)->getGroupId());
+    }
+    report.add("create_groups_s", secondsSince(started));
+    report.add("group_members", uint64_t(groupMembers));
+
+    // Ingest, batch by batch; only addExpenses is timed
+    vector<SplitwiseSystem::ExpenseRequest> batch(batchSize);
+    WorkloadExpense expense;
+    size_t added = 0, shares = 0;
+    double ingestSeconds = 0;
+    uint64_t ingestAllocations = 0;
+    for (bool more = true; more;)
+    {
+        size_t filled = 0;
+        while (filled < batchSize && (more = generator.next(expense)))
+        {
+            toRequest(expense, userIds, groupIds, batch[filled++]);
+            shares += expense.users.size();
+        }
+        if (filled == 0)
+            break;
+        uint64_t before = allocations.load(memory_order_relaxed);
+        started = Clock::now();
+        vector<Expense> handles = splitwise.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(batch.data(), filled));
+        ingestSeconds += secondsSince(started);
+        ingestAllocations += allocations.load(memory_order_relaxed) - before;
+        added += count_if(handles.begin(), handles.end(), [](const Expense &handle)
+                          { return handle.exists(); });
+    }
+    report.add("ingest_s", ingestSeconds);
+    report.add("ingest_expenses_per_s", ingestSeconds > 0 ? added / ingestSeconds : 0.0);
+    report.add("expenses_added", uint64_t(added));
+    report.add("ingest_allocs_per_expense", added > 0 ? double(ingestAllocations) / added : 0.0);
+    report.add("shares", uint64_t(shares));
+
+    // Queries, each for a user picked at random with its own seed, so every
+    // run asks about the same users
+    mt19937_64 picks(config.seed + 1);
+    uniform_int_distribution<size_t> anyone(0, config.users - 1);
+
+    // External id → user, as every API call resolves its arguments
+    size_t lookups = config.users > 0 ? queries * 100 : 0, found = 0;
+    started = Clock::now();
+    for (size_t i = 0; i < lookups; i++)
+        found += splitwise.findUser(userIds[anyone(picks)]) != nullptr;
+    double lookupSeconds = secondsSince(started);
+    report.add("user_lookups_per_s", lookupSeconds > 0 ? lookups / lookupSeconds : 0.0);
+    report.add("user_lookups_found", uint64_t(found));
+
+    int64_t middle = config.start + config.days * 86400 / 2;
+    uniform_int_distribution<int64_t> yearStart(config.start, config.start + max<int64_t>(0, config.days - 365) * 86400);
+    Latency balances, netBalance, history, statement, yearly;
+    size_t counterparties = 0;
+    for (size_t i = 0; i < queries && config.users > 0; i++)
+    {
+        const string &userId = userIds[anyone(picks)];
+        balances.time([&]
+                      { counterparties += splitwise.getBalances(userId).size(); });
+        netBalance.time([&]
+                        { splitwise.getNetBalance(userId); });
+        history.time([&]
+                     {
+            HistoryCursor cursor;
+            splitwise.getUserExpenses(userId, cursor, 20); });
+        statement.time([&]
+                       { splitwise.getStatement(userId, middle - 45 * 86400, middle + 45 * 86400); });
+        int64_t from = yearStart(picks);
+        yearly.time([&]
+                    { splitwise.getStatement(userId, from, from + 365 * 86400); });
+    }
+    report.add("balances_query", balances);
+    report.add("mean_counterparties", queries > 0 ? double(counterparties) / queries : 0.0);
+    report.add("net_balance_query", netBalance);
+    report.add("history_page_query", history);
+    report.add("statement_query", statement);
+    report.add("yearly_statement_query", yearly);
+
+    // Full scan of the ingested expenses, columnar and (with --baseline) as
+    // the per-object layout ExpenseStore replaced
+    {
+        int64_t checksum = 0;
+        started = Clock::now();
+        vector<Expense> all = splitwise.getExpensesBetween(config.start, config.start + config.days * 86400);
+        for (const Expense &scanned : all)
+        {
+            checksum += scanned.getTotalAmount().getCents() + scanned.getParticipants().size();
+            for (Money share : scanned.getShareAmounts())
+                checksum += share.getCents();
+        }
+        double seconds = secondsSince(started);
+        report.add("full_scan_expenses", uint64_t(all.size()));
+        report.add("full_scan_expenses_per_s", seconds > 0 ? all.size() / seconds : 0.0);
+        report.add("expense_store_bytes_per_expense", added > 0 ? double(splitwise.memoryUsage().expenses) / added : 0.0);
+
+        if (baseline)
+        {
+            struct HeapExpense
+            {
+                string id;
+                string description;
+                string paidBy;
+                double amount;
+                ExpenseType type;
+                int64_t timestamp;
+                vector<string> involvedUsers;
+                map<string, double> shares;
+            };
+            size_t heapBefore = heapInUse();
+            vector<unique_ptr<HeapExpense>> objects;
+            objects.reserve(all.size());
+            for (const Expense &scanned : all)
+            {
+                auto object = make_unique<HeapExpense>();
+                object->id = scanned.getExpenseId();
+                object->description = string(scanned.getDescription());
+                object->paidBy = userIds[scanned.getPaidBy()];
+                object->amount = scanned.getTotalAmount().getCents() / 100.0;
+                object->type = scanned.getType();
+                object->timestamp = scanned.getTimestamp();
+                Span<UserId> users = scanned.getParticipants();
+                Span<Money> shares = scanned.getShareAmounts();
+                for (size_t i = 0; i < users.size(); i++)
+                {
+                    object->involvedUsers.push_back(userIds[users[i]]);
+                    if (i < shares.size())
+                        object->shares[userIds[users[i]]] = shares[i].getCents() / 100.0;
+                }
+                objects.push_back(move(object));
+            }
+            size_t heapBytes = heapInUse() - heapBefore;
+            int64_t total = 0;
+            started = Clock::now();
+            for (const unique_ptr<HeapExpense> &object : objects)
+            {
+                // By value, as the old getParticipants()/getShares() returned them
+                vector<string> involved = object->involvedUsers;
+                map<string, double> shares = object->shares;
+                total += llround(object->amount * 100) + involved.size();
+                for (const auto &share : shares)
+                    total += llround(share.second * 100);
+            }
+            seconds = secondsSince(started);
+            report.add("heap_objects_scan_expenses_per_s", seconds > 0 ? objects.size() / seconds : 0.0);
+            report.add("heap_objects_bytes_per_expense", objects.empty() ? 0.0 : double(heapBytes) / objects.size());
+            report.add("scan_checksums_match", uint64_t(total == checksum));
+        }
+    }
+
+    // Edits and deletes of distinct random expenses; the edits' new shares
+    // come from a workload of their own, outside groups
+    {
+        vector<ExpenseId> ids(added);
+        iota(ids.begin(), ids.end(), 0);
+        shuffle(ids.begin(), ids.end(), picks);
+        edits = min(edits, added / 2);
+        WorkloadConfig changes = config;
+        changes.seed = config.seed + 3;
+        changes.expenses = edits;
+        changes.groups = 0;
+        WorkloadGenerator replacements(changes);
+        SplitwiseSystem::ExpenseRequest request;
+        Latency edited, deleted;
+        size_t accepted = 0;
+        for (size_t i = 0; i < edits && replacements.next(expense); i++)
+        {
+            toRequest(expense, userIds, groupIds, request);
+            request.timestamp = 0;
+            string expenseId = "E" + to_string(ids[i] + 1);
+            edited.time([&]
+                        { accepted += splitwise.editExpense(expenseId, request); });
+        }
+        for (size_t i = 0; i < edits; i++)
+        {
+            string expenseId = "E" + to_string(ids[edits + i] + 1);
+            deleted.time([&]
+                         { accepted += splitwise.deleteExpense(expenseId); });
+        }
+        report.add("edit_expense", edited);
+        report.add("delete_expense", deleted);
+        report.add("edits_accepted", uint64_t(accepted));
+    }
+
+    // The same shares again, straight into a lone pairwise ledger (and the
+    // old per-user maps), to price a balance update on its own
+    {
+        vector<pair<uint32_t, uint32_t>> pairs; // (creditor, debtor)
+        vector<int64_t> amounts;
+        WorkloadGenerator replay(config);
+        while (replay.next(expense))
+        {
+            for (uint32_t user : expense.users)
+            {
+                if (user == expense.payer)
+                    continue;
+                pairs.push_back({expense.payer, user});
+                amounts.push_back(expense.cents / int64_t(expense.users.size()));
+            }
+        }
+        report.add("ledger_updates", uint64_t(pairs.size()));
+
+        size_t heapBefore = heapInUse();
+        started = Clock::now();
+        BalanceLedger pairLedger;
+        for (size_t i = 0; i < pairs.size(); i++)
+            pairLedger.addDebt(pairs[i].first, pairs[i].second, Money(amounts[i]));
+        double seconds = secondsSince(started);
+        report.add("ledger_updates_per_s", seconds > 0 ? pairs.size() / seconds : 0.0);
+        report.add("ledger_pairs", uint64_t(pairLedger.size()));
+        report.add("ledger_heap_bytes", uint64_t(heapInUse() - heapBefore));
+
+        if (baseline)
+        {
+            heapBefore = heapInUse();
+            started = Clock::now();
+            vector<map<string, double>> sheets(config.users);
+            for (size_t i = 0; i < pairs.size(); i++)
+            {
+                double amount = amounts[i] / 100.0;
+                sheets[pairs[i].first][userIds[pairs[i].second]] += amount;
+                sheets[pairs[i].second][userIds[pairs[i].first]] -= amount;
+            }
+            seconds = secondsSince(started);
+            report.add("map_baseline_updates_per_s", seconds > 0 ? pairs.size() / seconds : 0.0);
+            report.add("map_baseline_heap_bytes", uint64_t(heapInUse() - heapBefore));
+        }
+    }
+
+    // Per-expense cost at each batch size; every size adds its own fresh
+    // expenses, outside groups (groups regenerated here would differ), on a
+    // day of its own after the ingested ones
+    for (size_t round = 0; round < sweepSizes.size() && config.users >= 2 && sweepExpenses > 0; round++)
+    {
+        WorkloadConfig fresh = config;
+        fresh.seed = config.seed + 50 + round;
+        fresh.expenses = sweepExpenses;
+        fresh.groups = 0;
+        fresh.start = config.start + (config.days + int64_t(round)) * 86400;
+        fresh.days = 1;
+        WorkloadGenerator extra(fresh);
+        vector<SplitwiseSystem::ExpenseRequest> requests;
+        while (extra.next(expense))
+        {
+            requests.emplace_back();
+            toRequest(expense, userIds, groupIds, requests.back());
+        }
+        size_t size = sweepSizes[round];
+        started = Clock::now();
+        for (size_t at = 0; at < requests.size(); at += size)
+            splitwise.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(requests.data() + at, min(size, requests.size() - at)));
+        report.add("batch_" + to_string(size) + "_us_per_expense", secondsSince(started) * 1e6 / requests.size());
+    }
+
+    // Mixed adds and reads from 1, 2, 4, ... threads; every round adds its
+    // own fresh expenses, outside groups (the replayed groups differ)
+    if (config.users >= 2)
+    {
+        report.add("mixed_ops", uint64_t(mixedOps));
+        report.add("hardware_threads", uint64_t(thread::hardware_concurrency()));
+        for (size_t threads = 1, round = 0; threads <= maxThreads; threads *= 2, round++)
+        {
+            WorkloadConfig mixed = config;
+            mixed.seed = config.seed + 100 + round;
+            mixed.expenses = mixedOps / 4 + 1;
+            mixed.groups = 0;
+            WorkloadGenerator extra(mixed);
+            vector<SplitwiseSystem::ExpenseRequest> requests;
+            while (extra.next(expense))
+            {
+                requests.emplace_back();
+                toRequest(expense, userIds, groupIds, requests.back());
+            }
+            double rate = runMixed(splitwise, userIds, requests, mixedOps, threads, mixed.seed);
+            report.add("mixed_ops_per_s_" + to_string(threads) + "_threads", rate);
+        }
+    }
+
+    // One full audit, then the auditor's cost to the mixed load at the
+    // widest thread count; every run adds fresh expenses of its own
+    if (config.users >= 2)
+    {
+        started = Clock::now();
+        AuditReport audited = splitwise.audit();
+        report.add("audit_pass_s", secondsSince(started));
+        report.add("audit_ok", uint64_t(audited.ok));
+
+        double rates[3];
+        for (size_t round = 0; round < 3; round++)
+        {
+            WorkloadConfig mixed = config;
+            mixed.seed = config.seed + 200 + round;
+            mixed.expenses = mixedOps / 4 + 1;
+            mixed.groups = 0;
+            WorkloadGenerator extra(mixed);
+            vector<SplitwiseSystem::ExpenseRequest> requests;
+            while (extra.next(expense))
+            {
+                requests.emplace_back();
+                toRequest(expense, userIds, groupIds, requests.back());
+            }
+            if (round == 1)
+                splitwise.startAuditor();
+            rates[round] = runMixed(splitwise, userIds, requests, mixedOps, maxThreads, mixed.seed);
+            splitwise.stopAuditor();
+        }
+        double unaudited = (rates[0] + rates[2]) / 2;
+        report.add("unaudited_mixed_ops_per_s", unaudited);
+        report.add("audited_mixed_ops_per_s", rates[1]);
+        report.add("auditor_overhead_pct", unaudited > 0 ? (1 - rates[1] / unaudited) * 100 : 0.0);
+        report.add("audit_passes", uint64_t(splitwise.auditPasses()));
+    }
+
+    // Currency conversion of a million balances, one convert() at a time and
+    // as one convertAdd(), as getBalances does for each currency a user holds
+    {
+        const size_t count = 1 << 20, passes = 20;
+        FxTable rates(FxTable(), {{Currency::find("EUR"), 0.92}});
+        mt19937_64 amounts(config.seed + 2);
+        vector<Money> balances(count), totals(count), batchTotals(count);
+        for (Money &balance : balances)
+            balance = Money(int64_t(amounts() % 2000000) - 1000000);
+        started = Clock::now();
+        for (size_t pass = 0; pass < passes; pass++)
+        {
+            for (size_t i = 0; i < count; i++)
+                totals[i] += rates.convert(balances[i], HOME_CURRENCY, Currency::find("EUR"));
+        }
+        double convertSeconds = secondsSince(started);
+        started = Clock::now();
+        for (size_t pass = 0; pass < passes; pass++)
+            rates.convertAdd(Span<Money>(balances.data(), count), HOME_CURRENCY, Currency::find("EUR"), batchTotals.data());
+        double convertAddSeconds = secondsSince(started);
+        report.add("fx_convert_per_s", convertSeconds > 0 ? count * passes / convertSeconds : 0.0);
+        report.add("fx_convert_add_per_s", convertAddSeconds > 0 ? count * passes / convertAddSeconds : 0.0);
+        report.add("fx_convert_add_matches", uint64_t(totals == batchTotals));
+    }
+
+    // Exports of the ingested ledger, and with --baseline the console
+    // printing path sent to a file instead
+    char exportScratch[] = "/tmp/splitWiseBench.XXXXXX";
+    if (mkdtemp(exportScratch))
+    {
+        string path = string(exportScratch) + "/export";
+        auto exportRate = [&](const string &name, auto run)
+        {
+            started = Clock::now();
+            SplitwiseSystem::ExportResult exported = run();
+            double seconds = secondsSince(started);
+            report.add(name + "_bytes", uint64_t(exported.bytes));
+            report.add(name + "_mb_per_s", seconds > 0 ? exported.bytes / seconds / 1e6 : 0.0);
+        };
+        for (ReportFormat format : {ReportFormat::CSV, ReportFormat::JSON})
+        {
+            string suffix = format == ReportFormat::CSV ? "_csv" : "_json";
+            exportRate("export_balances" + suffix, [&]
+                       { return splitwise.exportBalances(path, format); });
+            exportRate("export_expenses" + suffix, [&]
+                       { return splitwise.exportExpenses(path, format); });
+        }
+        if (baseline)
+        {
+            for (string name : {"print_balances", "print_expenses"})
+            {
+                ofstream printed(path);
+                streambuf *console = cout.rdbuf(printed.rdbuf());
+                started = Clock::now();
+                if (name == "print_balances")
+                    splitwise.showAllBalances();
+                else
+                    splitwise.displayExpenses();
+                cout.flush();
+                double seconds = secondsSince(started);
+                cout.rdbuf(console);
+                uint64_t bytes = uint64_t(printed.tellp());
+                report.add(name + "_bytes", bytes);
+                report.add(name + "_mb_per_s", seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+            }
+        }
+        filesystem::remove_all(exportScratch);
+    }
+
+    // Bulk import of the same rows from CSV and from binary, into systems
+    // that hold only the users
+    char importScratch[] = "/tmp/splitWiseBench.XXXXXX";
+    if (importRows > 0 && config.users >= 2 && mkdtemp(importScratch))
+    {
+        string directory = importScratch;
+        writeImportFiles(config, importRows, userIds, directory + "/rows.csv", directory + "/rows.bin");
+        report.add("import_rows", uint64_t(importRows));
+        report.add("import_csv_bytes", uint64_t(filesystem::file_size(directory + "/rows.csv")));
+        size_t widest = maxThreads ? maxThreads : max(1u, thread::hardware_concurrency());
+        for (string kind : {"csv", "binary"})
+        {
+            for (size_t threads = 1; threads <= widest; threads *= 2)
+            {
+                SplitwiseSystem fresh;
+                for (size_t i = 0; i < config.users; i++)
+                    fresh.registerUser("User" + to_string(i), "user" + to_string(i) + "@example.com");
+                started = Clock::now();
+                SplitwiseSystem::ImportResult imported = fresh.importExpenses(directory + (kind == "csv" ? "/rows.csv" : "/rows.bin"), threads);
+                double seconds = secondsSince(started);
+                report.add("import_" + kind + "_rows_per_s_" + to_string(threads) + "_threads", seconds > 0 ? imported.imported / seconds : 0.0);
+                if (threads == 1)
+                    report.add("import_" + kind + "_rejected", uint64_t(imported.rejected));
+            }
+        }
+        filesystem::remove_all(directory);
+    }
+
+    // Restart from the journal and from a snapshot; the durable system gets
+    // the same users and expenses of its own, outside groups
+    char scratch[] = "/tmp/splitWiseBench.XXXXXX";
+    if (restartExpenses > 0 && config.users >= 2 && mkdtemp(scratch))
+    {
+        string directory = scratch;
+        {
+            SplitwiseSystem durable;
+            durable.openStorage(directory);
+            for (size_t i = 0; i < config.users; i++)
+                durable.registerUser("User" + to_string(i), "user" + to_string(i) + "@example.com");
+            WorkloadConfig fresh = config;
+            fresh.seed = config.seed + 300;
+            fresh.expenses = restartExpenses;
+            fresh.groups = 0;
+            WorkloadGenerator extra(fresh);
+            vector<SplitwiseSystem::ExpenseRequest> requests;
+            for (bool more = true; more;)
+            {
+                requests.clear();
+                while (requests.size() < batchSize && (more = extra.next(expense)))
+                {
+                    requests.emplace_back();
+                    toRequest(expense, userIds, groupIds, requests.back());
+                }
+                durable.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(requests.data(), requests.size()));
+            }
+        }
+        report.add("restart_journal_bytes", uint64_t(filesystem::file_size(directory + "/journal-0.log")));
+        {
+            SplitwiseSystem restarted;
+            started = Clock::now();
+            restarted.openStorage(directory);
+            report.add("restart_journal_s", secondsSince(started));
+            restarted.checkpoint();
+        }
+        report.add("restart_snapshot_bytes", uint64_t(filesystem::file_size(directory + "/snapshot.bin")));
+        {
+            SplitwiseSystem restarted;
+            started = Clock::now();
+            restarted.openStorage(directory);
+            report.add("restart_snapshot_s", secondsSince(started));
+        }
+        filesystem::remove_all(directory);
+    }
+
+    started = Clock::now();
+    vector<Settlement> plan = splitwise.simplifyDebts();
+    report.add("simplify_s", secondsSince(started));
+    report.add("settlements", uint64_t(plan.size()));
+
+    SplitwiseSystem::MemoryUsage memory = splitwise.memoryUsage();
+    report.add("memory_directory_bytes", uint64_t(memory.directory));
+    report.add("memory_expenses_bytes", uint64_t(memory.expenses));
+    report.add("memory_history_bytes", uint64_t(memory.history));
+    report.add("memory_timeline_bytes", uint64_t(memory.timeline));
+    report.add("memory_ledger_bytes", uint64_t(memory.ledger));
+    report.add("memory_total_bytes", uint64_t(memory.total()));
+    report.add("rss_bytes", uint64_t(residentBytes("VmRSS")));
+    report.add("peak_rss_bytes", uint64_t(residentBytes("VmHWM")));
+
+    string json = report.finish();
+    if (outPath == "-")
+    {
+        cout << json;
+        return cout ? 0 : 1;
+    }
+    ofstream file(outPath);
+    file << json;
+    return file ? 0 : 1;
+}
@@ -1,11 +1,23 @@
 
 #include <bits/stdc++.h>
 #include "SplitSystem.cpp"
+#include "CommandProcessor.cpp"
 using namespace std;
 
-int main()
+int main(int argc, char **argv)
 {
     SplitwiseSystem splitwise;
+
+    // ./splitWise --commands [file]: replay a command log (stdin by default)
+    // instead of running the demo
+    if (argc > 1 && string(argv[1]) == "--commands")
+    {
+        CommandProcessor processor(splitwise);
+        CommandProcessor::Result result = processor.run(argc > 2 ? argv[2] : "-");
+        cerr << result.commands << " commands, " << result.expenses << " expenses added, " << result.invalid << " invalid" << endl;
+        return processor.ok() ? 0 : 1;
+    }
+
     // *************Register Users*************//
     User *user1 = splitwise.registerUser("John", "john@email.com");
     User *user2 = splitwise.registerUser("Alice", "alice@email.com");
@@ -18,18 +30,39 @@ int main()
 
     // Equal Split Expense
     vector<string> participants = {user1->getUserId(), user2->getUserId(), user3->getUserId()};
-    Expense *dinner = splitwise.addExpense("Dinner", user1->getUserId(), 300.0, participants, ExpenseType::EQUAL);
+    splitwise.addExpense("Dinner", user1->getUserId(), 300.0, participants, ExpenseType::EQUAL);
 
     // Custom split (EXACT)
     vector<string> movieParticipants = {user1->getUserId(), user2->getUserId()};
-    Expense *movie = splitwise.addExpense("Movie", user2->getUserId(), 100.0,
+    Expense movie = splitwise.addExpense("Movie", user2->getUserId(), 100.0,
                                           movieParticipants, ExpenseType::EXACT);
     map<string, double> movieShares = {
         {user1->getUserId(), 60.0},
         {user2->getUserId(), 40.0}
     };
-    splitwise.setExpenseShares(movie->getExpenseId(), movieShares);
+    splitwise.setExpenseShares(movie.getExpenseId(), movieShares);
 
+    // Equal split with a remainder: 33.34 / 33.33 / 33.33
+    splitwise.addExpense("Cab", user3->getUserId(), 100.0, participants, ExpenseType::EQUAL);
+
+    // Percent split (must add up to 100%)
+    Expense groceries = splitwise.addExpense("Groceries", user1->getUserId(), 250.0,
+                                              participants, ExpenseType::PERCENT);
+    map<string, double> groceryShares = {
+        {user1->getUserId(), 33.33},
+        {user2->getUserId(), 33.33},
+        {user3->getUserId(), 33.34}
+    };
+    splitwise.setExpenseShares(groceries.getExpenseId(), groceryShares);
+
+
+    // *************Groups *************//
+    Group *trip = splitwise.createGroup("Goa Trip", participants);
+    vector<string> hotelParticipants = {user1->getUserId(), user2->getUserId(), user3->getUserId()};
+    splitwise.addGroupExpense(trip->getGroupId(), "Hotel", user2->getUserId(), 900.0, hotelParticipants, ExpenseType::EQUAL);
+    vector<string> fuelParticipants = {user1->getUserId(), user3->getUserId()};
+    splitwise.addGroupExpense(trip->getGroupId(), "Fuel", user3->getUserId(), 120.0, fuelParticipants, ExpenseType::EQUAL);
+    splitwise.displayGroupSummary(trip->getGroupId());
 
     // *************Display expenses *************//
     // Display expenses
@@ -39,7 +72,44 @@ int main()
     // Show balances
     cout << "\nBalances after expenses:" << endl;
     splitwise.showAllBalances();
-    
+    splitwise.showSettlementPlan();
+    splitwise.displayLeaderboard(2);
+
+    // Settle up the trip on its own
+    cout << "\nSettling up " << trip->getName() << ":" << endl;
+    for (const Settlement &payment : splitwise.settleUpGroup(trip->getGroupId()))
+    {
+        cout << "  " << splitwise.getUser(payment.from)->getUserId() << " pays " << splitwise.getUser(payment.to)->getUserId() << ": " << payment.amount << endl;
+    }
+    splitwise.displayGroupSummary(trip->getGroupId());
+
+    // *************Other currencies *************//
+    // Balances stay in the expense's currency; conversion happens when asked
+    Expense museum = splitwise.addExpense("Museum", user2->getUserId(), 90.0, "EUR", participants, ExpenseType::EQUAL);
+    splitwise.setExchangeRates({{"EUR", 0.92}, {"INR", 83.10}});
+    cout << "\nAlice's balances in USD, then in INR:" << endl;
+    splitwise.displayBalances(user2);
+    splitwise.displayBalances(user2, "INR");
+
+    // Every balance as a CSV report, streamed to stdout
+    cout << "\nBalances report:" << endl;
+    splitwise.exportBalances("-");
+
+    // *************Edit / delete *************//
+    // Only the change in shares moves the balances
+    SplitwiseSystem::ExpenseRequest cab;
+    cab.paidBy = user3->getUserId();
+    cab.amount = Money::fromDouble(120.0);
+    cab.users = {user1->getUserId(), user3->getUserId()};
+    splitwise.editExpense("E3", cab);
+    splitwise.deleteExpense(museum.getExpenseId());
+    cout << "\nBob's balances after the cab was edited and the museum deleted:" << endl;
+    splitwise.displayBalances(user3);
+
+    // Ledger invariants, checked while the system stays live
+    AuditReport audit = splitwise.audit();
+    cout << "\nAudit: " << (audit.ok ? "ok" : "FAILED") << ", " << audit.pairs << " pairs, " << audit.expenses << " expenses" << endl;
+
     // Show individual expenses
     cout << "\nJohn's expenses:" << endl;
     splitwise.displayUserExpenses(user1->getUserId());
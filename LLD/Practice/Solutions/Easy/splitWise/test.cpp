@@ -0,0 +1,1174 @@
+#include <bits/stdc++.h>
+#include "SplitSystem.cpp"
+#include "CommandProcessor.cpp"
+using namespace std;
+
+// Checks that compare the system against a model of what it should hold,
+// or against itself before a save and reload. Prints each failed check and
+// exits non-zero if there were any.
+//
+//   ./splitWiseTest        (make test)
+
+static size_t failures = 0;
+
+static void expect(bool ok, const string &what)
+{
+    if (!ok)
+    {
+        failures++;
+        cout << "   ❌ " << what << endl;
+    }
+}
+
+// A fresh, empty directory under /tmp; removed again by the caller
+static string scratchDirectory()
+{
+    char path[] = "/tmp/splitWiseTest.XXXXXX";
+    return mkdtemp(path) ? string(path) : string();
+}
+
+//*************************************************Splits*************************************************//
+
+static vector<int64_t> centsOf(const vector<Money> &shares)
+{
+    vector<int64_t> cents;
+    for (Money share : shares)
+        cents.push_back(share.getCents());
+    return cents;
+}
+
+static vector<int64_t> split(int64_t total, ExpenseType type, const vector<int64_t> &values, size_t count, bool &accepted)
+{
+    vector<Money> shares(count);
+    accepted = ExpenseStore::splitShares(Money(total), type, values.data(), count, shares.data());
+    return centsOf(shares);
+}
+
+// Hand-worked EQUAL, EXACT and PERCENT splits, then random ones checked for
+// adding up to the total and for each share being its exact part rounded
+static void splitsAddUp()
+{
+    cout << "EQUAL / EXACT / PERCENT splits" << endl;
+    bool accepted;
+    expect(split(10000, ExpenseType::EQUAL, {}, 3, accepted) == vector<int64_t>{3334, 3333, 3333}, "100.00 / 3 is 33.34, 33.33, 33.33");
+    expect(split(-10000, ExpenseType::EQUAL, {}, 3, accepted) == vector<int64_t>{-3334, -3333, -3333}, "-100.00 / 3 is -33.34, -33.33, -33.33");
+    expect(split(2, ExpenseType::EQUAL, {}, 5, accepted) == vector<int64_t>{1, 1, 0, 0, 0}, "0.02 / 5 gives the remainder cents to the first shares");
+    expect(split(1001, ExpenseType::PERCENT, {5000, 5000}, 2, accepted) == vector<int64_t>{501, 500} && accepted, "10.01 at 50% / 50% is 5.01, 5.00");
+    expect(split(10000, ExpenseType::PERCENT, {3333, 3333, 3334}, 3, accepted) == vector<int64_t>{3333, 3333, 3334}, "33.33% / 33.33% / 33.34% of 100.00");
+    expect(split(1, ExpenseType::PERCENT, {3333, 3333, 3334}, 3, accepted) == vector<int64_t>{1, 0, 0}, "a lone cent goes to the first share");
+    expect(split(1250, ExpenseType::EXACT, {370, 880}, 2, accepted) == vector<int64_t>{370, 880} && accepted, "EXACT keeps the given cents");
+    split(1250, ExpenseType::EXACT, {370, 879}, 2, accepted);
+    expect(!accepted, "EXACT shares one cent short are refused");
+    split(1000, ExpenseType::PERCENT, {5000, 4999}, 2, accepted);
+    expect(!accepted, "percentages adding up to 99.99 are refused");
+    split(1000, ExpenseType::PERCENT, {-100, 10100}, 2, accepted);
+    expect(!accepted, "a negative percentage is refused");
+
+    // Far past where total * basis points fits in 64 bits
+    int64_t huge = INT64_MAX / 3;
+    vector<Money> shares(2);
+    int32_t halves[] = {5000, 5000};
+    Money::splitByBasisPoints(Money(huge), halves, 2, shares.data());
+    expect(shares[0].getCents() + shares[1].getCents() == huge && shares[0].getCents() - shares[1].getCents() <= 1 &&
+               shares[1].getCents() == huge / 2,
+           "a 50/50 split of INT64_MAX / 3 cents");
+
+    mt19937_64 random(33);
+    size_t wrong = 0;
+    for (int round = 0; round < 100000; round++)
+    {
+        size_t count = 1 + random() % 12;
+        int64_t total = int64_t(random() % uint64_t(round % 4 == 0 ? 1000 : Money::MAX_EXPENSE_CENTS + 1));
+        vector<int64_t> values;
+        ExpenseType type = ExpenseType(random() % 3);
+        int64_t left = type == ExpenseType::EXACT ? total : Money::FULL_BASIS_POINTS;
+        for (size_t i = 0; type != ExpenseType::EQUAL && i < count; i++)
+        {
+            int64_t value = i + 1 == count ? left : int64_t(random() % uint64_t(left + 1));
+            values.push_back(value);
+            left -= value;
+        }
+        vector<int64_t> cents = split(total, type, values, count, accepted);
+        bool ok = accepted && accumulate(cents.begin(), cents.end(), int64_t(0)) == total;
+        int64_t extra = total;
+        for (size_t i = 0; i < count && ok; i++)
+        {
+            // The exact part rounded down, before the leftover cents are handed out
+            int64_t floor = type == ExpenseType::EQUAL ? total / int64_t(count)
+                            : type == ExpenseType::EXACT ? values[i]
+                                                         : int64_t(__int128(total) * values[i] / Money::FULL_BASIS_POINTS);
+            ok = cents[i] == floor || (type != ExpenseType::EXACT && cents[i] == floor + 1);
+            extra -= floor;
+        }
+        // Leftover cents go one each to the first shares
+        for (size_t i = 0; i < count && ok && type != ExpenseType::EXACT; i++)
+        {
+            int64_t floor = type == ExpenseType::EQUAL ? total / int64_t(count)
+                                                       : int64_t(__int128(total) * values[i] / Money::FULL_BASIS_POINTS);
+            ok = cents[i] - floor == (int64_t(i) < extra ? 1 : 0);
+        }
+        wrong += !ok;
+    }
+    expect(wrong == 0, to_string(wrong) + " random splits did not add up or rounded a share wrongly");
+}
+
+//*************************************************Currencies*************************************************//
+
+// Everything a system holds in any currency, in a form two systems can be compared by
+static string currencyState(const SplitwiseSystem &system, const vector<string> &userIds)
+{
+    ostringstream state;
+    for (size_t currency = 0; currency < Currency::COUNT; currency++)
+    {
+        string code = Currency::code(CurrencyId(currency));
+        for (const auto &balance : system.getAllBalances(code))
+            state << code << ' ' << get<0>(balance)->getUserId() << ' ' << get<1>(balance)->getUserId() << ' ' << get<2>(balance).getCents() << '\n';
+        for (const string &userId : userIds)
+            state << code << ' ' << userId << " net " << system.getNetBalance(userId, code).getCents() << '\n';
+    }
+    for (const string &userId : userIds)
+    {
+        for (const auto &balance : system.getBalances(userId, "EUR"))
+            state << userId << " in EUR " << balance.first->getUserId() << ' ' << balance.second.getCents() << '\n';
+    }
+    shared_ptr<const FxTable> rates = system.getExchangeRates();
+    state << "rates v" << rates->getVersion();
+    for (size_t currency = 0; currency < Currency::COUNT; currency++)
+        state << ' ' << rates->rate(HOME_CURRENCY, CurrencyId(currency));
+    return state.str();
+}
+
+// Expenses in several currencies and rate changes, some before a checkpoint
+// and some after it; reopening must give back the same balances and rates
+// whether it starts from the snapshot or from the journal alone
+static void currencyRoundTrip()
+{
+    cout << "Currency snapshot / journal round trip" << endl;
+    static const vector<string> CODES = {"", "EUR", "GBP", "JPY", "INR"};
+    for (bool withCheckpoint : {true, false})
+    {
+        string directory = scratchDirectory();
+        vector<string> userIds;
+        string before;
+        {
+            SplitwiseSystem system;
+            expect(system.openStorage(directory, 4096), "openStorage on a new directory");
+            for (int i = 0; i < 40; i++)
+                userIds.push_back(system.registerUser("User" + to_string(i), "user" + to_string(i) + "@example.com")->getUserId());
+            mt19937_64 random(7);
+            for (int round = 0; round < 4; round++)
+            {
+                // Later rounds change fewer rates, so some are only ever in the snapshot
+                vector<pair<string, double>> rates = {{"JPY", 150.0 + round}, {"EUR", 0.9 + round * 0.01}, {"GBP", 0.8 - round * 0.01}, {"INR", 83.0}};
+                rates.resize(round < 2 ? 4 : 3 - round);
+                expect(system.setExchangeRates(rates), "setExchangeRates");
+                vector<SplitwiseSystem::ExpenseRequest> requests(500);
+                for (SplitwiseSystem::ExpenseRequest &request : requests)
+                {
+                    request.description = "Trip";
+                    request.currency = CODES[random() % CODES.size()];
+                    request.amount = Money(int64_t(100 + random() % 100000));
+                    size_t first = random() % userIds.size();
+                    for (size_t k = 0; k < 2 + random() % 4; k++)
+                        request.users.push_back(userIds[(first + k * 7) % userIds.size()]);
+                    request.paidBy = request.users[random() % request.users.size()];
+                    request.timestamp = 1700000000 + round * 86400;
+                }
+                system.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(requests.data(), requests.size()));
+                if (withCheckpoint && round == 1)
+                    expect(system.checkpoint(), "checkpoint");
+            }
+            before = currencyState(system, userIds);
+        }
+        SplitwiseSystem reopened;
+        expect(reopened.openStorage(directory, 4096), "openStorage on the written directory");
+        expect(currencyState(reopened, userIds) == before,
+               string("balances and rates after reopening ") + (withCheckpoint ? "from snapshot + journal" : "from the journal alone"));
+        filesystem::remove_all(directory);
+    }
+}
+
+//*************************************************Rankings*************************************************//
+
+// The k largest weights among 'nets' on the creditor (positive) or debtor side, largest first
+static vector<int64_t> bruteForceTop(const vector<vector<int64_t>> &nets, bool creditors, size_t k)
+{
+    vector<int64_t> weights;
+    for (const vector<int64_t> &ranking : nets)
+    {
+        for (int64_t net : ranking)
+        {
+            if (creditors ? net > 0 : net < 0)
+                weights.push_back(creditors ? net : -net);
+        }
+    }
+    sort(weights.rbegin(), weights.rend());
+    weights.resize(min(k, weights.size()));
+    return weights;
+}
+
+// Whether NetRanking::top over 'rankings' gives the brute-force top k, each
+// entry carrying its slot's current net
+static bool topMatches(const vector<NetRanking> &rankings, const vector<vector<int64_t>> &nets, bool creditors, size_t k)
+{
+    vector<const NetRanking *> pointers;
+    for (const NetRanking &ranking : rankings)
+        pointers.push_back(&ranking);
+    vector<int64_t> weights;
+    bool consistent = true;
+    NetRanking::top(pointers.data(), pointers.size(), creditors, k, [&](uint32_t ranking, uint32_t slot, int64_t net)
+                    {
+        consistent = consistent && net == nets[ranking][slot] && (creditors ? net > 0 : net < 0);
+        weights.push_back(creditors ? net : -net); });
+    return consistent && weights == bruteForceTop(nets, creditors, k);
+}
+
+// 200k random net changes over a few rankings, many of them flipping a
+// slot's sign, checked against a brute-force top k as they go
+static void netRankingAgainstBruteForce()
+{
+    cout << "NetRanking top k against brute force" << endl;
+    const size_t RANKINGS = 4, SLOTS = 3000, UPDATES = 200000;
+    vector<NetRanking> rankings(RANKINGS);
+    vector<vector<int64_t>> nets(RANKINGS, vector<int64_t>(SLOTS, 0));
+    mt19937_64 random(44);
+    size_t mismatches = 0;
+    for (size_t update = 1; update <= UPDATES; update++)
+    {
+        uint32_t ranking = random() % RANKINGS, slot = random() % SLOTS;
+        int64_t &net = nets[ranking][slot];
+        // Mostly small moves; now and then exactly back to zero or across it
+        int64_t delta = random() % 8 == 0 ? -net - int64_t(random() % 3) * (net > 0 ? 1 : -1)
+                                          : int64_t(random() % 20001) - 10000;
+        rankings[ranking].add(slot, delta);
+        net += delta;
+        if (update % 997 == 0)
+        {
+            size_t k = 1 + random() % 64;
+            mismatches += !topMatches(rankings, nets, true, k) + !topMatches(rankings, nets, false, k);
+        }
+    }
+    expect(mismatches == 0, to_string(mismatches) + " top-k queries differed from brute force");
+    size_t wrongNets = 0;
+    for (size_t r = 0; r < RANKINGS; r++)
+    {
+        for (uint32_t slot = 0; slot < SLOTS; slot++)
+            wrongNets += rankings[r].net(slot) != nets[r][slot];
+    }
+    expect(wrongNets == 0, to_string(wrongNets) + " nets differ");
+
+    // Ranking the same nets from scratch gives the same answers
+    vector<NetRanking> rebuilt(RANKINGS);
+    for (size_t r = 0; r < RANKINGS; r++)
+        rebuilt[r].assign(nets[r]);
+    expect(topMatches(rebuilt, nets, true, 200) && topMatches(rebuilt, nets, false, 200), "assign() ranks like the incremental updates");
+}
+
+// Top creditors and debtors, overall and per group, as text
+static string rankingState(const SplitwiseSystem &system, const vector<string> &groupIds)
+{
+    ostringstream state;
+    auto print = [&](const char *what, const vector<pair<User *, Money>> &ranked)
+    {
+        state << what;
+        for (const auto &entry : ranked)
+            state << ' ' << entry.first->getUserId() << '=' << entry.second.getCents();
+        state << '\n';
+    };
+    print("debtors", system.getTopDebtors(100));
+    print("creditors", system.getTopCreditors(100));
+    for (const string &groupId : groupIds)
+    {
+        print("group debtors", system.getGroupTopDebtors(groupId, 20));
+        print("group creditors", system.getGroupTopCreditors(groupId, 20));
+    }
+    return state.str();
+}
+
+// Rankings rebuilt from a snapshot give the same leaders, and those agree
+// with every user's net
+static void rankingRoundTrip()
+{
+    cout << "Rankings after a snapshot round trip" << endl;
+    string directory = scratchDirectory();
+    vector<string> userIds, groupIds;
+    string before;
+    {
+        SplitwiseSystem system;
+        expect(system.openStorage(directory), "openStorage on a new directory");
+        for (int i = 0; i < 500; i++)
+            userIds.push_back(system.registerUser("User" + to_string(i), "user" + to_string(i) + "@example.com")->getUserId());
+        for (int g = 0; g < 10; g++)
+            groupIds.push_back(system.createGroup("Group" + to_string(g), vector<string>(userIds.begin() + g * 40, userIds.begin() + g * 40 + 40))->getGroupId());
+        mt19937_64 random(45);
+        vector<SplitwiseSystem::ExpenseRequest> requests(20000);
+        for (SplitwiseSystem::ExpenseRequest &request : requests)
+        {
+            request.description = "Dinner";
+            request.amount = Money(int64_t(100 + random() % 50000));
+            size_t group = random() % 12; // 10 and 11: outside any group
+            for (size_t k = 0, count = 2 + random() % 5; k < count; k++)
+                request.users.push_back(group < 10 ? userIds[group * 40 + (random() % 40)] : userIds[random() % userIds.size()]);
+            sort(request.users.begin(), request.users.end());
+            request.users.erase(unique(request.users.begin(), request.users.end()), request.users.end());
+            request.paidBy = request.users[random() % request.users.size()];
+            request.groupId = group < 10 ? groupIds[group] : "";
+        }
+        system.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(requests.data(), requests.size()));
+        expect(system.checkpoint(), "checkpoint");
+        before = rankingState(system, groupIds);
+
+        vector<int64_t> debts;
+        for (const string &userId : userIds)
+        {
+            int64_t net = system.getNetBalance(userId).getCents();
+            if (net < 0)
+                debts.push_back(net);
+        }
+        sort(debts.begin(), debts.end());
+        debts.resize(min<size_t>(100, debts.size()));
+        vector<int64_t> ranked;
+        for (const auto &entry : system.getTopDebtors(100))
+            ranked.push_back(entry.second.getCents());
+        expect(ranked == debts, "getTopDebtors agrees with every user's net");
+    }
+    SplitwiseSystem reopened;
+    expect(reopened.openStorage(directory), "openStorage on the written directory");
+    expect(rankingState(reopened, groupIds) == before, "top creditors and debtors after reopening from the snapshot");
+    filesystem::remove_all(directory);
+}
+
+//*************************************************Edits and deletes*************************************************//
+
+// The expenses an edit/delete/add run should leave live, each as its latest
+// request (with the timestamp it ended up with), by the order it was added in
+struct ExpenseModel
+{
+    vector<SplitwiseSystem::ExpenseRequest> requests; // description "X<index>"
+    vector<string> expenseIds;
+    vector<bool> live;
+    vector<size_t> liveIndexes; // in no particular order
+    vector<size_t> slotOf;      // index → position in liveIndexes
+
+    void added(const SplitwiseSystem::ExpenseRequest &request, const string &expenseId)
+    {
+        slotOf.push_back(liveIndexes.size());
+        liveIndexes.push_back(requests.size());
+        requests.push_back(request);
+        expenseIds.push_back(expenseId);
+        live.push_back(true);
+    }
+
+    void deleted(size_t index)
+    {
+        size_t moved = liveIndexes.back();
+        liveIndexes[slotOf[index]] = moved;
+        slotOf[moved] = slotOf[index];
+        liveIndexes.pop_back();
+        live[index] = false;
+    }
+};
+
+static const vector<string> EDIT_CODES = {"", "EUR", "JPY"};
+static const int64_t EDIT_START = 1700000000, EDIT_SPAN = 3 * 365 * 86400;
+
+// A valid expense among a group's members or, outside groups, anyone
+static SplitwiseSystem::ExpenseRequest randomExpense(mt19937_64 &random, const vector<string> &userIds,
+                                                     const vector<string> &groupIds, const vector<vector<string>> &members)
+{
+    SplitwiseSystem::ExpenseRequest request;
+    size_t group = random() % (groupIds.size() * 3); // two in three outside any group
+    const vector<string> &pool = group < groupIds.size() ? members[group] : userIds;
+    request.groupId = group < groupIds.size() ? groupIds[group] : "";
+    size_t first = random() % pool.size();
+    for (size_t k = 0, count = 2 + random() % 4; k < count; k++)
+        request.users.push_back(pool[(first + k * 3) % pool.size()]);
+    request.paidBy = request.users[random() % request.users.size()];
+    request.amount = Money(int64_t(100 + random() % 100000));
+    request.currency = EDIT_CODES[random() % EDIT_CODES.size()];
+    request.timestamp = EDIT_START + int64_t(random() % EDIT_SPAN);
+    int64_t total = 0;
+    switch (random() % 3)
+    {
+    case 0:
+        request.type = ExpenseType::EQUAL;
+        break;
+    case 1:
+        request.type = ExpenseType::EXACT;
+        total = request.amount.getCents();
+        break;
+    default:
+        request.type = ExpenseType::PERCENT;
+        total = 10000;
+    }
+    if (request.type != ExpenseType::EQUAL)
+    {
+        for (size_t k = 0; k + 1 < request.users.size(); k++)
+        {
+            request.values.push_back(int64_t(random() % uint64_t(total + 1)));
+            total -= request.values.back();
+        }
+        request.values.push_back(total);
+    }
+    return request;
+}
+
+// Users, groups and rates for the edit run, identical each time it is called
+static void editRunDirectory(SplitwiseSystem &system, vector<string> &userIds, vector<string> &groupIds, vector<vector<string>> &members)
+{
+    userIds.clear();
+    groupIds.clear();
+    members.assign(6, vector<string>());
+    for (int i = 0; i < 2000; i++)
+        userIds.push_back(system.registerUser("User" + to_string(i), "user" + to_string(i) + "@example.com")->getUserId());
+    for (size_t g = 0; g < members.size(); g++)
+    {
+        members[g].assign(userIds.begin() + g * 40, userIds.begin() + g * 40 + 30);
+        groupIds.push_back(system.createGroup("Group" + to_string(g), members[g])->getGroupId());
+    }
+    system.setExchangeRates({{"EUR", 0.92}, {"JPY", 150.0}});
+}
+
+// Balances, nets, group nets, statements and expenses by date, as text; two
+// systems holding the same expenses (added in the same order) give the same
+static string ledgerState(const SplitwiseSystem &system, const vector<string> &userIds, const vector<string> &groupIds)
+{
+    ostringstream state;
+    for (const string &code : EDIT_CODES)
+    {
+        for (const auto &balance : system.getAllBalances(code))
+            state << code << ' ' << get<0>(balance)->getUserId() << ' ' << get<1>(balance)->getUserId() << ' ' << get<2>(balance).getCents() << '\n';
+        for (const string &userId : userIds)
+        {
+            state << code << ' ' << userId << " net " << system.getNetBalance(userId, code).getCents();
+            for (int64_t from = EDIT_START - 86400; from < EDIT_START + EDIT_SPAN; from += 61 * 86400 + 3700)
+            {
+                Statement statement = system.getStatement(userId, from, from + 45 * 86400, code);
+                state << ' ' << statement.paid.getCents() << '/' << statement.owed.getCents() << '/' << statement.expenses;
+            }
+            state << '\n';
+        }
+        for (const string &groupId : groupIds)
+        {
+            // Sorted, as ties may rank in either order
+            vector<string> nets;
+            for (const auto &entry : system.getGroupTopDebtors(groupId, 1000, code))
+                nets.push_back(entry.first->getUserId() + '=' + to_string(entry.second.getCents()));
+            for (const auto &entry : system.getGroupTopCreditors(groupId, 1000, code))
+                nets.push_back(entry.first->getUserId() + '=' + to_string(entry.second.getCents()));
+            sort(nets.begin(), nets.end());
+            state << groupId;
+            for (const string &net : nets)
+                state << ' ' << net;
+            state << '\n';
+        }
+    }
+    for (int64_t from = EDIT_START; from < EDIT_START + EDIT_SPAN; from += 97 * 86400 + 1234)
+    {
+        state << "between";
+        for (const Expense &expense : system.getExpensesBetween(from, from + 20 * 86400))
+            state << ' ' << expense.getDescription();
+        state << '\n';
+    }
+    return state.str();
+}
+
+// Every user's pages of history against the model's, newest first
+static size_t historyMismatches(const SplitwiseSystem &system, const vector<string> &userIds, const ExpenseModel &model)
+{
+    vector<vector<string>> expected(userIds.size());
+    unordered_map<string, size_t> userIndex;
+    for (size_t i = 0; i < userIds.size(); i++)
+        userIndex[userIds[i]] = i;
+    for (size_t index = model.requests.size(); index-- > 0;)
+    {
+        if (!model.live[index])
+            continue;
+        const SplitwiseSystem::ExpenseRequest &request = model.requests[index];
+        vector<size_t> involved = {userIndex[request.paidBy]};
+        for (const string &user : request.users)
+            involved.push_back(userIndex[user]);
+        sort(involved.begin(), involved.end());
+        involved.erase(unique(involved.begin(), involved.end()), involved.end());
+        for (size_t user : involved)
+            expected[user].push_back(request.description);
+    }
+    size_t mismatches = 0;
+    for (size_t i = 0; i < userIds.size(); i++)
+    {
+        vector<string> pages;
+        HistoryCursor cursor;
+        while (!cursor.done)
+        {
+            for (const Expense &expense : system.getUserExpenses(userIds[i], cursor, 97))
+                pages.push_back(string(expense.getDescription()));
+        }
+        mismatches += pages != expected[i];
+    }
+    return mismatches;
+}
+
+// 2M adds, edits and deletes in random order. Every so often the system is
+// checked against a fresh one built by adding just the live expenses, as
+// they now are, and each user's history against the model's.
+static void editsAgainstRecompute()
+{
+    cout << "Edits and deletes against a full recompute" << endl;
+    const size_t OPS = 2000000, CHECKS = 4;
+    SplitwiseSystem system;
+    vector<string> userIds, groupIds;
+    vector<vector<string>> members;
+    editRunDirectory(system, userIds, groupIds, members);
+    ExpenseModel model;
+    mt19937_64 random(46);
+    size_t wrongResults = 0;
+    for (size_t op = 1; op <= OPS; op++)
+    {
+        size_t kind = random() % 10;
+        if (kind < 4 || model.liveIndexes.empty())
+        {
+            SplitwiseSystem::ExpenseRequest request = randomExpense(random, userIds, groupIds, members);
+            request.description = "X" + to_string(model.requests.size());
+            vector<Expense> added = system.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(&request, 1));
+            wrongResults += added.size() != 1 || !added[0].exists();
+            if (added.size() == 1 && added[0].exists())
+                model.added(request, added[0].getExpenseId());
+        }
+        else
+        {
+            // Now and then one that is already gone, which must be refused
+            size_t index = model.liveIndexes[random() % model.liveIndexes.size()];
+            if (random() % 64 == 0)
+                index = random() % model.requests.size();
+            if (kind < 8)
+            {
+                SplitwiseSystem::ExpenseRequest request = randomExpense(random, userIds, groupIds, members);
+                request.description = model.requests[index].description;
+                if (random() % 2)
+                    request.timestamp = 0; // keeps its own
+                bool edited = system.editExpense(model.expenseIds[index], request);
+                wrongResults += edited != model.live[index];
+                if (edited)
+                {
+                    if (request.timestamp == 0)
+                        request.timestamp = model.requests[index].timestamp;
+                    model.requests[index] = request;
+                }
+            }
+            else
+            {
+                bool deleted = system.deleteExpense(model.expenseIds[index]);
+                wrongResults += deleted != model.live[index];
+                if (deleted)
+                    model.deleted(index);
+            }
+        }
+
+        if (op % (OPS / CHECKS) == 0)
+        {
+            SplitwiseSystem recomputed;
+            vector<string> sameUsers, sameGroups;
+            vector<vector<string>> sameMembers;
+            editRunDirectory(recomputed, sameUsers, sameGroups, sameMembers);
+            vector<SplitwiseSystem::ExpenseRequest> live;
+            for (size_t index = 0; index < model.requests.size(); index++)
+            {
+                if (model.live[index])
+                    live.push_back(model.requests[index]);
+            }
+            recomputed.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(live.data(), live.size()));
+            string after = to_string(op) + " operations (" + to_string(live.size()) + " live expenses)";
+            expect(ledgerState(system, userIds, groupIds) == ledgerState(recomputed, userIds, groupIds),
+                   "balances, nets, group nets, statements and expenses by date after " + after);
+            size_t histories = historyMismatches(system, userIds, model);
+            expect(histories == 0, to_string(histories) + " users' histories differ after " + after);
+        }
+    }
+    expect(wrongResults == 0, to_string(wrongResults) + " adds, edits or deletes returned the wrong result");
+}
+
+//*************************************************Command logs*************************************************//
+
+// A line that fails to parse registers none of the names on it
+static void commandsRegisterOnlyValidLines()
+{
+    cout << "Command log registers users only from valid lines" << endl;
+    string directory = scratchDirectory();
+    ofstream(directory + "/commands.txt") << "EXPENSE x abc 2 y z EQUAL\n"
+                                             "EXPENSE x 10 2 y z PERCENT 50\n"
+                                             "EXPENSE a 10 2 a b EQUAL\n"
+                                             "SHOW x\n"
+                                             "SHOW\n";
+    SplitwiseSystem system;
+    int first = stoi(system.registerUser("Before", "")->getUserId().substr(1));
+    CommandProcessor processor(system, directory + "/output.txt");
+    CommandProcessor::Result result = processor.run(directory + "/commands.txt");
+    expect(processor.ok() && result.commands == 5 && result.expenses == 1 && result.invalid == 2, "command counts");
+    // Only a and b were registered in between
+    int next = stoi(system.registerUser("After", "")->getUserId().substr(1));
+    expect(next == first + 3, to_string(next - first - 1) + " users registered by the log, expected 2");
+
+    ifstream output(directory + "/output.txt");
+    string text((istreambuf_iterator<char>(output)), istreambuf_iterator<char>());
+    expect(text == "Invalid command: EXPENSE x abc 2 y z EQUAL\n"
+                   "Invalid command: EXPENSE x 10 2 y z PERCENT 50\n"
+                   "No balances\n"
+                   "b owes a: 5.00\n",
+           "command log output");
+    filesystem::remove_all(directory);
+}
+
+//*************************************************Amount limit*************************************************//
+
+// An amount past Money::MAX_EXPENSE_CENTS is refused however it arrives:
+// bulk import, addExpenses, addExpense or a command log
+static void oversizedAmountsRefused()
+{
+    cout << "Amounts past the expense limit are refused" << endl;
+    string directory = scratchDirectory();
+    SplitwiseSystem system;
+    string first = system.registerUser("First", "")->getUserId();
+    string second = system.registerUser("Second", "")->getUserId();
+    ofstream(directory + "/big.csv") << "Big," << first << ",100000000000000,PERCENT," << first << "=50;" << second << "=50\n"
+                                     << "Limit," << first << ",9000000000000.01,EQUAL," << first << ';' << second << "\n"
+                                     << "Ok," << first << ",10,PERCENT," << first << "=50;" << second << "=50\n";
+    SplitwiseSystem::ImportResult imported = system.importExpenses(directory + "/big.csv", 2);
+    expect(imported.imported == 1 && imported.rejected == 2, "import keeps only the row within the limit");
+    expect(system.getBalance(first, second).getCents() == 500, "the imported row's balance");
+
+    SplitwiseSystem::ExpenseRequest request;
+    request.paidBy = first;
+    request.users = {first, second};
+    request.amount = Money(Money::MAX_EXPENSE_CENTS + 1);
+    expect(!system.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(&request, 1))[0].exists(), "addExpenses refuses one cent past the limit");
+    request.amount = Money(Money::MAX_EXPENSE_CENTS);
+    expect(system.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(&request, 1))[0].exists(), "addExpenses takes the limit itself");
+    vector<string> users = {first, second};
+    expect(!system.addExpense("Big", first, -1e13, users), "addExpense refuses a refund past the limit");
+
+    ofstream(directory + "/commands.txt") << "EXPENSE a 100000000000000 2 a b EQUAL\n";
+    CommandProcessor processor(system, directory + "/output.txt");
+    CommandProcessor::Result result = processor.run(directory + "/commands.txt");
+    expect(result.invalid == 1 && result.expenses == 0, "a command log line past the limit is invalid");
+    filesystem::remove_all(directory);
+}
+
+//*************************************************Import dates*************************************************//
+
+// One SWB2 record (see BulkImporter): users are internal ids, values for EXACT are cents
+static void putDatedRecord(string &out, uint32_t paidBy, int64_t cents, ExpenseType type, int64_t timestamp, CurrencyId currency,
+                           const string &description, const vector<uint32_t> &users, const vector<int64_t> &values)
+{
+    auto put = [&](const auto &value)
+    { out.append(reinterpret_cast<const char *>(&value), sizeof(value)); };
+    put(paidBy);
+    put(cents);
+    put(uint8_t(type));
+    put(uint8_t(description.size()));
+    put(uint16_t(users.size()));
+    put(timestamp);
+    put(currency);
+    out += description;
+    for (uint32_t user : users)
+        put(user);
+    for (int64_t value : values)
+        put(value);
+}
+
+static void importKeepsDatesAndCurrencies()
+{
+    cout << "Imported rows keep their timestamp and currency" << endl;
+    const int64_t JANUARY = 1673740800; // 2023-01-15
+    const int64_t MARCH = 1678406400;   // 2023-03-10
+    const int64_t APRIL = 1680307200;   // 2023-04-01
+    CurrencyId eur = Currency::find("EUR");
+    string directory = scratchDirectory();
+    string first, second;
+    {
+        SplitwiseSystem system;
+        expect(system.openStorage(directory, 4096), "openStorage on a new directory");
+        first = system.registerUser("First", "")->getUserId();
+        second = system.registerUser("Second", "")->getUserId();
+        ofstream(directory + "/dated.csv") << "Jan," << first << ",100,EQUAL," << first << ';' << second << ',' << JANUARY << "\n"
+                                           << "Mar," << second << ",30,EXACT," << first << "=30," << MARCH << ",EUR\n"
+                                           << "Now," << first << ",8,EQUAL," << first << ';' << second << ",,\n"
+                                           << "Bad," << first << ",8,EQUAL," << first << ',' << MARCH << ",XXX\n"
+                                           << "Extra," << first << ",8,EQUAL," << first << ',' << MARCH << ",EUR,x\n";
+        SplitwiseSystem::ImportResult imported = system.importExpenses(directory + "/dated.csv", 2);
+        expect(imported.imported == 3 && imported.rejected == 2, "CSV: unknown currency and extra fields are rejected");
+
+        string binary = "SWB2";
+        putDatedRecord(binary, 0, 2000, ExpenseType::EXACT, MARCH, eur, "Bin", {1}, {2000});
+        putDatedRecord(binary, 0, 500, ExpenseType::EQUAL, JANUARY, HOME_CURRENCY, "Bin", {0, 1}, {});
+        putDatedRecord(binary, 0, 500, ExpenseType::EQUAL, JANUARY, CurrencyId(Currency::COUNT), "Bad", {0, 1}, {});
+        ofstream(directory + "/dated.bin", ios::binary) << binary;
+        imported = system.importExpenses(directory + "/dated.bin", 2);
+        expect(imported.imported == 2 && imported.rejected == 1, "SWB2: an unknown currency is rejected");
+    }
+
+    SplitwiseSystem reopened;
+    expect(reopened.openStorage(directory, 4096), "openStorage on the written directory");
+    Statement january = reopened.getStatement(first, JANUARY, JANUARY + 86400);
+    expect(january.expenses == 2 && january.paid.getCents() == 10500 && january.owed.getCents() == 5250,
+           "January in USD holds the dated CSV and binary rows");
+    Statement march = reopened.getStatement(first, MARCH, APRIL, "EUR");
+    expect(march.expenses == 2 && march.paid.getCents() == 2000 && march.owed.getCents() == 3000, "March in EUR holds the EUR rows");
+    expect(reopened.getStatement(first, MARCH, APRIL).expenses == 0, "no USD expenses in March");
+    expect(reopened.getStatement(first, APRIL, time(nullptr) + 86400).expenses == 1, "the undated row is dated at import");
+    expect(reopened.getBalance(first, second, "EUR").getCents() == -1000, "EUR balance: First owes 30, is owed 20");
+    expect(reopened.getBalance(first, second).getCents() == 5650, "USD balance: 50 + 4 + 2.50");
+    filesystem::remove_all(directory);
+}
+
+//*************************************************Audit*************************************************//
+
+// Changes stored state without moving the checksums, as a bad write would
+struct AuditTamper
+{
+    // Shard the pair lives in
+    static size_t shiftBalance(SplitwiseSystem &system, UserId creditor, UserId debtor, int64_t cents)
+    {
+        size_t shard = ShardedLedger::shardOf(creditor, debtor);
+        system.ledger.shards[shard].ledgerIn(HOME_CURRENCY).addDebt(creditor, debtor, Money(cents));
+        return shard;
+    }
+
+    // Net stripe the user lives in
+    static size_t shiftNet(SplitwiseSystem &system, UserId user, int64_t cents)
+    {
+        size_t stripe = user % ShardedLedger::SHARD_COUNT;
+        system.ledger.netStripes[stripe].rankingIn(HOME_CURRENCY).add(user / ShardedLedger::SHARD_COUNT, cents);
+        return stripe;
+    }
+
+    static void shiftShare(SplitwiseSystem &system, ExpenseId id, int64_t cents)
+    {
+        const_cast<Money *>(system.expenses.getShareAmounts(id).data())[0] += Money(cents);
+    }
+};
+
+static bool onlyFlagged(const AuditReport &report, size_t shard, size_t stripe, bool netsBalance, size_t expense)
+{
+    return !report.ok && report.divergentShard == shard && report.divergentStripe == stripe && report.netsBalance == netsBalance &&
+           report.badExpense == expense;
+}
+
+static void auditFlagsTampering()
+{
+    cout << "audit() flags the exact item tampered with" << endl;
+    const size_t NONE = AuditReport::NONE;
+    SplitwiseSystem system;
+    vector<string> userIds;
+    for (size_t i = 0; i < 300; i++)
+        userIds.push_back(system.registerUser("User" + to_string(i), "")->getUserId());
+    mt19937_64 random(48);
+    vector<ExpenseId> added;
+    for (size_t i = 0; i < 5000; i++)
+    {
+        vector<string> involved = {userIds[random() % userIds.size()], userIds[random() % userIds.size()], userIds[random() % userIds.size()]};
+        Expense expense = system.addExpense("Audited", involved[0], double(random() % 100000) / 100 + 1, involved);
+        if (expense.exists())
+            added.push_back(expense.getId());
+    }
+    expect(system.audit(2).ok, "a clean system audits clean");
+
+    for (int round = 0; round < 20; round++)
+    {
+        UserId creditor = random() % userIds.size();
+        UserId debtor = (creditor + 1 + random() % (userIds.size() - 1)) % userIds.size();
+        size_t shard = AuditTamper::shiftBalance(system, creditor, debtor, 1);
+        expect(onlyFlagged(system.audit(2), shard, NONE, true, NONE), "a pair balance moved by a cent flags its shard only");
+        AuditTamper::shiftBalance(system, creditor, debtor, -1);
+
+        size_t stripe = AuditTamper::shiftNet(system, creditor, -7);
+        expect(onlyFlagged(system.audit(2), NONE, stripe, false, NONE), "a net moved by 7 cents flags its stripe and the zero sum");
+        AuditTamper::shiftNet(system, creditor, 7);
+
+        ExpenseId expense = added[random() % added.size()];
+        AuditTamper::shiftShare(system, expense, 1);
+        expect(onlyFlagged(system.audit(2), NONE, NONE, true, expense), "a stored share moved by a cent flags its expense");
+        AuditTamper::shiftShare(system, expense, -1);
+        expect(system.audit(2).ok, "undoing the tampering audits clean again");
+    }
+
+    // The background auditor reports the same
+    size_t shard = AuditTamper::shiftBalance(system, 0, 1, 5);
+    atomic<size_t> flagged(NONE);
+    system.startAuditor(0.5, 1, [&](const AuditReport &report)
+                        { flagged = report.divergentShard; });
+    while (system.auditPasses() == 0)
+        this_thread::sleep_for(chrono::milliseconds(1));
+    system.stopAuditor();
+    expect(flagged == shard && system.lastAudit().divergentShard == shard, "the background auditor reports the tampered shard");
+}
+
+//*************************************************Debt simplification*************************************************//
+
+// Most disjoint zero-sum blocks the nets split into: the block holding the
+// lowest remaining member, every way, then the rest
+static int mostZeroBlocks(const vector<int64_t> &nets, uint32_t remaining, unordered_map<uint32_t, int> &memo)
+{
+    if (!remaining)
+        return 0;
+    auto known = memo.find(remaining);
+    if (known != memo.end())
+        return known->second;
+    uint32_t lowest = remaining & -remaining;
+    uint32_t others = remaining ^ lowest;
+    int best = -1;
+    for (uint32_t rest = others;; rest = (rest - 1) & others)
+    {
+        uint32_t block = rest | lowest;
+        int64_t sum = 0;
+        for (size_t i = 0; i < nets.size(); i++)
+            sum += (block >> i & 1) ? nets[i] : 0;
+        if (sum == 0)
+        {
+            int after = mostZeroBlocks(nets, remaining ^ block, memo);
+            if (after >= 0)
+                best = max(best, after + 1);
+        }
+        if (!rest)
+            break;
+    }
+    return memo[remaining] = best;
+}
+
+// Whether paying out 'plan' leaves everyone at zero, with no empty or self transfers
+static bool settlesEveryone(const vector<pair<UserId, Money>> &nets, const vector<Settlement> &plan)
+{
+    unordered_map<UserId, int64_t> left;
+    for (const auto &entry : nets)
+        left[entry.first] += entry.second.getCents();
+    for (const Settlement &settlement : plan)
+    {
+        if (settlement.from == settlement.to || settlement.amount.getCents() <= 0)
+            return false;
+        left[settlement.from] += settlement.amount.getCents();
+        left[settlement.to] -= settlement.amount.getCents();
+    }
+    return all_of(left.begin(), left.end(), [](const pair<const UserId, int64_t> &entry)
+                  { return entry.second == 0; });
+}
+
+static void simplifyAgainstBruteForce()
+{
+    cout << "DebtSimplifier plans against brute force" << endl;
+    mt19937_64 random(34);
+    size_t misses = 0, unsettled = 0;
+    for (int round = 0; round < 3000; round++)
+    {
+        // Narrow ranges make zero-sum blocks, and so shorter plans, common
+        size_t count = 2 + round % 11;
+        int64_t range = round % 3 == 0 ? 5 : round % 3 == 1 ? 100 : 1000000;
+        vector<pair<UserId, Money>> nets;
+        vector<int64_t> nonZero;
+        int64_t total = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            int64_t cents = i + 1 < count ? int64_t(random() % (2 * range + 1)) - range : -total;
+            total += cents;
+            nets.push_back({UserId(i * 7 + 3), Money(cents)});
+            if (cents != 0)
+                nonZero.push_back(cents);
+        }
+        vector<Settlement> plan;
+        DebtSimplifier::settleNets(nets, HOME_CURRENCY, plan);
+        unsettled += !settlesEveryone(nets, plan);
+        unordered_map<uint32_t, int> memo;
+        int blocks = mostZeroBlocks(nonZero, (uint32_t(1) << nonZero.size()) - 1, memo);
+        misses += plan.size() != nonZero.size() - blocks;
+    }
+    expect(unsettled == 0, "exact plans leave every member's net at zero");
+    expect(misses == 0, "exact plans use the fewest transfers");
+
+    // Above the exact limit the greedy plan still settles everyone in at most n - 1 transfers
+    size_t tooLong = 0;
+    unsettled = 0;
+    for (int round = 0; round < 300; round++)
+    {
+        size_t count = 13 + random() % 300;
+        vector<pair<UserId, Money>> nets;
+        int64_t total = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            int64_t cents = i + 1 < count ? int64_t(random() % 2000001) - 1000000 : -total;
+            total += cents;
+            nets.push_back({UserId(i), Money(cents)});
+        }
+        vector<Settlement> plan;
+        DebtSimplifier::settleNets(nets, HOME_CURRENCY, plan);
+        unsettled += !settlesEveryone(nets, plan);
+        tooLong += plan.size() > count - 1;
+    }
+    expect(unsettled == 0, "greedy plans leave every member's net at zero");
+    expect(tooLong == 0, "greedy plans take at most n - 1 transfers");
+}
+
+//*************************************************Groups*************************************************//
+
+// Each group's nets, per currency, as recomputed from its stored expenses
+static map<tuple<GroupId, CurrencyId, UserId>, int64_t> recomputeGroupNets(const vector<Expense> &added)
+{
+    map<tuple<GroupId, CurrencyId, UserId>, int64_t> nets;
+    for (const Expense &expense : added)
+    {
+        Span<UserId> users = expense.getParticipants();
+        Span<Money> shares = expense.getShareAmounts();
+        nets[{expense.getGroupId(), expense.getCurrency(), expense.getPaidBy()}] += expense.getTotalAmount().getCents();
+        for (size_t i = 0; i < shares.size(); i++)
+            nets[{expense.getGroupId(), expense.getCurrency(), users[i]}] -= shares[i].getCents();
+    }
+    return nets;
+}
+
+static void groupsSettleToZero()
+{
+    cout << "Group nets per currency and settling up" << endl;
+    const vector<string> CURRENCIES = {"", "EUR", "JPY"};
+    string directory = scratchDirectory();
+    vector<string> userIds, groupIds;
+    vector<vector<string>> memberIds(3);
+    map<pair<string, CurrencyId>, int64_t> netsAfter; // (user, currency) → global net once settled
+    {
+        SplitwiseSystem system;
+        expect(system.openStorage(directory, 1 << 20), "openStorage on a new directory");
+        for (size_t i = 0; i < 24; i++)
+            userIds.push_back(system.registerUser("User" + to_string(i), "")->getUserId());
+        // Overlapping groups of 8: members in more than one group keep one net per group
+        for (size_t g = 0; g < 3; g++)
+        {
+            for (size_t i = 0; i < 8; i++)
+                memberIds[g].push_back(userIds[g * 6 + i]);
+            groupIds.push_back(system.createGroup("Group" + to_string(g), memberIds[g])->getGroupId());
+        }
+
+        mt19937_64 random(35);
+        vector<Expense> added;
+        size_t outsiders = 0, refused = 0;
+        for (size_t i = 0; i < 900; i++)
+        {
+            size_t g = random() % 4; // 3: no group
+            const vector<string> &pool = g < 3 ? memberIds[g] : userIds;
+            SplitwiseSystem::ExpenseRequest request;
+            request.description = "Shared";
+            request.currency = CURRENCIES[random() % CURRENCIES.size()];
+            request.amount = Money(int64_t(random() % 50000) + 1);
+            request.paidBy = pool[random() % pool.size()];
+            request.groupId = g < 3 ? groupIds[g] : "";
+            request.type = ExpenseType(random() % 3);
+            size_t count = 1 + random() % 5;
+            for (size_t k = 0; k < count; k++)
+                request.users.push_back(pool[(random() % pool.size() + k) % pool.size()]);
+            sort(request.users.begin(), request.users.end());
+            request.users.erase(unique(request.users.begin(), request.users.end()), request.users.end());
+            int64_t left = request.type == ExpenseType::EXACT ? request.amount.getCents() : 10000;
+            for (size_t k = 0; k < request.users.size(); k++)
+            {
+                int64_t value = k + 1 < request.users.size() ? int64_t(random() % uint64_t(left + 1)) : left;
+                request.values.push_back(value);
+                left -= value;
+            }
+            if (request.type == ExpenseType::EQUAL)
+                request.values.clear();
+            if (g < 3 && i % 50 == 0)
+            {
+                request.paidBy = userIds[(g * 6 + 8 + random() % 16) % 24]; // outside the group
+                outsiders++;
+                refused += !system.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(&request, 1))[0].exists();
+                continue;
+            }
+            Expense expense = system.addExpenses(Span<SplitwiseSystem::ExpenseRequest>(&request, 1))[0];
+            expect(expense.exists(), "a group expense among members is taken");
+            if (expense.getGroupId() != NO_GROUP)
+                added.push_back(expense);
+        }
+        expect(outsiders > 0 && refused == outsiders, "a payer outside the group is refused");
+
+        map<tuple<GroupId, CurrencyId, UserId>, int64_t> expected = recomputeGroupNets(added);
+        size_t wrong = 0;
+        for (size_t g = 0; g < 3; g++)
+        {
+            Group *group = system.findGroup(groupIds[g]);
+            for (CurrencyId currency = 0; currency < 4; currency++)
+            {
+                int64_t total = 0;
+                for (const string &member : memberIds[g])
+                {
+                    UserId user = system.findUser(member)->getId();
+                    int64_t net = group->getNet(user, currency).getCents();
+                    wrong += net != expected[{group->getId(), currency, user}];
+                    total += net;
+                }
+                wrong += total != 0;
+            }
+        }
+        expect(wrong == 0, "each member's group net per currency matches the group's expenses and adds up to zero");
+
+        // Settling a group moves its members' global nets by exactly their group nets
+        map<pair<string, CurrencyId>, int64_t> expectedAfter;
+        for (const string &userId : userIds)
+        {
+            for (CurrencyId currency = 0; currency < 3; currency++)
+                expectedAfter[{userId, currency}] = system.getNetBalance(userId, Currency::code(currency)).getCents();
+        }
+        for (size_t g = 0; g < 3; g++)
+        {
+            Group *group = system.findGroup(groupIds[g]);
+            for (const string &member : memberIds[g])
+            {
+                for (CurrencyId currency = 0; currency < 3; currency++)
+                    expectedAfter[{member, currency}] -= group->getNet(system.findUser(member)->getId(), currency).getCents();
+            }
+            vector<Settlement> plan = system.settleUpGroup(groupIds[g]);
+            size_t perCurrency[Currency::COUNT] = {};
+            for (const Settlement &payment : plan)
+                perCurrency[payment.currency]++;
+            expect(*max_element(perCurrency, perCurrency + Currency::COUNT) <= memberIds[g].size() - 1,
+                   "settling up takes at most members - 1 payments per currency");
+            for (const string &member : memberIds[g])
+            {
+                for (CurrencyId currency = 0; currency < 4; currency++)
+                    wrong += !group->getNet(system.findUser(member)->getId(), currency).isZero();
+            }
+            expect(system.settleUpGroup(groupIds[g]).empty(), "a settled group needs no more payments");
+        }
+        expect(wrong == 0, "settling up brings every member to zero in every currency");
+        for (const auto &entry : expectedAfter)
+            wrong += system.getNetBalance(entry.first.first, Currency::code(entry.first.second)).getCents() != entry.second;
+        expect(wrong == 0, "settling up moves global nets by the group nets only");
+        netsAfter = expectedAfter;
+    }
+
+    SplitwiseSystem reopened;
+    expect(reopened.openStorage(directory, 1 << 20), "openStorage on the written directory");
+    size_t wrong = 0;
+    for (const auto &entry : netsAfter)
+        wrong += reopened.getNetBalance(entry.first.first, Currency::code(entry.first.second)).getCents() != entry.second;
+    for (size_t g = 0; g < 3; g++)
+    {
+        Group *group = reopened.findGroup(groupIds[g]);
+        for (const string &member : memberIds[g])
+        {
+            for (CurrencyId currency = 0; currency < 3; currency++)
+                wrong += !group->getNet(reopened.findUser(member)->getId(), currency).isZero();
+        }
+    }
+    expect(wrong == 0, "settled groups and global nets survive a journal replay");
+    filesystem::remove_all(directory);
+}
+
+//*************************************************Torn journal*************************************************//
+
+// Start of every record in the journal file, and its end last
+static vector<size_t> recordOffsets(const string &log)
+{
+    vector<size_t> offsets = {0};
+    uint32_t header[2];
+    while (log.size() - offsets.back() >= sizeof(header))
+    {
+        memcpy(header, log.data() + offsets.back(), sizeof(header));
+        offsets.push_back(offsets.back() + sizeof(header) + header[0]);
+    }
+    return offsets;
+}
+
+// A journal cut or corrupted inside one record: recovery keeps the records
+// before it, drops it and everything after, and appends after the kept ones
+static void tornJournalRecovery()
+{
+    cout << "Recovery from a torn journal" << endl;
+    const size_t USERS = 10, EXPENSES = 200;
+    string directory = scratchDirectory();
+    vector<string> userIds;
+    vector<string> states; // after each expense count
+    {
+        SplitwiseSystem system;
+        expect(system.openStorage(directory), "openStorage on a new directory");
+        for (size_t i = 0; i < USERS; i++)
+            userIds.push_back(system.registerUser("User" + to_string(i), "")->getUserId());
+        states.push_back(currencyState(system, userIds));
+        mt19937_64 random(40);
+        for (size_t i = 0; i < EXPENSES; i++)
+        {
+            vector<string> involved = {userIds[random() % USERS], userIds[random() % USERS]};
+            system.addExpense("Torn", involved[0], double(random() % 10000) / 100 + 1, i % 3 ? "EUR" : "USD", involved);
+            states.push_back(currencyState(system, userIds));
+        }
+    }
+    string journal;
+    {
+        ifstream in(directory + "/journal-0.log", ios::binary);
+        journal.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    vector<size_t> offsets = recordOffsets(journal);
+    expect(offsets.size() == USERS + EXPENSES + 1 && offsets.back() == journal.size(), "one journal record per user and expense");
+    if (offsets.size() != USERS + EXPENSES + 1)
+        return;
+
+    mt19937_64 random(41);
+    for (int round = 0; round < 24; round++)
+    {
+        // The torn record, and where in it the damage is
+        size_t record = USERS + random() % EXPENSES;
+        size_t begin = offsets[record], end = offsets[record + 1];
+        string damaged = journal;
+        string how;
+        if (round % 3 == 0)
+        {
+            damaged.resize(begin + random() % 8); // inside the header
+            how = "cut in a header";
+        }
+        else if (round % 3 == 1)
+        {
+            damaged.resize(begin + 8 + random() % (end - begin - 8)); // inside the payload
+            how = "cut in a payload";
+        }
+        else
+        {
+            damaged[begin + 8 + random() % (end - begin - 8)] ^= 0x20; // a bad sector, records after it intact
+            how = "a corrupt payload";
+        }
+
+        string copy = scratchDirectory();
+        ofstream(copy + "/journal-0.log", ios::binary) << damaged;
+        string after;
+        {
+            SplitwiseSystem recovered;
+            expect(recovered.openStorage(copy), "openStorage over " + how);
+            expect(currencyState(recovered, userIds) == states[record - USERS], how + ": every record before the torn one replays");
+            expect(filesystem::file_size(copy + "/journal-0.log") == begin, how + ": the torn tail is cut off");
+            vector<string> involved = {userIds[0], userIds[1]};
+            recovered.addExpense("After", userIds[0], 12.34, involved);
+            after = currencyState(recovered, userIds);
+        }
+        SplitwiseSystem reopened;
+        expect(reopened.openStorage(copy), "openStorage after recovery");
+        expect(currencyState(reopened, userIds) == after, how + ": records written after recovery replay too");
+        filesystem::remove_all(copy);
+    }
+    filesystem::remove_all(directory);
+}
+
+int main()
+{
+    splitsAddUp();
+    simplifyAgainstBruteForce();
+    groupsSettleToZero();
+    tornJournalRecovery();
+    currencyRoundTrip();
+    netRankingAgainstBruteForce();
+    rankingRoundTrip();
+    editsAgainstRecompute();
+    commandsRegisterOnlyValidLines();
+    oversizedAmountsRefused();
+    importKeepsDatesAndCurrencies();
+    auditFlagsTampering();
+    if (failures > 0)
+    {
+        cout << "❌ " << failures << " check(s) failed" << endl;
+        return 1;
+    }
+    cout << "✅ All checks passed" << endl;
+    return 0;
+}